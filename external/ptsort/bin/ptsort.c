@@ -48,6 +48,7 @@ static bool printdepth;
 static bool printprio;
 static bool quiet;
 static bool strict;
+static bool weighted;
 static int vlevel;
 
 #define verbose(...)							\
@@ -69,11 +70,14 @@ static int vlevel;
 /*
  * Nodes in the graph.
  *
- * Each node has a name, a list of predecessors, a depth and a priority.
- * The depth is the length of the node's longest chain of successors.  The
- * priority is an integer in the range [prio, prio + P) where P is the
- * highest number by which the node itself or any of its successors has
- * been boosted.
+ * Each node has a name, a list of predecessors, a depth, a priority and
+ * a weight.  The depth is the length of the node's longest chain of
+ * successors.  The priority is an integer in the range [prio, prio + P)
+ * where P is the highest number by which the node itself or any of its
+ * successors has been boosted.  The weight is the cost of the node
+ * itself, which is 1 unless weights were loaded with -w, in which case
+ * the priority is the weighted length of the node's longest chain of
+ * successors including itself.
  */
 #define NAMELEN		 255
 
@@ -82,14 +86,24 @@ typedef struct pnode {
 	aa_tree		 pred;
 	unsigned long	 depth;
 	unsigned long	 prio;
+	unsigned long	 weight;
 } pnode;
 
+/*
+ * Node weights, loaded before any input.
+ */
+typedef struct pweight {
+	char		 name[NAMELEN + 1];
+	unsigned long	 weight;
+} pweight;
+
 /*
  * Comparison function.
  */
 typedef int (*pnode_cmp)(const pnode *, const pnode *);
 
 static aa_tree nodes;
+static aa_tree weights;
 static unsigned long tnedges, tnnodes;
 
 /*
@@ -151,6 +165,7 @@ pnode_new(void)
 		err(1, "calloc()");
 	aa_init(&n->pred, pnode_namecmp);
 	n->prio = 0;
+	n->weight = 1;
 	return (n);
 }
 
@@ -173,7 +188,8 @@ pnode_destroy(pnode *n)
  * specified value, set it to that value and propagate the change to all
  * of its predecessors, maintaining the invariant that a node's depth and
  * priority are strictly greater than the depths and priorities of all its
- * predecessors.
+ * successors.  A predecessor's priority exceeds its successor's by at
+ * least the predecessor's weight.
  *
  * In order to detect and break cycles, we mark a node busy by changing
  * the last byte of its name buffer (which should be 0) while iterating
@@ -207,12 +223,98 @@ pnode_recalc(pnode *n, unsigned long depth, unsigned long prio)
 				exit(3);
 			continue;
 		}
-		pnode_recalc(p, n->depth + 1, n->prio + 1);
+		pnode_recalc(p, n->depth + 1, n->prio + p->weight);
 	}
 	aa_finish(&nit);
 	n->name[NAMELEN] = '\0';
 }
 
+/*
+ * Assign a newly inserted node its weight.  In weighted mode the node's
+ * own weight is part of its priority even if it has no successors.
+ */
+static void
+pnode_weigh(pnode *n)
+{
+	pweight *w;
+
+	if (!weighted)
+		return;
+	if ((w = aa_find(&weights, n)) != NULL)
+		n->weight = w->weight;
+	pnode_recalc(n, 0, n->weight);
+}
+
+/*
+ * Read node weights from a file.  Each line is:
+ *
+ * NODE NUMBER
+ *    Set NODE's weight to NUMBER
+ *
+ * Weights less than 1 are raised to 1 so that a node's priority is
+ * always strictly greater than that of its successors.  Nodes which are
+ * not listed have a weight of 1.  Listing a node here does not insert
+ * it into the graph.
+ */
+static void
+weights_input(const char *fn)
+{
+	FILE *f;
+	struct fline_buf *lb;
+	pweight *w, *rw;
+	const char *nb, *ne, *wb, *we;
+	const char *line, *p;
+	char *e;
+	unsigned long nlines, weight;
+
+	if ((lb = fline_new()) == NULL)
+		err(1, "fline_new()");
+	if ((f = fopen(fn, "r")) == NULL)
+		err(1, "%s", fn);
+	if ((rw = calloc(1, sizeof *rw)) == NULL)
+		err(1, "calloc()");
+	nlines = 0;
+	while ((line = fline_read(f, lb)) != NULL) {
+		nlines++;
+		for (p = line; is_space(*p); p++)
+			/* nothing */;
+		if (*p == '\n' || *p == '\0')
+			continue;
+		for (nb = p; is_name(*p); p++)
+			/* nothing */;
+		for (ne = p; is_space(*p); p++)
+			/* nothing */;
+		for (wb = p; is_number(*p); p++)
+			/* nothing */;
+		for (we = p; is_space(*p); p++)
+			/* nothing */;
+		if (*p == '\n')
+			p++;
+		if (ne - nb == 0 || ne - nb > NAMELEN || we - wb == 0 ||
+		    *p != '\0')
+			errx(2, "%s:%lu: syntax error:\n%s", fn, nlines, line);
+		weight = strtoul(wb, &e, 10);
+		if (e != we)
+			errx(2, "%s:%lu: syntax error:\n%s", fn, nlines, line);
+		if (weight == 0)
+			weight = 1;
+		memset(rw->name, 0, sizeof rw->name);
+		strncpy(rw->name, nb, ne - nb);
+		if ((w = aa_insert(&weights, rw)) == NULL)
+			err(1, "aa_insert()");
+		if (w == rw && (rw = calloc(1, sizeof *rw)) == NULL)
+			err(1, "calloc()");
+		verbose("weight of node %s is %lu", w->name, weight);
+		w->weight = weight;
+	}
+	if (ferror(f))
+		err(1, "%s", fn);
+	fclose(f);
+	fline_free(lb);
+	free(rw);
+	weighted = true;
+}
+
 /*
  * Read nodes and edges from a file and construct our graph, setting and
  * propagating node priorities as we go along.
@@ -311,6 +413,7 @@ input(const char *fn)
 		if (pn == rn) {
 			/* new node */
 			verbose("insert new node %s", pn->name);
+			pnode_weigh(pn);
 			rn = pnode_new();
 			nnodes++;
 		} else {
@@ -334,6 +437,7 @@ input(const char *fn)
 			if (sn == rn) {
 				/* new node */
 				verbose("insert new node %s", sn->name);
+				pnode_weigh(sn);
 				rn = pnode_new();
 				nnodes++;
 			} else {
@@ -348,7 +452,8 @@ input(const char *fn)
 				verbose("insert new edge from %s to %s",
 				    pn->name, sn->name);
 				nedges++;
-				pnode_recalc(pn, sn->depth + 1, sn->prio + 1);
+				pnode_recalc(pn, sn->depth + 1,
+				    sn->prio + pn->weight);
 			}
 		}
 	}
@@ -453,7 +558,7 @@ static void
 usage(void)
 {
 
-	fprintf(stderr, "usage: ptsort [-DdPpqsv] [-o output] [input ...]\n");
+	fprintf(stderr, "usage: ptsort [-DdPpqsv] [-o output] [-w weights] [input ...]\n");
 	exit(1);
 }
 
@@ -461,11 +566,13 @@ int
 main(int argc, char *argv[])
 {
 	const char *ofn = NULL;
+	const char *wfn = NULL;
 	int opt;
 
 	aa_init(&nodes, (aa_comparator)strcmp);
+	aa_init(&weights, (aa_comparator)strcmp);
 
-	while ((opt = getopt(argc, argv, "Ddo:Ppqsv")) != -1)
+	while ((opt = getopt(argc, argv, "Ddo:Ppqsvw:")) != -1)
 		switch (opt) {
 		case 'o':
 			ofn = optarg;
@@ -491,6 +598,9 @@ main(int argc, char *argv[])
 		case 'v':
 			vlevel++;
 			break;
+		case 'w':
+			wfn = optarg;
+			break;
 		default:
 			usage();
 		}
@@ -503,6 +613,8 @@ main(int argc, char *argv[])
 	if (parallel && !bydepth && printdepth)
 		errx(1, "with -P, -d must be combined with -D");
 
+	if (wfn != NULL)
+		weights_input(wfn);
 	if (argc == 0)
 		input(NULL);
 	else
@@ -0,0 +1,651 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * List the files in a distfiles directory which no distinfo file expects,
+ * for distclean.  The distinfo files, given as arguments or one per line
+ * on stdin, are parsed and the directory is walked by a pool of threads.
+ * With -c a file whose size or SHA256 does not match any distinfo
+ * listing it is also printed.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sha256.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#define SHA256_LEN	32
+
+/* One distinfo's idea of a distfile. */
+struct variant {
+	struct variant *next;
+	off_t size;		/* -1 if not listed */
+	bool has_sha;
+	unsigned char sha[SHA256_LEN];
+};
+
+struct expect {
+	char *path;
+	struct variant *variants;
+};
+
+/* A distinfo entry before merging. */
+struct record {
+	char *path;
+	struct variant v;
+};
+
+struct file {
+	char *path;
+	off_t size;
+	bool bad;
+};
+
+struct vec {
+	void *items;
+	size_t n;
+	size_t alloc;
+	size_t size;
+};
+
+static struct expect *table;
+static size_t table_size, table_n;
+
+static char **distinfos;
+static size_t ndistinfos;
+static struct vec *records;	/* per thread */
+
+static int rootfd;
+static dev_t rootdev;
+static bool cflag;
+
+/* Directories to read, shared by the walking threads. */
+static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
+static char **queue;
+static size_t queue_n, queue_alloc, queue_busy;
+static struct vec *files;	/* per thread */
+
+static size_t next_job;
+static pthread_mutex_t job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "%s\n",
+	    "usage: distscan [-cv] [-j jobs] -d distdir [distinfo ...]");
+	exit(EX_USAGE);
+}
+
+static void *
+vec_add(struct vec *v)
+{
+
+	if (v->n == v->alloc) {
+		v->alloc = v->alloc == 0 ? 64 : v->alloc * 2;
+		v->items = reallocarray(v->items, v->alloc, v->size);
+		if (v->items == NULL)
+			err(EXIT_FAILURE, "%s", "reallocarray");
+	}
+	return ((char *)v->items + v->n++ * v->size);
+}
+
+static char *
+xstrndup(const char *s, size_t len)
+{
+	char *p;
+
+	if ((p = strndup(s, len)) == NULL)
+		err(EXIT_FAILURE, "%s", "strndup");
+	return (p);
+}
+
+/* Hand out the indexes [0, n) to the threads. */
+static bool
+job_next(size_t n, size_t *idx)
+{
+	bool ok;
+
+	pthread_mutex_lock(&job_lock);
+	ok = next_job < n;
+	if (ok)
+		*idx = next_job++;
+	pthread_mutex_unlock(&job_lock);
+	return (ok);
+}
+
+static void
+run_threads(int jobs, void *(*fn)(void *))
+{
+	pthread_t *thr;
+	intptr_t i;
+	int error;
+
+	next_job = 0;
+	if ((thr = calloc(jobs, sizeof(*thr))) == NULL)
+		err(EXIT_FAILURE, "%s", "calloc");
+	for (i = 0; i < jobs; i++) {
+		if ((error = pthread_create(&thr[i], NULL, fn,
+		    (void *)i)) != 0)
+			errc(EXIT_FAILURE, error, "%s", "pthread_create");
+	}
+	for (i = 0; i < jobs; i++)
+		pthread_join(thr[i], NULL);
+	free(thr);
+}
+
+static uint64_t
+hash_path(const char *s)
+{
+	uint64_t h;
+
+	h = 14695981039346656037ULL;
+	for (; *s != '\0'; s++) {
+		h ^= (unsigned char)*s;
+		h *= 1099511628211ULL;
+	}
+	return (h);
+}
+
+static struct expect *
+table_find(const char *path, bool create)
+{
+	struct expect *e, *old;
+	size_t i, oldsize;
+
+	if (create && (table_n + 1) * 2 > table_size) {
+		old = table;
+		oldsize = table_size;
+		table_size = table_size == 0 ? 1024 : table_size * 2;
+		if ((table = calloc(table_size, sizeof(*table))) == NULL)
+			err(EXIT_FAILURE, "%s", "calloc");
+		for (i = 0; i < oldsize; i++) {
+			if (old[i].path == NULL)
+				continue;
+			e = &table[hash_path(old[i].path) & (table_size - 1)];
+			while (e->path != NULL) {
+				if (++e == &table[table_size])
+					e = table;
+			}
+			*e = old[i];
+		}
+		free(old);
+	}
+	if (table_size == 0)
+		return (NULL);
+	e = &table[hash_path(path) & (table_size - 1)];
+	while (e->path != NULL) {
+		if (strcmp(e->path, path) == 0)
+			return (e);
+		if (++e == &table[table_size])
+			e = table;
+	}
+	if (!create)
+		return (NULL);
+	e->path = strdup(path);
+	if (e->path == NULL)
+		err(EXIT_FAILURE, "%s", "strdup");
+	table_n++;
+	return (e);
+}
+
+static bool
+parse_sha(const char *s, size_t len, unsigned char *sha)
+{
+	size_t i;
+	unsigned int c;
+
+	if (len != SHA256_LEN * 2)
+		return (false);
+	for (i = 0; i < SHA256_LEN; i++) {
+		if (sscanf(s + i * 2, "%2x", &c) != 1)
+			return (false);
+		sha[i] = c;
+	}
+	return (true);
+}
+
+/*
+ * Parse the SHA256 and SIZE lines of a distinfo:
+ *   SHA256 (subdir/file.tar.gz) = 0123...
+ *   SIZE (subdir/file.tar.gz) = 1234
+ */
+static void
+parse_distinfo(const char *file, struct vec *out)
+{
+	struct record *r;
+	FILE *fp;
+	char *line, *path, *end, *value;
+	size_t linecap, pathlen, first, i;
+	ssize_t linelen;
+	bool sha;
+
+	if ((fp = fopen(file, "re")) == NULL) {
+		/* Ports without distfiles have no distinfo. */
+		if (errno != ENOENT)
+			warn("%s", file);
+		return;
+	}
+	first = out->n;
+	line = NULL;
+	linecap = 0;
+	while ((linelen = getline(&line, &linecap, fp)) > 0) {
+		if (line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (strncmp(line, "SHA256 (", 8) == 0) {
+			sha = true;
+			path = line + 8;
+		} else if (strncmp(line, "SIZE (", 6) == 0) {
+			sha = false;
+			path = line + 6;
+		} else
+			continue;
+		if ((end = strstr(path, ") = ")) == NULL)
+			continue;
+		pathlen = end - path;
+		value = end + 4;
+		/* SHA256 and SIZE for a file are usually adjacent. */
+		r = NULL;
+		for (i = out->n; i > first; i--) {
+			r = &((struct record *)out->items)[i - 1];
+			if (strlen(r->path) == pathlen &&
+			    strncmp(r->path, path, pathlen) == 0)
+				break;
+			r = NULL;
+		}
+		if (r == NULL) {
+			r = vec_add(out);
+			r->path = xstrndup(path, pathlen);
+			r->v.next = NULL;
+			r->v.size = -1;
+			r->v.has_sha = false;
+		}
+		if (sha)
+			r->v.has_sha = parse_sha(value, strlen(value),
+			    r->v.sha);
+		else
+			r->v.size = strtoimax(value, NULL, 10);
+	}
+	if (ferror(fp))
+		warn("%s", file);
+	free(line);
+	fclose(fp);
+}
+
+static void *
+parse_thread(void *arg)
+{
+	struct vec *out;
+	size_t idx;
+
+	out = &records[(intptr_t)arg];
+	while (job_next(ndistinfos, &idx))
+		parse_distinfo(distinfos[idx], out);
+	return (NULL);
+}
+
+static void
+expect_add(const struct record *r)
+{
+	struct expect *e;
+	struct variant *v;
+
+	e = table_find(r->path, true);
+	for (v = e->variants; v != NULL; v = v->next) {
+		if (v->size == r->v.size && v->has_sha == r->v.has_sha &&
+		    (!v->has_sha ||
+		    memcmp(v->sha, r->v.sha, sizeof(v->sha)) == 0))
+			return;
+	}
+	if ((v = malloc(sizeof(*v))) == NULL)
+		err(EXIT_FAILURE, "%s", "malloc");
+	*v = r->v;
+	v->next = e->variants;
+	e->variants = v;
+}
+
+static void
+queue_push(char *dir)
+{
+
+	if (queue_n == queue_alloc) {
+		queue_alloc = queue_alloc == 0 ? 64 : queue_alloc * 2;
+		queue = reallocarray(queue, queue_alloc, sizeof(*queue));
+		if (queue == NULL)
+			err(EXIT_FAILURE, "%s", "reallocarray");
+	}
+	queue[queue_n++] = dir;
+}
+
+static char *
+path_join(const char *dir, const char *name)
+{
+	char *path;
+
+	if (*dir == '\0')
+		path = strdup(name);
+	else if (asprintf(&path, "%s/%s", dir, name) == -1)
+		path = NULL;
+	if (path == NULL)
+		err(EXIT_FAILURE, "%s", "asprintf");
+	return (path);
+}
+
+/* Read one directory, queueing its subdirectories.  Like find -x. */
+static void
+walk_dir(const char *dir, struct vec *out)
+{
+	struct dirent *de;
+	struct file *f;
+	struct stat st;
+	DIR *d;
+	char *path;
+	int fd;
+
+	fd = openat(rootfd, *dir == '\0' ? "." : dir,
+	    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+	if (fd == -1 || (d = fdopendir(fd)) == NULL) {
+		warn("%s", dir);
+		if (fd != -1)
+			close(fd);
+		return;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+		/* Hidden files, such as fetch's temporary files, are kept. */
+		if (de->d_name[0] == '.' && de->d_type == DT_REG)
+			continue;
+		if (fstatat(fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+			if (errno != ENOENT)
+				warn("%s/%s", dir, de->d_name);
+			continue;
+		}
+		if (S_ISDIR(st.st_mode)) {
+			if (st.st_dev != rootdev)
+				continue;
+			path = path_join(dir, de->d_name);
+			pthread_mutex_lock(&queue_lock);
+			queue_push(path);
+			pthread_cond_signal(&queue_cond);
+			pthread_mutex_unlock(&queue_lock);
+		} else if (S_ISREG(st.st_mode) && de->d_name[0] != '.') {
+			f = vec_add(out);
+			f->path = path_join(dir, de->d_name);
+			f->size = st.st_size;
+			f->bad = false;
+		}
+	}
+	closedir(d);
+}
+
+static void *
+walk_thread(void *arg)
+{
+	struct vec *out;
+	char *dir;
+
+	out = &files[(intptr_t)arg];
+	pthread_mutex_lock(&queue_lock);
+	for (;;) {
+		while (queue_n == 0 && queue_busy > 0)
+			pthread_cond_wait(&queue_cond, &queue_lock);
+		if (queue_n == 0)
+			break;
+		dir = queue[--queue_n];
+		queue_busy++;
+		pthread_mutex_unlock(&queue_lock);
+		walk_dir(dir, out);
+		free(dir);
+		pthread_mutex_lock(&queue_lock);
+		if (--queue_busy == 0 && queue_n == 0)
+			pthread_cond_broadcast(&queue_cond);
+	}
+	pthread_mutex_unlock(&queue_lock);
+	return (NULL);
+}
+
+static bool
+file_sha256(const char *path, unsigned char *sha)
+{
+	static __thread unsigned char buf[128 * 1024];
+	SHA256_CTX ctx;
+	ssize_t n;
+	int fd;
+
+	if ((fd = openat(rootfd, path, O_RDONLY | O_NOFOLLOW |
+	    O_CLOEXEC)) == -1) {
+		warn("%s", path);
+		return (false);
+	}
+	SHA256_Init(&ctx);
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		SHA256_Update(&ctx, buf, n);
+	if (n == -1)
+		warn("%s", path);
+	close(fd);
+	SHA256_Final(sha, &ctx);
+	return (n == 0);
+}
+
+/* Whether the file matches any of the distinfo entries for it. */
+static bool
+file_matches(const struct file *f, const struct expect *e)
+{
+	const struct variant *v;
+	unsigned char sha[SHA256_LEN];
+	bool have_sha;
+
+	have_sha = false;
+	for (v = e->variants; v != NULL; v = v->next) {
+		if (v->size != -1 && v->size != f->size)
+			continue;
+		if (!v->has_sha)
+			return (true);
+		if (!have_sha) {
+			if (!file_sha256(f->path, sha))
+				return (false);
+			have_sha = true;
+		}
+		if (memcmp(sha, v->sha, sizeof(sha)) == 0)
+			return (true);
+	}
+	return (false);
+}
+
+static struct file **check;
+static size_t ncheck;
+
+static void *
+check_thread(void *arg __unused)
+{
+	size_t idx;
+
+	while (job_next(ncheck, &idx)) {
+		check[idx]->bad = !file_matches(check[idx],
+		    table_find(check[idx]->path, false));
+	}
+	return (NULL);
+}
+
+static int
+path_cmp(const void *a, const void *b)
+{
+
+	return (strcmp(*(char *const *)a, *(char *const *)b));
+}
+
+int
+main(int argc, char **argv)
+{
+	struct vec list, bad;
+	struct stat st;
+	struct file *f;
+	char *distdir, *line;
+	size_t i, j, nfiles, linecap;
+	ssize_t linelen;
+	int ch, jobs;
+	bool vflag;
+
+	distdir = NULL;
+	jobs = sysconf(_SC_NPROCESSORS_ONLN);
+	vflag = false;
+	while ((ch = getopt(argc, argv, "cd:j:v")) != -1) {
+		switch (ch) {
+		case 'c':
+			cflag = true;
+			break;
+		case 'd':
+			distdir = optarg;
+			break;
+		case 'j':
+			jobs = atoi(optarg);
+			if (jobs < 1)
+				errx(EX_USAGE, "Invalid jobs: %s", optarg);
+			break;
+		case 'v':
+			vflag = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (distdir == NULL)
+		usage();
+	if (jobs < 1)
+		jobs = 1;
+
+	memset(&list, 0, sizeof(list));
+	list.size = sizeof(char *);
+	if (argc > 0) {
+		for (i = 0; i < (size_t)argc; i++)
+			*(char **)vec_add(&list) = argv[i];
+	} else {
+		line = NULL;
+		linecap = 0;
+		while ((linelen = getline(&line, &linecap, stdin)) > 0) {
+			if (line[linelen - 1] == '\n')
+				line[--linelen] = '\0';
+			if (linelen > 0)
+				*(char **)vec_add(&list) =
+				    xstrndup(line, linelen);
+		}
+		free(line);
+	}
+	distinfos = list.items;
+	ndistinfos = list.n;
+
+	if ((records = calloc(jobs, sizeof(*records))) == NULL)
+		err(EXIT_FAILURE, "%s", "calloc");
+	for (i = 0; i < (size_t)jobs; i++)
+		records[i].size = sizeof(struct record);
+	run_threads(jobs, parse_thread);
+	for (i = 0; i < (size_t)jobs; i++) {
+		for (j = 0; j < records[i].n; j++) {
+			expect_add(&((struct record *)records[i].items)[j]);
+			free(((struct record *)records[i].items)[j].path);
+		}
+		free(records[i].items);
+	}
+	free(records);
+	/* Never clean everything due to a bad list. */
+	if (table_n == 0)
+		errx(EX_DATAERR, "No distfiles found in %zu distinfo files",
+		    ndistinfos);
+
+	if ((rootfd = open(distdir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		err(EX_NOINPUT, "%s", distdir);
+	if (fstat(rootfd, &st) == -1)
+		err(EXIT_FAILURE, "%s", distdir);
+	rootdev = st.st_dev;
+	if ((files = calloc(jobs, sizeof(*files))) == NULL)
+		err(EXIT_FAILURE, "%s", "calloc");
+	for (i = 0; i < (size_t)jobs; i++)
+		files[i].size = sizeof(struct file);
+	queue_push(strdup(""));
+	run_threads(jobs, walk_thread);
+
+	memset(&bad, 0, sizeof(bad));
+	bad.size = sizeof(char *);
+	nfiles = 0;
+	for (i = 0; i < (size_t)jobs; i++) {
+		for (j = 0; j < files[i].n; j++) {
+			f = &((struct file *)files[i].items)[j];
+			nfiles++;
+			if (table_find(f->path, false) == NULL)
+				*(char **)vec_add(&bad) = f->path;
+			else if (cflag) {
+				if (ncheck % 1024 == 0) {
+					check = reallocarray(check,
+					    ncheck + 1024, sizeof(*check));
+					if (check == NULL)
+						err(EXIT_FAILURE, "%s",
+						    "reallocarray");
+				}
+				check[ncheck++] = f;
+			}
+		}
+	}
+	if (cflag) {
+		run_threads(jobs, check_thread);
+		for (i = 0; i < ncheck; i++) {
+			if (check[i]->bad)
+				*(char **)vec_add(&bad) = check[i]->path;
+		}
+	}
+
+	qsort(bad.items, bad.n, sizeof(char *), path_cmp);
+	for (i = strlen(distdir); i > 0 && distdir[i - 1] == '/'; i--)
+		distdir[i - 1] = '\0';
+	for (i = 0; i < bad.n; i++)
+		printf("%s/%s\n", distdir, ((char **)bad.items)[i]);
+	if (fflush(stdout) != 0)
+		err(EXIT_FAILURE, "%s", "stdout");
+	if (vflag)
+		fprintf(stderr, "distinfo files: %zu expected: %zu "
+		    "files: %zu checked: %zu unexpected: %zu\n",
+		    ndistinfos, table_n, nfiles, ncheck, bad.n);
+	return (0);
+}
@@ -0,0 +1,655 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Record the state of a builder and later list what changed in it, as
+ * 'mtree -c -k uid,gid,flags,mode,size' and 'mtree -f' did.  The index is
+ * a binary array of entries where the children of each directory are
+ * stored together sorted by name.  When checking, a directory whose inode
+ * and ctime are unchanged still has the same entries so it is not read
+ * again, only its entries are stat'd.  Changes are printed as check_leftovers
+ * expects them:
+ *
+ *   + <root>/path		extra, and everything under it
+ *   - <root>/path		missing, and everything under it
+ *   M <root>/path <changes>	changed
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <dirent.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#define	FSINDEX_MAGIC	"PFSIDX1"
+/* Same as mtree's MBITS. */
+#define	MODEBITS	(S_ISUID | S_ISGID | S_ISVTX | S_IRWXU | S_IRWXG | S_IRWXO)
+#ifdef UF_SETTABLE
+#define	ST_FLAGS(st)	((uint32_t)(st)->st_flags)
+#else
+#define	ST_FLAGS(st)	((uint32_t)0)
+#endif
+
+struct fsindex_hdr {
+	char magic[8];
+	/* Directories changed in or after this second are always read. */
+	int64_t start;
+	uint32_t nents;
+	uint32_t strsize;
+};
+
+struct ent {
+	uint64_t ino;
+	uint64_t size;
+	int64_t ctime_sec;
+	int64_t ctime_nsec;
+	uint32_t mode;
+	uint32_t uid;
+	uint32_t gid;
+	uint32_t flags;
+	uint32_t name;
+	uint32_t namelen;
+	uint32_t child;
+	uint32_t nchild;
+};
+
+struct exclude {
+	const char *glob;
+	bool pathname;
+};
+
+static struct fsindex_hdr hdr;
+static struct ent *ents;
+static size_t nents, entsalloc;
+static char *strtab;
+static size_t strsize, stralloc;
+static struct exclude *excludes;
+static size_t nexcludes;
+static const char *root;
+/* The current path as "./path" for matching excludes like mtree. */
+static char rel[PATH_MAX];
+static int ret;
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "%s\n%s\n",
+	    "usage: fscheck -c [-X exclude-file] -p root > index",
+	    "       fscheck [-X exclude-file] -f index -p root");
+	exit(EX_USAGE);
+}
+
+static void
+excludes_load(const char *file)
+{
+	FILE *fp;
+	char *line;
+	size_t linecap, nalloc;
+	ssize_t len;
+
+	if ((fp = fopen(file, "r")) == NULL)
+		err(EX_NOINPUT, "%s", file);
+	line = NULL;
+	linecap = nalloc = 0;
+	while ((len = getline(&line, &linecap, fp)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = '\0';
+		if (len == 0)
+			continue;
+		if (nexcludes == nalloc) {
+			nalloc = nalloc == 0 ? 32 : nalloc * 2;
+			excludes = reallocarray(excludes, nalloc,
+			    sizeof(*excludes));
+			if (excludes == NULL)
+				err(EXIT_FAILURE, "%s", "reallocarray");
+		}
+		if ((excludes[nexcludes].glob = strdup(line)) == NULL)
+			err(EXIT_FAILURE, "%s", "strdup");
+		excludes[nexcludes].pathname = strchr(line, '/') != NULL;
+		nexcludes++;
+	}
+	if (ferror(fp))
+		err(EXIT_FAILURE, "%s", file);
+	free(line);
+	fclose(fp);
+}
+
+/* Match mtree's check_excludes(). */
+static bool
+excluded(const char *name)
+{
+	const struct exclude *e;
+
+	for (e = excludes; e < &excludes[nexcludes]; e++) {
+		if ((e->pathname && fnmatch(e->glob, rel, FNM_PATHNAME) == 0) ||
+		    fnmatch(e->glob, name, FNM_PATHNAME) == 0)
+			return (true);
+	}
+	return (false);
+}
+
+static size_t
+rel_push(size_t len, const char *name)
+{
+	size_t namelen;
+
+	namelen = strlen(name);
+	if (len + 1 + namelen >= sizeof(rel))
+		errx(EXIT_FAILURE, "%s/%s: %s", rel, name, strerror(ENAMETOOLONG));
+	rel[len] = '/';
+	memcpy(&rel[len + 1], name, namelen + 1);
+	return (len + 1 + namelen);
+}
+
+static const char *
+ent_name(const struct ent *e)
+{
+
+	return (&strtab[e->name]);
+}
+
+static int
+namecmp(const void *a, const void *b)
+{
+
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+static void
+names_free(char **names, size_t n)
+{
+	size_t i;
+
+	for (i = 0; i < n; i++)
+		free(names[i]);
+	free(names);
+}
+
+/*
+ * The sorted names in a directory.  Excluded names are left out unless
+ * all is set.
+ */
+static char **
+dir_names(int dfd, size_t len, bool all, size_t *np)
+{
+	DIR *d;
+	struct dirent *de;
+	char **names;
+	size_t n, nalloc;
+	int fd;
+
+	if ((fd = dup(dfd)) == -1)
+		err(EXIT_FAILURE, "%s", "dup");
+	if ((d = fdopendir(fd)) == NULL)
+		err(EXIT_FAILURE, "%s", "fdopendir");
+	rewinddir(d);
+	names = NULL;
+	n = nalloc = 0;
+	while ((errno = 0, de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 ||
+		    strcmp(de->d_name, "..") == 0)
+			continue;
+		if (!all) {
+			rel_push(len, de->d_name);
+			if (excluded(de->d_name)) {
+				rel[len] = '\0';
+				continue;
+			}
+			rel[len] = '\0';
+		}
+		if (n == nalloc) {
+			nalloc = nalloc == 0 ? 32 : nalloc * 2;
+			names = reallocarray(names, nalloc, sizeof(*names));
+			if (names == NULL)
+				err(EXIT_FAILURE, "%s", "reallocarray");
+		}
+		if ((names[n++] = strdup(de->d_name)) == NULL)
+			err(EXIT_FAILURE, "%s", "strdup");
+	}
+	if (errno != 0) {
+		warn("%s%s", root, rel + 1);
+		ret = 1;
+	}
+	closedir(d);
+	qsort(names, n, sizeof(*names), namecmp);
+	*np = n;
+	return (names);
+}
+
+static void
+ent_set(struct ent *e, const struct stat *st)
+{
+
+	e->ino = st->st_ino;
+	e->size = st->st_size;
+	e->ctime_sec = st->st_ctim.tv_sec;
+	e->ctime_nsec = st->st_ctim.tv_nsec;
+	e->mode = st->st_mode;
+	e->uid = st->st_uid;
+	e->gid = st->st_gid;
+	e->flags = ST_FLAGS(st);
+	e->child = e->nchild = 0;
+}
+
+static uint32_t
+str_add(const char *s, size_t len)
+{
+	uint32_t off;
+
+	if (strsize + len + 1 > stralloc) {
+		while (strsize + len + 1 > stralloc)
+			stralloc = stralloc == 0 ? 64 * 1024 : stralloc * 2;
+		if ((strtab = realloc(strtab, stralloc)) == NULL)
+			err(EXIT_FAILURE, "%s", "realloc");
+	}
+	off = strsize;
+	memcpy(&strtab[strsize], s, len + 1);
+	strsize += len + 1;
+	return (off);
+}
+
+static void
+index_dir(size_t di, int dfd, size_t len)
+{
+	struct stat st;
+	struct ent *e;
+	char **names;
+	size_t i, n, first, clen;
+	int fd;
+
+	names = dir_names(dfd, len, false, &n);
+	if (nents + n > entsalloc) {
+		while (nents + n > entsalloc)
+			entsalloc = entsalloc == 0 ? 1024 : entsalloc * 2;
+		ents = reallocarray(ents, entsalloc, sizeof(*ents));
+		if (ents == NULL)
+			err(EXIT_FAILURE, "%s", "reallocarray");
+	}
+	first = nents;
+	for (i = 0; i < n; i++) {
+		if (fstatat(dfd, names[i], &st, AT_SYMLINK_NOFOLLOW) == -1) {
+			if (errno != ENOENT) {
+				rel_push(len, names[i]);
+				warn("%s%s", root, rel + 1);
+				rel[len] = '\0';
+				ret = 1;
+			}
+			continue;
+		}
+		e = &ents[nents++];
+		ent_set(e, &st);
+		e->namelen = strlen(names[i]);
+		e->name = str_add(names[i], e->namelen);
+	}
+	ents[di].child = first;
+	ents[di].nchild = nents - first;
+	for (i = first; i < first + ents[di].nchild; i++) {
+		if (!S_ISDIR(ents[i].mode))
+			continue;
+		clen = rel_push(len, ent_name(&ents[i]));
+		fd = openat(dfd, ent_name(&ents[i]),
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+		if (fd == -1) {
+			warn("%s%s", root, rel + 1);
+			ret = 1;
+		} else {
+			index_dir(i, fd, clen);
+			close(fd);
+		}
+		rel[len] = '\0';
+	}
+	names_free(names, n);
+}
+
+static void
+index_create(void)
+{
+	struct stat st;
+	int fd;
+
+	hdr.start = time(NULL);
+	if ((fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		err(EX_NOINPUT, "%s", root);
+	if (fstat(fd, &st) == -1)
+		err(EXIT_FAILURE, "%s", root);
+	entsalloc = 1024;
+	if ((ents = calloc(entsalloc, sizeof(*ents))) == NULL)
+		err(EXIT_FAILURE, "%s", "calloc");
+	nents = 1;
+	ent_set(&ents[0], &st);
+	ents[0].name = str_add("", 0);
+	strcpy(rel, ".");
+	index_dir(0, fd, 1);
+	close(fd);
+
+	memcpy(hdr.magic, FSINDEX_MAGIC, sizeof(hdr.magic));
+	hdr.nents = nents;
+	hdr.strsize = strsize;
+	if (fwrite(&hdr, sizeof(hdr), 1, stdout) != 1 ||
+	    fwrite(ents, sizeof(*ents), nents, stdout) != nents ||
+	    fwrite(strtab, 1, strsize, stdout) != strsize ||
+	    fflush(stdout) != 0)
+		err(EXIT_FAILURE, "%s", "stdout");
+}
+
+static void
+index_load(const char *file)
+{
+	FILE *fp;
+	size_t i;
+
+	if ((fp = fopen(file, "r")) == NULL)
+		err(EX_NOINPUT, "%s", file);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1 ||
+	    memcmp(hdr.magic, FSINDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+	    hdr.nents == 0)
+		errx(EX_DATAERR, "%s: not an index", file);
+	nents = hdr.nents;
+	strsize = hdr.strsize;
+	ents = reallocarray(NULL, nents, sizeof(*ents));
+	strtab = malloc(strsize);
+	if (ents == NULL || strtab == NULL)
+		err(EXIT_FAILURE, "%s", "malloc");
+	if (fread(ents, sizeof(*ents), nents, fp) != nents ||
+	    fread(strtab, 1, strsize, fp) != strsize)
+		errx(EX_DATAERR, "%s: truncated", file);
+	fclose(fp);
+	for (i = 0; i < nents; i++) {
+		if (ents[i].name + (size_t)ents[i].namelen >= strsize ||
+		    ents[i].child + (size_t)ents[i].nchild > nents)
+			errx(EX_DATAERR, "%s: corrupt", file);
+	}
+}
+
+static const char *
+type_name(mode_t mode)
+{
+
+	switch (mode & S_IFMT) {
+	case S_IFREG: return ("file");
+	case S_IFDIR: return ("dir");
+	case S_IFLNK: return ("link");
+	case S_IFBLK: return ("block");
+	case S_IFCHR: return ("char");
+	case S_IFIFO: return ("fifo");
+	case S_IFSOCK: return ("socket");
+	}
+	return ("unknown");
+}
+
+static void
+print_path(char type)
+{
+
+	printf("%c %s%s\n", type, root, rel + 1);
+}
+
+static void
+print_missing(const struct ent *e, size_t len)
+{
+	const struct ent *c;
+	size_t clen;
+
+	print_path('-');
+	for (c = &ents[e->child]; c < &ents[e->child + e->nchild]; c++) {
+		clen = rel_push(len, ent_name(c));
+		print_missing(c, clen);
+		rel[len] = '\0';
+	}
+}
+
+/* Everything under an extra directory, as find(1) lists it. */
+static void
+print_extra_children(int dfd, size_t len)
+{
+	struct stat st;
+	char **names;
+	size_t i, n, clen;
+	int fd;
+
+	names = dir_names(dfd, len, true, &n);
+	for (i = 0; i < n; i++) {
+		clen = rel_push(len, names[i]);
+		print_path('+');
+		if (fstatat(dfd, names[i], &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+		    S_ISDIR(st.st_mode) &&
+		    (fd = openat(dfd, names[i],
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1) {
+			print_extra_children(fd, clen);
+			close(fd);
+		}
+		rel[len] = '\0';
+	}
+	names_free(names, n);
+}
+
+static void
+print_extra(int dfd, const char *name, size_t len)
+{
+	struct stat st;
+	int fd;
+
+	print_path('+');
+	if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+	    S_ISDIR(st.st_mode) &&
+	    (fd = openat(dfd, name,
+	    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1) {
+		print_extra_children(fd, len);
+		close(fd);
+	}
+}
+
+static void check_dir(const struct ent *, const struct stat *, int, size_t);
+
+/* Compare the keys markfs used to give to mtree -k. */
+static void
+check_ent(const struct ent *e, int dfd, const char *name, size_t len)
+{
+	struct stat st;
+	const struct ent *c;
+	size_t clen;
+	bool changed;
+	int fd;
+
+	if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) == -1) {
+		if (errno == ENOENT) {
+			print_missing(e, len);
+		} else {
+			warn("%s%s", root, rel + 1);
+			ret = 1;
+		}
+		return;
+	}
+	if ((st.st_mode & S_IFMT) != (e->mode & S_IFMT)) {
+		printf("M %s%s type (%s, %s)\n", root, rel + 1,
+		    type_name(e->mode), type_name(st.st_mode));
+		for (c = &ents[e->child]; c < &ents[e->child + e->nchild];
+		    c++) {
+			clen = rel_push(len, ent_name(c));
+			print_missing(c, clen);
+			rel[len] = '\0';
+		}
+		if (S_ISDIR(st.st_mode) && (fd = openat(dfd, name,
+		    O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) != -1) {
+			print_extra_children(fd, len);
+			close(fd);
+		}
+		return;
+	}
+	changed = false;
+#define	CHANGED(fmt, ...) do {						\
+	if (!changed)							\
+		printf("M %s%s", root, rel + 1);			\
+	changed = true;							\
+	printf(" " fmt, __VA_ARGS__);					\
+} while (0)
+	if (e->uid != st.st_uid)
+		CHANGED("user (%u, %u)", e->uid, (uint32_t)st.st_uid);
+	if (e->gid != st.st_gid)
+		CHANGED("gid (%u, %u)", e->gid, (uint32_t)st.st_gid);
+	if ((e->mode & MODEBITS) != (st.st_mode & MODEBITS))
+		CHANGED("permissions (0%o, 0%o)", e->mode & MODEBITS,
+		    (uint32_t)(st.st_mode & MODEBITS));
+	if (!S_ISDIR(st.st_mode) && e->size != (uint64_t)st.st_size)
+		CHANGED("size (%ju, %ju)", (uintmax_t)e->size,
+		    (uintmax_t)st.st_size);
+	if (e->flags != ST_FLAGS(&st))
+		CHANGED("flags (%#o, %#o)", e->flags, ST_FLAGS(&st));
+#undef CHANGED
+	if (changed)
+		printf("\n");
+	if (!S_ISDIR(st.st_mode))
+		return;
+	fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW |
+	    O_CLOEXEC);
+	if (fd == -1) {
+		warn("%s%s", root, rel + 1);
+		ret = 1;
+		return;
+	}
+	check_dir(e, &st, fd, len);
+	close(fd);
+}
+
+static void
+check_dir(const struct ent *d, const struct stat *st, int dfd, size_t len)
+{
+	const struct ent *c, *end;
+	char **names;
+	size_t i, n, clen;
+	int cmp;
+
+	c = &ents[d->child];
+	end = c + d->nchild;
+	/*
+	 * Adding, removing or renaming an entry updates the directory's
+	 * ctime.  One changed in the same second the index was started may
+	 * have changed after it was read.
+	 */
+	if (st->st_ino == d->ino && st->st_ctim.tv_sec == d->ctime_sec &&
+	    st->st_ctim.tv_nsec == d->ctime_nsec &&
+	    st->st_ctim.tv_sec < hdr.start) {
+		for (; c < end; c++) {
+			clen = rel_push(len, ent_name(c));
+			check_ent(c, dfd, ent_name(c), clen);
+			rel[len] = '\0';
+		}
+		return;
+	}
+	names = dir_names(dfd, len, false, &n);
+	for (i = 0; c < end || i < n;) {
+		if (c == end)
+			cmp = 1;
+		else if (i == n)
+			cmp = -1;
+		else
+			cmp = strcmp(ent_name(c), names[i]);
+		if (cmp <= 0)
+			clen = rel_push(len, ent_name(c));
+		else
+			clen = rel_push(len, names[i]);
+		if (cmp < 0)
+			print_missing(c++, clen);
+		else if (cmp > 0)
+			print_extra(dfd, names[i++], clen);
+		else {
+			check_ent(c, dfd, ent_name(c), clen);
+			c++;
+			i++;
+		}
+		rel[len] = '\0';
+	}
+	names_free(names, n);
+}
+
+static void
+index_check(void)
+{
+	int fd;
+
+	strcpy(rel, ".");
+	if ((fd = open(root, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		err(EX_NOINPUT, "%s", root);
+	check_ent(&ents[0], fd, ".", 1);
+	close(fd);
+	if (fflush(stdout) != 0)
+		err(EXIT_FAILURE, "%s", "stdout");
+}
+
+int
+main(int argc, char **argv)
+{
+	const char *index;
+	int ch;
+	bool cflag;
+
+	index = NULL;
+	cflag = false;
+	while ((ch = getopt(argc, argv, "cf:p:X:")) != -1) {
+		switch (ch) {
+		case 'c':
+			cflag = true;
+			break;
+		case 'f':
+			index = optarg;
+			break;
+		case 'p':
+			root = optarg;
+			break;
+		case 'X':
+			excludes_load(optarg);
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	if (argc != 0 || root == NULL || cflag == (index != NULL))
+		usage();
+
+	if (cflag)
+		index_create();
+	else {
+		index_load(index);
+		index_check();
+	}
+	return (ret);
+}
@@ -0,0 +1,313 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Print a build log, or a range of it, whether it is plain, gzip or
+ * written by timestamp -z.  For the latter only the frames covering the
+ * range are read and inflated so tailing a large log, or one that is
+ * still being written, is cheap.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "../timestamp/logframe.h"
+
+struct frame {
+	off_t coff;
+	uint64_t uoff;
+	uint32_t csize;
+	uint32_t usize;
+};
+
+static void
+usage(void)
+{
+
+	fprintf(stderr, "%s\n",
+	    "usage: logcat [-o offset] [-n length | -t length] file");
+	exit(EX_USAGE);
+}
+
+static uint64_t
+parse_size(const char *arg)
+{
+	char *end;
+	uintmax_t v;
+
+	errno = 0;
+	v = strtoumax(arg, &end, 10);
+	if (*arg == '\0' || *end != '\0' || errno != 0)
+		errx(EX_USAGE, "Invalid size: %s", arg);
+	return (v);
+}
+
+static void
+output(const void *buf, size_t len)
+{
+
+	if (len > 0 && fwrite(buf, 1, len, stdout) != len)
+		err(EXIT_FAILURE, "%s", "stdout");
+}
+
+static bool
+read_full(int fd, void *buf, size_t len, off_t off)
+{
+	ssize_t n;
+
+	while (len > 0) {
+		n = pread(fd, buf, len, off);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (false);
+		}
+		if (n == 0)
+			return (false);
+		buf = (char *)buf + n;
+		len -= n;
+		off += n;
+	}
+	return (true);
+}
+
+/*
+ * Walk the frame headers.  Returns false if the file is not framed.  A
+ * frame which is not fully written yet ends the list.
+ */
+static bool
+frames_load(int fd, off_t fsize, struct frame **framesp, size_t *nframesp)
+{
+	unsigned char h[LOGFRAME_HDRLEN];
+	struct frame *frames, *f;
+	size_t nframes, nalloc;
+	uint64_t uoff;
+	off_t coff;
+	uint32_t csize, usize;
+
+	frames = NULL;
+	nframes = nalloc = 0;
+	uoff = 0;
+	for (coff = 0; coff + LOGFRAME_HDRLEN <= fsize; coff += csize) {
+		if (!read_full(fd, h, sizeof(h), coff))
+			err(EXIT_FAILURE, "%s", "read");
+		if (!logframe_header_parse(h, &csize, &usize))
+			break;
+		if (coff + csize > fsize)
+			break;
+		if (nframes == nalloc) {
+			nalloc = nalloc == 0 ? 64 : nalloc * 2;
+			frames = reallocarray(frames, nalloc, sizeof(*frames));
+			if (frames == NULL)
+				err(EXIT_FAILURE, "%s", "reallocarray");
+		}
+		f = &frames[nframes++];
+		f->coff = coff;
+		f->uoff = uoff;
+		f->csize = csize;
+		f->usize = usize;
+		uoff += usize;
+	}
+	*framesp = frames;
+	*nframesp = nframes;
+	return (nframes > 0);
+}
+
+static void
+frame_inflate(int fd, const struct frame *f, unsigned char *cbuf,
+    unsigned char *ubuf)
+{
+	z_stream strm = {0};
+	const unsigned char *trailer;
+
+	if (!read_full(fd, cbuf, f->csize, f->coff))
+		err(EXIT_FAILURE, "%s", "read");
+	if (inflateInit2(&strm, -MAX_WBITS) != Z_OK)
+		errx(EXIT_FAILURE, "inflateInit2: %s", strm.msg);
+	strm.next_in = cbuf + LOGFRAME_HDRLEN;
+	strm.avail_in = f->csize - LOGFRAME_HDRLEN - LOGFRAME_TRLLEN;
+	strm.next_out = ubuf;
+	strm.avail_out = f->usize;
+	if (inflate(&strm, Z_FINISH) != Z_STREAM_END ||
+	    strm.total_out != f->usize)
+		errx(EXIT_FAILURE, "corrupt frame at %jd", (intmax_t)f->coff);
+	inflateEnd(&strm);
+	trailer = cbuf + f->csize - LOGFRAME_TRLLEN;
+	if (logframe_le32dec(trailer) != crc32(0L, ubuf, f->usize))
+		errx(EXIT_FAILURE, "bad crc in frame at %jd",
+		    (intmax_t)f->coff);
+}
+
+static void
+cat_frames(int fd, const struct frame *frames, size_t nframes,
+    uint64_t start, uint64_t end)
+{
+	unsigned char *cbuf, *ubuf;
+	const struct frame *f;
+	size_t lo, hi, mid;
+	uint64_t from, to;
+
+	/* Find the first frame containing start. */
+	lo = 0;
+	hi = nframes;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (frames[mid].uoff + frames[mid].usize <= start)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	cbuf = ubuf = NULL;
+	for (f = &frames[lo]; f < &frames[nframes] && f->uoff < end; f++) {
+		cbuf = realloc(cbuf, f->csize);
+		ubuf = realloc(ubuf, f->usize);
+		if (cbuf == NULL || ubuf == NULL)
+			err(EXIT_FAILURE, "%s", "realloc");
+		frame_inflate(fd, f, cbuf, ubuf);
+		from = start > f->uoff ? start - f->uoff : 0;
+		to = end - f->uoff < f->usize ? end - f->uoff : f->usize;
+		output(ubuf + from, to - from);
+	}
+	free(cbuf);
+	free(ubuf);
+}
+
+/* Plain or foreign gzip files are read with zlib which handles both. */
+static void
+cat_stream(int fd, bool tail, uint64_t offset, uint64_t length)
+{
+	static unsigned char buf[64 * 1024];
+	uint64_t pos, start, end;
+	gzFile gz;
+	int n;
+
+	n = 0;
+	if ((gz = gzdopen(fd, "r")) == NULL)
+		err(EXIT_FAILURE, "%s", "gzdopen");
+	start = offset;
+	end = UINT64_MAX - length < offset ? UINT64_MAX : offset + length;
+	if (tail) {
+		/* Need the full size first. */
+		for (pos = 0; (n = gzread(gz, buf, sizeof(buf))) > 0;)
+			pos += n;
+		if (n == -1)
+			errx(EXIT_FAILURE, "%s", gzerror(gz, &n));
+		start = pos > length ? pos - length : 0;
+		end = pos;
+		if (gzrewind(gz) == -1)
+			errx(EXIT_FAILURE, "%s", gzerror(gz, &n));
+	}
+	for (pos = 0; pos < end && (n = gzread(gz, buf, sizeof(buf))) > 0;
+	    pos += n) {
+		if (pos + n <= start)
+			continue;
+		output(buf + (start > pos ? start - pos : 0),
+		    (end < pos + n ? end - pos : (uint64_t)n) -
+		    (start > pos ? start - pos : 0));
+	}
+	if (n == -1)
+		errx(EXIT_FAILURE, "%s", gzerror(gz, &n));
+	gzclose_r(gz);
+}
+
+int
+main(int argc, char **argv)
+{
+	struct frame *frames;
+	struct stat st;
+	size_t nframes;
+	uint64_t offset, length, total, start, end;
+	int ch, fd;
+	bool nflag, tflag;
+
+	offset = 0;
+	length = UINT64_MAX;
+	nflag = tflag = false;
+	while ((ch = getopt(argc, argv, "n:o:t:")) != -1) {
+		switch (ch) {
+		case 'n':
+			length = parse_size(optarg);
+			nflag = true;
+			break;
+		case 'o':
+			offset = parse_size(optarg);
+			break;
+		case 't':
+			length = parse_size(optarg);
+			tflag = true;
+			break;
+		default:
+			usage();
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1 || (nflag && tflag) || (tflag && offset != 0))
+		usage();
+
+	if ((fd = open(argv[0], O_RDONLY | O_CLOEXEC)) == -1)
+		err(EX_NOINPUT, "%s", argv[0]);
+	if (fstat(fd, &st) == -1)
+		err(EXIT_FAILURE, "%s", "fstat");
+	if (!S_ISREG(st.st_mode) ||
+	    !frames_load(fd, st.st_size, &frames, &nframes)) {
+		cat_stream(fd, tflag, offset, length);
+		goto out;
+	}
+	total = frames[nframes - 1].uoff + frames[nframes - 1].usize;
+	if (tflag) {
+		start = total > length ? total - length : 0;
+		end = total;
+	} else if (offset >= total) {
+		start = end = total;
+	} else {
+		start = offset;
+		end = total - offset < length ? total : offset + length;
+	}
+	if (start < end)
+		cat_frames(fd, frames, nframes, start, end);
+	free(frames);
+	close(fd);
+out:
+	if (fflush(stdout) != 0)
+		err(EXIT_FAILURE, "%s", "stdout");
+	return (0);
+}
@@ -0,0 +1,710 @@
+/*-
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ * 
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Read a single build log and output a failure reason.
+ *
+ * This is the same as awk/processonelog.awk but the log is read once, and
+ * may be compressed.  An Aho-Corasick automaton of literal strings which
+ * each rule's regex cannot match without is run over every line.  Only the
+ * rules with a hit, in their original order, are then checked with
+ * regexec(3).
+ */
+
+#include <sys/types.h>
+
+#include <archive.h>
+#include <assert.h>
+#include <err.h>
+#include <regex.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#ifndef nitems
+#define nitems(x)	(sizeof((x)) / sizeof((x)[0]))
+#endif
+
+struct rule {
+	const char *reason;
+	const char *pattern;
+	/* Only match lines which do not match this. */
+	const char *exclude;
+	regex_t re;
+	regex_t re_exclude;
+	/* No required literal was found; check every line. */
+	bool always;
+};
+
+/* Keep in sync with awk/processonelog.awk */
+static struct rule rules[] = {
+	{ .reason = "mtree",
+	    .pattern = "(Error: mtree file ./etc/mtree/BSD.local.dist. is missing|error in pkg_delete|filesystem was touched prior to .make install|list of extra files and directories|list of files present before this port was installed|list of filesystem changes from before and after|Error: Files or directories left over|Error: Filesystem touched during build)" },
+	/* note: must run before the configure_error check */
+	{ .reason = "arch",
+	    .pattern = "Configuration .* not supported" },
+	{ .reason = "missing_header",
+	    .pattern = "[.](c|cc|cxx|cpp|h|y)[0-9:]+ .+[.][hH](: No such file|' file not found)" },
+	{ .reason = "configure_error",
+	    .pattern = "(configure: error:|Script.*configure.*failed unexpectedly|script.*failed: here are the contents of|CMake Error at|fatal error.*file not found)" },
+	{ .reason = "fetch",
+	    .pattern = "Couldn't fetch it - please try" },
+	{ .reason = "LIB_DEPENDS",
+	    .pattern = "Error: shared library \".*\" does not exist" },
+	{ .reason = "duplicate_symbol",
+	    .pattern = "ld: error: duplicate symbol:" },
+	{ .reason = "lld_linker_error",
+	    .pattern = "error: .* create dynamic relocation .* against symbol: .* in readonly segment" },
+	{ .reason = "compiler_error",
+	    .pattern = "(parse error|too (many|few) arguments to|argument.*doesn.*prototype|incompatible type for argument|conflicting types for|undeclared \\(first use (in )?this function\\)|incorrect number of parameters|has incomplete type and cannot be initialized|error: storage size.* isn.t known|command .cc. terminated by signal 4)" },
+	{ .reason = "new_compiler_error",
+	    .pattern = "(ANSI C.. forbids|is a contravariance violation|changed for new ANSI .for. scoping|[0-9]: passing .* changes signedness|lacks a cast|redeclared as different kind of symbol|invalid type .* for default argument to|wrong type argument to unary exclamation mark|duplicate explicit instantiation of|incompatible types in assignment|assuming . on overloaded member function|call of overloaded .* is ambiguous|declaration of C function .* conflicts with|initialization of non-const reference type|using typedef-name .* after|[0-9]: size of array .* is too large|fixed or forbidden register .* for class|assignment of read-only variable|error: label at end of compound statement|error:.*(has no|is not a) member|error:.*is (private|protected)|error: uninitialized member|error: unrecognized command line option)" },
+	/* must preceed badc++ */
+	{ .reason = "clang11",
+	    .pattern = "ld: error:.*undefined (reference|symbol).*std::" },
+	{ .reason = "bad_C++_code",
+	    .pattern = "(syntax error before|friend declaration|no matching function for call to|.main. must return .int.|invalid conversion (between|from)|cannot be used as a macro name as it is an operator in C[+][+]|is not a member of type|after previous specification in|no class template named|because worst conversion for the former|better than worst conversion|no match for.*operator|no match for call to|undeclared in namespace|is used as a type, but is not|error: array bound forbidden|error: class definition|error: expected constructor|error: there are no arguments|error:.*cast.*loses precision|ISO C[+][+]|error: invalid pure specifier|error: invalid (argument type|integral value|operand|token|use of a cast|value)|error: expected.*(at end of declaration|expression|identifier)|error:.*not supported|error:.*assert failed|error: expected unqualified-id|error: non-constant-expression cannot be narrowed|error: cannot assign to variable|error: no type.*in namespace|error: constant expression evaluates)" },
+	{ .reason = "gcc4_error",
+	    .pattern = "error: (array type has incomplete element type|conflicts with new declaration|expected.*before .class|expected primary expression|extra qualification .* on member|.*has incomplete type|invalid cast.*type .* to type|invalid lvalue in (assignment|decrement|increment|unary)|invalid storage class for function|lvalue required as (increment operator|left operand)|.*should have been declared inside|static declaration of.*follows non-static declaration|two or more data types in declaration specifiers|.* was not declared in this scope)" },
+	{ .reason = "install_error",
+	    .pattern = "^(cp|install|make|pkg-static|strip|tar):.*No such file" },
+	{ .reason = "depend_object",
+	    .pattern = "(conflicts with installed package|installs files into the same place|is already installed - perhaps an older version|You may wish to ..make deinstall.. and install this port again)" },
+	{ .reason = "clang",
+	    .pattern = "(error: a parameter list without types|error: C++ requires a type specifier|error: allocation of incomplete type|error: array is too large|error: binding of reference|error: call to func.*neither visible|error: called object type|error: cannot combine with previous.*specifier|error: cannot initialize (a parameter|a variable|return object)|error: cannot pass object|error:.*cast from pointer|error: comparison of unsigned.*expression.*is always|error: (conversion|use of operator).*(is ambiguous|specifies type)|error:.*converts between pointers to integer|error: declaration of.*shadows template parameter|error:.*declared as an array with a negative size|error: default arguments cannotbe added|error: default initialization of an object|error: definition.*not in a namespace|error:.*directive requires a positive integer argument|error: elaborated type refers to a typedef|error: exception specification|error: explicit specialization.*after instantiation|error: explicitly assigning a variable|error: expression result unused|error: fields must have a constant size|error: flexible array member|error: (first|second) (argument|parameter) of .main|error: format string is not a string literal|error: function.*is not needed|error: global register values are not supported|error:.*hides overloaded virtual function|error: if statement has empty body|error: illegal storage class on function|error: implicit (conversion|declaration|instantiation)|error: indirection.*will be deleted|error: initializer element is not.*constant|error: initialization of pointer|error: indirect goto might cross|error:.*is a (private|protected) member|error: member (of anonymous union|reference)|error: no matching member|error: non-const lvalue|error: non-void function.*should return a value|error: no (matching constructor|member named|viable overloaded)|error: parameter.*must have type|error: passing.*(a.*value|incompatible type)|error: qualified reference|error: redeclaration of.*built-in type|error:.*requires a (constant expression|pointer or reference|type specifier)|error: redefinition of|error: switch condition has boolean|error: taking the address of a temporary object|error: target.*conflicts with declaration|error:.*unable to pass LLVM bit-code files to linker|error: unexpected token|error: unknown (machine mode|type name)|error: unsupported option|error: unused (function|parameter)|error: use of (GNU old-style field designator|undeclared identifier|unknown builtin)|error: using the result of an assignment|error: variable.*is unitialized|error: variable length array|error: void function.*should not return a value|the clang compiler does not support|Unknown depmode none)" },
+	/* must follow "clang" */
+	{ .reason = "linker_error",
+	    .pattern = "(/usr/libexec/elf/ld: cannot find|undefined reference to|cannot open -l.*: No such file|error: linker command failed with exit code 1)" },
+
+	/* below here are the less common items */
+	{ .reason = "arch",
+	    .pattern = "(.s: Assembler messages:|Cannot (determine .* target|find the byte order) for this architecture|^cc1: bad value.*for -mcpu.*switch|could not read symbols: File in wrong format|[Ee]rror: [Uu]nknown opcode|error.*Unsupported architecture|ENDIAN must be defined 0 or 1|failed to merge target-specific data|(file not recognized|failed to set dynamic section sizes): File format not recognized|impossible register constraint|inconsistent operand constraints in an .asm|Invalid configuration.*unknown.*machine.*unknown not recognized|invalid lvalue in asm statement|is only for.*, and you are running|not a valid 64 bit base/index expression|relocation R_X86_64_32.*can not be used when making a shared object|relocation truncated to fit: |shminit failed: Function not implemented|The target cpu, .*, is not currently supported.|This architecture seems to be neither big endian nor little endian|unknown register name|Unable to correct byte order|Unsupported platform, sorry|won't run on this architecture|error: invalid output constraint .* in asm|error: unsupported inline asm|error: invalid (instruction|operand)|error: Please add support for your architecture|error: unrecognized machine type|error: [Uu]nknown endian|<inline asm>.* error:|error: unrecognized instruction)" },
+	{ .reason = "checksum",
+	    .pattern = "Checksum mismatch" },
+	{ .reason = "clang-bug",
+	    .pattern = "(clang: error: unable to execute command|error: cannot compile this.*yet|error: clang frontend command failed|error:.*ignoring directive for now|error: (invalid|unknown) argument|error: (invalid|unknown use of) instruction mnemonic|error:.*please report this as a bug|LLVM ERROR: )" },
+	{ .reason = "DISPLAY",
+	    .pattern = "((Can't|unable to) open display|Cannot open /dev/tty for read|RuntimeError: cannot open display|You must run this program under the X-Window System)" },
+	{ .reason = "distinfo_update",
+	    .pattern = "(No checksum recorded for|(Maybe|Either) .* is out of date, or)" },
+	{ .reason = "fetch",
+	    .pattern = "(error.*hostname nor servname provided|fetch:.*No address record|Member name contains .[.][.])" },
+	{ .reason = "fetch_timeout",
+	    .pattern = "(pnohang: killing make checksum|fetch: transfer timed out)" },
+	{ .reason = "gcc_bug",
+	    .pattern = "See <URL:http://gcc.gnu.org/bugs.html> for instructions." },
+	{ .reason = "install_error",
+	    .pattern = "(Run-time system build failed for some reason|tar: Error opening archive: Failed to open.*No such file or directory)" },
+	{ .reason = "linker_error",
+	    .pattern = "(cc: .*libintl.*: No such file or directory|cc: ndbm[.]so: No such file or directory|error: linker command failed|error: The X11 shared library could not be loaded|libtool: link: cannot find the library|relocation against dynamic symbol|Shared object.*not found, required by|ld: unrecognized option|error: ld returned.*status )" },
+	{ .reason = "makefile",
+	    .pattern = "Could not create Makefile" },
+	{ .reason = "makefile",
+	    .pattern = "make.*(cannot open [Mm]akefile|don.t know how to make|fatal errors encountered|No rule to make target|built-in)",
+	    .exclude = "regression-test[.]continuing" },
+	{ .reason = "manpage",
+	    .pattern = "/usr/.*/man/.*: No such file or directory" },
+	{ .reason = "patch",
+	    .pattern = "(out of .* hunks .*--saving rejects to|FAILED to apply cleanly FreeBSD patch)" },
+	{ .reason = "process_failed",
+	    .pattern = "(Abort trap|Bus error|Error 127|Killed: 9|Signal 1[01])" },
+	{ .reason = "regparm",
+	    .pattern = "error: .regparm. is not valid on this platform" },
+	{ .reason = "runaway_process",
+	    .pattern = "(USER.*PID.*TIME.*COMMAND|pnohang: killing make package|Killing runaway|Killing timed out build)" },
+	/* this is usually a second-order effect */
+	{ .reason = "termios",
+	    .pattern = "#warning \"this file includes <sys/termios.h>" },
+	{ .reason = "threads",
+	    .pattern = "(/usr/bin/ld: cannot find -l(pthread|XThrStub)|cannot find -lc_r|Error: pthreads are required to build this package|Please install/update your POSIX threads (pthreads) library|requires.*thread support|: The -pthread option is deprecated|error: reference to .thread. is ambiguous)" },
+	{ .reason = "WRKDIR",
+	    .pattern = "Read-only file system" },
+
+	/*
+	 * Although these can be fairly common, and thus in one sense ought
+	 * to be earlier in the evaluation, in practice they are most often
+	 * secondary types of errors, and thus need to be evaluated after
+	 * all the specific cases.
+	 */
+	{ .reason = "clang_werror",
+	    .pattern = "[.](c|cc|cxx|cpp|h|y)[0-9:]+ error: .*-Werror" },
+	{ .reason = "compiler_error",
+	    .pattern = "cc1.*warnings being treated as errors" },
+	{ .reason = "coredump",
+	    .pattern = "core dumped" },
+	{ .reason = "install_error",
+	    .pattern = "tar: Error exit delayed from previous errors" },
+	{ .reason = "configure_error",
+	    .pattern = "Cannot stat: " },
+	{ .reason = "depend_package",
+	    .pattern = "error in dependency .*, exiting" },
+	{ .reason = "linker_error",
+	    .pattern = "/usr/bin/ld: cannot find -l" },
+	{ .reason = "explicit_error",
+	    .pattern = "^#error \"" },
+	{ .reason = "segfault",
+	    .pattern = "(Segmentation fault|signal: 11, SIGSEGV)" },
+	/* must come after segfault */
+	{ .reason = "rust",
+	    .pattern = "(process didn.t exit successfully:.*build-script-build|try .rustc --explain)" },
+	{ .reason = "ninja",
+	    .pattern = "ninja: build stopped: subcommand failed" },
+};
+
+#define PHASE_MARKER	"=======================<phase: "
+#define NRULES		nitems(rules)
+#define NWORDS		((NRULES + 63) / 64)
+
+struct ac_node {
+	int32_t next[256];
+	int32_t fail;
+	bool has_out;
+	uint64_t out[NWORDS];
+};
+
+static struct ac_node *ac;
+static size_t ac_nodes, ac_cap;
+
+/* A set of strings which a regex cannot match without one of. */
+struct litset {
+	char **strs;
+	size_t n;
+	/* Nothing is required. */
+	bool any;
+};
+
+static void
+litset_free(struct litset *ls)
+{
+	size_t i;
+
+	for (i = 0; i < ls->n; i++)
+		free(ls->strs[i]);
+	free(ls->strs);
+	ls->strs = NULL;
+	ls->n = 0;
+	ls->any = true;
+}
+
+static void
+litset_add(struct litset *ls, const char *s, size_t len)
+{
+	char **strs;
+
+	strs = reallocarray(ls->strs, ls->n + 1, sizeof(*ls->strs));
+	if (strs == NULL)
+		err(EX_OSERR, "reallocarray");
+	ls->strs = strs;
+	if ((ls->strs[ls->n] = strndup(s, len)) == NULL)
+		err(EX_OSERR, "strndup");
+	ls->n++;
+	ls->any = false;
+}
+
+static size_t
+litset_minlen(const struct litset *ls)
+{
+	size_t i, len, min;
+
+	min = SIZE_MAX;
+	for (i = 0; i < ls->n; i++) {
+		len = strlen(ls->strs[i]);
+		if (len < min)
+			min = len;
+	}
+	return (min);
+}
+
+/* Keep the better of the two in best. */
+static void
+litset_consider(struct litset *best, struct litset *ls)
+{
+
+	if (ls->any) {
+		litset_free(ls);
+		return;
+	}
+	if (best->any || litset_minlen(ls) > litset_minlen(best) ||
+	    (litset_minlen(ls) == litset_minlen(best) && ls->n < best->n)) {
+		litset_free(best);
+		*best = *ls;
+		ls->strs = NULL;
+		ls->n = 0;
+		ls->any = true;
+		return;
+	}
+	litset_free(ls);
+}
+
+enum atom_type {
+	ATOM_CHAR,
+	ATOM_GROUP,
+	/* Matches something of unknown content, or nothing at all. */
+	ATOM_OTHER,
+};
+
+static struct litset parse_alt(const char **p);
+
+/* Returns true if the bracket expression is a single literal char. */
+static bool
+parse_bracket(const char **p, char *c)
+{
+	const char *s;
+	bool negate, single;
+	int count;
+
+	s = *p;
+	negate = false;
+	single = true;
+	count = 0;
+	if (*s == '^') {
+		negate = true;
+		s++;
+	}
+	if (*s == ']') {
+		*c = *s++;
+		count++;
+	}
+	while (*s != '\0' && *s != ']') {
+		if (*s == '[' && (s[1] == ':' || s[1] == '.' || s[1] == '=')) {
+			const char *end;
+			char term[3] = { s[1], ']', '\0' };
+
+			end = strstr(s + 2, term);
+			if (end == NULL)
+				break;
+			s = end + 2;
+			single = false;
+			continue;
+		}
+		if (*s == '-' && count > 0 && s[1] != ']')
+			single = false;
+		*c = *s++;
+		count++;
+	}
+	if (*s == ']')
+		s++;
+	*p = s;
+	return (!negate && single && count == 1);
+}
+
+static struct litset
+parse_concat(const char **p)
+{
+	struct litset best = { .any = true }, group = { .any = true };
+	struct litset run_set;
+	enum atom_type type;
+	char run[1024];
+	size_t runlen;
+	bool optional, repeat;
+	char c = '\0';
+
+	runlen = 0;
+#define FLUSH_RUN() do {						\
+	if (runlen > 0) {						\
+		run_set = (struct litset){ .any = true };		\
+		litset_add(&run_set, run, runlen);			\
+		litset_consider(&best, &run_set);			\
+		runlen = 0;						\
+	}								\
+} while (0)
+	while (**p != '\0' && **p != '|' && **p != ')') {
+		switch (**p) {
+		case '(':
+			(*p)++;
+			group = parse_alt(p);
+			if (**p == ')')
+				(*p)++;
+			type = ATOM_GROUP;
+			break;
+		case '[':
+			(*p)++;
+			type = parse_bracket(p, &c) ? ATOM_CHAR : ATOM_OTHER;
+			break;
+		case '.':
+		case '^':
+		case '$':
+			(*p)++;
+			type = ATOM_OTHER;
+			break;
+		case '\\':
+			(*p)++;
+			if (**p != '\0')
+				c = *(*p)++;
+			else
+				c = '\\';
+			type = ATOM_CHAR;
+			break;
+		default:
+			c = *(*p)++;
+			type = ATOM_CHAR;
+			break;
+		}
+		/* Consecutive quantifiers, as in C++, apply to the atom. */
+		optional = repeat = false;
+		for (;;) {
+			switch (**p) {
+			case '*':
+			case '?':
+				(*p)++;
+				optional = true;
+				continue;
+			case '+':
+				(*p)++;
+				repeat = true;
+				continue;
+			case '{':
+				(*p)++;
+				if (**p == '0' || **p == ',')
+					optional = true;
+				repeat = true;
+				while (**p != '\0' && **p != '}')
+					(*p)++;
+				if (**p == '}')
+					(*p)++;
+				continue;
+			}
+			break;
+		}
+		if (optional) {
+			if (type == ATOM_GROUP)
+				litset_free(&group);
+			FLUSH_RUN();
+			continue;
+		}
+		switch (type) {
+		case ATOM_CHAR:
+			if (runlen == sizeof(run))
+				FLUSH_RUN();
+			run[runlen++] = c;
+			if (repeat)
+				FLUSH_RUN();
+			break;
+		case ATOM_GROUP:
+			FLUSH_RUN();
+			litset_consider(&best, &group);
+			break;
+		case ATOM_OTHER:
+			FLUSH_RUN();
+			break;
+		}
+	}
+	FLUSH_RUN();
+#undef FLUSH_RUN
+	return (best);
+}
+
+static struct litset
+parse_alt(const char **p)
+{
+	struct litset ls, branch;
+	size_t i;
+
+	ls = parse_concat(p);
+	while (**p == '|') {
+		(*p)++;
+		branch = parse_concat(p);
+		if (ls.any || branch.any) {
+			litset_free(&ls);
+			litset_free(&branch);
+			continue;
+		}
+		for (i = 0; i < branch.n; i++)
+			litset_add(&ls, branch.strs[i], strlen(branch.strs[i]));
+		litset_free(&branch);
+	}
+	return (ls);
+}
+
+static int32_t
+ac_new_node(void)
+{
+	struct ac_node *nac;
+
+	if (ac_nodes == ac_cap) {
+		ac_cap = ac_cap == 0 ? 256 : ac_cap * 2;
+		nac = reallocarray(ac, ac_cap, sizeof(*ac));
+		if (nac == NULL)
+			err(EX_OSERR, "reallocarray");
+		ac = nac;
+	}
+	memset(&ac[ac_nodes], 0, sizeof(*ac));
+	memset(ac[ac_nodes].next, -1, sizeof(ac[ac_nodes].next));
+	return ((int32_t)ac_nodes++);
+}
+
+static void
+ac_add(const char *s, size_t rule)
+{
+	int32_t node, next;
+	unsigned char c;
+
+	node = 0;
+	for (; *s != '\0'; s++) {
+		c = (unsigned char)*s;
+		next = ac[node].next[c];
+		if (next == -1) {
+			next = ac_new_node();
+			ac[node].next[c] = next;
+		}
+		node = next;
+	}
+	ac[node].out[rule / 64] |= (uint64_t)1 << (rule % 64);
+	ac[node].has_out = true;
+}
+
+/* Compute the failure links and turn the trie into a full DFA. */
+static void
+ac_build(void)
+{
+	int32_t *queue, node, next;
+	size_t head, tail, w;
+	int c;
+
+	queue = calloc(ac_nodes, sizeof(*queue));
+	if (queue == NULL)
+		err(EX_OSERR, "calloc");
+	head = tail = 0;
+	for (c = 0; c < 256; c++) {
+		next = ac[0].next[c];
+		if (next == -1) {
+			ac[0].next[c] = 0;
+			continue;
+		}
+		ac[next].fail = 0;
+		queue[tail++] = next;
+	}
+	while (head < tail) {
+		node = queue[head++];
+		for (w = 0; w < NWORDS; w++)
+			ac[node].out[w] |= ac[ac[node].fail].out[w];
+		ac[node].has_out |= ac[ac[node].fail].has_out;
+		for (c = 0; c < 256; c++) {
+			next = ac[node].next[c];
+			if (next == -1) {
+				ac[node].next[c] = ac[ac[node].fail].next[c];
+				continue;
+			}
+			ac[next].fail = ac[ac[node].fail].next[c];
+			queue[tail++] = next;
+		}
+	}
+	free(queue);
+}
+
+static void
+compile_rules(void)
+{
+	struct litset ls;
+	const char *p;
+	size_t i, j;
+	int error;
+	char errbuf[256];
+
+	ac_new_node();
+	for (i = 0; i < NRULES; i++) {
+		error = regcomp(&rules[i].re, rules[i].pattern,
+		    REG_EXTENDED | REG_NOSUB);
+		if (error == 0 && rules[i].exclude != NULL)
+			error = regcomp(&rules[i].re_exclude,
+			    rules[i].exclude, REG_EXTENDED | REG_NOSUB);
+		if (error != 0) {
+			regerror(error, &rules[i].re, errbuf, sizeof(errbuf));
+			errx(EX_SOFTWARE, "regcomp %s: %s", rules[i].reason,
+			    errbuf);
+		}
+		p = rules[i].pattern;
+		ls = parse_alt(&p);
+		if (ls.any || *p != '\0' || litset_minlen(&ls) == 0) {
+			rules[i].always = true;
+			litset_free(&ls);
+			continue;
+		}
+		for (j = 0; j < ls.n; j++)
+			ac_add(ls.strs[j], i);
+		litset_free(&ls);
+	}
+	ac_build();
+}
+
+struct classifier {
+	char *line;
+	size_t len;
+	size_t cap;
+	int32_t state;
+	uint64_t candidates[NWORDS];
+	const char *reason;
+	char *reason_last;
+};
+
+/* Same as awk's $2. */
+static char *
+field2(const char *line)
+{
+	const char *start, *end;
+
+	start = line;
+	start += strspn(start, " \t");
+	start += strcspn(start, " \t");
+	start += strspn(start, " \t");
+	end = start + strcspn(start, " \t");
+	return (strndup(start, end - start));
+}
+
+static void
+classify_line(struct classifier *cl)
+{
+	size_t i;
+
+	cl->line[cl->len] = '\0';
+	if (cl->reason_last == NULL) {
+		for (i = 0; i < NRULES; i++) {
+			if (!rules[i].always &&
+			    (cl->candidates[i / 64] &
+			    ((uint64_t)1 << (i % 64))) == 0)
+				continue;
+			if (regexec(&rules[i].re, cl->line, 0, NULL, 0) != 0)
+				continue;
+			if (rules[i].exclude != NULL &&
+			    regexec(&rules[i].re_exclude, cl->line, 0, NULL,
+			    0) == 0)
+				continue;
+			cl->reason = rules[i].reason;
+			return;
+		}
+	}
+	if (strstr(cl->line, PHASE_MARKER) != NULL) {
+		free(cl->reason_last);
+		cl->reason_last = field2(cl->line);
+		if (cl->reason_last != NULL && cl->reason_last[0] == '\0') {
+			free(cl->reason_last);
+			cl->reason_last = NULL;
+		}
+	}
+}
+
+/* Returns false once the reason is known. */
+static bool
+classify(struct classifier *cl, const char *buf, size_t len)
+{
+	const char *p, *end;
+	unsigned char c;
+	size_t w;
+
+	end = buf + len;
+	for (p = buf; p < end; p++) {
+		c = (unsigned char)*p;
+		if (c == '\n') {
+			classify_line(cl);
+			if (cl->reason != NULL)
+				return (false);
+			cl->len = 0;
+			cl->state = 0;
+			memset(cl->candidates, 0, sizeof(cl->candidates));
+			continue;
+		}
+		if (cl->len + 1 >= cl->cap) {
+			cl->cap *= 2;
+			cl->line = realloc(cl->line, cl->cap);
+			if (cl->line == NULL)
+				err(EX_OSERR, "realloc");
+		}
+		cl->line[cl->len++] = *p;
+		/* Rules are no longer checked once a phase was seen. */
+		if (cl->reason_last != NULL)
+			continue;
+		cl->state = ac[cl->state].next[c];
+		if (ac[cl->state].has_out) {
+			for (w = 0; w < NWORDS; w++)
+				cl->candidates[w] |= ac[cl->state].out[w];
+		}
+	}
+	return (true);
+}
+
+static void
+usage(void)
+{
+
+	errx(EX_USAGE, "Usage: processonelog [file]");
+}
+
+int
+main(int argc, char **argv)
+{
+	struct classifier cl = {0};
+	struct archive *a;
+	struct archive_entry *entry;
+	const char *file;
+	char buf[65536];
+	ssize_t len;
+	int ret;
+
+	if (argc > 2)
+		usage();
+	file = argc == 2 && strcmp(argv[1], "-") != 0 ? argv[1] : NULL;
+
+	compile_rules();
+	cl.cap = 4096;
+	if ((cl.line = malloc(cl.cap)) == NULL)
+		err(EX_OSERR, "malloc");
+
+	if ((a = archive_read_new()) == NULL)
+		errx(EX_OSERR, "archive_read_new");
+	archive_read_support_filter_all(a);
+	archive_read_support_format_empty(a);
+	archive_read_support_format_raw(a);
+	if (archive_read_open_filename(a, file, sizeof(buf)) != ARCHIVE_OK)
+		errx(EX_NOINPUT, "%s: %s", file != NULL ? file : "stdin",
+		    archive_error_string(a));
+	ret = archive_read_next_header(a, &entry);
+	if (ret == ARCHIVE_OK) {
+		while ((len = archive_read_data(a, buf, sizeof(buf))) > 0) {
+			if (!classify(&cl, buf, len))
+				break;
+		}
+		if (len < 0)
+			errx(EX_DATAERR, "%s: %s",
+			    file != NULL ? file : "stdin",
+			    archive_error_string(a));
+	} else if (ret != ARCHIVE_EOF) {
+		errx(EX_DATAERR, "%s: %s", file != NULL ? file : "stdin",
+		    archive_error_string(a));
+	}
+	/* The last line may not end in a newline. */
+	if (cl.reason == NULL && cl.len > 0)
+		classify_line(&cl);
+	archive_read_free(a);
+
+	if (cl.reason_last != NULL)
+		cl.reason = cl.reason_last;
+	printf("%s\n", cl.reason != NULL ? cl.reason : "???");
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,112 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef _LOGFRAME_H_
+#define _LOGFRAME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Compressed build logs are a series of gzip members, "frames", each of
+ * which is complete on its own.  gzip -dc and libarchive read them as one
+ * stream.  Each frame header has a 'PL' extra field with the frame's
+ * total compressed size and its uncompressed size so that a reader can
+ * walk the frame headers to find an offset without inflating anything.
+ *
+ *   1f 8b 08 04 <mtime 0> 00 ff  XLEN=12  'P' 'L' LEN=8  <csize> <usize>
+ *   <raw deflate data> <crc32> <usize>
+ *
+ * All sizes are little endian.
+ */
+#define	LOGFRAME_HDRLEN		24
+#define	LOGFRAME_TRLLEN		8
+/* Largest uncompressed frame written. */
+#define	LOGFRAME_SIZE		(1024 * 1024)
+
+static inline void
+logframe_le16enc(unsigned char *p, uint16_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+}
+
+static inline void
+logframe_le32enc(unsigned char *p, uint32_t v)
+{
+
+	p[0] = v & 0xff;
+	p[1] = (v >> 8) & 0xff;
+	p[2] = (v >> 16) & 0xff;
+	p[3] = (v >> 24) & 0xff;
+}
+
+static inline uint32_t
+logframe_le32dec(const unsigned char *p)
+{
+
+	return ((uint32_t)p[0] | ((uint32_t)p[1] << 8) |
+	    ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+static inline void
+logframe_header(unsigned char *h, uint32_t csize, uint32_t usize)
+{
+
+	h[0] = 0x1f;
+	h[1] = 0x8b;
+	h[2] = 8;		/* deflate */
+	h[3] = 4;		/* FEXTRA */
+	logframe_le32enc(&h[4], 0);
+	h[8] = 0;
+	h[9] = 0xff;		/* unknown OS */
+	logframe_le16enc(&h[10], 12);
+	h[12] = 'P';
+	h[13] = 'L';
+	logframe_le16enc(&h[14], 8);
+	logframe_le32enc(&h[16], csize);
+	logframe_le32enc(&h[20], usize);
+}
+
+static inline bool
+logframe_header_parse(const unsigned char *h, uint32_t *csize,
+    uint32_t *usize)
+{
+
+	if (h[0] != 0x1f || h[1] != 0x8b || h[2] != 8 || h[3] != 4 ||
+	    h[10] != 12 || h[11] != 0 || h[12] != 'P' || h[13] != 'L' ||
+	    h[14] != 8 || h[15] != 0)
+		return (false);
+	*csize = logframe_le32dec(&h[16]);
+	*usize = logframe_le32dec(&h[20]);
+	return (*csize >= LOGFRAME_HDRLEN + LOGFRAME_TRLLEN &&
+	    *usize <= LOGFRAME_SIZE);
+}
+
+#endif
@@ -28,6 +28,7 @@
 
 #include <sys/types.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <sys/wait.h>
 
 #include <assert.h>
@@ -44,6 +45,9 @@
 #include <sysexits.h>
 #include <time.h>
 #include <unistd.h>
+#include <zlib.h>
+
+#include "logframe.h"
 
 #ifndef timespecsub
 #define	timespecsub(tsp, usp, vsp)					\
@@ -69,13 +73,48 @@ enum timestamp_resolution {
 };
 static enum timestamp_resolution resolution = RESOLUTION_SECONDS;
 
+/*
+ * -z: compressed output.  Frames are closed when they are full or when
+ * input has been pending for ZFRAME_FLUSH_SECS so that a log being
+ * written can be read while the build is still running.
+ */
+#define	ZFRAME_FLUSH_SECS	1
+struct zframe {
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	pthread_t thr;
+	z_stream strm;
+	unsigned char *buf;
+	size_t bufsize;
+	uLong crc;
+	uint32_t usize;
+	struct timespec started;
+	int fd;
+	bool stop;
+};
+
+/* Read size and most writev(2) iovecs queued. */
+#define	KD_BUFSIZ	(64 * 1024)
+#define	KD_IOV_MAX	512
+
+struct elapsed_fmt {
+	struct timespec elapsed;
+	size_t len;
+	char buf[TIMESTAMP_BUFSIZ + 3];	/* '[' + timestamp + '] ' */
+};
+
 struct kdata {
 	FILE *fp_in;
-	FILE *fp_out;
+	int fd_out;
+	struct zframe *zf;
 	const char *prefix;
 	size_t prefix_len;
 	bool timestamp;
 	bool timestamp_line;
+	struct elapsed_fmt ts;
+	struct elapsed_fmt tl;
+	int iovcnt;
+	struct iovec iov[KD_IOV_MAX];
 };
 
 static size_t
@@ -122,139 +161,435 @@ calculate_duration(char *timestamp, size_t tlen, const struct timespec *elapsed)
 	return (len);
 }
 
+/* Write out the pending frame, if any.  zf->lock must be held. */
+static int
+zframe_close_frame(struct zframe *zf)
+{
+	unsigned char *p;
+	size_t len;
+	ssize_t n;
+	int zret;
+
+	if (zf->usize == 0)
+		return (0);
+	zf->strm.next_in = NULL;
+	zf->strm.avail_in = 0;
+	zret = deflate(&zf->strm, Z_FINISH);
+	if (zret != Z_STREAM_END) {
+		warnx("deflate: %s", zf->strm.msg != NULL ? zf->strm.msg :
+		    "buffer too small");
+		errno = EIO;
+		return (-1);
+	}
+	len = LOGFRAME_HDRLEN + zf->strm.total_out + LOGFRAME_TRLLEN;
+	logframe_header(zf->buf, len, zf->usize);
+	p = zf->buf + LOGFRAME_HDRLEN + zf->strm.total_out;
+	logframe_le32enc(p, zf->crc);
+	logframe_le32enc(p + 4, zf->usize);
+	/* One write so that readers never see a partial header. */
+	for (p = zf->buf; len > 0; p += n, len -= n) {
+		n = write(zf->fd, p, len);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+	}
+	if (deflateReset(&zf->strm) != Z_OK) {
+		errno = EIO;
+		return (-1);
+	}
+	zf->strm.next_out = zf->buf + LOGFRAME_HDRLEN;
+	zf->strm.avail_out = zf->bufsize - LOGFRAME_HDRLEN - LOGFRAME_TRLLEN;
+	zf->crc = crc32(0L, Z_NULL, 0);
+	zf->usize = 0;
+	return (0);
+}
+
+static int
+zframe_writev(struct zframe *zf, const struct iovec *iov, int iovcnt)
+{
+	const char *data;
+	size_t chunk, len;
+	int ret, zret;
+
+	ret = 0;
+	pthread_mutex_lock(&zf->lock);
+	for (; iovcnt > 0; iov++, iovcnt--) {
+		data = iov->iov_base;
+		len = iov->iov_len;
+		while (len > 0) {
+			if (zf->usize == 0 && clock_gettime(CLOCK_MONOTONIC_FAST,
+			    &zf->started))
+				err(EXIT_FAILURE, "%s", "clock_gettime");
+			chunk = LOGFRAME_SIZE - zf->usize;
+			if (chunk > len)
+				chunk = len;
+			zf->strm.next_in = (unsigned char *)(uintptr_t)data;
+			zf->strm.avail_in = chunk;
+			zret = deflate(&zf->strm, Z_NO_FLUSH);
+			if (zret != Z_OK || zf->strm.avail_in != 0) {
+				warnx("deflate: %s", zf->strm.msg != NULL ?
+				    zf->strm.msg : "buffer too small");
+				errno = EIO;
+				ret = -1;
+				goto out;
+			}
+			zf->crc = crc32(zf->crc, (const unsigned char *)data,
+			    chunk);
+			zf->usize += chunk;
+			data += chunk;
+			len -= chunk;
+			if (zf->usize == LOGFRAME_SIZE &&
+			    zframe_close_frame(zf) != 0) {
+				ret = -1;
+				goto out;
+			}
+		}
+	}
+out:
+	pthread_mutex_unlock(&zf->lock);
+	return (ret);
+}
+
+/* Close out frames which have had input pending for too long. */
+static void *
+zframe_main(void *arg)
+{
+	struct zframe *zf = arg;
+	struct timespec deadline, now;
+
+	pthread_mutex_lock(&zf->lock);
+	while (!zf->stop) {
+		if (clock_gettime(CLOCK_REALTIME, &deadline))
+			err(EXIT_FAILURE, "%s", "clock_gettime");
+		deadline.tv_sec += ZFRAME_FLUSH_SECS;
+		pthread_cond_timedwait(&zf->cond, &zf->lock, &deadline);
+		if (zf->stop || zf->usize == 0)
+			continue;
+		if (clock_gettime(CLOCK_MONOTONIC_FAST, &now))
+			err(EXIT_FAILURE, "%s", "clock_gettime");
+		if (now.tv_sec - zf->started.tv_sec >= ZFRAME_FLUSH_SECS &&
+		    zframe_close_frame(zf) != 0)
+			warn("%s", "write");
+	}
+	pthread_mutex_unlock(&zf->lock);
+	return (NULL);
+}
+
+/* Write out the last frame and free zf. */
+static int
+zframe_close(struct zframe *zf)
+{
+	int ret;
+
+	pthread_mutex_lock(&zf->lock);
+	zf->stop = true;
+	pthread_cond_signal(&zf->cond);
+	pthread_mutex_unlock(&zf->lock);
+	pthread_join(zf->thr, NULL);
+	ret = zframe_close_frame(zf);
+	deflateEnd(&zf->strm);
+	free(zf->buf);
+	pthread_cond_destroy(&zf->cond);
+	pthread_mutex_destroy(&zf->lock);
+	free(zf);
+	return (ret);
+}
+
+/* Setup writing compressed frames to fd. */
+static struct zframe *
+zframe_open(int fd)
+{
+	struct zframe *zf;
+
+	zf = calloc(1, sizeof(*zf));
+	if (zf == NULL)
+		err(EXIT_FAILURE, "calloc");
+	zf->fd = fd;
+	/* Raw deflate; the gzip header and trailer are written here. */
+	if (deflateInit2(&zf->strm, Z_DEFAULT_COMPRESSION, Z_DEFLATED,
+	    -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		errx(EXIT_FAILURE, "deflateInit2: %s", zf->strm.msg);
+	zf->bufsize = LOGFRAME_HDRLEN +
+	    deflateBound(&zf->strm, LOGFRAME_SIZE) + LOGFRAME_TRLLEN;
+	zf->buf = malloc(zf->bufsize);
+	if (zf->buf == NULL)
+		err(EXIT_FAILURE, "malloc");
+	zf->strm.next_out = zf->buf + LOGFRAME_HDRLEN;
+	zf->strm.avail_out = zf->bufsize - LOGFRAME_HDRLEN - LOGFRAME_TRLLEN;
+	zf->crc = crc32(0L, Z_NULL, 0);
+	pthread_mutex_init(&zf->lock, NULL);
+	pthread_cond_init(&zf->cond, NULL);
+	if (pthread_create(&zf->thr, NULL, zframe_main, zf))
+		err(EXIT_FAILURE, "pthread_create zframe");
+	pthread_set_name_np(zf->thr, "zframe");
+	return (zf);
+}
+
+/* Write out everything queued by kd_out(). */
+static int
+kd_flush(struct kdata *kd)
+{
+	struct iovec *iov;
+	ssize_t n;
+	int iovcnt;
+
+	iov = kd->iov;
+	iovcnt = kd->iovcnt;
+	kd->iovcnt = 0;
+	if (kd->zf != NULL)
+		return (zframe_writev(kd->zf, iov, iovcnt));
+	while (iovcnt > 0) {
+		n = writev(kd->fd_out, iov, iovcnt);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (-1);
+		}
+		for (; iovcnt > 0 && (size_t)n >= iov->iov_len; iov++, iovcnt--)
+			n -= iov->iov_len;
+		if (iovcnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + n;
+			iov->iov_len -= n;
+		}
+	}
+	return (0);
+}
+
+/*
+ * Queue data for output.  It must stay valid until the next kd_flush()
+ * which is done at least once per read.
+ */
 static inline int
-print_prefix(const struct kdata *kd, const char *prefix, const size_t prefix_len,
-    const struct timespec lastline, struct timespec *now)
+kd_out(struct kdata *kd, const void *data, size_t len)
 {
-	struct timespec elapsed;
-	char timestamp[TIMESTAMP_BUFSIZ]; /* '[HH:MM:SS] ' + 1 */
-	const size_t tlen = sizeof(timestamp);
+
+	if (len == 0)
+		return (0);
+	if (kd->iovcnt == KD_IOV_MAX && kd_flush(kd) != 0)
+		return (-1);
+	kd->iov[kd->iovcnt].iov_base = (void *)(uintptr_t)data;
+	kd->iov[kd->iovcnt].iov_len = len;
+	kd->iovcnt++;
+	return (0);
+}
+
+/*
+ * Format "[elapsed] " into ef, reusing the last one if it is the same at
+ * the displayed resolution.
+ */
+static int
+format_elapsed(struct kdata *kd, struct elapsed_fmt *ef, const char *type,
+    struct timespec elapsed)
+{
+	char timestamp[TIMESTAMP_BUFSIZ];
 	size_t dlen;
 
-	if (kd->timestamp || kd->timestamp_line)
-		if (clock_gettime(CLOCK_MONOTONIC_FAST, now))
-			err(EXIT_FAILURE, "%s", "clock_gettime");
+	switch (resolution) {
+	case RESOLUTION_SECONDS:
+		elapsed.tv_nsec = 0;
+		break;
+	case RESOLUTION_MILLISECONDS:
+		elapsed.tv_nsec -= elapsed.tv_nsec % 1000000;
+		break;
+	case RESOLUTION_MICROSECONDS:
+		elapsed.tv_nsec -= elapsed.tv_nsec % 1000;
+		break;
+	case RESOLUTION_NANOSECONDS:
+		break;
+	}
+	if (ef->len != 0 && ef->elapsed.tv_sec == elapsed.tv_sec &&
+	    ef->elapsed.tv_nsec == elapsed.tv_nsec)
+		return (0);
+	/* The old one may still be queued. */
+	if (kd_flush(kd) != 0)
+		return (-1);
+	dlen = calculate_duration(timestamp, sizeof(timestamp), &elapsed);
+	ef->buf[0] = type[0];
+	memcpy(&ef->buf[1], timestamp, dlen);
+	ef->buf[dlen + 1] = type[1];
+	ef->buf[dlen + 2] = ' ';
+	ef->len = dlen + 3;
+	ef->elapsed = elapsed;
+	return (0);
+}
+
+static inline int
+print_prefix(struct kdata *kd, const char *prefix, const size_t prefix_len,
+    const struct timespec *lastline, const struct timespec *now)
+{
+	struct timespec elapsed;
+
 	if (kd->timestamp) {
 		timespecsub(now, &start, &elapsed);
-		dlen = calculate_duration(timestamp,
-		    tlen, &elapsed);
-		if (putc(typefmt[0][0], kd->fp_out) == EOF)
-			return (-1);
-		if (fwrite(timestamp, sizeof(*timestamp), dlen,
-		    kd->fp_out) < dlen)
-			return (-1);
-		if (putc(typefmt[0][1], kd->fp_out) == EOF)
-			return (-1);
-		if (putc(' ', kd->fp_out) == EOF)
+		if (format_elapsed(kd, &kd->ts, typefmt[0], elapsed) != 0 ||
+		    kd_out(kd, kd->ts.buf, kd->ts.len) != 0)
 			return (-1);
 	}
 	if (kd->timestamp_line) {
-		timespecsub(now, &lastline, &elapsed);
-		if (putc(typefmt[1][0], kd->fp_out) == EOF)
-			return (-1);
-		dlen = calculate_duration(timestamp,
-		    tlen, &elapsed);
-		if (fwrite(timestamp, sizeof(*timestamp), dlen,
-		    kd->fp_out) < dlen)
-			return (-1);
-		if (putc(typefmt[1][1], kd->fp_out) == EOF)
-			return (-1);
-		if (putc(' ', kd->fp_out) == EOF)
+		timespecsub(now, lastline, &elapsed);
+		if (format_elapsed(kd, &kd->tl, typefmt[1], elapsed) != 0 ||
+		    kd_out(kd, kd->tl.buf, kd->tl.len) != 0)
 			return (-1);
 	}
 	if (prefix != NULL) {
-		if (fwrite(prefix, sizeof(prefix[0]),
-		    prefix_len, kd->fp_out) <
-		    prefix_len)
-			return (-1);
-		if (putc(' ', kd->fp_out) == EOF)
+		if (kd_out(kd, prefix, prefix_len) != 0 ||
+		    kd_out(kd, " ", 1) != 0)
 			return (-1);
 	}
 	return (0);
 }
 
+/*
+ * Read input a block at a time and queue each line, with its prefix,
+ * straight out of the read buffer.  Everything read is written out before
+ * the next read so output is never held back waiting for more input.
+ * All lines in a block share the time it was read.
+ */
 static int
 prefix_output(struct kdata *kd, const int dynamic_prefix_support)
 {
 	static const char prefix_change[] = "\001PX:";
+	const size_t prefix_change_len = sizeof(prefix_change) - 1;
 	char prefix_override[128] = {0};
 	const char *prefix;
-	int ch, ret;
+	char *buf, *p, *end, *lim, *cr, *ctl;
 	unsigned int changing_prefix;
-	struct timespec lastline = {0}, now = {0};
-	size_t prefix_len;
-	bool newline;
-
+	struct timespec lastline = {0}, linestart = {0}, now = {0};
+	size_t prefix_len, override_len, len;
+	ssize_t n;
+	int fd, ret;
+	bool newline, reading_prefix, literal;
+
+	if ((buf = malloc(KD_BUFSIZ)) == NULL)
+		err(EXIT_FAILURE, "%s", "malloc");
+	fd = fileno(kd->fp_in);
 	prefix = kd->prefix;
 	prefix_len = kd->prefix_len;
 	newline = true;
+	reading_prefix = literal = false;
 	changing_prefix = 0;
+	override_len = 0;
+	ret = 0;
 	if (kd->timestamp_line)
 		if (clock_gettime(CLOCK_MONOTONIC_FAST, &lastline))
 			err(EXIT_FAILURE, "%s", "clock_gettime");
-	while ((ch = getc(kd->fp_in)) != EOF) {
-		if (dynamic_prefix_support) {
-			if (ch == prefix_change[changing_prefix]) {
-				changing_prefix++;
-				if (changing_prefix == strlen(prefix_change)) {
-					char *p = prefix_override;
-
-					changing_prefix = 0;
-					/* Read in a new prefix */
-					while (p != prefix_override +
-					    sizeof(prefix_override) - 1) {
-						if ((ch = getc(kd->fp_in)) == EOF)
-							goto error;
-						if (ch == '\n')
-							break;
-						*p++ = ch;
-					}
-					*p = '\0';
-					if (prefix_override[0] != '\0') {
-						prefix = prefix_override;
-						prefix_len = p - prefix_override;
-					} else {
-						prefix = kd->prefix;
-						prefix_len = kd->prefix_len;
-					}
-				}
+	for (;;) {
+		n = read(fd, buf, KD_BUFSIZ);
+		if (n == -1) {
+			if (errno == EINTR)
 				continue;
-			} else if (changing_prefix > 0) {
-				if (newline &&
-				    (ret = print_prefix(kd, prefix, prefix_len,
-				    lastline, &now)) != 0) {
-					return (ret);
+			goto error;
+		}
+		if (n == 0)
+			break;
+		if (kd->timestamp || kd->timestamp_line)
+			if (clock_gettime(CLOCK_MONOTONIC_FAST, &now))
+				err(EXIT_FAILURE, "%s", "clock_gettime");
+		for (p = buf, end = buf + n; p < end;) {
+			if (reading_prefix) {
+				/* Read in a new prefix */
+				len = sizeof(prefix_override) - 1 -
+				    override_len;
+				if (len > (size_t)(end - p))
+					len = end - p;
+				lim = memchr(p, '\n', len);
+				if (lim != NULL)
+					len = lim - p;
+				memcpy(prefix_override + override_len, p, len);
+				override_len += len;
+				p += len;
+				if (lim != NULL)
+					p++;
+				else if (override_len <
+				    sizeof(prefix_override) - 1)
+					continue;
+				reading_prefix = false;
+				prefix_override[override_len] = '\0';
+				if (override_len > 0) {
+					prefix = prefix_override;
+					prefix_len = override_len;
+				} else {
+					prefix = kd->prefix;
+					prefix_len = kd->prefix_len;
 				}
-				for (size_t i = 0; i < changing_prefix; ++i) {
-					assert(i <= strlen(prefix_change));
-					if (putc(prefix_change[i],
-					    kd->fp_out) == EOF) {
-						return (-1);
+				continue;
+			}
+			if (changing_prefix > 0) {
+				if (*p == prefix_change[changing_prefix]) {
+					p++;
+					if (++changing_prefix ==
+					    prefix_change_len) {
+						changing_prefix = 0;
+						/* Still queued. */
+						if (kd_flush(kd) != 0)
+							goto error;
+						reading_prefix = true;
+						override_len = 0;
 					}
+					continue;
 				}
+				if (newline) {
+					linestart = now;
+					if (print_prefix(kd, prefix, prefix_len,
+					    &lastline, &now) != 0)
+						goto error;
+				}
+				if (kd_out(kd, prefix_change,
+				    changing_prefix) != 0)
+					goto error;
 				newline = false;
 				changing_prefix = 0;
+				/* Not checked for starting a prefix change. */
+				literal = true;
+			}
+			/* Up to the end of the line or a prefix change. */
+			ctl = NULL;
+			if (literal) {
+				literal = false;
+				lim = p + 1;
+			} else {
+				lim = memchr(p, '\n', end - p);
+				lim = lim != NULL ? lim + 1 : end;
+				if ((cr = memchr(p, '\r', lim - p)) != NULL)
+					lim = cr + 1;
+				if (dynamic_prefix_support &&
+				    (ctl = memchr(p, prefix_change[0],
+				    lim - p)) != NULL)
+					lim = ctl;
+			}
+			if (lim > p) {
+				if (newline) {
+					newline = false;
+					linestart = now;
+					if (print_prefix(kd, prefix, prefix_len,
+					    &lastline, &now) != 0)
+						goto error;
+				}
+				if (kd_out(kd, p, lim - p) != 0)
+					goto error;
+				if (lim[-1] == '\n' || lim[-1] == '\r') {
+					newline = true;
+					if (kd->timestamp_line)
+						lastline = linestart;
+				}
+				p = lim;
+			}
+			if (ctl != NULL) {
+				changing_prefix = 1;
+				p++;
 			}
 		}
-		if (newline) {
-			newline = false;
-			if ((ret = print_prefix(kd, prefix, prefix_len,
-			    lastline, &now)) != 0)
-				return (ret);
-		}
-		if (ch == '\n' || ch == '\r') {
-			newline = true;
-			if (kd->timestamp_line)
-				lastline = now;
-			changing_prefix = 0;
-		}
-		if (putc(ch, kd->fp_out) == EOF)
-			return (-1);
+		if (kd_flush(kd) != 0)
+			goto error;
 	}
+	goto out;
 error:
-	if (ferror(kd->fp_out) || ferror(kd->fp_in) || feof(kd->fp_in))
-		return (-1);
-	return (0);
+	ret = -1;
+out:
+	free(buf);
+	return (ret);
 }
 
 static void*
@@ -297,7 +632,7 @@ usage(void)
 {
 
 	fprintf(stderr, "%s\n",
-	    "usage: timestamp [-1 <stdout prefix>] [-2 <stderr prefix>] [-eo in.fifo] [-P <proctitle>] [-d duration] [-DutT] [-s {s,ms,us,ns}] [command]");
+	    "usage: timestamp [-1 <stdout prefix>] [-2 <stderr prefix>] [-eo in.fifo] [-P <proctitle>] [-d duration] [-DutTz] [-s {s,ms,us,ns}] [command]");
 	exit(EX_USAGE);
 }
 
@@ -326,13 +661,15 @@ main(int argc, char **argv)
 	FILE *fp_in_stdout, *fp_in_stderr;
 	pthread_t *thr_stdout, *thr_stderr;
 	struct kdata kdata_stdout = {0}, kdata_stderr = {0};
+	struct zframe *zf;
 	const char *prefix_stdout, *prefix_stderr, *time_start;
 	char *dflag;
 	int child_stdout[2], child_stderr[2];
-	int ch, status, ret, uflag, tflag, Tflag;
+	int ch, status, ret, uflag, tflag, Tflag, zflag;
 
 	ret = 0;
-	tflag = Tflag = uflag = 0;
+	tflag = Tflag = uflag = zflag = 0;
+	zf = NULL;
 	dflag = NULL;
 	thr_stdout = thr_stderr = NULL;
 	prefix_stdout = prefix_stderr = NULL;
@@ -344,7 +681,7 @@ main(int argc, char **argv)
 	resolution = RESOLUTION_SECONDS;
 #endif
 
-	while ((ch = getopt(argc, argv, "1:2:d:De:no:P:s:tTu")) != -1) {
+	while ((ch = getopt(argc, argv, "1:2:d:De:no:P:s:tTuz")) != -1) {
 		switch (ch) {
 		case '1':
 			prefix_stdout = strdup(optarg);
@@ -396,6 +733,9 @@ main(int argc, char **argv)
 		case 'u':
 			uflag = 1;
 			break;
+		case 'z':
+			zflag = 1;
+			break;
 		default:
 			usage();
 		}
@@ -478,7 +818,9 @@ main(int argc, char **argv)
 
 	if (fp_in_stdout != NULL) {
 		kdata_stdout.fp_in = fp_in_stdout;
-		kdata_stdout.fp_out = stdout;
+		kdata_stdout.fd_out = STDOUT_FILENO;
+		if (zflag)
+			kdata_stdout.zf = zf = zframe_open(STDOUT_FILENO);
 		kdata_stdout.prefix = prefix_stdout;
 		kdata_stdout.timestamp = !Tflag;
 		kdata_stdout.timestamp_line = tflag;
@@ -486,7 +828,7 @@ main(int argc, char **argv)
 
 	if (fp_in_stderr != NULL) {
 		kdata_stderr.fp_in = fp_in_stderr;
-		kdata_stderr.fp_out = stderr;
+		kdata_stderr.fd_out = STDERR_FILENO;
 		kdata_stderr.prefix = prefix_stderr;
 		kdata_stderr.timestamp = !Tflag;
 		kdata_stderr.timestamp_line = tflag;
@@ -536,6 +878,11 @@ main(int argc, char **argv)
 		pthread_join(*thr_stdout, NULL);
 	if (thr_stderr != NULL)
 		pthread_join(*thr_stderr, NULL);
+	if (zf != NULL && zframe_close(zf) != 0) {
+		warn("%s", "write");
+		if (ret == 0)
+			ret = EXIT_FAILURE;
+	}
 
 	return (ret);
 }
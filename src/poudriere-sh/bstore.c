@@ -0,0 +1,620 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The build attributes that bset() sets, such as the build and builder
+ * status, stats_* and snap_*, in a single mmap(2)ed file in the log
+ * directory.  This is the backend for bset() and _bget() when
+ * BSET_BACKEND=mmap.
+ *
+ * The file is a header and a fixed array of fixed size records.  A
+ * record is claimed for a name the first time it is set, by open
+ * addressing on the hash of the name, and is then only ever updated in
+ * place.  Each record has a sequence lock: a writer makes the sequence
+ * odd, copies the value in and makes it even again.  A reader copies the
+ * value out and retries if the sequence was odd or changed meanwhile, so
+ * readers, including html_json, normally take no locks.  A value too long
+ * for a record is marked as being in its legacy .poudriere.* file instead.
+ *
+ * Writers, and claimers, of a record hold an fcntl(2) lock on its first
+ * byte while they update it.  The kernel drops the lock if the process
+ * dies, so a record found odd, or being claimed, by the next one to get
+ * the lock was abandoned and is taken over.  A reader that keeps finding
+ * a record odd reads it under a read lock, and uses the file if it was
+ * left odd.
+ *
+ * bstore_export writes the records out to the legacy files for anything
+ * that still reads those.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "bstore.h"
+#include "helpers.h"
+#include "var.h"
+
+int
+mkostempsat_mode(int dfd, char *path, int slen, int oflags, mode_t mode);
+
+#define BSTORE_MAGIC		0x74736270	/* "pbst" */
+#define BSTORE_VERSION		1
+#define BSTORE_NRECORDS		1024
+#define BSTORE_PREFIX		".poudriere."
+/* The value is in the legacy file. */
+#define BSTORE_LEN_FILE		UINT32_MAX
+/*
+ * How long to wait for a record being written or claimed.  A writer only
+ * holds it while copying a value in, so this only runs out if it was
+ * killed in the middle.  Readers only spin before waiting on the
+ * record's lock instead.
+ */
+#define BSTORE_SPINS		1000
+#define BSTORE_SLEEPS		1000
+
+enum bstore_state {
+	REC_FREE,
+	REC_CLAIMING,
+	REC_NAMED,
+};
+
+struct bstore_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nrecords;
+	uint32_t recsize;
+};
+
+struct bstore_record {
+	_Atomic uint32_t state;
+	/* Odd while the value is being written. */
+	_Atomic uint32_t seq;
+	uint32_t len;
+	uint32_t unused;
+	char name[BSTORE_NAMESIZ];
+	char value[BSTORE_VALUESIZ];
+};
+
+struct bstore_db {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	int fd;
+	size_t size;
+	struct bstore_header *hdr;
+	struct bstore_record *records;
+};
+
+static struct bstore_db db = { .fd = -1 };
+
+static uint64_t
+bstore_hash(const char *name, size_t namelen)
+{
+	uint64_t hash;
+
+	/* FNV-1a */
+	hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < namelen; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+/* Back off while another process holds a record. */
+static bool
+bstore_backoff(unsigned int *tries)
+{
+	const struct timespec ts = { .tv_sec = 0, .tv_nsec = 1000000 };
+
+	if (*tries >= BSTORE_SPINS + BSTORE_SLEEPS)
+		return (false);
+	if ((*tries)++ < BSTORE_SPINS)
+		sched_yield();
+	else
+		(void)nanosleep(&ts, NULL);
+	return (true);
+}
+
+/* Take or drop the lock on rec, waiting for it if needed. */
+static int
+bstore_lock(const struct bstore_record *rec, short type)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = (const char *)rec - (const char *)db.hdr;
+	fl.l_len = 1;
+	while (fcntl(db.fd, type == F_UNLCK ? F_SETLK : F_SETLKW, &fl) ==
+	    -1) {
+		if (errno != EINTR)
+			return (-1);
+	}
+	return (0);
+}
+
+static void
+bstore_close(void)
+{
+	assert(is_int_on());
+	if (db.hdr != NULL)
+		munmap(db.hdr, db.size);
+	if (db.fd != -1)
+		close(db.fd);
+	free(db.path);
+	db.path = NULL;
+	db.hdr = NULL;
+	db.records = NULL;
+	db.fd = -1;
+}
+
+static size_t
+bstore_size(void)
+{
+	return (sizeof(struct bstore_header) +
+	    sizeof(struct bstore_record) * BSTORE_NRECORDS);
+}
+
+/*
+ * Map the store at path, reusing the existing mapping if it is the same
+ * file.  Returns 1 if the file does not exist and create is false.
+ */
+int
+bstore_open(const char *path, bool create)
+{
+	struct bstore_header hdr;
+	struct stat st;
+	void *addr;
+	int fd, serrno;
+
+	assert(is_int_on());
+	if (stat(path, &st) == -1) {
+		if (errno != ENOENT)
+			return (-1);
+		if (!create) {
+			bstore_close();
+			return (1);
+		}
+	} else if (db.hdr != NULL && st.st_dev == db.dev &&
+	    st.st_ino == db.ino) {
+		return (0);
+	}
+	bstore_close();
+	fd = open(path, (create ? O_CREAT : 0) | O_RDWR | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		if (errno == ENOENT && !create)
+			return (1);
+		return (-1);
+	}
+	if (flock(fd, LOCK_EX) == -1)
+		goto error;
+	if (fstat(fd, &st) == -1)
+		goto error;
+	if (st.st_size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = BSTORE_MAGIC;
+		hdr.version = BSTORE_VERSION;
+		hdr.nrecords = BSTORE_NRECORDS;
+		hdr.recsize = sizeof(struct bstore_record);
+		if (ftruncate(fd, bstore_size()) == -1)
+			goto error;
+		if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			goto error;
+	} else if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto error;
+	(void)flock(fd, LOCK_UN);
+	if (hdr.magic != BSTORE_MAGIC || hdr.version != BSTORE_VERSION ||
+	    hdr.nrecords != BSTORE_NRECORDS ||
+	    hdr.recsize != sizeof(struct bstore_record)) {
+		close(fd);
+		errno = EFTYPE;
+		return (-1);
+	}
+	addr = mmap(NULL, bstore_size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+	if ((db.path = strdup(path)) == NULL) {
+		munmap(addr, bstore_size());
+		goto error;
+	}
+	db.fd = fd;
+	db.dev = st.st_dev;
+	db.ino = st.st_ino;
+	db.size = bstore_size();
+	db.hdr = addr;
+	db.records = (struct bstore_record *)(db.hdr + 1);
+	return (0);
+error:
+	serrno = errno;
+	close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+size_t
+bstore_nrecords(void)
+{
+	return (db.hdr == NULL ? 0 : db.hdr->nrecords);
+}
+
+/*
+ * Find the record for name.  With create claim a free one for it.
+ */
+static struct bstore_record *
+bstore_find(const char *name, bool create)
+{
+	struct bstore_record *rec;
+	size_t namelen;
+	uint64_t hash;
+	uint32_t state;
+	unsigned int tries;
+
+	namelen = strlen(name);
+	if (namelen >= BSTORE_NAMESIZ) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+	hash = bstore_hash(name, namelen);
+	for (uint32_t i = 0; i < db.hdr->nrecords; i++) {
+		rec = &db.records[(hash + i) % db.hdr->nrecords];
+		state = atomic_load_explicit(&rec->state,
+		    memory_order_acquire);
+		tries = 0;
+		while (state == REC_CLAIMING && bstore_backoff(&tries))
+			state = atomic_load_explicit(&rec->state,
+			    memory_order_acquire);
+		if (state == REC_NAMED) {
+			if (strcmp(rec->name, name) == 0)
+				return (rec);
+			continue;
+		}
+		if (!create) {
+			if (state == REC_FREE) {
+				errno = ENOENT;
+				return (NULL);
+			}
+			continue;
+		}
+		/* Free, or a claim left by a dead process. */
+		if (bstore_lock(rec, F_WRLCK) == -1)
+			return (NULL);
+		if (atomic_load_explicit(&rec->state, memory_order_acquire) !=
+		    REC_NAMED) {
+			atomic_store_explicit(&rec->state, REC_CLAIMING,
+			    memory_order_relaxed);
+			memcpy(rec->name, name, namelen + 1);
+			atomic_store_explicit(&rec->state, REC_NAMED,
+			    memory_order_release);
+		}
+		(void)bstore_lock(rec, F_UNLCK);
+		if (strcmp(rec->name, name) == 0)
+			return (rec);
+	}
+	errno = ENOSPC;
+	return (NULL);
+}
+
+bool
+bstore_lookup(const char *name, size_t *idxp)
+{
+	struct bstore_record *rec;
+
+	if (db.hdr == NULL || (rec = bstore_find(name, false)) == NULL)
+		return (false);
+	*idxp = rec - db.records;
+	return (true);
+}
+
+/* Copy the value out of rec, returning its length. */
+static uint32_t
+bstore_copy(const struct bstore_record *rec, struct bstore_value *v)
+{
+	uint32_t len;
+
+	len = rec->len;
+	if (len != BSTORE_LEN_FILE && len > BSTORE_VALUESIZ)
+		len = BSTORE_VALUESIZ;
+	if (len != BSTORE_LEN_FILE)
+		memcpy(v->data, rec->value, len);
+	return (len);
+}
+
+/*
+ * Copy out record idx.  Returns false if it has no value.  A value left
+ * torn by a dead writer is returned as being in the file.
+ */
+bool
+bstore_read(size_t idx, struct bstore_value *v)
+{
+	struct bstore_record *rec;
+	uint32_t seq, len;
+	unsigned int tries;
+
+	if (db.hdr == NULL || idx >= db.hdr->nrecords)
+		return (false);
+	rec = &db.records[idx];
+	if (atomic_load_explicit(&rec->state, memory_order_acquire) !=
+	    REC_NAMED)
+		return (false);
+	tries = 0;
+	for (;;) {
+		seq = atomic_load_explicit(&rec->seq, memory_order_acquire);
+		if ((seq & 1) == 0) {
+			len = bstore_copy(rec, v);
+			atomic_thread_fence(memory_order_acquire);
+			if (atomic_load_explicit(&rec->seq,
+			    memory_order_relaxed) == seq)
+				break;
+		}
+		if (tries >= BSTORE_SPINS) {
+			/*
+			 * Wait on the writer's lock instead, which is
+			 * dropped if it died.  No writer can change the
+			 * record while it is held.
+			 */
+			if (bstore_lock(rec, F_RDLCK) == -1)
+				return (false);
+			seq = atomic_load_explicit(&rec->seq,
+			    memory_order_acquire);
+			/* Left torn by a dead writer; use the file. */
+			if ((seq & 1) != 0)
+				len = BSTORE_LEN_FILE;
+			else
+				len = bstore_copy(rec, v);
+			(void)bstore_lock(rec, F_UNLCK);
+			break;
+		}
+		(void)bstore_backoff(&tries);
+	}
+	/* Never set. */
+	if (seq == 0)
+		return (false);
+	strlcpy(v->name, rec->name, sizeof(v->name));
+	v->seq = seq;
+	v->file = len == BSTORE_LEN_FILE;
+	v->len = v->file ? 0 : len;
+	return (true);
+}
+
+/* Set the value, or mark it as being in the file if it is too long. */
+static int
+bstore_write(struct bstore_record *rec, const char *value, size_t len)
+{
+	uint32_t seq;
+
+	if (bstore_lock(rec, F_WRLCK) == -1)
+		return (-1);
+	/* Only still odd if the last writer died while writing. */
+	seq = atomic_load_explicit(&rec->seq, memory_order_relaxed) | 1;
+	atomic_store_explicit(&rec->seq, seq, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	if (len > BSTORE_VALUESIZ)
+		rec->len = BSTORE_LEN_FILE;
+	else {
+		memcpy(rec->value, value, len);
+		rec->len = len;
+	}
+	atomic_store_explicit(&rec->seq, seq + 1, memory_order_release);
+	(void)bstore_lock(rec, F_UNLCK);
+	return (0);
+}
+
+static void
+bstore_open_or_err(const char *cmd, const char *path, bool create, int *ret)
+{
+	int error;
+
+	assert(is_int_on());
+	error = bstore_open(path, create);
+	if (error == -1) {
+		INTON;
+		err(EXIT_FAILURE, "%s: %s", cmd, path);
+	}
+	*ret = error;
+}
+
+/*
+ * bstore_set store name value
+ * Returns 1 if the value is too long, or there is no room, and it needs
+ * to be written to the legacy file instead.
+ */
+int
+bstore_setcmd(int argc, char **argv)
+{
+	struct bstore_record *rec;
+	size_t len;
+	int ret;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: bstore_set store name value");
+	INTOFF;
+	bstore_open_or_err("bstore_set", argv[1], true, &ret);
+	if ((rec = bstore_find(argv[2], true)) == NULL) {
+		if (errno != ENOSPC && errno != ENAMETOOLONG) {
+			INTON;
+			err(EXIT_FAILURE, "bstore_set: %s", argv[2]);
+		}
+		INTON;
+		return (1);
+	}
+	len = strlen(argv[3]);
+	if (bstore_write(rec, argv[3], len) == -1) {
+		INTON;
+		err(EXIT_FAILURE, "bstore_set: %s", argv[2]);
+	}
+	INTON;
+	return (len > BSTORE_VALUESIZ ? 1 : 0);
+}
+
+/*
+ * bstore_get store name var_return|-
+ * Returns 1 if the store has no value for name, or it is in the legacy
+ * file.
+ */
+int
+bstore_getcmd(int argc, char **argv)
+{
+	struct bstore_value v;
+	size_t idx;
+	char *value;
+	int ret;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: bstore_get store name "
+		    "var_return|-");
+	INTOFF;
+	bstore_open_or_err("bstore_get", argv[1], false, &ret);
+	if (ret == 1 || !bstore_lookup(argv[2], &idx) ||
+	    !bstore_read(idx, &v) || v.file) {
+		INTON;
+		return (1);
+	}
+	if (strcmp(argv[3], "-") == 0) {
+		outbin(v.data, v.len, out1);
+		out1c('\n');
+		INTON;
+		return (0);
+	}
+	if ((value = strndup(v.data, v.len)) == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "strndup");
+	}
+	ret = setvarsafe(argv[3], value, 0) ? 1 : 0;
+	free(value);
+	INTON;
+	return (ret);
+}
+
+/* Write data to dir/path unless it already has it. */
+static int
+export_file(int dirfd, const char *dir, const char *path, const char *data,
+    size_t len)
+{
+	char tmpfile[PATH_MAX], rbuf[BSTORE_VALUESIZ + 2];
+	struct stat st;
+	ssize_t n;
+	int fd;
+
+	if ((fd = openat(dirfd, path, O_RDONLY | O_CLOEXEC)) != -1) {
+		n = -1;
+		if (fstat(fd, &st) == 0 && st.st_size == (off_t)len)
+			n = pread(fd, rbuf, len, 0);
+		close(fd);
+		if (n == (ssize_t)len && memcmp(rbuf, data, len) == 0)
+			return (0);
+	}
+	snprintf(tmpfile, sizeof(tmpfile), ".write_atomic-%s.XXXXXXXXXX",
+	    path);
+	if ((fd = mkostempsat_mode(dirfd, tmpfile, 0, O_CLOEXEC,
+	    0644)) == -1) {
+		warn("mkstemp %s/%s", dir, tmpfile);
+		return (-1);
+	}
+	for (; len > 0; data += n, len -= n) {
+		if ((n = write(fd, data, len)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			warn("write %s/%s", dir, tmpfile);
+			close(fd);
+			(void)unlinkat(dirfd, tmpfile, 0);
+			return (-1);
+		}
+	}
+	close(fd);
+	if (renameat(dirfd, tmpfile, dirfd, path) == -1) {
+		warn("rename %s/%s -> %s", dir, tmpfile, path);
+		(void)unlinkat(dirfd, tmpfile, 0);
+		return (-1);
+	}
+	return (0);
+}
+
+/*
+ * bstore_export store dir
+ * Write each value to its dir/.poudriere.<name> file, like bset did,
+ * unless it already has it.
+ */
+int
+bstore_exportcmd(int argc, char **argv)
+{
+	struct bstore_value v;
+	char path[sizeof(BSTORE_PREFIX) + BSTORE_NAMESIZ];
+	int dirfd, ret;
+
+	if (argc != 3)
+		errx(EX_USAGE, "%s", "Usage: bstore_export store dir");
+	INTOFF;
+	bstore_open_or_err("bstore_export", argv[1], false, &ret);
+	if (ret == 1) {
+		INTON;
+		return (0);
+	}
+	if ((dirfd = open(argv[2], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) ==
+	    -1) {
+		INTON;
+		err(EX_NOINPUT, "%s", argv[2]);
+	}
+	ret = 0;
+	for (size_t i = 0; i < bstore_nrecords(); i++) {
+		if (!bstore_read(i, &v) || v.file)
+			continue;
+		snprintf(path, sizeof(path), "%s%s", BSTORE_PREFIX, v.name);
+		v.data[v.len++] = '\n';
+		if (export_file(dirfd, argv[2], path, v.data, v.len) == -1)
+			ret = 1;
+	}
+	close(dirfd);
+	INTON;
+	return (ret);
+}
@@ -0,0 +1,590 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Native versions of the hash.sh hash_* functions.  The shell versions
+ * store each var/key as a mangled shell variable and have to parse the
+ * output of set to find the keys of a var.  These keep a table of named
+ * tables instead, each an open addressing hash table of key to value.
+ *
+ * Names are mangled the same as _hash_var_name() so that keys which
+ * collide in the shell version still collide here and hash_vars() output
+ * is the same.  Being process memory the tables are copied into subshells
+ * the same as variables are; for that reason the builtins which modify a
+ * table must not be run without forking in a command substitution.
+ */
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fnmatch.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "helpers.h"
+#include "syntax.h"
+#include "var.h"
+
+/* external/sh/options.h */
+#define Cflag optval[11]
+
+#define HT_MIN_SIZE	16
+/* Entries whose key was removed. */
+#define HT_TOMBSTONE	((char *)&ht_tombstone)
+
+static const char ht_tombstone;
+
+struct ht_entry {
+	char *key;
+	void *value;
+	uint32_t hash;
+};
+
+struct ht {
+	struct ht_entry *entries;
+	size_t size;	/* Power of 2 */
+	size_t count;
+	size_t used;	/* count + tombstones */
+};
+
+/* var -> struct ht * of key -> char * */
+static struct ht tables;
+
+static uint32_t
+ht_hash(const char *key)
+{
+	uint32_t hash;
+
+	/* FNV-1a */
+	hash = 2166136261U;
+	for (const unsigned char *p = (const unsigned char *)key; *p != '\0';
+	    p++) {
+		hash ^= *p;
+		hash *= 16777619U;
+	}
+	return (hash);
+}
+
+/* Return the slot for key, or the empty slot to insert it into. */
+static struct ht_entry *
+ht_slot(const struct ht *ht, const char *key, uint32_t hash)
+{
+	struct ht_entry *e, *tombstone;
+	size_t mask, i;
+
+	assert(ht->size > 0);
+	tombstone = NULL;
+	mask = ht->size - 1;
+	for (i = hash & mask;; i = (i + 1) & mask) {
+		e = &ht->entries[i];
+		if (e->key == NULL)
+			return (tombstone != NULL ? tombstone : e);
+		if (e->key == HT_TOMBSTONE) {
+			if (tombstone == NULL)
+				tombstone = e;
+			continue;
+		}
+		if (e->hash == hash && strcmp(e->key, key) == 0)
+			return (e);
+	}
+}
+
+static void *
+ht_get(const struct ht *ht, const char *key)
+{
+	struct ht_entry *e;
+
+	if (ht->count == 0)
+		return (NULL);
+	e = ht_slot(ht, key, ht_hash(key));
+	if (e->key == NULL || e->key == HT_TOMBSTONE)
+		return (NULL);
+	return (e->value);
+}
+
+static void
+ht_resize(struct ht *ht, size_t size)
+{
+	struct ht_entry *old, *e;
+	size_t oldsize;
+
+	assert(is_int_on());
+	old = ht->entries;
+	oldsize = ht->size;
+	ht->entries = calloc(size, sizeof(*ht->entries));
+	if (ht->entries == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "calloc");
+	}
+	ht->size = size;
+	ht->used = ht->count;
+	for (size_t i = 0; i < oldsize; i++) {
+		if (old[i].key == NULL || old[i].key == HT_TOMBSTONE)
+			continue;
+		e = ht_slot(ht, old[i].key, old[i].hash);
+		*e = old[i];
+	}
+	free(old);
+}
+
+/*
+ * Insert key with value. Returns the old value if there was one, which
+ * the caller must free.  The key is copied.
+ */
+static void *
+ht_set(struct ht *ht, const char *key, void *value, bool *existed)
+{
+	struct ht_entry *e;
+	void *old;
+	uint32_t hash;
+
+	assert(is_int_on());
+	if (ht->size == 0)
+		ht_resize(ht, HT_MIN_SIZE);
+	else if ((ht->used + 1) * 4 > ht->size * 3)
+		ht_resize(ht, ht->count * 2 >= ht->size ? ht->size * 2 :
+		    ht->size);
+	hash = ht_hash(key);
+	e = ht_slot(ht, key, hash);
+	if (e->key != NULL && e->key != HT_TOMBSTONE) {
+		old = e->value;
+		e->value = value;
+		*existed = true;
+		return (old);
+	}
+	if (e->key == NULL)
+		ht->used++;
+	if ((e->key = strdup(key)) == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "strdup");
+	}
+	e->value = value;
+	e->hash = hash;
+	ht->count++;
+	*existed = false;
+	return (NULL);
+}
+
+/* Remove key, returning its value for the caller to free. */
+static void *
+ht_remove(struct ht *ht, const char *key, bool *existed)
+{
+	struct ht_entry *e;
+	void *value;
+
+	assert(is_int_on());
+	*existed = false;
+	if (ht->count == 0)
+		return (NULL);
+	e = ht_slot(ht, key, ht_hash(key));
+	if (e->key == NULL || e->key == HT_TOMBSTONE)
+		return (NULL);
+	free(e->key);
+	e->key = HT_TOMBSTONE;
+	value = e->value;
+	e->value = NULL;
+	ht->count--;
+	*existed = true;
+	return (value);
+}
+
+static void
+ht_free(struct ht *ht, void (*free_value)(void *))
+{
+	assert(is_int_on());
+	for (size_t i = 0; i < ht->size; i++) {
+		if (ht->entries[i].key == NULL ||
+		    ht->entries[i].key == HT_TOMBSTONE)
+			continue;
+		free(ht->entries[i].key);
+		free_value(ht->entries[i].value);
+	}
+	free(ht->entries);
+	ht->entries = NULL;
+	ht->size = ht->count = ht->used = 0;
+}
+
+static void
+table_free(void *value)
+{
+	struct ht *table = value;
+
+	ht_free(table, free);
+	free(table);
+}
+
+/* Same as _gsub_var_name. The caller must free the result. */
+static char *
+mangle(const char *name)
+{
+	char *mangled;
+
+	assert(is_int_on());
+	if ((mangled = strdup(name)) == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "strdup");
+	}
+	for (char *p = mangled; *p != '\0'; p++) {
+		if (!is_in_name(*p))
+			*p = '_';
+	}
+	return (mangled);
+}
+
+static struct ht *
+table_lookup(const char *var, bool create)
+{
+	struct ht *table;
+	char *name;
+	bool existed;
+
+	assert(is_int_on());
+	name = mangle(var);
+	table = ht_get(&tables, name);
+	if (table == NULL && create) {
+		if ((table = calloc(1, sizeof(*table))) == NULL) {
+			free(name);
+			INTON;
+			errx(EX_OSERR, "%s", "calloc");
+		}
+		(void)ht_set(&tables, name, table, &existed);
+	}
+	free(name);
+	return (table);
+}
+
+/* Drop a table once it is empty so that hash_isset_var stays cheap. */
+static void
+table_gc(const char *var, struct ht *table)
+{
+	char *name;
+	bool existed;
+
+	assert(is_int_on());
+	if (table->count != 0)
+		return;
+	name = mangle(var);
+	(void)ht_remove(&tables, name, &existed);
+	free(name);
+	table_free(table);
+}
+
+static const char *
+table_get(const char *var, const char *key)
+{
+	struct ht *table;
+	const char *value;
+	char *mkey;
+
+	assert(is_int_on());
+	if ((table = table_lookup(var, false)) == NULL)
+		return (NULL);
+	mkey = mangle(key);
+	value = ht_get(table, mkey);
+	free(mkey);
+	return (value);
+}
+
+/* Set var_return like getvar does. */
+static int
+return_value(const char *var_return, const char *value)
+{
+	int ret;
+
+	ret = value == NULL ? 1 : 0;
+	if (var_return[0] != '\0' && strcmp(var_return, "-") != 0) {
+		if (value == NULL) {
+			if (unsetvar(var_return))
+				ret = 1;
+		} else if (setvarsafe(var_return, value, 0))
+			ret = 1;
+	} else if (value != NULL && value[0] != '\0') {
+		INTON;
+		printf("%s\n", value);
+		INTOFF;
+	}
+	return (ret);
+}
+
+int
+hash_getcmd(int argc, char **argv)
+{
+	int ret;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: hash_get var key var_return");
+	INTOFF;
+	ret = return_value(argv[3], table_get(argv[1], argv[2]));
+	INTON;
+	return (ret);
+}
+
+int
+hash_issetcmd(int argc, char **argv)
+{
+	int ret;
+
+	if (argc != 3)
+		errx(EX_USAGE, "%s", "Usage: hash_isset var key");
+	INTOFF;
+	ret = table_get(argv[1], argv[2]) != NULL ? 0 : 1;
+	INTON;
+	return (ret);
+}
+
+int
+hash_isset_varcmd(int argc, char **argv)
+{
+	int ret;
+
+	if (argc != 2)
+		errx(EX_USAGE, "%s", "Usage: hash_isset_var var");
+	INTOFF;
+	ret = table_lookup(argv[1], false) != NULL ? 0 : 1;
+	INTON;
+	return (ret);
+}
+
+int
+hash_setcmd(int argc, char **argv)
+{
+	struct ht *table;
+	char *mkey, *value, *old;
+	bool existed;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: hash_set var key value");
+	INTOFF;
+	table = table_lookup(argv[1], true);
+	mkey = mangle(argv[2]);
+	if (Cflag && ht_get(table, mkey) != NULL) {
+		/* noclobber: only set if not already set. */
+		free(mkey);
+		INTON;
+		return (1);
+	}
+	if ((value = strdup(argv[3])) == NULL) {
+		free(mkey);
+		INTON;
+		errx(EX_OSERR, "%s", "strdup");
+	}
+	old = ht_set(table, mkey, value, &existed);
+	free(old);
+	free(mkey);
+	INTON;
+	return (0);
+}
+
+static int
+hash_unset_key(const char *var, const char *key, const char *var_return)
+{
+	struct ht *table;
+	char *mkey, *value;
+	bool existed;
+	int ret;
+
+	assert(is_int_on());
+	if ((table = table_lookup(var, false)) == NULL)
+		return (1);
+	mkey = mangle(key);
+	value = ht_remove(table, mkey, &existed);
+	free(mkey);
+	ret = existed ? 0 : 1;
+	if (existed && var_return != NULL && var_return[0] != '\0' &&
+	    setvarsafe(var_return, value, 0))
+		ret = 1;
+	free(value);
+	table_gc(var, table);
+	return (ret);
+}
+
+int
+hash_removecmd(int argc, char **argv)
+{
+	int ret;
+
+	if (argc != 3 && argc != 4)
+		errx(EX_USAGE, "%s",
+		    "Usage: hash_remove var key [var_return]");
+	INTOFF;
+	ret = hash_unset_key(argv[1], argv[2], argc == 4 ? argv[3] : NULL);
+	INTON;
+	return (ret);
+}
+
+int
+hash_unsetcmd(int argc, char **argv)
+{
+
+	if (argc != 3)
+		errx(EX_USAGE, "%s", "Usage: hash_unset var key");
+	INTOFF;
+	(void)hash_unset_key(argv[1], argv[2], NULL);
+	INTON;
+	return (0);
+}
+
+int
+hash_unset_varcmd(int argc, char **argv)
+{
+	struct ht *table;
+	char *name;
+	bool existed;
+
+	if (argc != 2)
+		errx(EX_USAGE, "%s", "Usage: hash_unset_var var");
+	INTOFF;
+	name = mangle(argv[1]);
+	table = ht_remove(&tables, name, &existed);
+	free(name);
+	if (table != NULL)
+		table_free(table);
+	INTON;
+	return (0);
+}
+
+static int
+strcmp_p(const void *a, const void *b)
+{
+
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+/*
+ * hash_vars var_return var|* key|*
+ * List "var:key" for every matching key, sorted the same as the shell
+ * version which sorts by the variable names from set.
+ */
+int
+hash_varscmd(int argc, char **argv)
+{
+	struct ht *table;
+	const char *var_return, *var_pattern, *key_pattern;
+	char **names, *list, *p;
+	size_t nnames, namessize, listlen;
+	int ret;
+
+	if (argc != 3 && argc != 4)
+		errx(EX_USAGE, "%s",
+		    "Usage: hash_vars var_return var|* key|*");
+	var_return = argv[1];
+	var_pattern = argv[2];
+	key_pattern = argc == 4 && argv[3][0] != '\0' ? argv[3] : "*";
+	INTOFF;
+	names = NULL;
+	nnames = namessize = 0;
+	listlen = 0;
+	for (size_t i = 0; i < tables.size; i++) {
+		const struct ht_entry *te = &tables.entries[i];
+
+		if (te->key == NULL || te->key == HT_TOMBSTONE)
+			continue;
+		if (fnmatch(var_pattern, te->key, 0) != 0)
+			continue;
+		table = te->value;
+		for (size_t j = 0; j < table->size; j++) {
+			const struct ht_entry *e = &table->entries[j];
+
+			if (e->key == NULL || e->key == HT_TOMBSTONE)
+				continue;
+			if (fnmatch(key_pattern, e->key, 0) != 0)
+				continue;
+			if (nnames == namessize) {
+				namessize = namessize == 0 ? 16 :
+				    namessize * 2;
+				names = reallocf(names,
+				    sizeof(*names) * namessize);
+				if (names == NULL) {
+					INTON;
+					errx(EX_OSERR, "%s", "realloc");
+				}
+			}
+			/* Sort key: var_Kkey, the same as set(1) does. */
+			if (asprintf(&names[nnames], "%s_K%s", te->key,
+			    e->key) == -1) {
+				INTON;
+				errx(EX_OSERR, "%s", "asprintf");
+			}
+			listlen += strlen(names[nnames]) + 1;
+			nnames++;
+		}
+	}
+	if (nnames > 1)
+		qsort(names, nnames, sizeof(*names), strcmp_p);
+	if ((list = malloc(listlen + 1)) == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "malloc");
+	}
+	p = list;
+	for (size_t i = 0; i < nnames; i++) {
+		const char *first, *last, *sep;
+		size_t len;
+
+		if (i > 0)
+			*p++ = ' ';
+		/*
+		 * var_Kkey -> var:key split the same as the shell version
+		 * which takes var up to the first _K and key after the last.
+		 */
+		first = last = strstr(names[i], "_K");
+		assert(first != NULL);
+		while ((sep = strstr(last + 2, "_K")) != NULL)
+			last = sep;
+		len = first - names[i];
+		memcpy(p, names[i], len);
+		p += len;
+		*p++ = ':';
+		len = strlen(last + 2);
+		memcpy(p, last + 2, len);
+		p += len;
+		free(names[i]);
+	}
+	*p = '\0';
+	free(names);
+	ret = nnames > 0 ? 0 : 1;
+	if (var_return[0] == '\0' || strcmp(var_return, "-") == 0) {
+		if (nnames > 0) {
+			INTON;
+			printf("%s\n", list);
+			INTOFF;
+		}
+	} else if (setvarsafe(var_return, list, 0))
+		ret = 1;
+	free(list);
+	INTON;
+	return (ret);
+}
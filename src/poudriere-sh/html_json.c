@@ -0,0 +1,1620 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Native version of the json.awk pipeline in html.sh _build_json().  That
+ * runs awk, awk and sed twice over every .poudriere.* file on every tick
+ * even though nearly all of the data, the ports lists, only ever grows.
+ *
+ * The html_json coprocess is a long lived shell so the parsed state is
+ * kept here between calls.  Each file is read from where the last call
+ * stopped; only when a file is replaced or truncated is it read again from
+ * the start.  The JSON for each line of the ports lists is made once when
+ * the line is read.  Both .data.json and .data.mini.json are then
+ * assembled in one pass and only written if they changed.
+ *
+ * The output is the same as json.awk's other than the order of the ports
+ * status groups and skipped counts, which awk leaves unspecified.
+ *
+ * With -e the changes are also appended to .data.events so that the web
+ * UI does not need to fetch all of .data.json on every poll.  Each line is
+ * one JSON event with a sequence number:
+ *   {"seq":N,"type":"port","status":"built","n":I,"port":{...}}
+ *	port I of the status list was added.
+ *   {"seq":N,"type":"reset","status":"remaining"}
+ *	the status list was rewritten and its ports follow.
+ *   {"seq":N,"type":"jobs","jobs":[...]}
+ *	the builders changed.
+ *   {"seq":N,"type":"state","data":{...}}
+ *	anything else changed; data is .data.mini.json plus snap.
+ *   {"seq":N,"type":"restart"}
+ *	the first line; a reader that gets here missed events.
+ * .data.json then has "events":{"seq":N,"offset":O} with the last event
+ * it includes and where the line for it starts.  A reader reads from
+ * there on and checks that the first line is still event N.  The log is
+ * started over once it is larger than .data.json.  The sequence carries
+ * on so a reader at an old offset sees that and fetches .data.json again.
+ *
+ * The values bset() keeps in the attribute store, see bstore.c, are read
+ * from there as if they were their .poudriere.* files, which the store
+ * takes precedence over.
+ */
+
+#include <sys/param.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "bstore.h"
+#include "helpers.h"
+#include "var.h"
+
+int
+mkostempsat_mode(int dfd, char *path, int slen, int oflags, mode_t mode);
+
+#define HJ_PREFIX	".poudriere."
+/* Bytes kept from before the read offset to notice a rewritten file. */
+#define HJ_TAILLEN	32
+#define HJ_READSIZ	(64 * 1024)
+#define HJ_EVENTS	".data.events"
+/* Smallest event log which is started over. */
+#define HJ_EVENTS_MIN	(1024 * 1024)
+
+struct buf {
+	char *data;
+	size_t len;
+	size_t cap;
+};
+
+enum hj_out_kind {
+	OUT_FULL,
+	OUT_MINI,
+	OUT_STATE,	/* OUT_MINI plus snap for the state event */
+};
+
+enum hj_kind {
+	HJ_SKIP,	/* Not part of the output */
+	HJ_PORTS,
+	HJ_JOBS,
+	HJ_OTHER,
+};
+
+enum hj_ports {
+	PS_OTHER,
+	PS_BUILT,
+	PS_REMAINING,
+	PS_FAILED,
+	PS_REASON,	/* ignored, queued and inspected */
+	PS_SKIPPED,
+};
+
+struct hj_file {
+	char *name;
+	char *type;
+	char *group;
+	enum hj_kind kind;
+	enum hj_ports pstatus;
+	bool skipped;		/* .poudriere.ports.skipped */
+	bool seen;
+	dev_t dev;
+	ino_t ino;
+	off_t size;
+	struct timespec mtim;
+	/* End of the last full line read. */
+	off_t off;
+	/* Full lines read. */
+	size_t nlines;
+	char tail[HJ_TAILLEN];
+	size_t taillen;
+	/* Full lines for HJ_JOBS and HJ_OTHER; their JSON for HJ_PORTS. */
+	struct buf lines;
+	/* A last line with no newline yet. */
+	struct buf partial;
+	/* The partial line last logged as port nlines. */
+	struct buf partial_sent;
+	/* The store record index + 1 if the value is in the store. */
+	size_t store;
+	uint32_t store_seq;
+};
+
+struct hj_count {
+	char *key;
+	size_t count;
+};
+
+struct hj_out {
+	const char *path;
+	struct buf json;
+	struct buf prev;
+	bool have_prev;
+	enum hj_out_kind kind;
+	const char *in_type;
+};
+
+struct hj_stats {
+	size_t files;
+	size_t changed;
+	size_t reread;
+	uintmax_t bytes;
+	int written;
+};
+
+static char *hj_log_path;
+static struct hj_file **hj_files;
+static size_t hj_nfiles;
+/* skipped counts in the order first seen plus an index into them. */
+static struct hj_count *hj_skipped;
+static size_t hj_nskipped, hj_askipped;
+static size_t *hj_skipped_idx;
+static size_t hj_skipped_idxsize;
+static struct hj_out hj_full = { .path = ".data.json", .kind = OUT_FULL };
+static struct hj_out hj_mini = { .path = ".data.mini.json",
+    .kind = OUT_MINI };
+static struct hj_out hj_state = { .kind = OUT_STATE };
+static bool hj_oom;
+/* Events are only logged once the log was started. */
+static bool hj_events;
+static uintmax_t hj_seq;
+static off_t hj_events_size;
+/* Where the line for event hj_seq starts. */
+static off_t hj_events_last;
+static struct buf hj_events_buf;
+static struct buf hj_jobs_prev;
+
+static void
+buf_reserve(struct buf *b, size_t len)
+{
+	size_t cap;
+	char *data;
+
+	assert(is_int_on());
+	if (b->cap - b->len >= len)
+		return;
+	for (cap = b->cap == 0 ? 256 : b->cap; cap - b->len < len; cap *= 2)
+		;
+	if ((data = realloc(b->data, cap)) == NULL) {
+		hj_oom = true;
+		return;
+	}
+	b->data = data;
+	b->cap = cap;
+}
+
+static void
+buf_cat(struct buf *b, const char *s, size_t len)
+{
+
+	buf_reserve(b, len);
+	if (b->cap - b->len < len)
+		return;
+	memcpy(b->data + b->len, s, len);
+	b->len += len;
+}
+
+static void
+buf_puts(struct buf *b, const char *s)
+{
+
+	buf_cat(b, s, strlen(s));
+}
+
+static void
+buf_free(struct buf *b)
+{
+
+	free(b->data);
+	b->data = NULL;
+	b->len = b->cap = 0;
+}
+
+/* "key":"value", */
+static void
+buf_field(struct buf *b, const char *key, const char *value, size_t len)
+{
+
+	buf_puts(b, "\"");
+	buf_puts(b, key);
+	buf_puts(b, "\":\"");
+	buf_cat(b, value, len);
+	buf_puts(b, "\",");
+}
+
+/* Drop a comma before a closing bracket the same as _build_json()'s sed. */
+static void
+buf_cat_json(struct buf *b, const char *s, size_t len)
+{
+	const char *end;
+
+	buf_reserve(b, len);
+	if (hj_oom)
+		return;
+	for (end = s + len; s < end; s++) {
+		if (*s == ',' && s + 1 < end && (s[1] == ']' || s[1] == '}'))
+			continue;
+		b->data[b->len++] = *s;
+	}
+}
+
+/* {"seq":N,"type":"type" */
+static void
+event_start(const char *type)
+{
+	char num[32];
+
+	snprintf(num, sizeof(num), "%ju", ++hj_seq);
+	buf_puts(&hj_events_buf, "{\"seq\":");
+	buf_puts(&hj_events_buf, num);
+	buf_puts(&hj_events_buf, ",\"type\":\"");
+	buf_puts(&hj_events_buf, type);
+	buf_puts(&hj_events_buf, "\"");
+}
+
+static uint32_t
+hj_hash(const char *s, size_t len)
+{
+	uint32_t h;
+
+	/* FNV-1a */
+	for (h = 2166136261u; len > 0; len--)
+		h = (h ^ (unsigned char)*s++) * 16777619u;
+	return (h);
+}
+
+static void
+skipped_clear(void)
+{
+	size_t i;
+
+	for (i = 0; i < hj_nskipped; i++)
+		free(hj_skipped[i].key);
+	hj_nskipped = 0;
+	for (i = 0; i < hj_skipped_idxsize; i++)
+		hj_skipped_idx[i] = SIZE_MAX;
+}
+
+static void
+skipped_rehash(void)
+{
+	size_t *idx, size, i, slot;
+
+	size = hj_skipped_idxsize == 0 ? 64 : hj_skipped_idxsize * 2;
+	if ((idx = malloc(size * sizeof(*idx))) == NULL) {
+		hj_oom = true;
+		return;
+	}
+	for (i = 0; i < size; i++)
+		idx[i] = SIZE_MAX;
+	for (i = 0; i < hj_nskipped; i++) {
+		slot = hj_hash(hj_skipped[i].key, strlen(hj_skipped[i].key)) &
+		    (size - 1);
+		while (idx[slot] != SIZE_MAX)
+			slot = (slot + 1) & (size - 1);
+		idx[slot] = i;
+	}
+	free(hj_skipped_idx);
+	hj_skipped_idx = idx;
+	hj_skipped_idxsize = size;
+}
+
+static void
+skipped_add(const char *key, size_t len)
+{
+	struct hj_count *c;
+	size_t slot, i;
+
+	assert(is_int_on());
+	if ((hj_nskipped + 1) * 2 > hj_skipped_idxsize) {
+		skipped_rehash();
+		if (hj_oom)
+			return;
+	}
+	slot = hj_hash(key, len) & (hj_skipped_idxsize - 1);
+	while ((i = hj_skipped_idx[slot]) != SIZE_MAX) {
+		if (strncmp(hj_skipped[i].key, key, len) == 0 &&
+		    hj_skipped[i].key[len] == '\0') {
+			hj_skipped[i].count++;
+			return;
+		}
+		slot = (slot + 1) & (hj_skipped_idxsize - 1);
+	}
+	if (hj_nskipped == hj_askipped) {
+		hj_askipped = hj_askipped == 0 ? 64 : hj_askipped * 2;
+		c = reallocarray(hj_skipped, hj_askipped, sizeof(*c));
+		if (c == NULL) {
+			hj_oom = true;
+			return;
+		}
+		hj_skipped = c;
+	}
+	c = &hj_skipped[hj_nskipped];
+	if ((c->key = strndup(key, len)) == NULL) {
+		hj_oom = true;
+		return;
+	}
+	c->count = 1;
+	hj_skipped_idx[slot] = hj_nskipped++;
+}
+
+/* Split on blanks the same as awk's default field splitting. */
+static size_t
+split_blank(const char *line, size_t len, const char **fields,
+    size_t *flens, size_t max)
+{
+	const char *p, *end, *start;
+	size_t n;
+
+	n = 0;
+	end = line + len;
+	for (p = line; p < end;) {
+		while (p < end && (*p == ' ' || *p == '\t'))
+			p++;
+		if (p == end)
+			break;
+		start = p;
+		while (p < end && *p != ' ' && *p != '\t')
+			p++;
+		if (n < max) {
+			fields[n] = start;
+			flens[n] = p - start;
+		}
+		n++;
+	}
+	return (n);
+}
+
+/* Split on sep keeping empty fields, the same as awk's split(s, a, ":"). */
+static size_t
+split_char(const char *line, size_t len, char sep, const char **fields,
+    size_t *flens, size_t max)
+{
+	const char *p, *end, *start;
+	size_t n;
+
+	if (len == 0)
+		return (0);
+	n = 0;
+	end = line + len;
+	for (start = p = line;; p++) {
+		if (p == end || *p == sep) {
+			if (n < max) {
+				fields[n] = start;
+				flens[n] = p - start;
+			}
+			n++;
+			if (p == end)
+				break;
+			start = p + 1;
+		}
+	}
+	return (n);
+}
+
+/*
+ * awk's truth value of a split() element: a numeric looking one is
+ * false when it is 0.
+ */
+static bool
+awk_true(const char *s, size_t len)
+{
+	char buf[64], *end;
+	double d;
+
+	if (len == 0)
+		return (false);
+	if (len >= sizeof(buf))
+		return (true);
+	memcpy(buf, s, len);
+	buf[len] = '\0';
+	d = strtod(buf, &end);
+	if (end == buf)
+		return (true);
+	while (*end == ' ' || *end == '\t' || *end == '\n')
+		end++;
+	if (*end != '\0')
+		return (true);
+	return (d != 0);
+}
+
+/* "origin":"...",["flavor":"...",] */
+static void
+buf_originspec(struct buf *b, const char *originspec, size_t len)
+{
+	const char *at, *flavor;
+	size_t flen;
+
+	if ((at = memchr(originspec, '@', len)) == NULL) {
+		buf_field(b, "origin", originspec, len);
+		return;
+	}
+	buf_field(b, "origin", originspec, at - originspec);
+	flavor = at + 1;
+	flen = len - (flavor - originspec);
+	if ((at = memchr(flavor, '@', flen)) != NULL)
+		flen = at - flavor;
+	if (awk_true(flavor, flen))
+		buf_field(b, "flavor", flavor, flen);
+}
+
+/* Same as json.awk's escape(). */
+static void
+buf_escape(struct buf *b, const char *s, size_t len)
+{
+	const char *end;
+
+	for (end = s + len; s < end; s++) {
+		switch (*s) {
+		case '\n':
+		case '\\':
+			break;
+		case '"':
+			buf_cat(b, "\\\"", 2);
+			break;
+		default:
+			buf_cat(b, s, 1);
+		}
+	}
+}
+
+#define	PORTS_MAXFIELDS	5
+
+static void
+ports_line_json(struct buf *b, enum hj_ports pstatus, const char *line,
+    size_t len)
+{
+	const char *f[PORTS_MAXFIELDS];
+	size_t flen[PORTS_MAXFIELDS], n, i;
+	const char *p, *end;
+
+	n = split_blank(line, len, f, flen, PORTS_MAXFIELDS);
+	for (i = n; i < PORTS_MAXFIELDS; i++) {
+		f[i] = "";
+		flen[i] = 0;
+	}
+	buf_puts(b, "{");
+	if (pstatus != PS_REMAINING) {
+		buf_originspec(b, f[0], flen[0]);
+		buf_field(b, "pkgname", f[1], flen[1]);
+	} else
+		buf_field(b, "pkgname", f[0], flen[0]);
+	switch (pstatus) {
+	case PS_BUILT:
+		buf_field(b, "elapsed", f[2], flen[2]);
+		break;
+	case PS_REMAINING:
+		buf_field(b, "status", f[1], flen[1]);
+		break;
+	case PS_FAILED:
+		buf_field(b, "phase", f[2], flen[2]);
+		buf_field(b, "errortype", f[3], flen[3]);
+		buf_field(b, "elapsed", f[4], flen[4]);
+		break;
+	case PS_REASON:
+		/* Fields 3 on joined by a single space. */
+		buf_puts(b, "\"reason\":\"");
+		if (n >= 3) {
+			end = line + len;
+			for (p = f[2]; p < end;) {
+				i = 0;
+				while (p + i < end && p[i] != ' ' &&
+				    p[i] != '\t')
+					i++;
+				buf_escape(b, p, i);
+				p += i;
+				while (p < end && (*p == ' ' || *p == '\t'))
+					p++;
+				if (p < end)
+					buf_cat(b, " ", 1);
+			}
+		}
+		buf_puts(b, "\",");
+		break;
+	case PS_SKIPPED:
+		buf_field(b, "depends", f[2], flen[2]);
+		break;
+	case PS_OTHER:
+		break;
+	}
+	buf_puts(b, "},");
+}
+
+static void
+jobs_line_json(struct buf *b, const struct hj_file *hf, const char *line,
+    size_t len)
+{
+	const char *f[5];
+	size_t flen[5], n, i;
+
+	buf_puts(b, "{");
+	buf_field(b, "id", hf->group, strlen(hf->group));
+	n = split_char(line, len, ':', f, flen, nitems(f));
+	if (n > 2) {
+		for (i = n; i < nitems(f); i++) {
+			f[i] = "";
+			flen[i] = 0;
+		}
+		buf_field(b, "status", f[0], flen[0]);
+		buf_originspec(b, f[1], flen[1]);
+		buf_field(b, "pkgname", f[2], flen[2]);
+		buf_field(b, "started", f[3], flen[3]);
+		buf_puts(b, "\"elapsed\":\"");
+		buf_cat(b, f[4], flen[4]);
+		buf_puts(b, "\"");
+	} else {
+		buf_puts(b, "\"status\":\"");
+		buf_cat(b, line, len);
+		buf_puts(b, "\"");
+	}
+	buf_puts(b, "},");
+}
+
+/* The port a .poudriere.ports.skipped line is skipped for. */
+static void
+skipped_depends(const char *line, size_t len, const char **key,
+    size_t *klen)
+{
+	const char *f[3];
+	size_t flen[3];
+
+	if (split_blank(line, len, f, flen, nitems(f)) >= nitems(f)) {
+		*key = f[2];
+		*klen = flen[2];
+	} else {
+		*key = "";
+		*klen = 0;
+	}
+}
+
+/* Port n of the file's status list is json, with its trailing comma. */
+static void
+event_port(const struct hj_file *hf, size_t n, const char *json,
+    size_t len)
+{
+	char num[32];
+
+	snprintf(num, sizeof(num), "%zu", n);
+	event_start("port");
+	buf_puts(&hj_events_buf, ",\"status\":\"");
+	buf_puts(&hj_events_buf, hf->group);
+	buf_puts(&hj_events_buf, "\",\"n\":");
+	buf_puts(&hj_events_buf, num);
+	buf_puts(&hj_events_buf, ",\"port\":");
+	buf_cat_json(&hj_events_buf, json, len - 1);
+	buf_puts(&hj_events_buf, "}\n");
+}
+
+/* A full line was read. */
+static void
+file_add_line(struct hj_file *hf, const char *line, size_t len)
+{
+	const char *key;
+	size_t klen, start;
+
+	if (hf->skipped) {
+		skipped_depends(line, len, &key, &klen);
+		skipped_add(key, klen);
+	}
+	switch (hf->kind) {
+	case HJ_PORTS:
+		start = hf->lines.len;
+		ports_line_json(&hf->lines, hf->pstatus, line, len);
+		if (hj_events)
+			event_port(hf, hf->nlines, hf->lines.data + start,
+			    hf->lines.len - start);
+		hf->partial_sent.len = 0;
+		break;
+	case HJ_JOBS:
+	case HJ_OTHER:
+		buf_cat(&hf->lines, line, len);
+		buf_cat(&hf->lines, "\n", 1);
+		break;
+	case HJ_SKIP:
+		break;
+	}
+	hf->nlines++;
+}
+
+static void
+file_reset(struct hj_file *hf)
+{
+
+	if (hj_events && hf->kind == HJ_PORTS &&
+	    (hf->nlines > 0 || hf->partial_sent.len > 0)) {
+		event_start("reset");
+		buf_puts(&hj_events_buf, ",\"status\":\"");
+		buf_puts(&hj_events_buf, hf->group);
+		buf_puts(&hj_events_buf, "\"}\n");
+	}
+	hf->nlines = 0;
+	hf->off = 0;
+	hf->taillen = 0;
+	hf->lines.len = 0;
+	hf->partial.len = 0;
+	hf->partial_sent.len = 0;
+	/* The skipped counts are only from this file. */
+	if (hf->skipped)
+		skipped_clear();
+}
+
+static void
+file_free(struct hj_file *hf)
+{
+
+	if (hf->skipped)
+		skipped_clear();
+	buf_free(&hf->lines);
+	buf_free(&hf->partial);
+	buf_free(&hf->partial_sent);
+	free(hf->name);
+	free(hf->type);
+	free(hf->group);
+	free(hf);
+}
+
+static const char *
+group_type(const char *type)
+{
+	static const char *strings[] = {
+		"svn_url", "git_hash", "git_dirty", "overlays", "setname",
+		"ptname", "jailname", "buildname", "mastername", "started",
+		"ended", "status",
+	};
+	size_t i;
+
+	if (strcmp(type, "builders") == 0 || strcmp(type, "jobs") == 0)
+		return ("array");
+	for (i = 0; i < nitems(strings); i++) {
+		if (strcmp(type, strings[i]) == 0)
+			return ("string");
+	}
+	return ("object");
+}
+
+/* Classify a file by its name the same as json.awk does. */
+static struct hj_file *
+file_new(const char *log_path, const char *name)
+{
+	struct hj_file *hf;
+	const char *type, *group, *end;
+	size_t tlen, glen;
+
+	if ((hf = calloc(1, sizeof(*hf))) == NULL)
+		return (NULL);
+	/* .poudriere.<type>[.<group>[...]] */
+	type = name + strlen(HJ_PREFIX);
+	end = strchr(type, '.');
+	tlen = end == NULL ? strlen(type) : (size_t)(end - type);
+	group = end == NULL ? "" : end + 1;
+	end = strchr(group, '.');
+	glen = end == NULL ? strlen(group) : (size_t)(end - group);
+	if (tlen == strlen("status") && strncmp(type, "status", tlen) == 0 &&
+	    glen > 0) {
+		type = "jobs";
+		tlen = strlen(type);
+	} else if (strncmp(type, "stats", strlen("stats")) == 0 &&
+	    tlen >= strlen("stats")) {
+		group = tlen > strlen("stats_") ? type + strlen("stats_") : "";
+		glen = tlen > strlen("stats_") ? tlen - strlen("stats_") : 0;
+		type = "stats";
+		tlen = strlen(type);
+	} else if (strncmp(type, "snap", strlen("snap")) == 0 &&
+	    tlen >= strlen("snap")) {
+		group = tlen > strlen("snap_") ? type + strlen("snap_") : "";
+		glen = tlen > strlen("snap_") ? tlen - strlen("snap_") : 0;
+		type = "snap";
+		tlen = strlen(type);
+	}
+	hf->name = strdup(name);
+	hf->type = strndup(type, tlen);
+	hf->group = strndup(group, glen);
+	if (hf->name == NULL || hf->type == NULL || hf->group == NULL) {
+		file_free(hf);
+		return (NULL);
+	}
+	if (strcmp(name, HJ_PREFIX "builders") == 0 ||
+	    strstr(log_path, ".swp") != NULL || strstr(name, ".swp") != NULL)
+		hf->kind = HJ_SKIP;
+	else if (strcmp(hf->type, "ports") == 0)
+		hf->kind = HJ_PORTS;
+	else if (strcmp(hf->type, "jobs") == 0)
+		hf->kind = HJ_JOBS;
+	else
+		hf->kind = HJ_OTHER;
+	hf->skipped = hf->kind != HJ_SKIP &&
+	    strcmp(name, HJ_PREFIX "ports.skipped") == 0;
+	if (strcmp(hf->group, "built") == 0)
+		hf->pstatus = PS_BUILT;
+	else if (strcmp(hf->group, "remaining") == 0)
+		hf->pstatus = PS_REMAINING;
+	else if (strcmp(hf->group, "failed") == 0)
+		hf->pstatus = PS_FAILED;
+	else if (strcmp(hf->group, "ignored") == 0 ||
+	    strcmp(hf->group, "queued") == 0 ||
+	    strcmp(hf->group, "inspected") == 0)
+		hf->pstatus = PS_REASON;
+	else if (strcmp(hf->group, "skipped") == 0)
+		hf->pstatus = PS_SKIPPED;
+	else
+		hf->pstatus = PS_OTHER;
+	return (hf);
+}
+
+static bool
+read_full(int fd, char *buf, size_t len, off_t off, size_t *nread)
+{
+	ssize_t n;
+
+	*nread = 0;
+	while (len > 0) {
+		n = pread(fd, buf, len, off);
+		if (n == -1) {
+			if (errno == EINTR)
+				continue;
+			return (false);
+		}
+		if (n == 0)
+			break;
+		buf += n;
+		len -= n;
+		off += n;
+		*nread += n;
+	}
+	return (true);
+}
+
+/* The store record for name, as hj_file.store. */
+static size_t
+store_index(const char *name)
+{
+	struct bstore_value v;
+	size_t idx;
+
+	if (strncmp(name, HJ_PREFIX, strlen(HJ_PREFIX)) != 0 ||
+	    !bstore_lookup(name + strlen(HJ_PREFIX), &idx) ||
+	    !bstore_read(idx, &v) || v.file)
+		return (0);
+	return (idx + 1);
+}
+
+/* Read the value from the store if it was set since the last call. */
+static void
+store_update(struct hj_file *hf, struct hj_stats *stats)
+{
+	struct bstore_value v;
+	const char *p, *end, *nl;
+
+	if (!bstore_read(hf->store - 1, &v) || v.file ||
+	    v.seq == hf->store_seq)
+		return;
+	stats->changed++;
+	stats->bytes += v.len;
+	file_reset(hf);
+	hf->store_seq = v.seq;
+	/* The file would have the value and a newline. */
+	p = v.data;
+	end = v.data + v.len;
+	while ((nl = memchr(p, '\n', end - p)) != NULL) {
+		file_add_line(hf, p, nl - p);
+		p = nl + 1;
+	}
+	file_add_line(hf, p, end - p);
+}
+
+/* Read whatever was added to the file since the last call. */
+static void
+file_update(int dirfd, struct hj_file *hf, struct hj_stats *stats)
+{
+	static char rbuf[HJ_READSIZ];
+	char check[HJ_TAILLEN];
+	struct stat st;
+	const char *p, *end, *nl;
+	size_t n, len;
+	off_t pos;
+	int fd;
+
+	if (hf->kind == HJ_SKIP)
+		return;
+	if (hf->store != 0) {
+		store_update(hf, stats);
+		return;
+	}
+	if ((fd = openat(dirfd, hf->name, O_RDONLY | O_CLOEXEC)) == -1) {
+		/* Gone since the readdir. */
+		if (hf->off > 0 || hf->partial.len > 0)
+			stats->changed++;
+		file_reset(hf);
+		return;
+	}
+	if (fstat(fd, &st) == -1)
+		goto out;
+	if (st.st_dev == hf->dev && st.st_ino == hf->ino &&
+	    st.st_size == hf->size &&
+	    st.st_mtim.tv_sec == hf->mtim.tv_sec &&
+	    st.st_mtim.tv_nsec == hf->mtim.tv_nsec)
+		goto out;
+	stats->changed++;
+	/*
+	 * Start over if the file was replaced, shrank or was rewritten in
+	 * place.  Shrinking only in the partial line could be handled
+	 * without that but is rare and a logged partial line would then
+	 * need to be taken back.
+	 */
+	if (st.st_dev != hf->dev || st.st_ino != hf->ino ||
+	    st.st_size < hf->size || (hf->taillen > 0 &&
+	    (!read_full(fd, check, hf->taillen, hf->off - hf->taillen, &n) ||
+	    n != hf->taillen || memcmp(check, hf->tail, n) != 0))) {
+		if (hf->off > 0 || hf->partial.len > 0)
+			stats->reread++;
+		file_reset(hf);
+	}
+	hf->dev = st.st_dev;
+	hf->ino = st.st_ino;
+	hf->size = st.st_size;
+	hf->mtim = st.st_mtim;
+	hf->partial.len = 0;
+	for (pos = hf->off; pos < st.st_size; pos += n) {
+		len = st.st_size - pos < (off_t)sizeof(rbuf) ?
+		    (size_t)(st.st_size - pos) : sizeof(rbuf);
+		if (!read_full(fd, rbuf, len, pos, &n) || n == 0)
+			break;
+		stats->bytes += n;
+		p = rbuf;
+		end = rbuf + n;
+		while ((nl = memchr(p, '\n', end - p)) != NULL) {
+			if (hf->partial.len > 0) {
+				buf_cat(&hf->partial, p, nl - p);
+				file_add_line(hf, hf->partial.data,
+				    hf->partial.len);
+				hf->partial.len = 0;
+			} else
+				file_add_line(hf, p, nl - p);
+			p = nl + 1;
+		}
+		buf_cat(&hf->partial, p, end - p);
+		/* Remember the bytes before the end of the last full line. */
+		if (p == rbuf)
+			continue;
+		hf->off = pos + (p - rbuf);
+		if ((size_t)(p - rbuf) >= HJ_TAILLEN) {
+			memcpy(hf->tail, p - HJ_TAILLEN, HJ_TAILLEN);
+			hf->taillen = HJ_TAILLEN;
+			continue;
+		}
+		hf->taillen = hf->off < HJ_TAILLEN ? (size_t)hf->off :
+		    HJ_TAILLEN;
+		if (!read_full(fd, hf->tail, hf->taillen,
+		    hf->off - hf->taillen, &len) || len != hf->taillen)
+			hf->taillen = 0;
+	}
+out:
+	close(fd);
+}
+
+static int
+name_cmp(const void *a, const void *b)
+{
+
+	return (strcmp(*(char * const *)a, *(char * const *)b));
+}
+
+static int
+file_cmp(const void *key, const void *elem)
+{
+
+	return (strcmp(key, (*(struct hj_file * const *)elem)->name));
+}
+
+/* Same as the .poudriere.*[!%] glob. */
+static bool
+name_match(const char *name)
+{
+	size_t len;
+
+	len = strlen(name);
+	return (len > strlen(HJ_PREFIX) &&
+	    strncmp(name, HJ_PREFIX, strlen(HJ_PREFIX)) == 0 &&
+	    name[len - 1] != '%');
+}
+
+static bool
+names_add(char ***namesp, size_t *nnamesp, size_t *anamesp,
+    const char *prefix, const char *name)
+{
+	char **tmp;
+
+	if (*nnamesp == *anamesp) {
+		*anamesp = *anamesp == 0 ? 64 : *anamesp * 2;
+		tmp = reallocarray(*namesp, *anamesp, sizeof(**namesp));
+		if (tmp == NULL)
+			return (false);
+		*namesp = tmp;
+	}
+	if (asprintf(&(*namesp)[*nnamesp], "%s%s", prefix, name) == -1)
+		return (false);
+	(*nnamesp)++;
+	return (true);
+}
+
+/*
+ * Find the current files and update them, carrying over the state of
+ * the ones seen before.
+ */
+static bool
+files_update(int dirfd, struct hj_stats *stats)
+{
+	struct hj_file **files, **found, *hf;
+	struct bstore_value v;
+	struct dirent *de;
+	char **names, store_path[PATH_MAX];
+	size_t nnames, anames, i, j, store;
+	int dupfd;
+	DIR *d;
+
+	names = NULL;
+	nnames = anames = 0;
+	if ((dupfd = dup(dirfd)) == -1)
+		return (false);
+	if ((d = fdopendir(dupfd)) == NULL) {
+		close(dupfd);
+		return (false);
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (!name_match(de->d_name))
+			continue;
+		if (!names_add(&names, &nnames, &anames, "", de->d_name)) {
+			hj_oom = true;
+			break;
+		}
+	}
+	closedir(d);
+	if (hj_oom)
+		goto out;
+	/* Add the values in the store which have no file yet. */
+	snprintf(store_path, sizeof(store_path), "%s/%s", hj_log_path,
+	    BSTORE_FILE);
+	if (bstore_open(store_path, false) == -1)
+		warn("%s", store_path);
+	for (i = 0; i < bstore_nrecords(); i++) {
+		if (!bstore_read(i, &v) || v.file)
+			continue;
+		if (!names_add(&names, &nnames, &anames, HJ_PREFIX, v.name)) {
+			hj_oom = true;
+			goto out;
+		}
+	}
+	qsort(names, nnames, sizeof(*names), name_cmp);
+	for (i = j = 0; i < nnames; i++) {
+		if (j > 0 && strcmp(names[j - 1], names[i]) == 0)
+			free(names[i]);
+		else
+			names[j++] = names[i];
+	}
+	nnames = j;
+	if ((files = calloc(nnames + 1, sizeof(*files))) == NULL) {
+		hj_oom = true;
+		goto out;
+	}
+	for (i = 0; i < hj_nfiles; i++)
+		hj_files[i]->seen = false;
+	for (i = 0; i < nnames; i++) {
+		found = hj_nfiles == 0 ? NULL : bsearch(names[i], hj_files,
+		    hj_nfiles, sizeof(*hj_files), file_cmp);
+		if (found != NULL) {
+			hf = *found;
+		} else if ((hf = file_new(hj_log_path, names[i])) == NULL) {
+			hj_oom = true;
+			break;
+		}
+		hf->seen = true;
+		files[i] = hf;
+		/* Start over when it moves between the store and a file. */
+		store = store_index(names[i]);
+		if (hf->store != store) {
+			if (hf->nlines > 0 || hf->partial.len > 0)
+				stats->changed++;
+			file_reset(hf);
+			hf->dev = 0;
+			hf->ino = 0;
+			hf->size = 0;
+			hf->mtim = (struct timespec){ 0 };
+			hf->store = store;
+			hf->store_seq = 0;
+		}
+	}
+	if (hj_oom) {
+		for (; i > 0; i--) {
+			if (!files[i - 1]->seen)
+				file_free(files[i - 1]);
+		}
+		free(files);
+		goto out;
+	}
+	for (i = 0; i < hj_nfiles; i++) {
+		if (!hj_files[i]->seen) {
+			file_reset(hj_files[i]);
+			file_free(hj_files[i]);
+			stats->changed++;
+		}
+	}
+	free(hj_files);
+	hj_files = files;
+	hj_nfiles = nnames;
+	stats->files = nnames;
+	for (i = 0; i < hj_nfiles; i++)
+		file_update(dirfd, hj_files[i], stats);
+out:
+	for (i = 0; i < nnames; i++)
+		free(names[i]);
+	free(names);
+	return (!hj_oom);
+}
+
+/* json.awk end_type(): close the current group and open the next. */
+static void
+out_end_type(struct hj_out *out, const char *type)
+{
+	const struct hj_file *hf, *other;
+	const char *gtype;
+	size_t i, j;
+
+	if (out->in_type != NULL) {
+		if (strcmp(out->in_type, "ports") == 0) {
+			/* Each status group with every file for it. */
+			for (i = 0; i < hj_nfiles; i++) {
+				hf = hj_files[i];
+				if (hf->kind != HJ_PORTS ||
+				    (hf->lines.len == 0 &&
+				    hf->partial.len == 0))
+					continue;
+				for (j = 0; j < i; j++) {
+					other = hj_files[j];
+					if (other->kind == HJ_PORTS &&
+					    (other->lines.len > 0 ||
+					    other->partial.len > 0) &&
+					    strcmp(other->group,
+					    hf->group) == 0)
+						break;
+				}
+				if (j < i)
+					continue;
+				buf_puts(&out->json, "\"");
+				buf_puts(&out->json, hf->group);
+				buf_puts(&out->json, "\":[");
+				for (j = i; j < hj_nfiles; j++) {
+					other = hj_files[j];
+					if (other->kind != HJ_PORTS ||
+					    strcmp(other->group,
+					    hf->group) != 0)
+						continue;
+					buf_cat(&out->json, other->lines.data,
+					    other->lines.len);
+					if (other->partial.len > 0)
+						ports_line_json(&out->json,
+						    other->pstatus,
+						    other->partial.data,
+						    other->partial.len);
+				}
+				buf_puts(&out->json, "],");
+			}
+		}
+		gtype = group_type(out->in_type);
+		if (strcmp(gtype, "array") == 0)
+			buf_puts(&out->json, "],");
+		else if (strcmp(gtype, "object") == 0)
+			buf_puts(&out->json, "},");
+	}
+	if (type != NULL) {
+		buf_puts(&out->json, "\"");
+		buf_puts(&out->json, type);
+		buf_puts(&out->json, "\":");
+		gtype = group_type(type);
+		if (strcmp(gtype, "array") == 0)
+			buf_puts(&out->json, "[");
+		else if (strcmp(gtype, "object") == 0)
+			buf_puts(&out->json, "{");
+	}
+	out->in_type = type;
+}
+
+static void
+out_line(struct hj_out *out, const struct hj_file *hf, const char *line,
+    size_t len)
+{
+
+	if (hf->kind == HJ_JOBS) {
+		jobs_line_json(&out->json, hf, line, len);
+		return;
+	}
+	if (hf->group[0] != '\0') {
+		buf_puts(&out->json, "\"");
+		buf_puts(&out->json, hf->group);
+		buf_puts(&out->json, "\":");
+	}
+	buf_puts(&out->json, "\"");
+	buf_cat(&out->json, line, len);
+	buf_puts(&out->json, "\",");
+}
+
+static void
+out_file(struct hj_out *out, const struct hj_file *hf)
+{
+	const char *p, *end, *nl;
+
+	if (hf->kind == HJ_SKIP ||
+	    (hf->lines.len == 0 && hf->partial.len == 0))
+		return;
+	if (out->kind != OUT_FULL &&
+	    (hf->kind == HJ_PORTS || hf->kind == HJ_JOBS))
+		return;
+	if (out->kind == OUT_MINI && strcmp(hf->type, "snap") == 0)
+		return;
+	if (out->in_type == NULL || strcmp(out->in_type, hf->type) != 0)
+		out_end_type(out, hf->type);
+	/* The ports are all written when the group is closed. */
+	if (hf->kind == HJ_PORTS)
+		return;
+	end = hf->lines.data + hf->lines.len;
+	for (p = hf->lines.data; p < end; p = nl + 1) {
+		nl = memchr(p, '\n', end - p);
+		out_line(out, hf, p, nl - p);
+	}
+	if (hf->partial.len > 0)
+		out_line(out, hf, hf->partial.data, hf->partial.len);
+}
+
+/* Assemble the JSON the same as _build_json() does. */
+static void
+out_build(struct hj_out *out, struct buf *raw)
+{
+	char num[64];
+	const char *key;
+	size_t i, klen, count;
+	bool partial;
+
+	raw->len = 0;
+	out->json.len = 0;
+	out->in_type = NULL;
+	buf_puts(&out->json, "{");
+	for (i = 0; i < hj_nfiles; i++)
+		out_file(out, hj_files[i]);
+	out_end_type(out, NULL);
+	if (out->kind == OUT_FULL && hj_events) {
+		snprintf(num, sizeof(num), "\"events\":{\"seq\":%ju,"
+		    "\"offset\":%jd},", hj_seq, (intmax_t)hj_events_last);
+		buf_puts(&out->json, num);
+	}
+	if (out->kind == OUT_FULL) {
+		/* A partial line is counted too but not kept. */
+		partial = false;
+		key = NULL;
+		klen = 0;
+		for (i = 0; i < hj_nfiles; i++) {
+			if (hj_files[i]->skipped &&
+			    hj_files[i]->partial.len > 0) {
+				skipped_depends(hj_files[i]->partial.data,
+				    hj_files[i]->partial.len, &key, &klen);
+				partial = true;
+			}
+		}
+		buf_puts(&out->json, "\"skipped\":{");
+		for (i = 0; i < hj_nskipped; i++) {
+			count = hj_skipped[i].count;
+			if (partial &&
+			    strncmp(hj_skipped[i].key, key, klen) == 0 &&
+			    hj_skipped[i].key[klen] == '\0') {
+				count++;
+				partial = false;
+			}
+			buf_puts(&out->json, "\"");
+			buf_puts(&out->json, hj_skipped[i].key);
+			snprintf(num, sizeof(num), "\":%zu,", count);
+			buf_puts(&out->json, num);
+		}
+		if (partial) {
+			buf_puts(&out->json, "\"");
+			buf_cat(&out->json, key, klen);
+			buf_puts(&out->json, "\":1,");
+		}
+		buf_puts(&out->json, "}");
+	}
+	buf_puts(&out->json, "}");
+	if (hj_oom)
+		return;
+	buf_cat_json(raw, out->json.data, out->json.len);
+	buf_cat(raw, "\n", 1);
+}
+
+static bool
+out_same(int dirfd, const struct hj_out *out, const struct buf *data)
+{
+	static char rbuf[HJ_READSIZ];
+	struct stat st;
+	size_t off, n, len;
+	bool same;
+	int fd;
+
+	if (out->have_prev && (out->prev.len != data->len ||
+	    memcmp(out->prev.data, data->data, data->len) != 0))
+		return (false);
+	/* Same as the last write but it may have been removed since. */
+	if ((fd = openat(dirfd, out->path, O_RDONLY | O_CLOEXEC)) == -1)
+		return (false);
+	same = fstat(fd, &st) == 0 && st.st_size == (off_t)data->len;
+	if (same && !out->have_prev) {
+		for (off = 0; same && off < data->len; off += n) {
+			len = data->len - off < sizeof(rbuf) ?
+			    data->len - off : sizeof(rbuf);
+			same = read_full(fd, rbuf, len, off, &n) && n == len &&
+			    memcmp(rbuf, data->data + off, n) == 0;
+		}
+	}
+	close(fd);
+	return (same);
+}
+
+/* write_atomic */
+static int
+write_atomic(int dirfd, const char *path, const char *data, size_t len)
+{
+	char tmpfile[PATH_MAX];
+	ssize_t n;
+	int fd;
+
+	snprintf(tmpfile, sizeof(tmpfile), ".write_atomic-%s.XXXXXXXXXX",
+	    path);
+	if ((fd = mkostempsat_mode(dirfd, tmpfile, 0, O_CLOEXEC,
+	    0644)) == -1) {
+		warn("mkstemp %s/%s", hj_log_path, tmpfile);
+		return (-1);
+	}
+	for (; len > 0; data += n, len -= n) {
+		if ((n = write(fd, data, len)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			warn("write %s/%s", hj_log_path, tmpfile);
+			close(fd);
+			(void)unlinkat(dirfd, tmpfile, 0);
+			return (-1);
+		}
+	}
+	close(fd);
+	if (renameat(dirfd, tmpfile, dirfd, path) == -1) {
+		warn("rename %s/%s -> %s", hj_log_path, tmpfile, path);
+		(void)unlinkat(dirfd, tmpfile, 0);
+		return (-1);
+	}
+	return (0);
+}
+
+/* write_atomic -C */
+static int
+out_write(int dirfd, struct hj_out *out, struct buf *data)
+{
+	int written;
+
+	written = 0;
+	if (out_same(dirfd, out, data))
+		goto done;
+	if (write_atomic(dirfd, out->path, data->data, data->len) == -1)
+		return (-1);
+	written = 1;
+done:
+	/* Keep it to compare with next time. */
+	buf_free(&out->prev);
+	out->prev = *data;
+	out->have_prev = true;
+	*data = (struct buf){ 0 };
+	return (written);
+}
+
+/*
+ * Log what changed other than the full lines of the ports lists, which
+ * file_add_line() did: a line still being written, the builders and
+ * everything else.
+ */
+static void
+events_state(struct buf *data)
+{
+	struct hj_file *hf;
+	const char *p, *end, *nl;
+	size_t i;
+
+	for (i = 0; i < hj_nfiles; i++) {
+		hf = hj_files[i];
+		if (hf->kind != HJ_PORTS || hf->partial.len == 0 ||
+		    (hf->partial.len == hf->partial_sent.len &&
+		    memcmp(hf->partial.data, hf->partial_sent.data,
+		    hf->partial.len) == 0))
+			continue;
+		if (hj_events) {
+			data->len = 0;
+			ports_line_json(data, hf->pstatus, hf->partial.data,
+			    hf->partial.len);
+			if (hj_oom)
+				return;
+			event_port(hf, hf->nlines, data->data, data->len);
+		}
+		hf->partial_sent.len = 0;
+		buf_cat(&hf->partial_sent, hf->partial.data, hf->partial.len);
+	}
+	out_build(&hj_state, data);
+	if (hj_oom)
+		return;
+	data->len--;
+	if (!hj_state.have_prev || data->len != hj_state.prev.len ||
+	    memcmp(data->data, hj_state.prev.data, data->len) != 0) {
+		if (hj_events) {
+			event_start("state");
+			buf_puts(&hj_events_buf, ",\"data\":");
+			buf_cat(&hj_events_buf, data->data, data->len);
+			buf_puts(&hj_events_buf, "}\n");
+		}
+		hj_state.prev.len = 0;
+		buf_cat(&hj_state.prev, data->data, data->len);
+		hj_state.have_prev = true;
+	}
+
+	hj_state.json.len = 0;
+	buf_puts(&hj_state.json, "[");
+	for (i = 0; i < hj_nfiles; i++) {
+		hf = hj_files[i];
+		if (hf->kind != HJ_JOBS)
+			continue;
+		end = hf->lines.data + hf->lines.len;
+		for (p = hf->lines.data; p < end; p = nl + 1) {
+			nl = memchr(p, '\n', end - p);
+			jobs_line_json(&hj_state.json, hf, p, nl - p);
+		}
+		if (hf->partial.len > 0)
+			jobs_line_json(&hj_state.json, hf, hf->partial.data,
+			    hf->partial.len);
+	}
+	buf_puts(&hj_state.json, "]");
+	data->len = 0;
+	buf_cat_json(data, hj_state.json.data, hj_state.json.len);
+	if (hj_oom)
+		return;
+	if (data->len != hj_jobs_prev.len ||
+	    memcmp(data->data, hj_jobs_prev.data, data->len) != 0) {
+		if (hj_events) {
+			event_start("jobs");
+			buf_puts(&hj_events_buf, ",\"jobs\":");
+			buf_cat(&hj_events_buf, data->data, data->len);
+			buf_puts(&hj_events_buf, "}\n");
+		}
+		hj_jobs_prev.len = 0;
+		buf_cat(&hj_jobs_prev, data->data, data->len);
+	}
+}
+
+/*
+ * Append the pending events to .data.events.  The log is started over when
+ * it would be bigger than .data.json since a reader that far behind is
+ * better off fetching that.  Returns 1 if the log changed.
+ */
+static int
+events_flush(int dirfd)
+{
+	const char *p;
+	size_t len;
+	ssize_t n;
+	int fd;
+
+	if (!hj_events || hj_events_size + (off_t)hj_events_buf.len >
+	    (off_t)MAX(HJ_EVENTS_MIN, hj_full.prev.len)) {
+		hj_events_buf.len = 0;
+		event_start("restart");
+		buf_puts(&hj_events_buf, "}\n");
+		if (hj_oom)
+			return (-1);
+		if (write_atomic(dirfd, HJ_EVENTS, hj_events_buf.data,
+		    hj_events_buf.len) == -1) {
+			hj_events = false;
+			hj_events_buf.len = 0;
+			return (-1);
+		}
+		hj_events = true;
+		hj_events_size = hj_events_buf.len;
+		hj_events_last = 0;
+		hj_events_buf.len = 0;
+		return (1);
+	}
+	if (hj_events_buf.len == 0)
+		return (0);
+	if ((fd = openat(dirfd, HJ_EVENTS, O_WRONLY | O_APPEND |
+	    O_CLOEXEC)) == -1) {
+		warn("open %s/%s", hj_log_path, HJ_EVENTS);
+		hj_events = false;
+		return (-1);
+	}
+	for (p = hj_events_buf.data, len = hj_events_buf.len; len > 0;
+	    p += n, len -= n) {
+		if ((n = write(fd, p, len)) == -1) {
+			if (errno == EINTR) {
+				n = 0;
+				continue;
+			}
+			warn("write %s/%s", hj_log_path, HJ_EVENTS);
+			close(fd);
+			/* Start over next time. */
+			hj_events = false;
+			hj_events_buf.len = 0;
+			return (-1);
+		}
+	}
+	close(fd);
+	for (len = hj_events_buf.len - 1; len > 0 &&
+	    hj_events_buf.data[len - 1] != '\n'; len--)
+		continue;
+	hj_events_last = hj_events_size + len;
+	hj_events_size += hj_events_buf.len;
+	hj_events_buf.len = 0;
+	return (1);
+}
+
+static void
+state_free(void)
+{
+	size_t i;
+
+	for (i = 0; i < hj_nfiles; i++)
+		file_free(hj_files[i]);
+	free(hj_files);
+	hj_files = NULL;
+	hj_nfiles = 0;
+	skipped_clear();
+	buf_free(&hj_full.prev);
+	buf_free(&hj_mini.prev);
+	buf_free(&hj_state.prev);
+	hj_full.have_prev = hj_mini.have_prev = hj_state.have_prev = false;
+	buf_free(&hj_events_buf);
+	buf_free(&hj_jobs_prev);
+	hj_events = false;
+	hj_seq = 0;
+	hj_events_size = hj_events_last = 0;
+	free(hj_log_path);
+	hj_log_path = NULL;
+}
+
+/*
+ * html_json [-e] [-s var_return] log_path
+ * Write log_path/.data.json and .data.mini.json from the .poudriere.*
+ * files.  With -e the changes since the last call are appended to
+ * .data.events.  With -s var_return is set to some stats about the update.
+ */
+int
+html_jsoncmd(int argc, char **argv)
+{
+	static const char usage[] = "Usage: html_json [-e] [-s var_return] "
+	    "log_path";
+	struct hj_out *outs[] = { &hj_full, &hj_mini };
+	struct hj_stats stats = {0};
+	struct buf data = {0};
+	struct stat st;
+	const char *var_return;
+	char statbuf[128];
+	size_t i;
+	int ch, dirfd, ret, wret, eret;
+	bool eflag;
+
+	var_return = NULL;
+	eflag = false;
+	while ((ch = getopt(argc, argv, "es:")) != -1) {
+		switch (ch) {
+		case 'e':
+			eflag = true;
+			break;
+		case 's':
+			var_return = optarg;
+			break;
+		default:
+			errx(EX_USAGE, "%s", usage);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 1)
+		errx(EX_USAGE, "%s", usage);
+
+	if ((dirfd = open(argv[0], O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+		err(EX_NOINPUT, "%s", argv[0]);
+	INTOFF;
+	ret = 0;
+	hj_oom = false;
+	if (hj_log_path == NULL || strcmp(hj_log_path, argv[0]) != 0) {
+		state_free();
+		if ((hj_log_path = strdup(argv[0])) == NULL)
+			hj_oom = true;
+	}
+	if (!eflag)
+		hj_events = false;
+	if (!hj_oom && !files_update(dirfd, &stats) && !hj_oom) {
+		warn("readdir %s", argv[0]);
+		ret = 1;
+		goto out;
+	}
+	/* Before .data.json so that it has the new log offset. */
+	eret = 0;
+	if (eflag && !hj_oom) {
+		events_state(&data);
+		if (!hj_oom && (eret = events_flush(dirfd)) == -1)
+			ret = 1;
+	}
+	for (i = 0; i < nitems(outs) && !hj_oom; i++) {
+		/* Nothing to do if no file changed since the last write. */
+		if (stats.changed == 0 && eret == 0 && outs[i]->have_prev &&
+		    fstatat(dirfd, outs[i]->path, &st, 0) == 0)
+			continue;
+		out_build(outs[i], &data);
+		if (hj_oom)
+			break;
+		if ((wret = out_write(dirfd, outs[i], &data)) == -1)
+			ret = 1;
+		else
+			stats.written += wret;
+	}
+	if (var_return != NULL) {
+		snprintf(statbuf, sizeof(statbuf),
+		    "files=%zu changed=%zu reread=%zu read=%ju written=%d",
+		    stats.files, stats.changed, stats.reread, stats.bytes,
+		    stats.written);
+		if (setvarsafe(var_return, statbuf, 0))
+			ret = 1;
+	}
+out:
+	buf_free(&data);
+	if (hj_oom) {
+		/* Start over next time. */
+		state_free();
+		buf_free(&hj_full.json);
+		buf_free(&hj_mini.json);
+		buf_free(&hj_state.json);
+		close(dirfd);
+		INTON;
+		errx(EX_OSERR, "%s", "out of memory");
+	}
+	close(dirfd);
+	INTON;
+	return (ret);
+}
@@ -24,8 +24,11 @@
  * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
  * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
  */
+#include <sys/event.h>
+
 #include <assert.h>
 #include <stdbool.h>
+#include <string.h>
 
 static bool
 job_has_pid(const struct job *jp, pid_t pid)
@@ -307,3 +310,369 @@ bad:
 	INTON;
 	return (1);
 }
+
+/*
+ * Wait until fd is readable or any of the given jobs has exited.
+ * This lets a job dispatcher react to both job-done notifications
+ * written to a pipe and jobs that died without writing one, without
+ * polling.
+ * Returns 0 if fd is readable, 1 if a job exited (or had already),
+ * 142 on timeout, like read -t, and 128+sig if interrupted.
+ */
+int
+jobs_wait_fdcmd(int argc __unused, char *argv[] __unused)
+{
+	struct kevent *changes, *events;
+	struct timespec ts, *tsp;
+	struct job *jp;
+	char **ap;
+	bool exited;
+	int ch, fd, jobno, kq, nchanges, nevents, ret;
+
+	tsp = NULL;
+	while ((ch = nextopt("t:")) != '\0') {
+		switch (ch) {
+		case 't':
+			ts.tv_sec = number(shoptarg);
+			ts.tv_nsec = 0;
+			tsp = &ts;
+			break;
+		}
+	}
+	if (argptr[0] == NULL || argptr[1] == NULL)
+		error("Usage: jobs_wait_fd [-t timeout] fd %%job...");
+	fd = number(*argptr++);
+	nchanges = 1;
+	for (ap = argptr; *ap != NULL; ap++) {
+		if ((*ap)[0] != '%')
+			error("jobs_wait_fd: Only %%job is supported");
+		jobno = number(*ap + 1);
+		if (jobno < 1 || jobno > njobs)
+			error("Invalid jobno");
+		nchanges += jobtab[jobno - 1].nprocs;
+	}
+	INTOFF;
+	/* Ensure job status updates. */
+	checkzombies();
+	changes = ckmalloc(sizeof(*changes) * nchanges);
+	events = ckmalloc(sizeof(*events) * nchanges);
+	nchanges = 0;
+	EV_SET(&changes[nchanges++], fd, EVFILT_READ, EV_ADD, 0, 0, NULL);
+	exited = false;
+	for (ap = argptr; *ap != NULL && !exited; ap++) {
+		jp = jobtab + number(*ap + 1) - 1;
+		if (jp->used == 0 || jp->nprocs == 0)
+			continue;
+		if (jp->state != 0) {
+			exited = true;
+			break;
+		}
+		for (int n = 0; n < jp->nprocs; n++) {
+			if (jp->ps[n].status != -1)
+				continue;
+			EV_SET(&changes[nchanges++], jp->ps[n].pid,
+			    EVFILT_PROC, EV_ADD, NOTE_EXIT, 0, NULL);
+		}
+	}
+	if ((kq = kqueue()) == -1) {
+		ckfree(changes);
+		ckfree(events);
+		INTON;
+		error("kqueue: %s", strerror(errno));
+	}
+	/*
+	 * Register one at a time so that a process which already exited
+	 * (ESRCH) is noticed rather than failing the whole set.
+	 */
+	for (int n = 0; n < nchanges && !exited; n++) {
+		if (kevent(kq, &changes[n], 1, NULL, 0, NULL) == 0)
+			continue;
+		if (errno == ESRCH && changes[n].filter == EVFILT_PROC) {
+			exited = true;
+			break;
+		}
+		close(kq);
+		ckfree(changes);
+		ckfree(events);
+		INTON;
+		error("kevent: %s", strerror(errno));
+	}
+	if (exited) {
+		/*
+		 * Still poll the fd; its notification is preferred over
+		 * collecting the exited job.
+		 */
+		if (kevent(kq, &changes[0], 1, NULL, 0, NULL) == -1) {
+			close(kq);
+			ckfree(changes);
+			ckfree(events);
+			INTON;
+			error("kevent: %s", strerror(errno));
+		}
+		ts.tv_sec = 0;
+		ts.tv_nsec = 0;
+		tsp = &ts;
+	}
+	nevents = kevent(kq, NULL, 0, events, nchanges, tsp);
+	if (nevents == -1) {
+		if (errno != EINTR) {
+			close(kq);
+			ckfree(changes);
+			ckfree(events);
+			INTON;
+			error("kevent: %s", strerror(errno));
+		}
+		ret = pendingsig != 0 ? 128 + pendingsig : 1;
+	} else if (nevents == 0) {
+		ret = exited ? 1 : 142;
+	} else {
+		/* Prefer the fd so that its data is consumed first. */
+		ret = 1;
+		for (int n = 0; n < nevents; n++) {
+			if (events[n].filter == EVFILT_READ) {
+				ret = 0;
+				break;
+			}
+		}
+	}
+	close(kq);
+	ckfree(changes);
+	ckfree(events);
+	if (ret == 1)
+		checkzombies();
+	INTON;
+	return (ret);
+}
+
+/*
+ * A bounded pool of background jobs for parallel_run().  A slot is
+ * refilled as soon as wait(2) finds one of the jobs has exited rather
+ * than the jobs writing to a fifo and the pool polling jobs(1).
+ *
+ *   parallel_pool start max
+ *   parallel_pool add %job slot
+ *   parallel_pool get slot_var ret_var
+ *   parallel_pool wait ret_var
+ *   parallel_pool jobs var
+ *   parallel_pool stop
+ *
+ * get blocks until a slot is free.  get and wait set ret_var to the last
+ * non-zero status, in the order the jobs were added, of the jobs they
+ * collected.  They return 128+sig if interrupted; nothing collected is
+ * lost and the next call reports it.
+ */
+struct pool_job {
+	int jobidx;
+	pid_t pid;
+	int slot;
+};
+
+static struct pool_job *pool;
+static bool *pool_busy;
+static int pool_max, pool_n, pool_status;
+
+/* Whether the job is done.  A job waited on elsewhere counts as done. */
+static bool
+pool_job_done(const struct pool_job *pj)
+{
+	const struct job *jp;
+
+	if (pj->jobidx >= njobs)
+		return (true);
+	jp = jobtab + pj->jobidx;
+	if (!jp->used || jp->nprocs == 0 || jp->ps[0].pid != pj->pid)
+		return (true);
+	return (jp->state == JOBDONE);
+}
+
+/* Free the done job, as wait does, and return its status. */
+static int
+pool_job_collect(const struct pool_job *pj)
+{
+	struct job *jp;
+	int status;
+
+	if (pj->jobidx >= njobs)
+		return (0);
+	jp = jobtab + pj->jobidx;
+	if (!jp->used || jp->nprocs == 0 || jp->ps[0].pid != pj->pid)
+		return (0);
+	status = getjobstatus(jp);
+	if (!iflag || !jp->changed)
+		freejob(jp);
+	else {
+		jp->remembered = 0;
+		deljob(jp);
+		if (jp == bgjob)
+			bgjob = NULL;
+	}
+	if (WIFEXITED(status))
+		return (WEXITSTATUS(status));
+	return (WTERMSIG(status) + 128);
+}
+
+/* Collect the done jobs, in the order they were added. */
+static int
+pool_reap(void)
+{
+	int i, n, reaped, status;
+
+	INTOFF;
+	reaped = 0;
+	for (i = n = 0; i < pool_n; i++) {
+		if (!pool_job_done(&pool[i])) {
+			pool[n++] = pool[i];
+			continue;
+		}
+		status = pool_job_collect(&pool[i]);
+		if (status != 0)
+			pool_status = status;
+		pool_busy[pool[i].slot] = false;
+		reaped++;
+	}
+	pool_n = n;
+	INTON;
+	return (reaped);
+}
+
+/*
+ * Wait for any child to exit.  Returns 128+sig if interrupted.  With no
+ * children left everything is marked done.
+ */
+static int
+pool_wait_child(void)
+{
+	int sig;
+
+	if (dowait(DOWAIT_BLOCK | DOWAIT_SIG, NULL) != -1)
+		return (0);
+	if (errno == ECHILD) {
+		for (int i = 0; i < pool_n; i++)
+			pool[i].jobidx = njobs;
+		return (0);
+	}
+	sig = pendingsig_waitcmd;
+	pendingsig_waitcmd = 0;
+	return (128 + sig);
+}
+
+static void
+pool_setstatus(const char *var)
+{
+	char buf[16];
+
+	fmtstr(buf, sizeof(buf), "%d", pool_status);
+	pool_status = 0;
+	setvar(var, buf, 0);
+}
+
+int
+parallel_poolcmd(int argc, char *argv[])
+{
+	struct pool_job *pj;
+	struct job *jp;
+	char buf[16];
+	const char *cmd;
+	char *p;
+	int i, jobno, ret, slot;
+	bool done;
+
+	if (argc < 2)
+		goto usage;
+	cmd = argv[1];
+	if (strcmp(cmd, "start") == 0 && argc == 3) {
+		i = number(argv[2]);
+		if (i < 1)
+			error("parallel_pool: Invalid max: %s", argv[2]);
+		INTOFF;
+		ckfree(pool);
+		ckfree(pool_busy);
+		pool_max = i;
+		pool_n = pool_status = 0;
+		pool = ckmalloc(sizeof(*pool) * pool_max);
+		pool_busy = ckmalloc(sizeof(*pool_busy) * (pool_max + 1));
+		memset(pool_busy, 0, sizeof(*pool_busy) * (pool_max + 1));
+		INTON;
+		return (0);
+	}
+	if (strcmp(cmd, "stop") == 0 && argc == 2) {
+		INTOFF;
+		ckfree(pool);
+		ckfree(pool_busy);
+		pool = NULL;
+		pool_busy = NULL;
+		pool_max = pool_n = pool_status = 0;
+		INTON;
+		return (0);
+	}
+	if (pool == NULL)
+		error("parallel_pool: Not started");
+	if (strcmp(cmd, "add") == 0 && argc == 4) {
+		if (argv[2][0] != '%')
+			error("parallel_pool: Only %%job is supported");
+		jobno = number(argv[2] + 1);
+		slot = number(argv[3]);
+		if (jobno < 1 || jobno > njobs)
+			error("Invalid jobno");
+		if (slot < 1 || slot > pool_max || pool_busy[slot])
+			error("parallel_pool: Invalid slot: %s", argv[3]);
+		if (pool_n == pool_max)
+			error("parallel_pool: Pool is full");
+		jp = jobtab + jobno - 1;
+		if (!jp->used || jp->nprocs == 0)
+			error("parallel_pool: Job %s not found", argv[2]);
+		INTOFF;
+		pj = &pool[pool_n++];
+		pj->jobidx = jobno - 1;
+		pj->pid = jp->ps[0].pid;
+		pj->slot = slot;
+		pool_busy[slot] = true;
+		INTON;
+		return (0);
+	}
+	if (strcmp(cmd, "get") == 0 && argc == 4) {
+		while (pool_n == pool_max) {
+			checkzombies();
+			if (pool_reap() > 0)
+				break;
+			if ((ret = pool_wait_child()) != 0)
+				return (ret);
+		}
+		for (slot = 1; pool_busy[slot]; slot++)
+			;
+		fmtstr(buf, sizeof(buf), "%d", slot);
+		setvar(argv[2], buf, 0);
+		pool_setstatus(argv[3]);
+		return (0);
+	}
+	if (strcmp(cmd, "wait") == 0 && argc == 3) {
+		/* Wait for all so that the status is in the added order. */
+		for (;;) {
+			checkzombies();
+			done = true;
+			for (i = 0; i < pool_n && done; i++)
+				done = pool_job_done(&pool[i]);
+			if (done)
+				break;
+			if ((ret = pool_wait_child()) != 0)
+				return (ret);
+		}
+		pool_reap();
+		pool_setstatus(argv[2]);
+		return (0);
+	}
+	if (strcmp(cmd, "jobs") == 0 && argc == 3) {
+		STARTSTACKSTR(p);
+		for (i = 0; i < pool_n; i++) {
+			fmtstr(buf, sizeof(buf), "%s%%%d", i == 0 ? "" : " ",
+			    pool[i].jobidx + 1);
+			STPUTS(buf, p);
+		}
+		STPUTC('\0', p);
+		setvar(argv[2], stackblock(), 0);
+		return (0);
+	}
+usage:
+	error("Usage: parallel_pool start max | add %%job slot | "
+	    "get slot_var ret_var | wait ret_var | jobs var | stop");
+}
@@ -0,0 +1,150 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include <sys/types.h>
+
+#include <assert.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "helpers.h"
+#include "var.h"
+
+/*
+ * Return 1 if dfd/name is an empty directory, 0 if it is a non-empty
+ * directory and -1 if it is not a directory or has gone away.
+ */
+static int
+subdir_empty(int dfd, const char *name)
+{
+	struct dirent *ent;
+	DIR *d;
+	int fd, ret;
+
+	assert(is_int_on());
+	fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+	if (fd == -1)
+		return (-1);
+	if ((d = fdopendir(fd)) == NULL) {
+		close(fd);
+		return (-1);
+	}
+	ret = 1;
+	while ((ent = readdir(d)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 ||
+		    strcmp(ent->d_name, "..") == 0)
+			continue;
+		ret = 0;
+		break;
+	}
+	closedir(d);
+	return (ret);
+}
+
+/*
+ * Find the first empty directory directly inside of bucket. The caller
+ * must free the returned path.
+ */
+static char *
+bucket_find_ready(const char *bucket)
+{
+	struct dirent *ent;
+	DIR *d;
+	char *found;
+
+	assert(is_int_on());
+	found = NULL;
+	if ((d = opendir(bucket)) == NULL) {
+		/* Same as find -ignore_readdir_race */
+		if (errno == ENOENT)
+			return (NULL);
+		INTON;
+		err(EXIT_FAILURE, "opendir: %s", bucket);
+	}
+	while ((ent = readdir(d)) != NULL) {
+		if (strcmp(ent->d_name, ".") == 0 ||
+		    strcmp(ent->d_name, "..") == 0)
+			continue;
+		switch (ent->d_type) {
+		case DT_DIR:
+		case DT_UNKNOWN:
+			break;
+		default:
+			continue;
+		}
+		if (subdir_empty(dirfd(d), ent->d_name) != 1)
+			continue;
+		if (asprintf(&found, "%s/%s", bucket, ent->d_name) == -1) {
+			closedir(d);
+			INTON;
+			errx(EX_OSERR, "%s", "asprintf");
+		}
+		break;
+	}
+	closedir(d);
+	return (found);
+}
+
+/*
+ * This is a replacement for:
+ *   find bucket... -type d -depth 1 -empty -print -quit
+ * which pkgqueue_get_next() otherwise forks for every dispatch.
+ * Buckets are searched in the given order.
+ */
+int
+pkgqueue_find_readycmd(int argc, char **argv)
+{
+	const char *var_return;
+	char *found;
+	int ret;
+
+	if (argc < 3)
+		errx(EX_USAGE, "%s",
+		    "Usage: pkgqueue_find_ready var_return bucket...");
+	var_return = argv[1];
+	found = NULL;
+	INTOFF;
+	for (int i = 2; i < argc && found == NULL; i++)
+		found = bucket_find_ready(argv[i]);
+	ret = setvarsafe(var_return, found != NULL ? found : "", 0) ? 1 :
+	    found == NULL ? 1 : 0;
+	free(found);
+	INTON;
+	return (ret);
+}
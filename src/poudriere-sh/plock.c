@@ -0,0 +1,858 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+/*
+ * A lock service for lock_acquire() and slock_acquire() that queues
+ * waiters fairly in front of locked_mkdir.  Every lock in a directory
+ * lives in one mmap(2)ed file, with a slot per lock name.  Slots nobody
+ * holds or waits for are reused for new names once the file is full.
+ *
+ * Each slot is a ticket lock.  A waiter takes the next ticket and holds
+ * a fcntl(2) byte lock on the byte for its ticket for as long as it is
+ * queued or owns the lock.  It then sleeps in F_SETLKW on the byte of
+ * the ticket before it, so waiters are woken one at a time and in the
+ * order they queued.  The kernel drops the byte locks of a process that
+ * exits, so a waiter is also woken when the one before it died; it then
+ * waits on the ticket before that, and takes the lock over from an owner
+ * that died holding it.  Taking a ticket is serialized by a byte lock of
+ * its own so that a ticket's byte is always locked before anyone queues
+ * behind it.
+ *
+ * Each slot also counts acquires, contention, timeouts, stale owners and
+ * the time spent waiting for and holding the lock, for plock_stats.
+ *
+ * fcntl(2) locks belong to the process and are all dropped when it
+ * closes any descriptor for the file, so the file is kept open for as
+ * long as this process holds a lock in it.
+ */
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "helpers.h"
+#include "trap.h"
+
+#define PLOCK_MAGIC		0x6b6c7070	/* "pplk" */
+#define PLOCK_VERSION		1
+#define PLOCK_NSLOTS		256
+#define PLOCK_NAMESIZ		128
+/* Lock files and held locks this process keeps track of. */
+#define PLOCK_MAXFILES		4
+#define PLOCK_MAXHELD		64
+/*
+ * The byte locks: the header while the file is set up, the names while
+ * slots are claimed, then a byte per slot to take a ticket, then 2^32
+ * bytes per slot for the tickets.
+ */
+#define PLOCK_OFF_INIT		0
+#define PLOCK_OFF_NAMES		1
+#define PLOCK_OFF_TICKET(idx)	((off_t)1 << 32 | (off_t)(idx))
+#define PLOCK_OFF_NODE(idx, t)	((off_t)1 << 40 | (off_t)(idx) << 32 | \
+				    (off_t)((t) & UINT32_MAX))
+
+enum plock_state {
+	SLOT_FREE,
+	SLOT_CLAIMING,
+	SLOT_NAMED,
+};
+
+struct plock_header {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t nslots;
+	uint32_t slotsize;
+};
+
+struct plock_slot {
+	_Atomic uint32_t state;
+	/* Pid of the owner, or 0 once released. */
+	_Atomic int32_t owner;
+	/* The next ticket to hand out. */
+	_Atomic uint64_t tail;
+	/* The ticket that owns the lock. */
+	_Atomic uint64_t serving;
+	_Atomic uint64_t acquired_ns;
+	_Atomic uint64_t acquires;
+	_Atomic uint64_t contended;
+	_Atomic uint64_t timeouts;
+	_Atomic uint64_t stale;
+	_Atomic uint64_t wait_ns;
+	_Atomic uint64_t wait_max_ns;
+	_Atomic uint64_t hold_ns;
+	_Atomic uint64_t hold_max_ns;
+	char name[PLOCK_NAMESIZ];
+};
+
+struct plock_file {
+	dev_t dev;
+	ino_t ino;
+	int fd;
+	size_t size;
+	struct plock_header *hdr;
+	struct plock_slot *slots;
+};
+
+struct plock_held {
+	struct plock_file *pf;
+	struct plock_slot *slot;
+	pid_t pid;
+	uint64_t ticket;
+	uint64_t acquired_ns;
+};
+
+static struct plock_file files[PLOCK_MAXFILES];
+static struct plock_held held[PLOCK_MAXHELD];
+static volatile sig_atomic_t timed_out;
+static struct sigaction oact;
+static struct sigdata oinfo;
+static int did_sigalrm;
+
+static uint64_t
+plock_hash(const char *name, size_t namelen)
+{
+	uint64_t hash;
+
+	/* FNV-1a */
+	hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < namelen; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+static uint64_t
+plock_now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec);
+}
+
+static void
+plock_max(_Atomic uint64_t *max, uint64_t value)
+{
+	uint64_t cur;
+
+	cur = atomic_load_explicit(max, memory_order_relaxed);
+	while (cur < value && !atomic_compare_exchange_weak_explicit(max,
+	    &cur, value, memory_order_relaxed, memory_order_relaxed))
+		;
+}
+
+static int
+plock_byte(int fd, int cmd, short type, off_t off)
+{
+	struct flock fl;
+
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = type;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = off;
+	fl.l_len = 1;
+	return (fcntl(fd, cmd, &fl));
+}
+
+static void
+plock_unlock(int fd, off_t off)
+{
+	int serrno;
+
+	serrno = errno;
+	(void)plock_byte(fd, F_SETLK, F_UNLCK, off);
+	errno = serrno;
+}
+
+static size_t
+plock_size(void)
+{
+	return (sizeof(struct plock_header) +
+	    sizeof(struct plock_slot) * PLOCK_NSLOTS);
+}
+
+static bool
+plock_file_held(const struct plock_file *pf)
+{
+	pid_t pid;
+
+	pid = getpid();
+	for (size_t i = 0; i < nitems(held); i++) {
+		if (held[i].pf == pf && held[i].pid == pid)
+			return (true);
+	}
+	return (false);
+}
+
+/* Only safe if this process holds no lock in it. */
+static void
+plock_file_close(struct plock_file *pf)
+{
+	assert(is_int_on());
+	for (size_t i = 0; i < nitems(held); i++) {
+		/* Locks held by the process this was forked from. */
+		if (held[i].pf == pf)
+			held[i].pf = NULL;
+	}
+	if (pf->hdr != NULL)
+		munmap(pf->hdr, pf->size);
+	if (pf->fd != -1)
+		close(pf->fd);
+	memset(pf, 0, sizeof(*pf));
+	pf->fd = -1;
+}
+
+/*
+ * Map the lock file at path, reusing the existing mapping if it is the
+ * same file.  Returns NULL with errno ENOENT if the file does not exist
+ * and create is false.
+ */
+static struct plock_file *
+plock_open(const char *path, bool create)
+{
+	struct plock_header hdr;
+	struct plock_file *pf;
+	struct stat st;
+	void *addr;
+	int fd, newfd, serrno;
+
+	assert(is_int_on());
+	if (stat(path, &st) == -1) {
+		if (errno != ENOENT || !create)
+			return (NULL);
+	} else {
+		for (size_t i = 0; i < nitems(files); i++) {
+			if (files[i].hdr != NULL &&
+			    files[i].dev == st.st_dev &&
+			    files[i].ino == st.st_ino)
+				return (&files[i]);
+		}
+	}
+	pf = NULL;
+	for (size_t i = 0; i < nitems(files); i++) {
+		if (files[i].hdr == NULL) {
+			pf = &files[i];
+			break;
+		}
+	}
+	if (pf == NULL) {
+		for (size_t i = 0; i < nitems(files); i++) {
+			if (!plock_file_held(&files[i])) {
+				pf = &files[i];
+				plock_file_close(pf);
+				break;
+			}
+		}
+	}
+	if (pf == NULL) {
+		errno = EMFILE;
+		return (NULL);
+	}
+	fd = open(path, (create ? O_CREAT : 0) | O_RDWR | O_CLOEXEC, 0644);
+	if (fd == -1)
+		return (NULL);
+	/* sh has <=10 reserved. */
+	if (fd < 10) {
+		if ((newfd = fcntl(fd, F_DUPFD_CLOEXEC, 10)) == -1)
+			goto error;
+		close(fd);
+		fd = newfd;
+	}
+	if (plock_byte(fd, F_SETLKW, F_WRLCK, PLOCK_OFF_INIT) == -1)
+		goto error;
+	if (fstat(fd, &st) == -1)
+		goto error_unlock;
+	if (st.st_size == 0) {
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic = PLOCK_MAGIC;
+		hdr.version = PLOCK_VERSION;
+		hdr.nslots = PLOCK_NSLOTS;
+		hdr.slotsize = sizeof(struct plock_slot);
+		if (ftruncate(fd, plock_size()) == -1)
+			goto error_unlock;
+		if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+			goto error_unlock;
+	} else if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto error_unlock;
+	plock_unlock(fd, PLOCK_OFF_INIT);
+	if (hdr.magic != PLOCK_MAGIC || hdr.version != PLOCK_VERSION ||
+	    hdr.nslots != PLOCK_NSLOTS ||
+	    hdr.slotsize != sizeof(struct plock_slot)) {
+		close(fd);
+		errno = EFTYPE;
+		return (NULL);
+	}
+	addr = mmap(NULL, plock_size(), PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+	pf->fd = fd;
+	pf->dev = st.st_dev;
+	pf->ino = st.st_ino;
+	pf->size = plock_size();
+	pf->hdr = addr;
+	pf->slots = (struct plock_slot *)(pf->hdr + 1);
+	return (pf);
+error_unlock:
+	plock_unlock(fd, PLOCK_OFF_INIT);
+error:
+	serrno = errno;
+	close(fd);
+	errno = serrno;
+	return (NULL);
+}
+
+static struct plock_held *
+plock_held_find(const struct plock_file *pf, const struct plock_slot *slot)
+{
+	pid_t pid;
+
+	pid = getpid();
+	for (size_t i = 0; i < nitems(held); i++) {
+		if (held[i].pf == pf && held[i].slot == slot &&
+		    held[i].pid == pid)
+			return (&held[i]);
+	}
+	return (NULL);
+}
+
+static struct plock_held *
+plock_held_alloc(void)
+{
+	pid_t pid;
+
+	pid = getpid();
+	for (size_t i = 0; i < nitems(held); i++) {
+		/* Or left over from the process this was forked from. */
+		if (held[i].pf == NULL || held[i].pid != pid)
+			return (&held[i]);
+	}
+	return (NULL);
+}
+
+/*
+ * Look for the slot for name without taking the names lock.  This may
+ * miss a slot that is being claimed or renamed.
+ */
+static struct plock_slot *
+plock_lookup(struct plock_file *pf, const char *name, uint64_t hash)
+{
+	struct plock_slot *slot;
+	uint32_t state;
+
+	for (uint32_t i = 0; i < pf->hdr->nslots; i++) {
+		slot = &pf->slots[(hash + i) % pf->hdr->nslots];
+		state = atomic_load_explicit(&slot->state,
+		    memory_order_acquire);
+		if (state == SLOT_FREE)
+			break;
+		if (state == SLOT_NAMED && strcmp(slot->name, name) == 0)
+			return (slot);
+	}
+	return (NULL);
+}
+
+/*
+ * If nobody holds or is queued for the slot return true with its ticket
+ * byte held so that nobody can queue for it until it is renamed.
+ */
+static bool
+plock_slot_idle(struct plock_file *pf, struct plock_slot *slot)
+{
+	struct flock fl;
+	size_t idx;
+
+	idx = slot - pf->slots;
+	/* F_GETLK does not report our own locks. */
+	if (plock_held_find(pf, slot) != NULL)
+		return (false);
+	if (plock_byte(pf->fd, F_SETLK, F_WRLCK, PLOCK_OFF_TICKET(idx)) == -1)
+		return (false);
+	/* Every holder and waiter has the byte for its ticket locked. */
+	memset(&fl, 0, sizeof(fl));
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	fl.l_start = PLOCK_OFF_NODE(idx, 0);
+	fl.l_len = (off_t)1 << 32;
+	if (fcntl(pf->fd, F_GETLK, &fl) == -1 || fl.l_type != F_UNLCK) {
+		plock_unlock(pf->fd, PLOCK_OFF_TICKET(idx));
+		return (false);
+	}
+	return (true);
+}
+
+/* Give the slot to name, starting its queue and stats over. */
+static void
+plock_slot_name(struct plock_slot *slot, const char *name, size_t namelen)
+{
+	atomic_store_explicit(&slot->state, SLOT_CLAIMING,
+	    memory_order_release);
+	/* Nobody is queued on it, see plock_slot_idle(). */
+	memset((char *)slot + offsetof(struct plock_slot, owner), 0,
+	    offsetof(struct plock_slot, name) -
+	    offsetof(struct plock_slot, owner));
+	memcpy(slot->name, name, namelen + 1);
+	atomic_store_explicit(&slot->state, SLOT_NAMED, memory_order_release);
+}
+
+/*
+ * Find the slot for name, claiming one for it if needed.  Slots are
+ * claimed and renamed only while holding the names lock.  Once the table
+ * is full a slot that nobody holds or is queued for is renamed, so the
+ * names of past builds do not fill it up.  Returns NULL with ENOSPC if
+ * every slot is in use.
+ */
+static struct plock_slot *
+plock_find(struct plock_file *pf, const char *name)
+{
+	struct plock_slot *slot, *claim;
+	size_t namelen;
+	uint64_t hash;
+	uint32_t state;
+	int serrno;
+
+	namelen = strlen(name);
+	if (namelen >= PLOCK_NAMESIZ) {
+		errno = ENAMETOOLONG;
+		return (NULL);
+	}
+	hash = plock_hash(name, namelen);
+	if ((slot = plock_lookup(pf, name, hash)) != NULL)
+		return (slot);
+	while (plock_byte(pf->fd, F_SETLKW, F_WRLCK, PLOCK_OFF_NAMES) == -1) {
+		if (errno != EINTR || pendingsig != 0)
+			return (NULL);
+	}
+	claim = NULL;
+	for (uint32_t i = 0; i < pf->hdr->nslots; i++) {
+		slot = &pf->slots[(hash + i) % pf->hdr->nslots];
+		state = atomic_load_explicit(&slot->state,
+		    memory_order_acquire);
+		if (state == SLOT_NAMED) {
+			if (strcmp(slot->name, name) == 0)
+				goto done;
+			continue;
+		}
+		/* A claim left by a process that died holding the lock. */
+		if (claim == NULL)
+			claim = slot;
+		if (state == SLOT_FREE)
+			break;
+	}
+	if (claim != NULL) {
+		slot = claim;
+		plock_slot_name(slot, name, namelen);
+		goto done;
+	}
+	slot = NULL;
+	for (uint32_t i = 0; i < pf->hdr->nslots; i++) {
+		if (plock_slot_idle(pf, &pf->slots[i])) {
+			slot = &pf->slots[i];
+			plock_slot_name(slot, name, namelen);
+			plock_unlock(pf->fd, PLOCK_OFF_TICKET(i));
+			break;
+		}
+	}
+	if (slot == NULL)
+		errno = ENOSPC;
+done:
+	serrno = errno;
+	plock_unlock(pf->fd, PLOCK_OFF_NAMES);
+	errno = serrno;
+	return (slot);
+}
+
+/* Give up a queued ticket, passing the lock on if its turn came. */
+static void
+plock_abandon(struct plock_file *pf, struct plock_slot *slot, size_t idx,
+    uint64_t ticket)
+{
+	uint64_t serving;
+
+	serving = ticket;
+	(void)atomic_compare_exchange_strong_explicit(&slot->serving,
+	    &serving, ticket + 1, memory_order_release,
+	    memory_order_relaxed);
+	plock_unlock(pf->fd, PLOCK_OFF_NODE(idx, ticket));
+}
+
+/*
+ * Lock the byte at off, retrying if interrupted by a signal that is not
+ * for us.
+ */
+static int
+plock_byte_wait(int fd, int cmd, off_t off)
+{
+	for (;;) {
+		if (timed_out)
+			break;
+		if (plock_byte(fd, cmd, F_WRLCK, off) == 0)
+			return (0);
+		if (errno != EINTR || timed_out || pendingsig != 0)
+			return (-1);
+	}
+	errno = EINTR;
+	return (-1);
+}
+
+/*
+ * Queue for the lock and wait until it is ours.  cmd is F_SETLK to give
+ * up rather than wait.  Returns -1 with the lock not held on error, with
+ * ESTALE if the slot was given to another name meanwhile.
+ */
+static int
+plock_queue(struct plock_file *pf, struct plock_slot *slot, const char *name,
+    int cmd, uint64_t *ticketp, bool *contendedp)
+{
+	uint64_t serving, ticket, k;
+	size_t idx;
+
+	idx = slot - pf->slots;
+	if (plock_byte_wait(pf->fd, F_SETLKW, PLOCK_OFF_TICKET(idx)) == -1)
+		return (-1);
+	if (atomic_load_explicit(&slot->state, memory_order_acquire) !=
+	    SLOT_NAMED || strcmp(slot->name, name) != 0) {
+		plock_unlock(pf->fd, PLOCK_OFF_TICKET(idx));
+		errno = ESTALE;
+		return (-1);
+	}
+	ticket = atomic_fetch_add_explicit(&slot->tail, 1,
+	    memory_order_acq_rel);
+	/* Nobody else can want this byte yet. */
+	if (plock_byte(pf->fd, F_SETLK, F_WRLCK,
+	    PLOCK_OFF_NODE(idx, ticket)) == -1) {
+		plock_abandon(pf, slot, idx, ticket);
+		plock_unlock(pf->fd, PLOCK_OFF_TICKET(idx));
+		return (-1);
+	}
+	plock_unlock(pf->fd, PLOCK_OFF_TICKET(idx));
+	/*
+	 * Every ticket from k on, up to ours, has let go of its byte and
+	 * so released, given up or died.  The lock is ours once every
+	 * ticket before k is done as well.
+	 */
+	k = ticket;
+	for (;;) {
+		serving = atomic_load_explicit(&slot->serving,
+		    memory_order_acquire);
+		if (serving >= k)
+			break;
+		*contendedp = true;
+		if (plock_byte_wait(pf->fd, cmd,
+		    PLOCK_OFF_NODE(idx, k - 1)) == -1) {
+			plock_abandon(pf, slot, idx, ticket);
+			return (-1);
+		}
+		plock_unlock(pf->fd, PLOCK_OFF_NODE(idx, k - 1));
+		k--;
+	}
+	/* Skip past any tickets that gave up or died. */
+	if (serving != ticket)
+		atomic_store_explicit(&slot->serving, ticket,
+		    memory_order_release);
+	*ticketp = ticket;
+	return (0);
+}
+
+/*
+ * Signal handler for SIGALRM.
+ */
+static void
+sig_timeout(int sig __unused)
+{
+
+	timed_out = 1;
+}
+
+static void
+plock_cleanup(void)
+{
+	int serrno;
+
+	serrno = errno;
+	if (did_sigalrm == 1) {
+		alarm(0);
+		sigaction(SIGALRM, &oact, NULL);
+		did_sigalrm = 0;
+	}
+	trap_pop(SIGINFO, &oinfo);
+	errno = serrno;
+}
+
+static struct plock_file *
+plock_open_or_err(const char *cmd, const char *path, bool create)
+{
+	struct plock_file *pf;
+
+	assert(is_int_on());
+	if ((pf = plock_open(path, create)) == NULL &&
+	    (create || errno != ENOENT)) {
+		INTON;
+		err(EXIT_FAILURE, "%s: %s", cmd, path);
+	}
+	return (pf);
+}
+
+/*
+ * plock_acquire waittime lockfile name
+ * Returns 124 if the lock was not acquired within waittime seconds, or
+ * at once if waittime is 0, and 128+sig if interrupted by a signal.
+ * Returns 69 (EX_UNAVAILABLE) if there is no slot for name.
+ */
+int
+plock_acquirecmd(int argc, char **argv)
+{
+	struct sigaction act;
+	struct plock_file *pf;
+	struct plock_slot *slot;
+	struct plock_held *h;
+	const char *name;
+	char *end;
+	uint64_t start, now, ticket, waited;
+	pid_t pid, stale;
+	int waitsec, ret, serrno;
+	bool contended;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: plock_acquire waittime lockfile "
+		    "name");
+	errno = 0;
+	waitsec = strtol(argv[1], &end, 10);
+	if (waitsec < 0 || *end != '\0' || errno != 0)
+		errx(EX_USAGE, "%s: bad waittime", argv[1]);
+	name = argv[3];
+	INTOFF;
+	pf = plock_open_or_err("plock_acquire", argv[2], true);
+	if ((h = plock_held_alloc()) == NULL) {
+		INTON;
+		errx(EXIT_FAILURE, "plock_acquire: %s: too many locks held",
+		    name);
+	}
+	if ((slot = plock_find(pf, name)) == NULL)
+		goto no_slot;
+	if (plock_held_find(pf, slot) != NULL) {
+		INTON;
+		errx(EXIT_FAILURE, "plock_acquire: %s: already held", name);
+	}
+	trap_push(SIGINFO, &oinfo);
+	timed_out = 0;
+	if (waitsec > 0) {
+		act.sa_handler = sig_timeout;
+		sigemptyset(&act.sa_mask);
+		/* No SA_RESTART so that F_SETLKW is interrupted. */
+		act.sa_flags = 0;
+		did_sigalrm = 1;
+		sigaction(SIGALRM, &act, &oact);
+		alarm(waitsec);
+	}
+	start = plock_now();
+	contended = false;
+	while ((ret = plock_queue(pf, slot, name,
+	    waitsec > 0 ? F_SETLKW : F_SETLK, &ticket, &contended)) == -1 &&
+	    errno == ESTALE) {
+		if ((slot = plock_find(pf, name)) == NULL)
+			break;
+	}
+	serrno = errno;
+	plock_cleanup();
+	if (slot == NULL) {
+		errno = serrno;
+		goto no_slot;
+	}
+	now = plock_now();
+	waited = now - start;
+	if (contended) {
+		atomic_fetch_add_explicit(&slot->contended, 1,
+		    memory_order_relaxed);
+		atomic_fetch_add_explicit(&slot->wait_ns, waited,
+		    memory_order_relaxed);
+		plock_max(&slot->wait_max_ns, waited);
+	}
+	if (ret == -1) {
+		if (timed_out || serrno == EAGAIN || serrno == EACCES) {
+			atomic_fetch_add_explicit(&slot->timeouts, 1,
+			    memory_order_relaxed);
+			INTON;
+			return (124);
+		}
+		if (serrno == EINTR && pendingsig != 0) {
+			ret = 128 + pendingsig;
+			INTON;
+			return (ret);
+		}
+		INTON;
+		errno = serrno;
+		/* EDEADLK: another lock we hold is wanted by the owner. */
+		if (errno == EDEADLK) {
+			warn("plock_acquire: %s", name);
+			return (EX_TEMPFAIL);
+		}
+		err(EX_OSERR, "plock_acquire: %s", name);
+	}
+	pid = getpid();
+	stale = atomic_exchange_explicit(&slot->owner, pid,
+	    memory_order_acq_rel);
+	/* The owner before us died without releasing it. */
+	if (stale != 0)
+		atomic_fetch_add_explicit(&slot->stale, 1,
+		    memory_order_relaxed);
+	atomic_store_explicit(&slot->acquired_ns, now, memory_order_relaxed);
+	atomic_fetch_add_explicit(&slot->acquires, 1, memory_order_relaxed);
+	h->pf = pf;
+	h->slot = slot;
+	h->pid = pid;
+	h->ticket = ticket;
+	h->acquired_ns = now;
+	INTON;
+	return (0);
+no_slot:
+	serrno = errno;
+	if (serrno == EINTR && pendingsig != 0) {
+		ret = 128 + pendingsig;
+		INTON;
+		return (ret);
+	}
+	INTON;
+	errno = serrno;
+	/* The caller can fall back to locked_mkdir. */
+	if (errno == ENOSPC || errno == ENAMETOOLONG)
+		return (EX_UNAVAILABLE);
+	err(EXIT_FAILURE, "plock_acquire: %s", name);
+}
+
+/*
+ * plock_release lockfile name
+ */
+int
+plock_releasecmd(int argc, char **argv)
+{
+	struct plock_held *h;
+	struct plock_slot *slot;
+	struct stat st;
+	const char *name;
+	uint64_t hold;
+	pid_t pid;
+	bool have_st;
+
+	if (argc != 3)
+		errx(EX_USAGE, "%s", "Usage: plock_release lockfile name");
+	name = argv[2];
+	INTOFF;
+	/* The lock file may already be gone along with its directory. */
+	have_st = stat(argv[1], &st) == 0;
+	pid = getpid();
+	h = NULL;
+	for (size_t i = 0; i < nitems(held); i++) {
+		if (held[i].pf == NULL || held[i].pid != pid ||
+		    strcmp(held[i].slot->name, name) != 0)
+			continue;
+		if (have_st && (held[i].pf->dev != st.st_dev ||
+		    held[i].pf->ino != st.st_ino))
+			continue;
+		h = &held[i];
+		break;
+	}
+	if (h == NULL) {
+		INTON;
+		errx(EXIT_FAILURE, "plock_release: %s: not held", name);
+	}
+	slot = h->slot;
+	hold = plock_now() - h->acquired_ns;
+	atomic_fetch_add_explicit(&slot->hold_ns, hold, memory_order_relaxed);
+	plock_max(&slot->hold_max_ns, hold);
+	atomic_store_explicit(&slot->owner, 0, memory_order_relaxed);
+	atomic_store_explicit(&slot->serving, h->ticket + 1,
+	    memory_order_release);
+	plock_unlock(h->pf->fd, PLOCK_OFF_NODE(slot - h->pf->slots,
+	    h->ticket));
+	h->pf = NULL;
+	h->slot = NULL;
+	INTON;
+	return (0);
+}
+
+/*
+ * plock_stats lockfile
+ * Print a line for each lock:
+ *   name acquires contended timeouts stale wait_ms wait_max_ms hold_ms
+ *   hold_max_ms owner
+ */
+int
+plock_statscmd(int argc, char **argv)
+{
+	struct plock_file *pf;
+	struct plock_slot *slot;
+
+	if (argc != 2)
+		errx(EX_USAGE, "%s", "Usage: plock_stats lockfile");
+	INTOFF;
+	if ((pf = plock_open_or_err("plock_stats", argv[1], false)) == NULL) {
+		INTON;
+		return (0);
+	}
+	for (uint32_t i = 0; i < pf->hdr->nslots; i++) {
+		slot = &pf->slots[i];
+		if (atomic_load_explicit(&slot->state, memory_order_acquire) !=
+		    SLOT_NAMED)
+			continue;
+		printf("%s %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+		    " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %d\n",
+		    slot->name,
+		    atomic_load(&slot->acquires),
+		    atomic_load(&slot->contended),
+		    atomic_load(&slot->timeouts),
+		    atomic_load(&slot->stale),
+		    atomic_load(&slot->wait_ns) / 1000000,
+		    atomic_load(&slot->wait_max_ns) / 1000000,
+		    atomic_load(&slot->hold_ns) / 1000000,
+		    atomic_load(&slot->hold_max_ns) / 1000000,
+		    (int)atomic_load(&slot->owner));
+	}
+	INTON;
+	return (0);
+}
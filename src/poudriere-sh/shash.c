@@ -0,0 +1,697 @@
+/*-
+ * SPDX-License-Identifier: BSD-2-Clause
+ *
+ * Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer
+ *    in this position and unchanged.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE AUTHOR(S) ``AS IS'' AND ANY EXPRESS OR
+ * IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED WARRANTIES
+ * OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE DISCLAIMED.
+ * IN NO EVENT SHALL THE AUTHOR(S) BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT
+ * NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF
+ * THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * A shared hash table in a single mmap(2)ed file.  This is the backend
+ * for shared_hash.sh when SHASH_BACKEND=mmap.
+ *
+ * The file is a header, a fixed array of bucket heads and an append-only
+ * arena of entries.  Entries are never modified once published.  A set
+ * or unset allocates a new entry from the arena with an atomic add and
+ * then publishes it by a compare-and-swap of the bucket head.  The
+ * newest entry for a name in a chain shadows older ones, and an unset
+ * is a deleted entry.  Readers only follow the chains so they need no
+ * locking at all.  The arena is never compacted; the file only lives
+ * as long as the SHASH_VAR_PATH it is in.
+ *
+ * The file is sparse, so only the buckets and arena actually used take
+ * up space.
+ */
+
+#include <sys/types.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sysexits.h>
+#include <unistd.h>
+
+#ifndef SHELL
+#error Only supported as a builtin
+#endif
+
+#include "bltin/bltin.h"
+#include "helpers.h"
+#include "trap.h"
+#include "var.h"
+
+/* external/sh/options.h */
+#define Cflag optval[11]
+
+#define SHASH_MAGIC		0x68736170	/* "pash" */
+#define SHASH_VERSION		1
+#define SHASH_NBUCKETS		(1 << 20)
+/* MiB, override with SHASH_MMAP_SIZE */
+#define SHASH_DEFAULT_SIZE	512
+#define SHASH_ALIGN(x)		(((x) + 7) & ~(uint64_t)7)
+
+#define SHASH_ENTRY_DELETED	0x1
+
+struct shash_header {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+	uint64_t nbuckets;
+	uint64_t data_start;
+	_Atomic uint64_t data_end;
+};
+
+struct shash_entry {
+	/* Offset of the next entry in the chain, 0 terminates. */
+	uint64_t next;
+	uint64_t valuelen;
+	uint32_t namelen;
+	uint32_t flags;
+	/* name NUL value */
+	char data[];
+};
+
+struct shash_db {
+	char *path;
+	dev_t dev;
+	ino_t ino;
+	int fd;
+	struct shash_header *hdr;
+	_Atomic uint64_t *buckets;
+};
+
+static struct shash_db db = { .fd = -1 };
+
+static uint64_t
+shash_hash(const char *name, size_t namelen)
+{
+	uint64_t hash;
+
+	/* FNV-1a */
+	hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < namelen; i++) {
+		hash ^= (unsigned char)name[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return (hash);
+}
+
+static inline struct shash_entry *
+shash_entry(uint64_t off)
+{
+	if (off == 0)
+		return (NULL);
+	return ((struct shash_entry *)((char *)db.hdr + off));
+}
+
+static inline const char *
+entry_value(const struct shash_entry *e)
+{
+	return (e->data + e->namelen + 1);
+}
+
+static void
+shash_db_close(void)
+{
+	assert(is_int_on());
+	if (db.hdr != NULL)
+		munmap(db.hdr, (size_t)db.hdr->size);
+	if (db.fd != -1)
+		close(db.fd);
+	free(db.path);
+	db.path = NULL;
+	db.hdr = NULL;
+	db.buckets = NULL;
+	db.fd = -1;
+}
+
+static uint64_t
+shash_db_size(void)
+{
+	const char *val;
+	char *end;
+	unsigned long long mb;
+
+	mb = SHASH_DEFAULT_SIZE;
+	if ((val = lookupvar("SHASH_MMAP_SIZE")) != NULL && val[0] != '\0') {
+		errno = 0;
+		mb = strtoull(val, &end, 10);
+		if (errno != 0 || *end != '\0' || mb == 0)
+			mb = SHASH_DEFAULT_SIZE;
+	}
+	return ((uint64_t)mb * 1024 * 1024);
+}
+
+/*
+ * Initialize a new file. The caller holds an exclusive flock(2).
+ */
+static int
+shash_db_init(int fd)
+{
+	struct shash_header hdr;
+	uint64_t size, data_start;
+
+	assert(is_int_on());
+	size = shash_db_size();
+	data_start = SHASH_ALIGN(sizeof(hdr) +
+	    sizeof(uint64_t) * SHASH_NBUCKETS);
+	if (size < data_start * 2)
+		size = data_start * 2;
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.magic = SHASH_MAGIC;
+	hdr.version = SHASH_VERSION;
+	hdr.size = size;
+	hdr.nbuckets = SHASH_NBUCKETS;
+	hdr.data_start = data_start;
+	atomic_init(&hdr.data_end, data_start);
+	if (ftruncate(fd, size) == -1)
+		return (-1);
+	if (pwrite(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return (-1);
+	return (0);
+}
+
+/*
+ * Map the db at path, reusing the existing mapping if it is the same file.
+ * Returns 1 if the file does not exist and create is false.
+ */
+static int
+shash_db_open(const char *path, bool create)
+{
+	struct shash_header hdr;
+	struct stat st;
+	void *addr;
+	int fd, serrno;
+
+	assert(is_int_on());
+	if (stat(path, &st) == -1) {
+		if (errno != ENOENT)
+			return (-1);
+		if (!create)
+			return (1);
+	} else if (db.hdr != NULL && st.st_dev == db.dev &&
+	    st.st_ino == db.ino) {
+		return (0);
+	}
+	shash_db_close();
+	fd = open(path, (create ? O_CREAT : 0) | O_RDWR | O_CLOEXEC, 0644);
+	if (fd == -1) {
+		if (errno == ENOENT && !create)
+			return (1);
+		return (-1);
+	}
+	if (flock(fd, LOCK_EX) == -1)
+		goto error;
+	if (fstat(fd, &st) == -1)
+		goto error;
+	if (st.st_size == 0) {
+		if (shash_db_init(fd) == -1)
+			goto error;
+	}
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr))
+		goto error;
+	(void)flock(fd, LOCK_UN);
+	if (hdr.magic != SHASH_MAGIC || hdr.version != SHASH_VERSION) {
+		close(fd);
+		errno = EFTYPE;
+		return (-1);
+	}
+	addr = mmap(NULL, hdr.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    fd, 0);
+	if (addr == MAP_FAILED)
+		goto error;
+	if ((db.path = strdup(path)) == NULL) {
+		munmap(addr, hdr.size);
+		goto error;
+	}
+	db.fd = fd;
+	db.dev = st.st_dev;
+	db.ino = st.st_ino;
+	db.hdr = addr;
+	db.buckets = (_Atomic uint64_t *)(db.hdr + 1);
+	return (0);
+error:
+	serrno = errno;
+	close(fd);
+	errno = serrno;
+	return (-1);
+}
+
+static const struct shash_entry *
+chain_lookup(uint64_t head, const char *name, size_t namelen)
+{
+	const struct shash_entry *e;
+
+	for (e = shash_entry(head); e != NULL; e = shash_entry(e->next)) {
+		if (e->namelen == namelen &&
+		    memcmp(e->data, name, namelen) == 0)
+			return (e);
+	}
+	return (NULL);
+}
+
+/* Find the live entry for name, or NULL. */
+static const struct shash_entry *
+shash_lookup(const char *name)
+{
+	const struct shash_entry *e;
+	size_t namelen;
+	uint64_t head;
+
+	namelen = strlen(name);
+	head = atomic_load_explicit(&db.buckets[shash_hash(name, namelen) %
+	    db.hdr->nbuckets], memory_order_acquire);
+	e = chain_lookup(head, name, namelen);
+	if (e == NULL || (e->flags & SHASH_ENTRY_DELETED) != 0)
+		return (NULL);
+	return (e);
+}
+
+/*
+ * Add an entry for name. With noclobber fail with EEXIST if it
+ * already has a live entry.
+ */
+static int
+shash_insert(const char *name, const char *value, size_t valuelen,
+    bool addnl, uint32_t flags, bool noclobber)
+{
+	struct shash_entry *e;
+	const struct shash_entry *found;
+	_Atomic uint64_t *bucket;
+	size_t namelen;
+	uint64_t off, len, head;
+
+	namelen = strlen(name);
+	len = SHASH_ALIGN(sizeof(*e) + namelen + 1 + valuelen +
+	    (addnl ? 1 : 0) + 1);
+	off = atomic_fetch_add_explicit(&db.hdr->data_end, len,
+	    memory_order_relaxed);
+	if (off + len > db.hdr->size) {
+		errno = ENOSPC;
+		return (-1);
+	}
+	e = shash_entry(off);
+	e->namelen = namelen;
+	e->flags = flags;
+	e->valuelen = valuelen + (addnl ? 1 : 0);
+	memcpy(e->data, name, namelen + 1);
+	memcpy(e->data + namelen + 1, value, valuelen);
+	if (addnl)
+		e->data[namelen + 1 + valuelen] = '\n';
+	e->data[namelen + 1 + e->valuelen] = '\0';
+	bucket = &db.buckets[shash_hash(name, namelen) % db.hdr->nbuckets];
+	head = atomic_load_explicit(bucket, memory_order_acquire);
+	do {
+		/*
+		 * Any concurrent writer to this name must change the head
+		 * of this same chain, so rechecking after a failed CAS is
+		 * enough for noclobber.
+		 */
+		if (noclobber) {
+			found = chain_lookup(head, name, namelen);
+			if (found != NULL &&
+			    (found->flags & SHASH_ENTRY_DELETED) == 0) {
+				errno = EEXIST;
+				return (-1);
+			}
+		}
+		e->next = head;
+	} while (!atomic_compare_exchange_weak_explicit(bucket, &head, off,
+	    memory_order_release, memory_order_acquire));
+	return (0);
+}
+
+static bool
+has_glob(const char *s)
+{
+	return (strpbrk(s, "*?[") != NULL);
+}
+
+static int
+name_cmp(const void *a, const void *b)
+{
+	const struct shash_entry *ea = *(const struct shash_entry * const *)a;
+	const struct shash_entry *eb = *(const struct shash_entry * const *)b;
+
+	return (strcmp(ea->data, eb->data));
+}
+
+/*
+ * Collect the live entries matching the glob pattern, sorted by name
+ * like sh(1) globbing would. The caller must free *matchesp.
+ */
+static size_t
+shash_glob(const char *pattern, const struct shash_entry ***matchesp)
+{
+	const struct shash_entry **matches, *e, *newest;
+	size_t nmatches, matchessize;
+	uint64_t head;
+
+	assert(is_int_on());
+	matches = NULL;
+	nmatches = matchessize = 0;
+	for (uint64_t b = 0; b < db.hdr->nbuckets; b++) {
+		head = atomic_load_explicit(&db.buckets[b],
+		    memory_order_acquire);
+		for (e = shash_entry(head); e != NULL;
+		    e = shash_entry(e->next)) {
+			if (fnmatch(pattern, e->data, 0) != 0)
+				continue;
+			/* Only the newest entry for a name counts. */
+			newest = chain_lookup(head, e->data, e->namelen);
+			if (newest != e ||
+			    (e->flags & SHASH_ENTRY_DELETED) != 0)
+				continue;
+			if (nmatches == matchessize) {
+				matchessize = matchessize == 0 ? 8 :
+				    matchessize * 2;
+				matches = realloc(matches,
+				    sizeof(*matches) * matchessize);
+				if (matches == NULL) {
+					INTON;
+					errx(EX_OSERR, "%s", "realloc");
+				}
+			}
+			matches[nmatches++] = e;
+		}
+	}
+	if (nmatches > 1)
+		qsort(matches, nmatches, sizeof(*matches), name_cmp);
+	*matchesp = matches;
+	return (nmatches);
+}
+
+static char *
+shash_name(const char *var, const char *key)
+{
+	char *name;
+
+	assert(is_int_on());
+	if (asprintf(&name, "%s%%%s", var, key) == -1) {
+		INTON;
+		errx(EX_OSERR, "%s", "asprintf");
+	}
+	return (name);
+}
+
+static void
+db_open_or_err(const char *cmd, const char *path, bool create, int *ret)
+{
+	int error;
+
+	assert(is_int_on());
+	error = shash_db_open(path, create);
+	if (error == -1) {
+		INTON;
+		err(EXIT_FAILURE, "%s: %s", cmd, path);
+	}
+	*ret = error;
+}
+
+int
+shash_mmap_getcmd(int argc, char **argv)
+{
+	const struct shash_entry **matches, *e;
+	const char *var_return;
+	char *name, *result, *p;
+	size_t nmatches, resultlen, len;
+	int ret;
+
+	if (argc != 5)
+		errx(EX_USAGE, "%s", "Usage: shash_mmap_get db var key "
+		    "var_return|-");
+	var_return = argv[4];
+	INTOFF;
+	db_open_or_err("shash_mmap_get", argv[1], false, &ret);
+	if (ret == 1) {
+		ret = 1;
+		nmatches = 0;
+		matches = NULL;
+		goto out;
+	}
+	name = shash_name(argv[2], argv[3]);
+	if (has_glob(argv[3])) {
+		nmatches = shash_glob(name, &matches);
+	} else {
+		matches = malloc(sizeof(*matches));
+		if (matches == NULL) {
+			free(name);
+			INTON;
+			errx(EX_OSERR, "%s", "malloc");
+		}
+		e = shash_lookup(name);
+		nmatches = 0;
+		if (e != NULL)
+			matches[nmatches++] = e;
+	}
+	free(name);
+	ret = nmatches > 0 ? 0 : 1;
+out:
+	if (strcmp(var_return, "-") == 0) {
+		for (size_t i = 0; i < nmatches; i++)
+			outbin(entry_value(matches[i]), matches[i]->valuelen,
+			    out1);
+		free(matches);
+		INTON;
+		return (ret);
+	}
+	/*
+	 * Like readlines_file: each value's lines are joined by newline,
+	 * skipping leading blank lines. Multiple values are joined by space.
+	 */
+	resultlen = 0;
+	for (size_t i = 0; i < nmatches; i++)
+		resultlen += matches[i]->valuelen + 1;
+	if ((result = malloc(resultlen + 1)) == NULL) {
+		free(matches);
+		INTON;
+		errx(EX_OSERR, "%s", "malloc");
+	}
+	p = result;
+	for (size_t i = 0; i < nmatches; i++) {
+		const char *line, *nl, *end;
+		char *start;
+
+		if (p != result)
+			*p++ = ' ';
+		start = p;
+		line = entry_value(matches[i]);
+		end = line + matches[i]->valuelen;
+		while (line < end) {
+			if ((nl = memchr(line, '\n', end - line)) == NULL)
+				nl = end;
+			len = nl - line;
+			if (p != start)
+				*p++ = '\n';
+			memcpy(p, line, len);
+			p += len;
+			line = nl + 1;
+		}
+	}
+	*p = '\0';
+	free(matches);
+	if (setvarsafe(var_return, result, 0))
+		ret = 1;
+	free(result);
+	INTON;
+	return (ret);
+}
+
+int
+shash_mmap_existscmd(int argc, char **argv)
+{
+	const struct shash_entry **matches;
+	char *name;
+	int ret;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: shash_mmap_exists db var key");
+	INTOFF;
+	db_open_or_err("shash_mmap_exists", argv[1], false, &ret);
+	if (ret == 1) {
+		INTON;
+		return (1);
+	}
+	name = shash_name(argv[2], argv[3]);
+	if (has_glob(argv[3])) {
+		ret = shash_glob(name, &matches) > 0 ? 0 : 1;
+		free(matches);
+	} else {
+		ret = shash_lookup(name) != NULL ? 0 : 1;
+	}
+	free(name);
+	INTON;
+	return (ret);
+}
+
+/*
+ * Read all of stdin. If tee is set also copy it to stdout, adding a
+ * missing trailing newline like mapfile_write does.
+ */
+static char *
+read_stdin(bool tee, size_t *lenp)
+{
+	char *data;
+	size_t len, size;
+	ssize_t n;
+
+	assert(is_int_on());
+	size = 8192;
+	len = 0;
+	if ((data = malloc(size)) == NULL) {
+		INTON;
+		errx(EX_OSERR, "%s", "malloc");
+	}
+	for (;;) {
+		if (len == size) {
+			size *= 2;
+			if ((data = reallocf(data, size)) == NULL) {
+				INTON;
+				errx(EX_OSERR, "%s", "realloc");
+			}
+		}
+		n = read(STDIN_FILENO, data + len, size - len);
+		if (n == -1) {
+			if (errno == EINTR && pendingsig == 0)
+				continue;
+			free(data);
+			INTON;
+			err(EXIT_FAILURE, "%s", "read");
+		}
+		if (n == 0)
+			break;
+		if (tee)
+			outbin(data + len, n, out1);
+		len += n;
+	}
+	if (tee && len > 0 && data[len - 1] != '\n')
+		out1c('\n');
+	*lenp = len;
+	return (data);
+}
+
+/*
+ * shash_mmap_set [-T] db var key [value]
+ * Without a value the value is read from stdin, like shash_write.
+ */
+int
+shash_mmap_setcmd(int argc, char **argv)
+{
+	const char *value;
+	char *name, *data;
+	size_t valuelen;
+	bool addnl, tee;
+	int ch, ret, serrno;
+
+	static const char usage[] = "Usage: shash_mmap_set [-T] db var key "
+	    "[value]";
+	tee = false;
+	while ((ch = getopt(argc, argv, "T")) != -1) {
+		switch (ch) {
+		case 'T':
+			tee = true;
+			break;
+		default:
+			errx(EX_USAGE, "%s", usage);
+		}
+	}
+	argc -= optind;
+	argv += optind;
+	if (argc != 3 && argc != 4)
+		errx(EX_USAGE, "%s", usage);
+	if (tee && Cflag)
+		errx(EX_USAGE, "%s", "shash_mmap_set: Teeing with noclobber "
+		    "cannot work");
+	INTOFF;
+	db_open_or_err("shash_mmap_set", argv[0], true, &ret);
+	data = NULL;
+	if (argc == 4) {
+		value = argv[3];
+		valuelen = strlen(value);
+		addnl = true;
+	} else {
+		data = read_stdin(tee, &valuelen);
+		value = data;
+		addnl = valuelen > 0 && data[valuelen - 1] != '\n';
+	}
+	name = shash_name(argv[1], argv[2]);
+	ret = shash_insert(name, value, valuelen, addnl, 0, Cflag != 0);
+	serrno = errno;
+	free(data);
+	free(name);
+	if (ret == -1) {
+		INTON;
+		errc(EXIT_FAILURE, serrno, "shash_mmap_set: %s%%%s", argv[1],
+		    argv[2]);
+	}
+	INTON;
+	return (0);
+}
+
+int
+shash_mmap_unsetcmd(int argc, char **argv)
+{
+	const struct shash_entry **matches;
+	char *name;
+	size_t nmatches;
+	int ret;
+
+	if (argc != 4)
+		errx(EX_USAGE, "%s", "Usage: shash_mmap_unset db var key");
+	INTOFF;
+	db_open_or_err("shash_mmap_unset", argv[1], false, &ret);
+	if (ret == 1) {
+		INTON;
+		return (0);
+	}
+	name = shash_name(argv[2], argv[3]);
+	ret = 0;
+	if (has_glob(argv[3])) {
+		/* Entries are immutable so the matched names stay valid. */
+		nmatches = shash_glob(name, &matches);
+		for (size_t i = 0; i < nmatches && ret == 0; i++)
+			ret = shash_insert(matches[i]->data, "", 0, false,
+			    SHASH_ENTRY_DELETED, false);
+		free(matches);
+	} else if (shash_lookup(name) != NULL) {
+		ret = shash_insert(name, "", 0, false, SHASH_ENTRY_DELETED,
+		    false);
+	}
+	free(name);
+	if (ret == -1) {
+		INTON;
+		err(EXIT_FAILURE, "shash_mmap_unset: %s%%%s", argv[2],
+		    argv[3]);
+	}
+	INTON;
+	return (0);
+}
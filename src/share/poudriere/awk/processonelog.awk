@@ -3,6 +3,8 @@
 # Originally factored out of portbuild's processonelog
 # not up-to-date with:
 # http://www.marcuscom.com:8080/cgi-bin/cvsweb.cgi/portstools/tinderbox/sql/values.{lp|pfp|pfr}
+#
+# Keep in sync with src/libexec/poudriere/processonelog/processonelog.c
 
 function found(reason) {
 	if (!REASON && !REASON_LAST) {
@@ -1384,14 +1384,48 @@ run_hook_file() {
 	return 0
 }
 
+# Are build logs written compressed with timestamp -z?  testport always
+# tees the log to the terminal so its logs are left plain.
+log_compressed() {
+	case "${LOG_COMPRESS-}" in
+	yes) ;;
+	*) return 1 ;;
+	esac
+	! was_a_testport_run
+}
+
+# Append the output of a command to a build log, compressing it if the
+# log is.  The command is run in the current shell.
+log_append() {
+	[ $# -ge 2 ] || eargs log_append logfile cmd ...
+	local la_logfile="$1"
+	shift
+	local la_tmpfile la_ret
+
+	if ! log_compressed; then
+		"$@" >> "${la_logfile}"
+		return
+	fi
+	_mktemp la_tmpfile || return
+	la_ret=0
+	"$@" > "${la_tmpfile:?}" || la_ret=$?
+	timestamp -T -z < "${la_tmpfile:?}" >> "${la_logfile}" || :
+	unlink "${la_tmpfile:?}"
+	return "${la_ret}"
+}
+
 log_start() {
 	[ $# -eq 2 ] || eargs log_start pkgname need_tee
 	local pkgname="$1"
 	local need_tee="$2"
-	local logfile
+	local logfile zflag
 	local -
 
 	_logfile logfile "${pkgname}"
+	zflag=
+	if [ ${need_tee} -eq 0 ] && log_compressed; then
+		zflag="-z"
+	fi
 
 	critical_start
 	# Save stdout/stderr for restoration later for bulk/testport -i
@@ -1400,7 +1434,8 @@ log_start() {
 	export OUTPUT_REDIRECTED_STDOUT=3
 	export OUTPUT_REDIRECTED_STDERR=4
 	# Pipe output to tee(1) or timestamp if needed.
-	if [ ${need_tee} -eq 1 ] || [ "${TIMESTAMP_LOGS}" = "yes" ]; then
+	if [ ${need_tee} -eq 1 ] || [ "${TIMESTAMP_LOGS}" = "yes" ] ||
+	    [ -n "${zflag}" ]; then
 		if [ ! -e ${logfile}.pipe ]; then
 			mkfifo ${logfile}.pipe
 		fi
@@ -1422,7 +1457,12 @@ log_start() {
 		elif [ "${TIMESTAMP_LOGS}" = "yes" ]; then
 			TIME_START="${TIME_START_JOB:-${TIME_START:-0}}" \
 			    _spawn_wrapper \
-			    timestamp ${TIMESTAMP_FLAGS-} \
+			    timestamp ${TIMESTAMP_FLAGS-} ${zflag} \
+			    > ${logfile} < ${logfile}.pipe &
+		else
+			# Compress only.
+			_spawn_wrapper \
+			    timestamp -T -z \
 			    > ${logfile} < ${logfile}.pipe &
 		fi
 		set +m
@@ -1722,6 +1762,20 @@ _pget() {
 	_attr_get "${_pg_outvar}" ports "$@"
 }
 
+# Return the build's attribute store in _bstore, or 1 if bset() should
+# use a file per property.
+_bstore() {
+	[ $# -eq 1 ] || eargs _bstore log
+	local log="$1"
+
+	case "${BSET_BACKEND}" in
+	mmap) ;;
+	*) return 1 ;;
+	esac
+	have_builtin bstore_set || return 1
+	_bstore="${log:?}/.poudriere.store%"
+}
+
 #build getter/setter
 _bget() {
 	local -; set +x
@@ -1729,6 +1783,7 @@ _bget() {
 	"") return 1 ;;
 	esac
 	local _bg_outvar id property mnt log file READ_FILE_USE_CAT file
+	local _bstore
 
 	_bg_outvar="$1"
 	_log_path log
@@ -1744,6 +1799,14 @@ _bget() {
 	"ports."*)
 		READ_FILE_USE_CAT=1
 		;;
+	*)
+		if [ -n "${_bg_outvar}" ] && _bstore "${log:?}" &&
+		    bstore_get "${_bstore:?}" "${file#.poudriere.}" \
+		    "${_bg_outvar}"; then
+			_read_file_lines_read=1
+			return 0
+		fi
+		;;
 	esac
 
 	read_file "${_bg_outvar}" "${log:?}/${file:?}"
@@ -1770,7 +1833,7 @@ bset() {
 	case "${POUDRIERE_BUILD_TYPE-}" in
 	"") return 1 ;;
 	esac
-	local id property mnt log file
+	local id property mnt log file _bstore
 
 	_log_path log
 	# Early error
@@ -1787,9 +1850,42 @@ bset() {
 		echo "$(clock -epoch):$*" >> "${log:?}/${file:?}.journal%" || :
 		;;
 	esac
+	if _bstore "${log:?}" &&
+	    bstore_set "${_bstore:?}" "${file#.poudriere.}" "$*"; then
+		# The build status file is also how logclean finds builds.
+		case "${id:+set}.${property}" in
+		".status") ;;
+		*) return 0 ;;
+		esac
+	fi
 	write_atomic "${log:?}/${file:?}" "$@"
 }
 
+# Write the values in the attribute store out to their .poudriere.* files
+# for anything still reading those.  With a log dir, export that build's
+# store if it has one; this is for builds killed before they could.
+bset_export() {
+	[ $# -le 1 ] || eargs bset_export '[log]'
+	local log="${1-}"
+	local _bstore
+
+	if [ -n "${log}" ]; then
+		have_builtin bstore_export || return 0
+		_bstore="${log}/.poudriere.store%"
+		[ -f "${_bstore}" ] || return 0
+		bstore_export "${_bstore}" "${log}"
+		return
+	fi
+	was_a_bulk_run || return 0
+	case "${POUDRIERE_BUILD_TYPE-}" in
+	"") return 1 ;;
+	esac
+	_log_path log
+	[ -d "${log:?}" ] || return 0
+	_bstore "${log:?}" || return 0
+	bstore_export "${_bstore:?}" "${log:?}"
+}
+
 job_build_status() {
 	[ "$#" -eq 3 ] || eargs job_build_status phase origingspec pkgname
 	local phase="$1"
@@ -1813,7 +1909,7 @@ bset_job_status() {
 }
 
 badd() {
-	local id property mnt log file
+	local id property mnt log file originspec
 	_log_path log
 	# Early error
 	[ -d "${log:?}" ] || return
@@ -1821,13 +1917,73 @@ badd() {
 		id=$1
 		shift
 	fi
-	file=.poudriere.${1}${id:+.${id}}
+	property="$1"
+	file=.poudriere.${property}${id:+.${id}}
 	shift
 	echo "$@" >> "${log:?}/${file:?}" || :
+	case "${property}" in
+	ports.skipped)
+		# Skipped may have duplicates in it.  Only count an origin
+		# the first time it is seen.
+		originspec="${1%% *}"
+		mkdir "${log:?}/${file:?}.seen%/${originspec%%/*}!${originspec#*/}" \
+		    2>/dev/null || return 0
+		;;
+	esac
+	case "${property}" in
+	ports.built|ports.failed|ports.ignored|ports.inspected|ports.skipped)
+		bstats_tally "${log:?}/${file:?}"
+		;;
+	esac
+}
+
+# Each of the ports.* lists that update_stats() counts has a tally file
+# which gets one byte appended for every entry.  The appends are atomic so
+# any process may add to it without a lock, and counting is just a stat(1)
+# of the tally's size rather than reading the whole list.  The '%' suffix
+# keeps these out of the .data.json.
+bstats_tally() {
+	[ "$#" -eq 1 ] || eargs bstats_tally list
+	local list="$1"
+
+	echo -n "." >> "${list:?}.tally%" || :
+}
+
+# Create the tallies from the current lists.  They are empty for a new
+# build but a resumed build needs to count what it already has.
+bstats_tally_init() {
+	[ "$#" -eq 0 ] || eargs bstats_tally_init
+	local log type list seen count
+
+	_log_path log
+	seen="${log:?}/.poudriere.ports.skipped.seen%"
+	rm -rf "${seen:?}"
+	mkdir -p "${seen:?}"
+	for type in built failed ignored inspected skipped; do
+		list="${log:?}/.poudriere.ports.${type}"
+		case "${type}" in
+		skipped)
+			awk '{print $1}' "${list:?}" 2>/dev/null |
+			    sort -u | sed -e 's,/,!,' |
+			    (cd "${seen:?}" && xargs -r mkdir -p) ||
+			    err 1 "bstats_tally_init: Failed to count ${list}"
+			count="$(find "${seen:?}" -mindepth 1 -maxdepth 1 | wc -l)"
+			count="$((count + 0))"
+			;;
+		*)
+			count_lines "${list:?}" count || count=0
+			;;
+		esac
+		: > "${list:?}.tally%"
+		if [ "${count}" -gt 0 ]; then
+			truncate -s "${count}" "${list:?}.tally%" ||
+			    err 1 "bstats_tally_init: Failed to set tally for ${list}"
+		fi
+	done
 }
 
 update_stats() {
-	local type unused scnt
+	local type unused scnt log tally
 	local -
 
 	set +e
@@ -1835,17 +1991,29 @@ update_stats() {
 	lock_acquire update_stats || return 1
 	critical_start
 
-	for type in built failed inspected ignored; do
-		critical_retry _bget '' "ports.${type}"
-		critical_retry bset "stats_${type}" "${_read_file_lines_read:?}"
+	_log_path log
+	for type in built failed inspected ignored skipped; do
+		tally="${log:?}/.poudriere.ports.${type}.tally%"
+		if [ -e "${tally}" ]; then
+			critical_retry_cmdsubst scnt \
+			    "\$(stat -f %z \"\${tally}\")"
+		else
+			case "${type}" in
+			skipped)
+				# Skipped may have duplicates in it
+				critical_retry_cmdsubst scnt \
+				    "\$(bget ports.skipped | awk '{print \$1}' | sort -u | wc -l)"
+				scnt="${scnt##* }"
+				;;
+			*)
+				critical_retry _bget '' "ports.${type}"
+				scnt="${_read_file_lines_read:?}"
+				;;
+			esac
+		fi
+		critical_retry bset "stats_${type}" "${scnt}"
 	done
 
-	# Skipped may have duplicates in it
-	critical_retry_cmdsubst scnt \
-	    "\$(bget ports.skipped | awk '{print \$1}' | sort -u | wc -l)"
-	scnt="${scnt##* }"
-	critical_retry bset stats_skipped "${scnt}"
-
 	lock_release update_stats
 	critical_end
 }
@@ -1985,6 +2153,7 @@ exit_handler() {
 			msg_warn "pkg_cacher exited with status $?"
 			EXIT_STATUS=$((EXIT_STATUS + 1))
 		}
+		coprocess_stop distfile_prefetch || :
 		coprocess_stop html_json ||
 		{
 			msg_warn "html_json exited with $?"
@@ -2006,6 +2175,7 @@ exit_handler() {
 	fi
 
 	if was_a_bulk_run; then
+		bset_export || :
 		log_stop
 	fi
 
@@ -2126,7 +2296,7 @@ show_dry_run_summary() {
 
 show_build_summary() {
 	local status nbb nbf nbs nbi nbin nbq nbp ndone nbremaining buildname
-	local log now elapsed buildtime nbtb dev_msg
+	local log now elapsed buildtime nbtb dev_msg eta idle
 
 	_bget status status || status=unknown
 	_log_path log
@@ -2169,6 +2339,19 @@ ${COLOR_RESET}Remaining: %d\n" \
 	    "${MASTERNAME}" "${buildname}" "${status%%:*}" "${buildtime}" \
 	    "${nbq}" "${nbin}" "${nbi}" "${nbb}" "${nbf}" "${nbs}" "${nbp}" \
 	    "${nbremaining}"
+	case "${nbremaining}" in
+	0|-*) ;;
+	*)
+		if history_estimate_remaining eta; then
+			calculate_duration eta "${eta}"
+			msg "Estimated time remaining: ${eta}"
+		fi
+		;;
+	esac
+	if _bget idle snap_builder_idle && [ "${idle}" -gt 0 ]; then
+		calculate_duration idle "${idle}"
+		msg "Builder idle time: ${idle}"
+	fi
 	case "${CRASHED:-0}" in
 	0) dev_msg="dev_err ${EX_SOFTWARE}" ;;
 	1) dev_msg="msg_warn" ;;
@@ -2618,9 +2801,6 @@ markfs() {
 	fi
 	(
 		trap - INT
-		# cd for 'mtree -p .' but do it early as MASTER_DATADIR is
-		# a relative path.
-		cd "${mnt}"
 		mtreefile="${MASTER_DATADIR}/mtree.${name}exclude${PORTTESTING}"
 		if [ ! -f "${mtreefile}" ]; then
 			{
@@ -2656,8 +2836,8 @@ markfs() {
 				esac
 			} | write_atomic "${mtreefile}"
 		fi
-		{ mtree -X "${mtreefile}" -cn -k uid,gid,flags,mode,size -p .; } \
-		    > "${MNT_DATADIR}/mtree.${name}"
+		fscheck -c -X "${mtreefile}" -p "${mnt:?}" \
+		    > "${MNT_DATADIR}/fsindex.${name}"
 	)
 	echo " done"
 }
@@ -5170,69 +5350,8 @@ check_leftovers() {
 	[ $# -eq 1 ] || eargs check_leftovers mnt
 	local mnt="${1}"
 
-	( cd "${mnt:?}" && \
-	    mtree -X "${MASTER_DATADIR:?}/mtree.preinstexclude${PORTTESTING}" \
-	    -f "${MNT_DATADIR:?}/mtree.preinst" -p . ) | \
-	    while mapfile_read_loop_redir l; do
-		local changed read_again
-
-		changed=
-		while :; do
-			read_again=0
-
-			# Handle leftover read from changed paths
-			case ${l} in
-			*extra|*missing|extra:*|*changed|*:*)
-				case "${changed:+set}" in
-				set)
-					echo "${changed}"
-					changed=
-					;;
-				esac
-				;;
-			esac
-			case ${l} in
-			*extra)
-				if [ -d "${mnt:?}/${l% *}" ]; then
-					find "${mnt:?}/${l% *}" -exec echo "+ {}" \;
-				else
-					echo "+ ${mnt:?}/${l% *}"
-				fi
-				;;
-			*missing)
-				l="${l#./}"
-				echo "- ${mnt:?}/${l% *}"
-				;;
-			*changed)
-				changed="M ${mnt:?}/${l% *}"
-				read_again=1
-				;;
-			extra:*)
-				if [ -d "${mnt:?}/${l#* }" ]; then
-					find "${mnt:?}/${l#* }" -exec echo "+ {}" \;
-				else
-					echo "+ ${mnt:?}/${l#* }"
-				fi
-				;;
-			*:*)
-				changed="M ${mnt:?}/${l%:*} ${l#*:}"
-				read_again=1
-				;;
-			*)
-				changed="${changed} ${l}"
-				read_again=1
-				;;
-			esac
-			# Need to read again to find all changes
-			if [ "${read_again}" -eq 1 ] && read l; then
-				continue
-			fi
-			case "${changed:+set}" in
-			set) echo "${changed}" ;;
-			esac
-			break
-		done
-	done
+	fscheck -X "${MASTER_DATADIR:?}/mtree.preinstexclude${PORTTESTING}" \
+	    -f "${MNT_DATADIR:?}/fsindex.preinst" -p "${mnt:?}"
 }
 
 check_fs_violation() {
@@ -5250,10 +5369,10 @@ check_fs_violation() {
 
 	tmpfile=$(mktemp -t check_fs_violation)
 	msg_n "${status_msg}..."
-	( cd "${mnt:?}" && \
-		mtree -X "${MASTER_DATADIR:?}/mtree.${mtree_target}exclude${PORTTESTING}" \
-		-f "${MNT_DATADIR:?}/mtree.${mtree_target}" \
-		-p . ) >> "${tmpfile:?}"
+	fscheck \
+	    -X "${MASTER_DATADIR:?}/mtree.${mtree_target}exclude${PORTTESTING}" \
+	    -f "${MNT_DATADIR:?}/fsindex.${mtree_target}" \
+	    -p "${mnt:?}" >> "${tmpfile:?}"
 	echo " done"
 
 	if [ -s "${tmpfile:?}" ]; then
@@ -5267,6 +5386,134 @@ check_fs_violation() {
 	return $ret
 }
 
+# Whether all of pkgname's distfiles are in the distfiles dir.
+distfiles_present() {
+	[ $# -eq 2 ] || eargs distfiles_present pkgname dir
+	local pkgname="$1"
+	local dir="$2"
+	local sub dists d
+
+	shash_get pkgname-dist_subdir "${pkgname}" sub || sub=
+	shash_get pkgname-dist_allfiles "${pkgname}" dists || dists=
+	for d in ${dists}; do
+		if [ ! -f "${dir:?}/${sub:+${sub}/}${d}" ]; then
+			return 1
+		fi
+	done
+	return 0
+}
+
+# Fetch and checksum pkgname's distfiles in the ref jail and copy them
+# into DISTFILES_CACHE before a builder gets to it.
+distfile_prefetch_pkg() {
+	[ $# -eq 1 ] || eargs distfile_prefetch_pkg pkgname
+	local pkgname="$1"
+	local originspec origin flavor subpkg portdir stage
+
+	if distfiles_present "${pkgname}" "${DISTFILES_CACHE:?}"; then
+		return 0
+	fi
+	get_originspec_from_pkgname originspec "${pkgname}"
+	originspec_decode "${originspec}" origin flavor subpkg
+	_lookup_portdir portdir "${origin}"
+	stage="${DATADIR_NAME:?}/prefetch/${pkgname:?}"
+	mkdir -p "${MASTERMNT:?}/${stage:?}"
+	# Only fetch what is missing.
+	gather_distfiles -l "${originspec}" "${pkgname}" \
+	    "${originspec}" "${pkgname}" \
+	    "${MASTERMNT:?}/distfiles" "${MASTERMNT:?}/${stage:?}" || :
+	if JNETNAME="n" cleanenv injail /usr/bin/env USER=root UID=0 GID=0 \
+	    /usr/bin/make -C "${portdir:?}" ${flavor:+FLAVOR=${flavor}} \
+	    DISTDIR="/${stage:?}" NO_DEPENDS=yes checksum \
+	    >/dev/null 2>&1 &&
+	    gather_distfiles "${originspec}" "${pkgname}" \
+	    "${originspec}" "${pkgname}" \
+	    "${MASTERMNT:?}/${stage:?}" "${DISTFILES_CACHE:?}"; then
+		echo "fetched ${pkgname}" >> \
+		    "${MASTER_DATADIR:?}/distfile_prefetch"
+	else
+		msg_verbose "Distfile prefetch failed for" \
+		    "${COLOR_PORT}${originspec} | ${pkgname}${COLOR_RESET}"
+		echo "failed ${pkgname}" >> \
+		    "${MASTER_DATADIR:?}/distfile_prefetch"
+	fi
+	rm -rf "${MASTERMNT:?}/${stage:?}"
+	return 0
+}
+
+# Background process started by parallel_build() which fetches the distfiles
+# of packages that are ready, or nearly ready, to build.
+distfile_prefetch_main() {
+	local jobs job job_type job_name
+	local PARALLEL_JOBS
+	local IFS -
+
+	set +e +u
+
+	setup_traps distfile_prefetch_cleanup
+	PARALLEL_JOBS="${PREFETCH_DISTFILES_JOBS:?}"
+	parallel_start || return
+	while :; do
+		jobs="$(pkgqueue_near_ready "${PREFETCH_DISTFILES_DEPS:?}")"
+		for job in ${jobs}; do
+			pkgqueue_job_decode "${job}" job_type job_name
+			case "${job_type}" in
+			"build") ;;
+			*) continue ;;
+			esac
+			if hash_isset distfile_prefetch_seen "${job_name}"; then
+				continue
+			fi
+			hash_set distfile_prefetch_seen "${job_name}" 1
+			parallel_run distfile_prefetch_pkg "${job_name}" || :
+		done
+		sleep 5
+	done
+}
+
+distfile_prefetch_cleanup() {
+	parallel_shutdown || :
+}
+
+# Record whether a build found its distfiles already fetched.
+distfile_prefetch_record() {
+	[ $# -eq 2 ] || eargs distfile_prefetch_record pkgname dir
+	local pkgname="$1"
+	local dir="$2"
+	local dists
+
+	shash_get pkgname-dist_allfiles "${pkgname}" dists || dists=
+	case "${dists:+set}" in
+	"") return 0 ;;
+	esac
+	if distfiles_present "${pkgname}" "${dir}"; then
+		echo "hit ${pkgname}"
+	else
+		echo "miss ${pkgname}"
+	fi >> "${MASTER_DATADIR:?}/distfile_prefetch"
+}
+
+# Report how many builds found their distfiles already fetched.
+distfile_prefetch_summary() {
+	[ $# -eq 0 ] || eargs distfile_prefetch_summary
+	local file="${MASTER_DATADIR:?}/distfile_prefetch"
+	local summary
+
+	[ -s "${file}" ] || return 0
+	summary="$(awk '
+	    { n[$1]++ }
+	    END {
+		printf("fetched for %d packages, %d failed", n["fetched"],
+		    n["failed"])
+		if (n["hit"] + n["miss"] > 0)
+			printf("; %d of %d builds had all distfiles ready" \
+			    " (%d%% hit rate)", n["hit"],
+			    n["hit"] + n["miss"],
+			    100 * n["hit"] / (n["hit"] + n["miss"]))
+	    }' "${file}")"
+	msg "Distfile prefetch: ${summary}"
+}
+
 gather_distfiles() {
 	[ $# -eq 7 ] || [ $# -eq 6 ] ||
 	    eargs gather_distfiles '[-l]' originspec_main pkgname_main \
@@ -5425,6 +5672,48 @@ cleanenv() {
 	"$@"
 }
 
+# Install the build dependencies, and with them their run-depends, with a
+# single pkg add rather than leaving the *-depends targets to run one for
+# each dependency.  Anything missing is still installed by the targets.
+install_build_deps() {
+	[ $# -eq 1 ] || eargs install_build_deps pkgname
+	local pkgname="$1"
+	local deps dep_originspec dep_pkgname pkgfiles npkgs
+	local start end
+
+	shash_remove pkgname-deps-build "${pkgname}" deps || return 0
+	pkgfiles=
+	npkgs=0
+	for dep_originspec in ${deps}; do
+		get_pkgname_from_originspec "${dep_originspec}" dep_pkgname ||
+		    continue
+		if [ ! -f "${PACKAGES:?}/All/${dep_pkgname}.${PKG_EXT}" ]; then
+			continue
+		fi
+		pkgfiles="${pkgfiles:+${pkgfiles} }/packages/All/${dep_pkgname}.${PKG_EXT}"
+		npkgs=$((npkgs + 1))
+	done
+	case "${pkgfiles:+set}" in
+	"") return 0 ;;
+	esac
+	echo "===== Installing ${npkgs} build dependencies"
+	_builder_now start
+	if ! cleanenv injail ${PKG_ADD:?} -A ${pkgfiles}; then
+		echo "===== Failed to install all build dependencies," \
+		    "leaving the rest to the *-depends targets"
+	fi
+	_builder_now end
+	echo "===== elapsed: $(phase_elapsed "${start}" "${end}")"
+}
+
+# Format the time between two _builder_now values as seconds.
+phase_elapsed() {
+	[ $# -eq 2 ] || eargs phase_elapsed start_ns end_ns
+	local ms="$(((($2) - ($1)) / 1000000))"
+
+	printf "%d.%03ds\n" "$((ms / 1000))" "$((ms % 1000))"
+}
+
 # Build+test port and return 1 on first failure
 # Return 2 on test failure if PORTTESTING_FATAL=no
 build_port() {
@@ -5443,6 +5732,7 @@ build_port() {
 	local max_execution_time allownetworking
 	local NEED_ROOT PREFIX MAX_FILES
 	local JEXEC_SETSID
+	local phase_start phase_end
 	local -
 
 	_my_path mnt
@@ -5534,6 +5824,12 @@ build_port() {
 			case "${DISTFILES_CACHE}" in
 			"no") ;;
 			*)
+				case "${PREFETCH_DISTFILES}" in
+				"yes")
+					distfile_prefetch_record "${pkgname}" \
+					    "${mnt:?}/distfiles"
+					;;
+				esac
 				mkdir -p "${mnt:?}/portdistfiles"
 				echo "DISTDIR=/portdistfiles" >> \
 				    "${mnt:?}/etc/make.conf"
@@ -5673,9 +5969,17 @@ build_port() {
 		phaseenv="${phaseenv:+${phaseenv} }GID=${GID}"
 
 		print_phase_header "${phase}" "${phaseenv}"
+		_builder_now phase_start
 
 		case "${phase}" in
 		*"-depends")
+			# testport checks that the targets install what the
+			# port needs so leave it to them.
+			case "${BATCH_INSTALL_DEPENDS}.${PORTTESTING}.${phase}" in
+			"yes.0.pkg-depends")
+				install_build_deps "${pkgname}"
+				;;
+			esac
 			cleanenv injail /usr/bin/env ${phaseenv:+-S "${phaseenv}"} \
 			    /usr/bin/make -C ${portdir} ${MAKE_ARGS} \
 			    ${phase} || return 1
@@ -5724,6 +6028,9 @@ build_port() {
 			;;
 		esac
 
+		_builder_now phase_end
+		echo "===== elapsed: $(phase_elapsed "${phase_start}" \
+		    "${phase_end}")"
 		print_phase_footer
 
 		case "${PORTTESTING}${phase}" in
@@ -6114,9 +6421,18 @@ job_done() {
 	list_remove BUILDER_JOBS "${job:?}" || return 7
 	dev_assert_true hash_isset builder_busy "${builder_id:?}"
 	hash_unset builder_busy "${builder_id:?}"
+	hash_set builder_idle_since "${builder_id:?}" "$(clock -monotonic)"
 	_bget status "${builder_id:?}" status ||
 	    err 1 "job_done: Failed to grab status for builder_id=${builder_id}"
-	pkgqueue_job_done "${job_type}" "${job_name}"
+	case "${job_type}" in
+	"reset") ;;
+	*)
+		pkgqueue_job_done "${job_type}" "${job_name}"
+		case "${PREWARM_BUILDERS}" in
+		"yes") hash_set builder_dirty "${builder_id:?}" 1 ;;
+		esac
+		;;
+	esac
 	ret=0
 	_wait "${job}" || ret="$?"
 	case "${status}:" in
@@ -6125,14 +6441,94 @@ job_done() {
 		bset "${builder_id:?}" status "idle:"
 		;;
 	*)
-		# Try to cleanup and mark build crashed
-		MY_BUILDER_ID="${builder_id:?}" crashed_build "${job_type}" \
-		    "${job_name}" "${status%%:*}"
+		case "${job_type}" in
+		"reset")
+			# The next package on it will try again.
+			msg_warn "Builder ${builder_id} failed to reset"
+			bset "${builder_id:?}" status "idle:"
+			;;
+		*)
+			# Try to cleanup and mark build crashed
+			MY_BUILDER_ID="${builder_id:?}" crashed_build \
+			    "${job_type}" "${job_name}" "${status%%:*}"
+			;;
+		esac
 		;;
 	esac
 	return "${ret}"
 }
 
+# Track a job started on a builder by build_queue().
+_build_queue_job_add() {
+	[ $# -eq 5 ] || eargs _build_queue_job_add job job_idx builder_id \
+	    job_type job_name
+	local job="$1"
+	local job_idx="$2"
+	local builder_id="$3"
+	local job_type="$4"
+	local job_name="$5"
+
+	hash_set job_idx_job "${job_idx:?}" "${job:?}"
+	hash_set job_job_idx "${job:?}" "${job_idx:?}"
+	hash_set job_idx_job_type "${job_idx:?}" "${job_type}"
+	hash_set job_idx_job_name "${job_idx:?}" "${job_name}"
+	hash_set job_idx_builder_id "${job_idx:?}" "${builder_id:?}"
+	list_add BUILDER_JOBS "${job:?}"
+	hash_set builder_busy "${builder_id:?}" 1
+}
+
+# Summarize what builder_overhead_add() recorded.
+builder_overhead_summary() {
+	[ $# -eq 0 ] || eargs builder_overhead_summary
+	local file="${MASTER_DATADIR:?}/builder_overhead"
+	local summary
+
+	[ -s "${file}" ] || return 0
+	summary="$(awk '
+	    $2 == "build" { n++; setup += $4; teardown += $5 }
+	    $2 == "reset" { resets++; reset += $4 }
+	    END {
+		if (n > 0)
+			printf("setup %.2fs teardown %.2fs per package" \
+			    " over %d packages", setup / n / 1000,
+			    teardown / n / 1000, n)
+		if (resets > 0)
+			printf("%s%d builder resets while idle %.2fs each",
+			    n > 0 ? "; " : "", resets, reset / resets / 1000)
+	    }' "${file}")"
+	case "${summary:+set}" in
+	set) msg "Builder overhead: ${summary}" ;;
+	esac
+}
+
+# Summarize the contention on the build's locks that plock_acquire
+# recorded.  See plock_stats for the full numbers.
+lock_contention_summary() {
+	[ $# -eq 0 ] || eargs lock_contention_summary
+	local _plock_file summary
+
+	_plock_file=
+	_plock_file "${POUDRIERE_TMPDIR:?}/lock" || return 0
+	[ -s "${_plock_file}" ] || return 0
+	summary="$(plock_stats "${_plock_file}" | sort -k6,6nr -k3,3nr |
+	    awk -v prefix="lock-${MASTERNAME:+${MASTERNAME}-}" '
+	    $3 > 0 && n < 5 {
+		name = $1
+		if (index(name, prefix) == 1)
+			name = substr(name, length(prefix) + 1)
+		printf("%s%s waited %d/%d times %.2fs (max %.2fs)" \
+		    " held %.2fs (max %.2fs)", n++ > 0 ? "; " : "", name,
+		    $3, $2, $6 / 1000, $7 / 1000, $8 / 1000, $9 / 1000)
+		if ($4 > 0)
+			printf(" %d timeouts", $4)
+		if ($5 > 0)
+			printf(" %d stale", $5)
+	    }')"
+	case "${summary:+set}" in
+	set) msg_verbose "Lock contention: ${summary}" ;;
+	esac
+}
+
 _build_queue_runner_exit() {
 	local ret="$?"
 
@@ -6201,6 +6597,7 @@ build_queue() {
 	# job_idx is a unique id for the job
 	local builder_id job job_name builders_active queue_empty
 	local next_job_idx job_idx job_type job_status check_orphans timeout
+	local wait_ret idle_since idle_total now
 
 	run_hook build_queue start
 
@@ -6215,13 +6612,21 @@ build_queue() {
 	check_orphans=0
 	next_job_idx=0
 	BUILDER_JOBS=
+	idle_total=0
+	now="$(clock -monotonic)"
 	# Mark all builders idle
 	for builder_id in ${BUILDERS:?}; do
 		hash_unset builder_busy "${builder_id}" || :
+		hash_set builder_idle_since "${builder_id}" "${now}"
 	done
 	# Timeout indicates how often we check for dead jobs or
-	# a stuck queue.
-	timeout="${BUILD_QUEUE_TIMEOUT:-30}"
+	# a stuck queue.  With jobs_wait_fd a job exiting wakes us up
+	# directly so the timeout is only a backstop.
+	if have_builtin jobs_wait_fd; then
+		timeout="${BUILD_QUEUE_TIMEOUT:-300}"
+	else
+		timeout="${BUILD_QUEUE_TIMEOUT:-30}"
+	fi
 	while :; do
 		local -
 		case "${check_orphans}" in
@@ -6254,11 +6659,31 @@ build_queue() {
 				if pkgqueue_empty; then
 					queue_empty=1
 					msg_dev "build_queue: queue empty"
-				else
-					# The queue is blocked until we finish
-					# some work.
-					msg_dev "build_queue: queue idle"
+					continue
 				fi
+				# The queue is blocked until we finish
+				# some work.
+				msg_dev "build_queue: queue idle"
+				# Reset the builder while it waits rather
+				# than when it gets its next package.
+				if ! hash_isset builder_dirty "${builder_id}"
+				then
+					continue
+				fi
+				hash_unset builder_dirty "${builder_id}"
+				next_job_idx="$((next_job_idx + 1))"
+				job_idx="${next_job_idx:?}"
+				MY_BUILDER_ID="${builder_id:?}" \
+				    MY_JOB_IDX="${job_idx:?}" \
+				    spawn_job_protected \
+				    build_queue_runner builder_prewarm
+				_build_queue_job_add "${spawn_job:?}" \
+				    "${job_idx:?}" "${builder_id:?}" reset \
+				    "${builder_id:?}"
+				msg_dev "build_queue: launched job=${spawn_job}" \
+				    "job_idx=${job_idx}" \
+				    "builder_id=${builder_id}" \
+				    "runjob=reset"
 				continue
 				;;
 			esac
@@ -6282,14 +6707,13 @@ build_queue() {
 			    build_queue_runner \
 			    build_pkg "${job_name}"
 			job="${spawn_job:?}"
-			hash_set job_idx_job "${job_idx:?}" "${job:?}"
-			hash_set job_job_idx "${job:?}" "${job_idx:?}"
-			hash_set job_idx_job_type "${job_idx:?}" "${job_type}"
-			hash_set job_idx_job_name "${job_idx:?}" "${job_name}"
-			hash_set job_idx_builder_id "${job_idx:?}" \
-			    "${builder_id:?}"
-			list_add BUILDER_JOBS "${job:?}"
-			hash_set builder_busy "${builder_id:?}" 1
+			_build_queue_job_add "${job:?}" "${job_idx:?}" \
+			    "${builder_id:?}" "${job_type}" "${job_name}"
+			if hash_remove builder_idle_since "${builder_id:?}" \
+			    idle_since; then
+				now="$(clock -monotonic)"
+				idle_total="$((idle_total + now - idle_since))"
+			fi
 			msg_dev "build_queue: launched job=${job}" \
 			    "job_idx=${job_idx}" \
 			    "builder_id=${builder_id}" \
@@ -6327,7 +6751,23 @@ build_queue() {
 
 		# Wait for an event from a child. All builders are busy.
 		job_idx=
-		read_blocking -t "${timeout:?}" job_idx <&6 || :
+		wait_ret=0
+		case "${BUILDER_JOBS:+set}" in
+		set)
+			# Wake on either a job writing its job_idx to the
+			# pipe or any job exiting, such as a crashed builder
+			# that never wrote to it.
+			if have_builtin jobs_wait_fd; then
+				# shellcheck disable=SC2086
+				jobs_wait_fd -t "${timeout:?}" 6 \
+				    ${BUILDER_JOBS} || wait_ret="$?"
+			fi
+			;;
+		esac
+		case "${wait_ret}" in
+		0) read_blocking -t "${timeout:?}" job_idx <&6 || : ;;
+		1) msg_dev "build_queue: job exited without notification" ;;
+		esac
 		fp_sleep FP_BUILD_QUEUE_POST_READ
 		case "${job_idx:+set}" in
 		set)
@@ -6350,7 +6790,8 @@ build_queue() {
 			;;
 		"")
 			msg_dev "build_queue: jobpipe read timeout"
-			# No event found. The next scan will check for
+			# No event found or a job exited without writing
+			# to the pipe. The next scan will check for
 			# crashed builders and deadlocks by validating
 			# every builder is really non-idle.
 			check_orphans=1
@@ -6359,6 +6800,23 @@ build_queue() {
 	done
 	exec 6>&-
 
+	for builder_id in ${BUILDERS:?}; do
+		hash_unset builder_idle_since "${builder_id}" || :
+		hash_unset builder_dirty "${builder_id}" || :
+	done
+	bset snap_builder_idle "${idle_total}"
+	if [ "${idle_total}" -gt 0 ]; then
+		local idle_avg
+
+		idle_avg="$((idle_total / PARALLEL_JOBS))"
+		calculate_duration idle_total "${idle_total}"
+		calculate_duration idle_avg "${idle_avg}"
+		msg "Builder idle time while waiting for work: ${idle_total}" \
+		    "(${idle_avg} per builder)"
+	fi
+	builder_overhead_summary
+	lock_contention_summary
+
 	run_hook build_queue stop
 }
 
@@ -6481,6 +6939,10 @@ parallel_build() {
 	fi
 
 	coprocess_start pkg_cacher
+	case "${PREFETCH_DISTFILES}.${DISTFILES_CACHE}" in
+	"yes.no") ;;
+	"yes."*) coprocess_start distfile_prefetch ;;
+	esac
 
 	bset builders "${BUILDERS:?}"
 	bset status "parallel_build:"
@@ -6507,6 +6969,8 @@ parallel_build() {
 		msg_warn "pkg_cacher exited with status $?"
 		EXIT_STATUS=$((${EXIT_STATUS:-0} + 1))
 	}
+	coprocess_stop distfile_prefetch || :
+	distfile_prefetch_summary
 
 	bset status "updating_stats:"
 	update_stats || msg_warn "Error updating build stats"
@@ -6532,7 +6996,7 @@ crashed_build() {
 
 	log="${logd:?}/logs/${pkgname:?}.log"
 	log_error="${logd:?}/logs/errors/${pkgname:?}.log"
-	echo "${job_type} crashed: ${failed_phase}" >> "${log:?}"
+	log_append "${log:?}" echo "${job_type} crashed: ${failed_phase}"
 
 	# If the file already exists then all of this handling was done in
 	# build_pkg() already; The port failed already. What crashed
@@ -6556,7 +7020,7 @@ crashed_build() {
 		    "log: ${log_error:?}"
 	fi
 	clean_pool "${job_type}" "${pkgname}" "${originspec}" "${failed_phase}"
-	stop_build "${pkgname}" "${originspec}" 1 >> "${log:?}"
+	log_append "${log:?}" stop_build "${pkgname}" "${originspec}" 1
 	case "${MY_BUILDER_ID-}" in
 	"") ;;
 	*)
@@ -6688,6 +7152,86 @@ _build_pkg_fp() {
 	fi
 }
 
+_builder_now() {
+	local bn_now
+
+	bn_now="$(clock -monotonic -nsec)"
+	setvar "$1" "${bn_now%.*}${bn_now#*.}"
+}
+
+# Record how long a job spent outside of building the port for the
+# summary at the end of build_queue().
+builder_overhead_add() {
+	[ $# -eq 4 ] || eargs builder_overhead_add type name setup_ns \
+	    teardown_ns
+	local type="$1"
+	local name="$2"
+	local setup="$3"
+	local teardown="$4"
+
+	# A single short write with O_APPEND so concurrent builders
+	# do not interleave.
+	echo "${MY_BUILDER_ID:?} ${type} ${name:--}" \
+	    "$((setup / 1000000)) $((teardown / 1000000))" \
+	    >> "${MASTER_DATADIR:?}/builder_overhead" || :
+	msg_debug "Builder ${MY_BUILDER_ID} ${type} ${name}:" \
+	    "setup=$((setup / 1000000))ms teardown=$((teardown / 1000000))ms"
+}
+
+# Return a builder to its prepkg state after a package was built in it.
+# This is normally done when the builder starts its next package.  With
+# PREWARM_BUILDERS it is done as soon as the builder would otherwise sit
+# idle waiting on the queue so the next package starts right away.
+builder_reset() {
+	[ $# -eq 0 ] || eargs builder_reset
+	local mnt tmpfs_blacklist_dir
+
+	_my_path mnt
+	# The tmpfs LOCALBASE is discarded and cloned again rather than
+	# rolled back.
+	if [ ${TMPFS_LOCALBASE} -eq 1 -o ${TMPFS_ALL} -eq 1 ] &&
+	    { [ -f "${mnt:?}/.need_rollback" ] ||
+	    ! [ -f "${mnt:?}/${LOCALBASE:-/usr/local}/.mounted" ]; }; then
+		if [ -f "${mnt:?}/${LOCALBASE:-/usr/local}/.mounted" ]; then
+			umount -n "${mnt:?}/${LOCALBASE:-/usr/local}" || \
+			    umount -f "${mnt:?}/${LOCALBASE:-/usr/local}"
+		fi
+		mnt_tmpfs localbase "${mnt:?}/${LOCALBASE:-/usr/local}"
+		do_clone -r "${MASTERMNT:?}/${LOCALBASE:-/usr/local}" \
+		    "${mnt:?}/${LOCALBASE:-/usr/local}"
+		:> "${mnt:?}/${LOCALBASE:-/usr/local}/.mounted"
+	fi
+
+	if [ -f "${mnt:?}/.tmpfs_blacklist_dir" ]; then
+		umount -n "${mnt:?}/wrkdirs" ||
+		    umount -f "${mnt:?}/wrkdirs"
+		read_line tmpfs_blacklist_dir \
+		    "${mnt:?}/.tmpfs_blacklist_dir" ||
+		    err 1 "Failed to read tmpfs blacklist dir"
+		rm -rfx "${tmpfs_blacklist_dir:?}"
+	fi
+	if [ -f "${mnt:?}/.need_rollback" ]; then
+		rollbackfs prepkg "${mnt:?}" || :
+		if [ -f "${mnt:?}/.need_rollback" ]; then
+			err 1 "Failed to rollback ${mnt} to prepkg"
+		fi
+	fi
+}
+
+# build_queue job to reset an idle builder ahead of its next package.
+builder_prewarm() {
+	[ $# -eq 0 ] || eargs builder_prewarm
+	local start end
+
+	setproctitle "builder_prewarm (${MY_BUILDER_ID})" || :
+	_builder_now start
+	bset "${MY_BUILDER_ID:?}" status "resetting:"
+	builder_reset
+	_builder_now end
+	builder_overhead_add reset "" "$((end - start))" 0
+	bset "${MY_BUILDER_ID:?}" status "done:"
+}
+
 build_pkg() {
 	[ "$#" -eq 1 ] || eargs build_pkg pkgname
 	local pkgname="$1"
@@ -6703,6 +7247,7 @@ build_pkg() {
 	local tmpfs_blacklist_dir JEXEC_LIMITS
 	local elapsed now originspec status
 	local PORTTESTING build_reason
+	local job_start setup_end port_end job_end
 	local -
 
 	_my_path mnt
@@ -6716,6 +7261,7 @@ build_pkg() {
 	# which goes to master
 	NO_ELAPSED_IN_MSG="$((NO_ELAPSED_IN_MSG + 1))"
 	TIME_START_JOB=$(clock -monotonic)
+	_builder_now job_start
 	colorize_job_id COLOR_JOBID "${MY_BUILDER_ID}"
 
 	get_originspec_from_pkgname originspec "${pkgname}"
@@ -6772,33 +7318,7 @@ build_pkg() {
 	add_relpath_var MNT_DATADIR
 	cd "${MNT_DATADIR:?}"
 
-	if [ ${TMPFS_LOCALBASE} -eq 1 -o ${TMPFS_ALL} -eq 1 ]; then
-		if [ -f "${mnt:?}/${LOCALBASE:-/usr/local}/.mounted" ]; then
-			umount -n "${mnt:?}/${LOCALBASE:-/usr/local}" || \
-			    umount -f "${mnt:?}/${LOCALBASE:-/usr/local}"
-		fi
-		mnt_tmpfs localbase "${mnt:?}/${LOCALBASE:-/usr/local}"
-		do_clone -r "${MASTERMNT:?}/${LOCALBASE:-/usr/local}" \
-		    "${mnt:?}/${LOCALBASE:-/usr/local}"
-		:> "${mnt:?}/${LOCALBASE:-/usr/local}/.mounted"
-	fi
-
-	if [ -f "${mnt:?}/.tmpfs_blacklist_dir" ]; then
-		local tmpfs_blacklist_dir
-
-		umount -n "${mnt:?}/wrkdirs" ||
-		    umount -f "${mnt:?}/wrkdirs"
-		read_line tmpfs_blacklist_dir \
-		    "${mnt:?}/.tmpfs_blacklist_dir" ||
-		    err 1 "Failed to read tmpfs blacklist dir"
-		rm -rfx "${tmpfs_blacklist_dir:?}"
-	fi
-	if [ -f "${mnt:?}/.need_rollback" ]; then
-		rollbackfs prepkg "${mnt:?}" || :
-		if [ -f "${mnt:?}/.need_rollback" ]; then
-			err 1 "Failed to rollback ${mnt} to prepkg"
-		fi
-	fi
+	builder_reset
 	:> "${mnt:?}/.need_rollback"
 
 	if patternlist_match "${TMPFS_BLACKLIST-}" "${pkgbase:?}"; then
@@ -6835,13 +7355,16 @@ build_pkg() {
 		devfs -m "${mnt:?}/dev" rule apply path null unhide
 	fi
 
+	_builder_now setup_end
 	build_port "${originspec}" "${pkgname}" || ret=$?
+	_builder_now port_end
 	if [ ${ret} -ne 0 ]; then
 		build_failed=1
 		# ret=2 is a test failure
 		if [ ${ret} -eq 2 ]; then
-			failed_phase=$(awk -f ${AWKPREFIX:?}/processonelog2.awk \
-				"${log:?}/logs/${pkgname:?}.log" \
+			failed_phase=$(logcat \
+				"${log:?}/logs/${pkgname:?}.log" 2>/dev/null |
+				awk -f ${AWKPREFIX:?}/processonelog2.awk \
 				2> /dev/null)
 		else
 			_bget failed_status "${MY_BUILDER_ID:?}" status
@@ -6862,6 +7385,8 @@ build_pkg() {
 		ln -s "../${pkgname:?}.log" \
 		    "${log:?}/logs/built/${pkgname:?}.log"
 		badd ports.built "${originspec} ${pkgname} ${elapsed}"
+		history_add "${pkgname}" built "${elapsed}" \
+		    "${log:?}/logs/${pkgname:?}.log"
 		COLOR_ARROW="${COLOR_SUCCESS}" \
 		    job_msg_status "Finished" \
 		    "${port}${FLAVOR:+@${FLAVOR}}" "${pkgname}" \
@@ -6879,7 +7404,7 @@ build_pkg() {
 		"yes")
 			_bget status "${MY_BUILDER_ID:?}" status
 			bset_job_status "processlog" "${originspec}" "${pkgname}"
-			errortype="$(awk -f ${AWKPREFIX:?}/processonelog.awk \
+			errortype="$(processonelog \
 				"${log:?}/logs/errors/${pkgname:?}.log" \
 				2> /dev/null)" || :
 			bset_job_status "${status%%:*}" "${originspec}" "${pkgname}"
@@ -6889,6 +7414,8 @@ build_pkg() {
 			;;
 		esac
 		badd ports.failed "${originspec} ${pkgname} ${failed_phase} ${errortype} ${elapsed}"
+		history_add "${pkgname}" failed "${elapsed}" \
+		    "${log:?}/logs/${pkgname:?}.log"
 		COLOR_ARROW="${COLOR_FAIL}" \
 		    job_msg_status "Finished" \
 		    "${port}${FLAVOR:+@${FLAVOR}}" "${pkgname}" \
@@ -6936,6 +7463,9 @@ build_pkg() {
 
 	log_stop
 
+	_builder_now job_end
+	builder_overhead_add build "${pkgname}" \
+	    "$((setup_end - job_start))" "$((job_end - port_end))"
 	bset "${MY_BUILDER_ID:?}" status "done:"
 }
 
@@ -7135,7 +7665,7 @@ deps_fetch_vars() {
 	# This is for testport.
 	shash_remove originspec-port_flags "${originspec}" port_flags ||
 	    port_flags=
-	if ! port_var_fetch_originspec "${originspec}" \
+	if ! port_var_fetch_originspec_cached "${originspec}" \
 		${port_flags-} \
 		${_pkgname_var} _pkgname \
 		${_lookup_flavors} \
@@ -7977,7 +8507,9 @@ delete_old_pkgs() {
 	ensure_pkg_installed ||
 	    err ${EX_SOFTWARE} "delete_old_pkgs: Missing bootstrap pkg"
 
-	parallel_start || err 1 "parallel_start"
+	# delete_old_pkg only sets locals and the per-package shash cache so
+	# nothing carries over between packages in a parallel_run worker.
+	parallel_start -w || err 1 "parallel_start"
 	for pkg in "${PACKAGES:?}"/All/*; do
 		case "${pkg}" in
 		"${PACKAGES:?}/All/*")  break ;;
@@ -8320,10 +8852,24 @@ port_var_fetch() {
 	shiftcnt=0
 	local data
 
-	data="$({
-		IFS="${sep}"
-		${MASTERNAME+injail} /usr/bin/make ${_make_origin} ${_makeflags-}
-	})" || pvf_ret=$?
+	local pvf_worker
+
+	if _port_var_fetch_worker pvf_worker; then
+		_port_var_fetch_worker_request data "${pvf_worker}" \
+		    "${_make_origin}${sep}${_makeflags-}" || pvf_ret=$?
+	else
+		pvf_ret=255
+	fi
+	case "${pvf_ret}" in
+	255)
+		pvf_ret=0
+		data="$({
+			IFS="${sep}"
+			${MASTERNAME+injail} /usr/bin/make ${_make_origin} \
+			    ${_makeflags-}
+		})" || pvf_ret=$?
+		;;
+	esac
 	while mapfile_read_loop_redir pvf_line; do
 		# Skip assignment vars.
 		# This var was just an assignment, no actual value to read from
@@ -8407,6 +8953,157 @@ port_var_fetch_originspec() {
 	port_var_fetch "${origin}" "$@" ${flavor:+FLAVOR=${flavor}}
 }
 
+# port_var_fetch normally runs injail make for every lookup.  While
+# gathering ports metadata there is instead a worker shell in the jail for
+# each parallel_run slot which runs make for each request sent to it over a
+# fifo.  This saves the cost of forking this large shell and jexec for
+# every port.
+# Protocol, tab separated:
+#   request: id make-args...
+#   response: make output, then: \001EOR id status
+_PORT_VAR_FETCH_WORKER_SCRIPT='
+errfile="$1"
+while IFS= read -r req; do
+	IFS="	"
+	set -f
+	set -- ${req}
+	unset IFS
+	set +f
+	id="$1"
+	shift
+	/usr/bin/make "$@" </dev/null 2>"${errfile}"
+	printf "\001EOR %s %s\n" "${id}" "$?"
+done
+'
+
+_port_var_fetch_worker_main() {
+	[ $# -eq 1 ] || eargs _port_var_fetch_worker_main slot
+	local slot="$1"
+	local fifo="${MASTER_DATADIR:?}/port_var_fetch.${slot}"
+
+	setproctitle "port_var_fetch worker ${slot}" || :
+	injail /bin/sh -c "${_PORT_VAR_FETCH_WORKER_SCRIPT}" \
+	    port_var_fetch_worker "/tmp/.port_var_fetch.${slot}.err" \
+	    0<> "${fifo:?}.in" 1<> "${fifo:?}.out"
+}
+
+port_var_fetch_workers_start() {
+	[ $# -eq 0 ] || eargs port_var_fetch_workers_start
+	local slot fifo spawn_jobid spawn_job spawn_pgid spawn_pid
+
+	case "${PORT_VAR_FETCH_WORKERS-}" in
+	yes) ;;
+	*) return 0 ;;
+	esac
+	case "${MASTERNAME:+set}" in
+	"") return 0 ;;
+	esac
+	slot=0
+	until [ "${slot}" -eq "${PARALLEL_JOBS:?}" ]; do
+		slot="$((slot + 1))"
+		fifo="${MASTER_DATADIR:?}/port_var_fetch.${slot}"
+		unlink "${fifo:?}.in" 2>/dev/null || :
+		unlink "${fifo:?}.out" 2>/dev/null || :
+		mkfifo "${fifo:?}.in" "${fifo:?}.out" ||
+		    err 1 "port_var_fetch_workers_start: mkfifo"
+		spawn_job_protected _port_var_fetch_worker_main "${slot}" ||
+		    err 1 "port_var_fetch_workers_start: spawn_job"
+		hash_set port_var_fetch_worker_job "${slot}" "${spawn_job:?}"
+		hash_set port_var_fetch_worker_pid "${slot}" "${spawn_pid:?}"
+	done
+	msg_verbose "Started ${PARALLEL_JOBS} port_var_fetch workers"
+}
+
+port_var_fetch_workers_stop() {
+	[ $# -eq 0 ] || eargs port_var_fetch_workers_stop
+	local slot job fifo ret
+
+	ret=0
+	slot=0
+	until [ "${slot}" -eq "${PARALLEL_JOBS:?}" ]; do
+		slot="$((slot + 1))"
+		hash_unset port_var_fetch_worker_pid "${slot}"
+		hash_remove port_var_fetch_worker_job "${slot}" job ||
+		    continue
+		kill_job 10 "${job}" || case "$?" in
+			143) ;;
+			*) ret=1 ;;
+		esac
+		fifo="${MASTER_DATADIR:?}/port_var_fetch.${slot}"
+		unlink "${fifo:?}.in" || :
+		unlink "${fifo:?}.out" || :
+		unlink "${MASTERMNT:?}/tmp/.port_var_fetch.${slot}.err" \
+		    2>/dev/null || :
+	done
+	return "${ret}"
+}
+
+# Return the fifo prefix for this slot's worker if there is one.
+_port_var_fetch_worker() {
+	[ $# -eq 1 ] || eargs _port_var_fetch_worker var_return
+	local pvfw_var_return="$1"
+	local pvfw_pid
+
+	case "${PARALLEL_SLOT:+set}" in
+	"") return 1 ;;
+	esac
+	hash_get port_var_fetch_worker_pid "${PARALLEL_SLOT}" pvfw_pid ||
+	    return 1
+	kill -0 "${pvfw_pid}" 2>/dev/null || return 1
+	setvar "${pvfw_var_return}" \
+	    "${MASTER_DATADIR:?}/port_var_fetch.${PARALLEL_SLOT}"
+}
+
+# Send a request to a worker and collect the output the same as $(make).
+# Returns 255 if the worker did not respond.
+_port_var_fetch_worker_request() {
+	[ $# -eq 3 ] || eargs _port_var_fetch_worker_request var_return \
+	    fifo make_args
+	local pvfwr_var_return="$1"
+	local pvfwr_fifo="$2"
+	local pvfwr_args="$3"
+	local pvfwr_id pvfwr_line pvfwr_data pvfwr_ret pvfwr_eor pvfwr_errfile
+	local pvfwr_nl=$'\n'
+
+	_PORT_VAR_FETCH_REQUEST_ID="$((${_PORT_VAR_FETCH_REQUEST_ID:-0} + 1))"
+	pvfwr_id="$(getpid).${_PORT_VAR_FETCH_REQUEST_ID}"
+	pvfwr_eor=$'\001'"EOR "
+	echo "${pvfwr_id}	${pvfwr_args}" >> "${pvfwr_fifo:?}.in" ||
+	    return 255
+	pvfwr_data=
+	unset pvfwr_ret
+	while IFS= read -r pvfwr_line; do
+		case "${pvfwr_line}" in
+		"${pvfwr_eor}${pvfwr_id} "*)
+			pvfwr_ret="${pvfwr_line##* }"
+			break
+			;;
+		# A response for a request that was interrupted.
+		"${pvfwr_eor}"*)
+			pvfwr_data=
+			continue
+			;;
+		esac
+		pvfwr_data="${pvfwr_data}${pvfwr_line}${pvfwr_nl}"
+	done < "${pvfwr_fifo:?}.out"
+	case "${pvfwr_ret:+set}" in
+	"") return 255 ;;
+	esac
+	pvfwr_errfile="${MASTERMNT:?}/tmp/.port_var_fetch.${PARALLEL_SLOT:?}.err"
+	if [ -s "${pvfwr_errfile}" ]; then
+		mapfile_cat_file "${pvfwr_errfile}" >&2 || :
+	fi
+	# Same as $() trimming trailing newlines.
+	while :; do
+		case "${pvfwr_data}" in
+		*"${pvfwr_nl}") pvfwr_data="${pvfwr_data%"${pvfwr_nl}"}" ;;
+		*) break ;;
+		esac
+	done
+	setvar "${pvfwr_var_return}" "${pvfwr_data}" || return
+	return "${pvfwr_ret}"
+}
+
 # Determine if a given origin has a given PKGBASE for any of its FLAVORS
 origin_has_pkgbase() {
 	[ $# -eq 2 ] || eargs origin_has_pkgbase origin pkgbase
@@ -8627,6 +9324,8 @@ gather_port_vars() {
 	msg "Gathering ports metadata"
 	bset status "gatheringportvars:"
 	run_hook gather_port_vars start
+	metadata_cache_init
+	port_var_fetch_workers_start
 
 	:> "${MASTER_DATADIR:?}/all_pkgs"
 
@@ -8634,7 +9333,10 @@ gather_port_vars() {
 	mkdir gqueue dqueue mqueue fqueue
 	qlist=$(mktemp -t poudriere.qlist)
 
-	parallel_start || err 1 "parallel_start"
+	# gather_port_vars_port only sets locals.  What it finds is kept in
+	# shash and the queue dirs so nothing carries over between ports
+	# in a parallel_run worker.
+	parallel_start -w || err 1 "parallel_start"
 	ports="$(listed_ports show_moved)" ||
 	    err "${EX_SOFTWARE}" "gather_port_vars: listed_ports failure"
 	for originspec in ${ports}; do
@@ -8648,8 +9350,7 @@ gather_port_vars() {
 				;;
 			esac
 			parallel_run \
-			    prefix_stderr_quick \
-			    "(${COLOR_PORT}${originspec}${COLOR_RESET})" \
+			    -p "(${COLOR_PORT}${originspec}${COLOR_RESET})" \
 			    gather_port_vars_port "${originspec}" \
 			    "${rdep}" || \
 			    set_pipe_fatal_error
@@ -8754,7 +9455,7 @@ gather_port_vars() {
 		if ! dirempty gqueue; then
 			msg_debug "Processing gatherqueue"
 			:> "${qlist:?}"
-			parallel_start || err 1 "parallel_start"
+			parallel_start -w || err 1 "parallel_start"
 			for qorigin in gqueue/*; do
 				case "${qorigin}" in
 				"gqueue/*") break ;;
@@ -8767,8 +9468,7 @@ gather_port_vars() {
 				read_line rdep "${qorigin}/rdep" || \
 				    err 1 "gather_port_vars: Failed to read rdep for ${COLOR_PORT}${originspec}${COLOR_RESET}"
 				parallel_run \
-				    prefix_stderr_quick \
-				    "(${COLOR_PORT}${originspec}${COLOR_RESET})" \
+				    -p "(${COLOR_PORT}${originspec}${COLOR_RESET})" \
 				    gather_port_vars_port \
 				    "${originspec}" "${rdep}" || \
 				    set_pipe_fatal_error
@@ -8811,6 +9511,8 @@ gather_port_vars() {
 		err 1 "Gather port queues not empty"
 	fi
 	unlink "${qlist:?}" || :
+	port_var_fetch_workers_stop || :
+	metadata_cache_report
 	run_hook gather_port_vars stop
 }
 
@@ -9280,7 +9982,8 @@ generate_queue() {
 
 	:> "${MASTER_DATADIR:?}/pkg_deps.unsorted"
 
-	parallel_start || err 1 "parallel_start"
+	parallel_start -w -r generate_queue_pkg_reset ||
+	    err 1 "parallel_start"
 	while mapfile_read_loop "${MASTER_DATADIR:?}/all_pkgs_not_ignored" \
 	    pkgname originspec _rdep _ignored; do
 		parallel_run generate_queue_pkg "${pkgname}" "${originspec}" \
@@ -9294,8 +9997,6 @@ generate_queue() {
 	    -o "${MASTER_DATADIR:?}/pkg_deps"
 	unlink "${MASTER_DATADIR:?}/pkg_deps.unsorted"
 
-	bset status "computingrdeps:"
-	pkgqueue_compute_rdeps
 	{ find deps rdeps; } > "pkg_pool"
 
 	run_hook compute_deps stop
@@ -9455,6 +10156,13 @@ generate_queue_pkg() {
 	return 0
 }
 
+# Run after each generate_queue_pkg in a parallel_run worker so the next
+# package does not see this one's cache.
+generate_queue_pkg_reset() {
+	[ $# -eq 0 ] || eargs generate_queue_pkg_reset
+	hash_unset_var generate_queue_originspec-pkgname
+}
+
 test_port_origin_exist() {
 	[ $# -eq 1 ] || eargs test_port_origin_exist origin
 	local _origin="$1"
@@ -10253,6 +10961,7 @@ prepare_ports() {
 				bset git_dirty "${top_unclean}"
 			fi
 		fi
+		bstats_tally_init
 
 		show_log_info
 		case "${HTML_JSON_UPDATE_INTERVAL}" in
@@ -10394,6 +11103,7 @@ prepare_ports() {
 			    err 1 "Failure looking up pkg ABI"
 		fi
 		determine_base_shlibs
+		pkg_metadata_index_update || :
 		delete_old_pkgs
 
 		# PKG_NO_VERSION_FOR_DEPS still uses this to trim out old
@@ -10424,7 +11134,6 @@ prepare_ports() {
 			    pkgname-ignore \
 			    pkgname-options \
 			    pkgname-deps \
-			    pkgname-deps-build \
 			    pkgname-forbidden \
 			    pkgname-no_arch \
 			    pkgname-run_deps \
@@ -10483,15 +11192,53 @@ prepare_ports() {
 	return 0
 }
 
+# Weight build jobs by how long they are expected to take so that the
+# longest chains, rather than the deepest, are started first.
+# Returns 1 if there is nothing to weigh by.
+load_priorities_weights() {
+	[ $# -eq 1 ] || eargs load_priorities_weights weights_file
+	local weights_file="$1"
+
+	case "${PRIORITY_BUILDTIME}" in
+	yes) ;;
+	*) return 1 ;;
+	esac
+	[ -s "${MASTER_DATADIR:?}/pkg_buildtimes" ] || return 1
+	# Elapsed times are put on a log scale of quanta and clamped to
+	# PRIORITY_BUILDTIME_BUCKETS weights so that a chain's priority is
+	# at most that many times its depth, keeping the number of distinct
+	# priorities, and pool buckets, bounded.
+	awk -v quantum="${PRIORITY_BUILDTIME_QUANTUM:?}" \
+	    -v buckets="${PRIORITY_BUILDTIME_BUCKETS:?}" '{
+		weight = 1 + int(log(1 + $2 / quantum) / log(2))
+		if (weight > buckets)
+			weight = buckets
+		print "build:" $1, weight
+	}' "${MASTER_DATADIR:?}/pkg_buildtimes" > "${weights_file}"
+	msg "Weighting priorities by expected build times"
+}
+
 load_priorities_ptsort() {
 	local priority pkgname originspec origin flavor _rdep
-	local log pkgbase job_type
+	local log pkgbase job_type boost_value weights
 	local -
 
 	_log_path log
 	{ awk '{print $2 " " $1}' "${MASTER_DATADIR:?}/pkg_deps"; } \
 	    > "${MASTER_DATADIR:?}/pkg_deps.ptsort"
 
+	boost_value="${PRIORITY_BOOST_VALUE}"
+	weights="${MASTER_DATADIR:?}/pkg_deps.weights"
+	if load_priorities_weights "${weights}"; then
+		cp -f "${weights}" "${log:?}/.poudriere.pkg_deps.weights%"
+		# Keep boosts above weighted chains the same as they are
+		# above unweighted chains.
+		boost_value="$((boost_value * PRIORITY_BUILDTIME_BUCKETS))"
+	else
+		unlink "${weights}" 2>/dev/null || :
+		weights=
+	fi
+
 	# Add in boosts before running ptsort
 	while mapfile_read_loop "${MASTER_DATADIR:?}/tobuild_pkgs" \
 	    pkgname originspec _rdep; do
@@ -10514,15 +11261,19 @@ load_priorities_ptsort() {
 			;;
 		esac
 		echo "${job_type}:${pkgname}" \
-		    "${PRIORITY_BOOST_VALUE}" >> \
+		    "${boost_value}" >> \
 		    "${MASTER_DATADIR:?}/pkg_deps.ptsort"
 	done
 
 	cp -f "${MASTER_DATADIR:?}/pkg_deps.ptsort" \
 	    "${log:?}/.poudriere.pkg_deps.ptsort%"
-	ptsort -p "${MASTER_DATADIR:?}/pkg_deps.ptsort" > \
+	ptsort -p ${weights:+-w "${weights}"} \
+	    "${MASTER_DATADIR:?}/pkg_deps.ptsort" > \
 	    "${MASTER_DATADIR:?}/pkg_deps.priority"
 	unlink "${MASTER_DATADIR:?}/pkg_deps.ptsort"
+	case "${weights:+set}" in
+	set) unlink "${weights}" ;;
+	esac
 	cp -f "${MASTER_DATADIR:?}/pkg_deps.priority" \
 	    "${log:?}/.poudriere.pkg_deps_priority%"
 
@@ -10538,6 +11289,8 @@ load_priorities() {
 	msg "Processing PRIORITY_BOOST"
 	bset status "load_priorities:"
 
+	history_compact || :
+	history_load_buildtimes "${MASTER_DATADIR:?}/pkg_buildtimes" || :
 	load_priorities_ptsort
 }
 
@@ -11119,6 +11872,21 @@ esac
 : ${PORTTESTING_FATAL:=yes}
 : ${PORTTESTING_RECURSIVE:=0}
 : ${PRIORITY_BOOST_VALUE:=99}
+: ${PRIORITY_BUILDTIME:=yes}
+: ${PRIORITY_BUILDTIME_QUANTUM:=300}
+: ${PRIORITY_BUILDTIME_BUCKETS:=8}
+: ${BATCH_INSTALL_DEPENDS:=no}
+: ${PREFETCH_DISTFILES:=no}
+: ${PREFETCH_DISTFILES_JOBS:=2}
+: ${PREFETCH_DISTFILES_DEPS:=1}
+: ${PREWARM_BUILDERS:=no}
+: ${BUILD_HISTORY:=yes}
+: ${BUILD_HISTORY_KEEP:=5}
+: ${METADATA_CACHE:=no}
+: ${PORT_VAR_FETCH_WORKERS:=yes}
+: ${PARALLEL_WORKERS:=no}
+: ${BSET_BACKEND:=file}
+: ${LOCK_BACKEND:=plock}
 : ${RESTRICT_NETWORKING:=yes}
 : ${DISALLOW_NETWORKING:=no}
 : ${TRIM_ORPHANED_BUILD_DEPS:=yes}
@@ -11167,6 +11935,7 @@ esac
 : ${QEMU_MAX_EXECUTION_TIME:=345600}   # 4 days for 1 command (phase)
 : ${QEMU_NOHANG_TIME:=21600}           # 6 hours with no log update
 : ${TIMESTAMP_LOGS:=no}
+: ${LOG_COMPRESS:=no}
 : "${TIMESTAMP_FLAGS:=}"
 : ${ATOMIC_PACKAGE_REPOSITORY:=yes}
 : ${KEEP_OLD_PACKAGES:=no}
@@ -11224,7 +11993,9 @@ EPOCH_START=$(clock -epoch)
 
 . ${SCRIPTPREFIX:?}/include/colors.sh
 . ${SCRIPTPREFIX:?}/include/display.sh
+. ${SCRIPTPREFIX:?}/include/history.sh
 . ${SCRIPTPREFIX:?}/include/html.sh
+. ${SCRIPTPREFIX:?}/include/metadata_cache.sh
 . ${SCRIPTPREFIX:?}/include/parallel.sh
 . ${SCRIPTPREFIX:?}/include/shared_hash.sh
 . ${SCRIPTPREFIX:?}/include/cache.sh
@@ -37,6 +37,8 @@ Parameters:
     [ports...]  -- List of ports to clean on the command line
 
 Options:
+    -c          -- Also remove distfiles whose size or SHA256 do not match
+                   their distinfo
     -J n        -- Run n jobs in parallel (Defaults to the number of CPUs
                    times 1.25)
     -p tree     -- Specify which ports tree to use for comparing to distfiles.
@@ -53,14 +55,18 @@ EOF
 
 DRY_RUN=0
 ALL=0
+CHECKSUM=
 
 [ $# -eq 0 ] && usage
 
-while getopts "af:J:np:vy" FLAG; do
+while getopts "acf:J:np:vy" FLAG; do
 	case "${FLAG}" in
 		a)
 			ALL=1
 			;;
+		c)
+			CHECKSUM="-c"
+			;;
 		f)
 			# If this is a relative path, add in ${PWD} as
 			# a cd / was done.
@@ -100,8 +106,7 @@ post_getopts
 PARALLEL_JOBS=${PREPARE_PARALLEL_JOBS}
 
 distfiles_cleanup() {
-	rm -f ${DISTFILES_LIST} ${DISTFILES_LIST}.expected \
-		${DISTFILES_LIST}.actual ${DISTFILES_LIST}.unexpected \
+	rm -f ${DISTFILES_LIST} ${DISTFILES_LIST}.unexpected \
 		2>/dev/null
 	if [ -n "${__MAKE_CONF}" ]; then
 		rm -f "${__MAKE_CONF}"
@@ -122,11 +127,7 @@ gather_distfiles() {
 
 	msg_verbose "Gathering distfiles for: ${originspec}"
 
-	# Append from inside awk to force line buffering
-	awk -v distdir="${DISTFILES_CACHE%/}" \
-	    -v out="${DISTFILES_LIST}" \
-	    '/SIZE/ {print distdir "/" substr($2, 2, length($2) - 2) >> out}' \
-	    "${distinfo_file}"
+	echo "${distinfo_file}" >> "${DISTFILES_LIST}"
 }
 
 case "${DISTFILES_CACHE}" in
@@ -149,6 +150,16 @@ for PTNAME in ${PTNAMES}; do
 	[ -d "${PORTSDIR}/ports" ] && PORTSDIR="${PORTSDIR}/ports"
 	[ -z "${PORTSDIR}" ] && err 1 "No such ports tree: ${PTNAME}"
 
+	if [ "${ALL}" -eq 1 ]; then
+		# Every port's distinfo, without asking make where each
+		# one is.  Slave ports use their master's.
+		msg "Gathering all distinfo files for ports tree '${PTNAME}'"
+		find "${PORTSDIR}/" -mindepth 3 -maxdepth 3 \
+		    -name 'distinfo*' -type f >> "${DISTFILES_LIST}" ||
+		    err 1 "Failed to find distinfo files for ${PTNAME}"
+		continue
+	fi
+
 	__MAKE_CONF=$(mktemp -t poudriere-make.conf)
 	export __MAKE_CONF
 	setup_ports_env "" "${__MAKE_CONF}"
@@ -179,22 +190,15 @@ for PTNAME in ${PTNAMES}; do
 	unset __MAKE_CONF
 done
 
-# Remove duplicates
-sort -u "${DISTFILES_LIST}" -o "${DISTFILES_LIST}.expected"
-
-# Gather list of actual files
-msg "Gathering list of actual distfiles"
+msg "Gathering list of stale distfiles"
 # This is redundant but here for paranoia.
 [ -n "${DISTFILES_CACHE}" ] ||
     err 1 "DISTFILES_CACHE must be set (cf. poudriere.conf)"
-find -x ${DISTFILES_CACHE:?}/ -type f ! -name '.*' | \
-    sort -o "${DISTFILES_LIST}.actual"
-
-comm -1 -3 ${DISTFILES_LIST}.expected ${DISTFILES_LIST}.actual \
-	> ${DISTFILES_LIST}.unexpected
-
-[ -s "${DISTFILES_LIST}.expected" ] || \
-	err 1 "Something went wrong. All distfiles would have been removed."
+# This fails rather than listing every distfile if none are expected.
+sort -u "${DISTFILES_LIST}" |
+    distscan ${CHECKSUM} -j "${PARALLEL_JOBS:?}" -d "${DISTFILES_CACHE:?}" \
+    > "${DISTFILES_LIST}.unexpected" ||
+    err 1 "Something went wrong. All distfiles would have been removed."
 
 distfiles_found_cnt=0
 distfiles_deleted=0
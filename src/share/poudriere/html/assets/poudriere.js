@@ -41,6 +41,10 @@ var page_type;
 var page_buildname;
 var page_mastername;
 var data_url = "";
+/* Build data kept up to date from .data.events. */
+var build_data;
+/* Port lists changed other than at the end, by status. */
+var ports_redraw = {};
 
 function getParameterByName(name) {
   name = name.replace(/[\[]/, "\\[").replace(/[\]]/, "\\]");
@@ -64,6 +68,10 @@ function scrollToElement(element) {
 }
 
 function update_data() {
+  if (build_data) {
+    update_events();
+    return;
+  }
   $.ajax({
     url: data_url + ".data.json",
     dataType: "json",
@@ -72,6 +80,9 @@ function update_data() {
     },
     success: function (data) {
       load_attempts = 0;
+      if (data.buildname && data.events) {
+        build_data = data;
+      }
       process_data(data);
     },
     error: function (data) {
@@ -87,6 +98,147 @@ function update_data() {
   });
 }
 
+/* Drop the events and fetch all of .data.json again. */
+function events_resync() {
+  if (build_data.ports) {
+    $.each(build_data.ports, function (status) {
+      ports_redraw[status] = true;
+    });
+  }
+  build_data = undefined;
+  update_data();
+}
+
+/* Length of a string in UTF-8, as the offsets are. */
+function utf8_length(str) {
+  return unescape(encodeURIComponent(str)).length;
+}
+
+function apply_event(event) {
+  var data = build_data;
+  var list, key;
+
+  if (!data.ports) {
+    data.ports = {};
+  }
+  if (!data.skipped) {
+    data.skipped = {};
+  }
+  switch (event.type) {
+    case "port":
+      if ((list = data.ports[event.status]) === undefined) {
+        list = data.ports[event.status] = [];
+      }
+      if (event.n < list.length) {
+        /* A line that was still being written. */
+        if (event.status == "skipped") {
+          data.skipped[list[event.n].depends]--;
+        }
+        list[event.n] = event.port;
+        ports_redraw[event.status] = true;
+      } else {
+        list.push(event.port);
+      }
+      if (event.status == "skipped") {
+        key = event.port.depends;
+        data.skipped[key] = (data.skipped[key] || 0) + 1;
+      }
+      break;
+    case "reset":
+      data.ports[event.status] = [];
+      ports_redraw[event.status] = true;
+      if (event.status == "skipped") {
+        data.skipped = {};
+      }
+      break;
+    case "jobs":
+      data.jobs = event.jobs;
+      break;
+    case "state":
+      for (key in data) {
+        if (
+          key != "ports" &&
+          key != "jobs" &&
+          key != "skipped" &&
+          key != "events"
+        ) {
+          delete data[key];
+        }
+      }
+      $.extend(data, event.data);
+      break;
+    default:
+      /* The log was started over since the last poll. */
+      return false;
+  }
+  return true;
+}
+
+/* Apply the events in text, which starts with the last one applied. */
+function apply_events(text) {
+  var events = build_data.events;
+  var lines, n, event;
+
+  lines = text.split("\n");
+  try {
+    if (lines.length < 2 || JSON.parse(lines[0]).seq != events.seq) {
+      return false;
+    }
+  } catch (e) {
+    return false;
+  }
+  /* The last one is empty or still being written. */
+  for (n = 1; n < lines.length - 1; n++) {
+    try {
+      event = JSON.parse(lines[n]);
+    } catch (e) {
+      return false;
+    }
+    if (event.seq != events.seq + 1 || !apply_event(event)) {
+      return false;
+    }
+    events.seq = event.seq;
+    events.offset += utf8_length(lines[n - 1]) + 1;
+  }
+  return true;
+}
+
+/* Only fetch what was logged since the last poll rather than all of
+ * .data.json. */
+function update_events() {
+  var start = build_data.events.offset;
+
+  $.ajax({
+    url: data_url + ".data.events",
+    dataType: "text",
+    headers: {
+      "Cache-Control": "max-age=0",
+      Range: "bytes=" + start + "-",
+    },
+    success: function (text, textStatus, jqXHR) {
+      if (jqXHR.status != 206) {
+        /* The Range was ignored, such as for file://. */
+        try {
+          text = decodeURIComponent(
+            escape(unescape(encodeURIComponent(text)).substring(start)),
+          );
+        } catch (e) {
+          text = "";
+        }
+      }
+      if (!apply_events(text)) {
+        events_resync();
+        return;
+      }
+      process_data(build_data);
+    },
+    error: function () {
+      /* Started over since the last poll, or gone. */
+      events_resync();
+    },
+  });
+}
+
 function format_origin(origin, flavor) {
   var data;
 
@@ -725,7 +877,7 @@ function process_data_build(data) {
 
     if (data.snap) {
       $.each(data.snap, function (status, count) {
-        if (status == "elapsed") {
+        if (status == "elapsed" || status == "eta") {
           count = format_start_to_end(count);
         }
         $("#snap_" + status).html(count);
@@ -741,6 +893,16 @@ function process_data_build(data) {
    * is to lessen the amount of DOM redrawing on -a builds that
    * may involve looping 24000 times. */
 
+  /* Lists changed other than at the end are drawn again. */
+  $.each(ports_redraw, function (status) {
+    $("#" + status + "_table")
+      .DataTable()
+      .clear()
+      .draw(false);
+    $("#" + status + "_body").removeData("index");
+  });
+  ports_redraw = {};
+
   if (data.ports) {
     if (data.ports["remaining"] === undefined) {
       data.ports["remaining"] = [];
@@ -133,6 +133,8 @@ gsub() {
 }
 fi
 
+# The hash_* builtins from poudriere-sh replace all of these.
+if ! type hash_set 2>/dev/null >&2; then
 _hash_var_name() {
 	# Replace anything not HASH_VAR_NAME_SUB_GLOB with _
 	_gsub_var_name "${HASH_VAR_NAME_PREFIX}B${1}_K${2}" _hash_var_name
@@ -186,23 +188,6 @@ hash_vars() {
 	return 0
 }
 
-hash_assert_no_vars() {
-       local -; set +x
-       [ "$#" -eq 1 ] || [ "$#" -eq 2 ] ||
-           eargs hash_assert_no_vars 'var|*' 'key|*'
-       local hanv_var="$1"
-       local hanv_key="${2-}"
-       local hanv_vars
-
-       if ! hash_vars hanv_vars "${hanv_var:?}" "${hanv_key}"; then
-               return 0
-       fi
-       for hanv_var in ${hanv_vars}; do
-	       msg_warn "Leaked hash var: ${hanv_var}"
-       done
-       return 1
-}
-
 hash_isset() {
 	local -; set +x
 	[ $# -eq 2 ] || eargs hash_isset var key
@@ -246,10 +231,6 @@ hash_get() {
 	getvar "${_hash_var_name}" "${3}"
 }
 
-hash_push() {
-	hash_push_front "$@"
-}
-
 hash_push_front() {
 	local -; set +x
 	[ $# -eq 3 ] || eargs hash_push_front var key value
@@ -274,10 +255,6 @@ hash_push_back() {
 	stack_push_back "${_hash_var_name}" "${hp_value}"
 }
 
-hash_pop() {
-	hash_pop_front "$@"
-}
-
 hash_pop_front() {
 	local -; set +x
 	[ $# -eq 3 ] || eargs hash_pop_front var key var_return
@@ -302,10 +279,6 @@ hash_pop_back() {
 	stack_pop_back "${_hash_var_name}" "${hp_var_return}"
 }
 
-hash_foreach() {
-	hash_foreach_front "$@"
-}
-
 hash_foreach_front() {
 	local -; set +x
 	[ $# -eq 4 ] || eargs hash_foreach_front var key var_return tmp_var
@@ -410,6 +383,148 @@ hash_unset_var() {
 	$(set)
 	EOF
 }
+else
+# The hash_* builtins keep the stack for a key in the hash itself rather
+# than in the mangled variable, so load it into a local, operate on it, and
+# store it back.  The count is kept under key_count, the same as the
+# variable which stack_push would create.
+_hash_stack_load() {
+	[ $# -eq 2 ] || eargs _hash_stack_load var key
+	# Set local _hash_stack and _hash_stack_count in the caller.
+	hash_get "$1" "$2" _hash_stack || :
+	hash_get "$1" "$2_count" _hash_stack_count || :
+}
+
+_hash_stack_store() {
+	local -; set +C
+	[ $# -eq 2 ] || eargs _hash_stack_store var key
+
+	if isset _hash_stack; then
+		hash_set "$1" "$2" "${_hash_stack}" || return
+		hash_set "$1" "$2_count" "${_hash_stack_count-}"
+	else
+		hash_unset "$1" "$2"
+		hash_unset "$1" "$2_count"
+	fi
+}
+
+hash_push_front() {
+	local -; set +x
+	[ $# -eq 3 ] || eargs hash_push_front var key value
+	local hpf_var="$1"
+	local hpf_key="$2"
+	local hpf_value="$3"
+	local _hash_stack _hash_stack_count
+
+	_hash_stack_load "${hpf_var}" "${hpf_key}"
+	stack_push_front _hash_stack "${hpf_value}" || return
+	_hash_stack_store "${hpf_var}" "${hpf_key}"
+}
+
+hash_push_back() {
+	local -; set +x
+	[ $# -eq 3 ] || eargs hash_push_back var key value
+	local hp_var="$1"
+	local hp_key="$2"
+	local hp_value="$3"
+	local _hash_stack _hash_stack_count
+
+	_hash_stack_load "${hp_var}" "${hp_key}"
+	stack_push_back _hash_stack "${hp_value}" || return
+	_hash_stack_store "${hp_var}" "${hp_key}"
+}
+
+hash_pop_front() {
+	local -; set +x
+	[ $# -eq 3 ] || eargs hash_pop_front var key var_return
+	local hpf_var="$1"
+	local hpf_key="$2"
+	local hpf_var_return="$3"
+	local _hash_stack _hash_stack_count hpf_ret
+
+	_hash_stack_load "${hpf_var}" "${hpf_key}"
+	hpf_ret=0
+	stack_pop_front _hash_stack "${hpf_var_return}" || hpf_ret="$?"
+	_hash_stack_store "${hpf_var}" "${hpf_key}" || return
+	return "${hpf_ret}"
+}
+
+hash_pop_back() {
+	local -; set +x
+	[ $# -eq 3 ] || eargs hash_pop_back var key var_return
+	local hp_var="$1"
+	local hp_key="$2"
+	local hp_var_return="$3"
+	local _hash_stack _hash_stack_count hp_ret
+
+	_hash_stack_load "${hp_var}" "${hp_key}"
+	hp_ret=0
+	stack_pop_back _hash_stack "${hp_var_return}" || hp_ret="$?"
+	_hash_stack_store "${hp_var}" "${hp_key}" || return
+	return "${hp_ret}"
+}
+
+hash_foreach_front() {
+	local -; set +x
+	[ $# -eq 4 ] || eargs hash_foreach_front var key var_return tmp_var
+	local hff_var="$1"
+	local hff_key="$2"
+	local hff_var_return="$3"
+	local hff_tmp_var="$4"
+	local _hash_stack _hash_stack_count
+
+	# Only the first iteration needs the stack; after that it is in
+	# tmp_var.
+	if ! isset "${hff_tmp_var}"; then
+		_hash_stack_load "${hff_var}" "${hff_key}"
+	fi
+	stack_foreach_front _hash_stack "${hff_var_return}" "${hff_tmp_var}"
+}
+
+hash_foreach_back() {
+	local -; set +x
+	[ $# -eq 4 ] || eargs hash_foreach_back var key var_return tmp_var
+	local hfb_var="$1"
+	local hfb_key="$2"
+	local hfb_var_return="$3"
+	local hfb_tmp_var="$4"
+	local _hash_stack _hash_stack_count
+
+	if ! isset "${hfb_tmp_var}"; then
+		_hash_stack_load "${hfb_var}" "${hfb_key}"
+	fi
+	stack_foreach_back _hash_stack "${hfb_var_return}" "${hfb_tmp_var}"
+}
+fi
+
+hash_assert_no_vars() {
+       local -; set +x
+       [ "$#" -eq 1 ] || [ "$#" -eq 2 ] ||
+           eargs hash_assert_no_vars 'var|*' 'key|*'
+       local hanv_var="$1"
+       local hanv_key="${2-}"
+       local hanv_vars
+
+       if ! hash_vars hanv_vars "${hanv_var:?}" "${hanv_key}"; then
+               return 0
+       fi
+       for hanv_var in ${hanv_vars}; do
+	       msg_warn "Leaked hash var: ${hanv_var}"
+       done
+       return 1
+}
+
+hash_push() {
+	hash_push_front "$@"
+}
+
+hash_pop() {
+	hash_pop_front "$@"
+}
+
+hash_foreach() {
+	hash_foreach_front "$@"
+}
 
 patternlist_match() {
 	local -; set +x -u
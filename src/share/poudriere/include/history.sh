@@ -0,0 +1,257 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+# Build history is kept per MASTERNAME across builds. It is an append-only
+# file with one line per package build:
+#   pkgbase epoch result elapsed logsize
+# result is one of built or failed. The file is compacted at the start of
+# each build to the last BUILD_HISTORY_KEEP entries per pkgbase.
+
+_history_path() {
+	local -; set -u +x
+
+	setvar "$1" "${POUDRIERE_DATA:?}/history/${MASTERNAME:?}"
+}
+
+history_enabled() {
+	case "${BUILD_HISTORY-}" in
+	yes) return 0 ;;
+	esac
+	return 1
+}
+
+# Record a finished package build.
+history_add() {
+	[ $# -eq 4 ] || eargs history_add pkgname result elapsed logfile
+	local pkgname="$1"
+	local result="$2"
+	local elapsed="$3"
+	local logfile="$4"
+	local history logsize
+
+	history_enabled || return 0
+	_history_path history
+	logsize="$(stat -f %z "${logfile}" 2>/dev/null)" || logsize=0
+	# A single short write with O_APPEND so concurrent builders
+	# do not interleave.
+	echo "${pkgname%-*} $(clock -epoch) ${result} ${elapsed} ${logsize}" \
+	    >> "${history:?}" || :
+}
+
+# Trim the history to the last BUILD_HISTORY_KEEP entries per pkgbase.
+# This must not be called while builders may be appending.
+history_compact() {
+	[ $# -eq 0 ] || eargs history_compact
+	local history
+
+	history_enabled || return 0
+	_history_path history
+	if [ ! -e "${history:?}" ]; then
+		mkdir -p "${history%/*}"
+		return 0
+	fi
+	awk -v keep="${BUILD_HISTORY_KEEP:?}" '
+	    {
+		n = ++count[$1]
+		line[$1, n] = $0
+		if (n == 1)
+			order[++npkgs] = $1
+	    }
+	    END {
+		for (i = 1; i <= npkgs; i++) {
+			pkgbase = order[i]
+			n = count[pkgbase]
+			first = n - keep + 1
+			if (first < 1)
+				first = 1
+			for (j = first; j <= n; j++)
+				print line[pkgbase, j]
+		}
+	    }
+	' "${history}" | write_atomic "${history}"
+}
+
+# Lookup the expected build time of each pkgname given on stdin.
+# Outputs: pkgname elapsed last_result builds
+# elapsed is the mean of the successful builds, or of the failed builds
+# if there were no successful ones. Packages with no history are not
+# output.
+history_lookup() {
+	[ $# -eq 0 ] || eargs history_lookup
+	local history
+
+	_history_path history
+	[ -r "${history:?}" ] || return 1
+	awk '
+	    FNR == NR {
+		if ($3 == "built") {
+			bsum[$1] += $4
+			bcnt[$1]++
+		} else {
+			fsum[$1] += $4
+			fcnt[$1]++
+		}
+		last[$1] = $3
+		next
+	    }
+	    {
+		pkgbase = $1
+		sub(/-[^-]*$/, "", pkgbase)
+		if (!(pkgbase in last))
+			next
+		if (bcnt[pkgbase])
+			elapsed = int(bsum[pkgbase] / bcnt[pkgbase])
+		else
+			elapsed = int(fsum[pkgbase] / fcnt[pkgbase])
+		print $1, elapsed, last[pkgbase], \
+		    bcnt[pkgbase] + fcnt[pkgbase]
+	    }
+	' "${history}" -
+}
+
+# Write "pkgname elapsed" for every package to build that has a known
+# build time. The previous build's .poudriere.ports.built is used if there
+# is no history yet. Returns 1 if nothing is known.
+history_load_buildtimes() {
+	[ $# -eq 1 ] || eargs history_load_buildtimes output
+	local output="$1"
+	local log_jail prev_built
+
+	if history_enabled; then
+		cut -d ' ' -f 1 "${MASTER_DATADIR:?}/tobuild_pkgs" |
+		    history_lookup |
+		    awk '{print $1, $2}' > "${output:?}" || :
+		if [ -s "${output}" ]; then
+			return 0
+		fi
+	fi
+	_log_path_jail log_jail
+	prev_built="${log_jail:?}/latest-done/.poudriere.ports.built"
+	if [ ! -s "${prev_built}" ]; then
+		unlink "${output}" 2>/dev/null || :
+		return 1
+	fi
+	awk '
+	    FNR == NR {
+		pkgbase = $2
+		sub(/-[^-]*$/, "", pkgbase)
+		elapsed[pkgbase] = $3
+		next
+	    }
+	    {
+		pkgbase = $1
+		sub(/-[^-]*$/, "", pkgbase)
+		if (pkgbase in elapsed)
+			print $1, elapsed[pkgbase]
+	    }
+	' "${prev_built}" "${MASTER_DATADIR:?}/tobuild_pkgs" > "${output:?}"
+	if [ ! -s "${output}" ]; then
+		unlink "${output}"
+		return 1
+	fi
+}
+
+# Load the expected build time of each package to build into the
+# history_eta hash. This is only done once per process; after that
+# history_estimate_remaining only reads what was added to the
+# .poudriere.ports.* lists since its last call.
+_history_eta_init() {
+	[ $# -eq 0 ] || eargs _history_eta_init
+	# shellcheck disable=SC2034
+	local hei_pkgname hei_elapsed hei_rest hei_sum hei_known hei_avg
+
+	[ -s "${MASTER_DATADIR:?}/pkg_buildtimes" ] || return 1
+	hei_sum=0
+	hei_known=0
+	while mapfile_read_loop "${MASTER_DATADIR:?}/pkg_buildtimes" \
+	    hei_pkgname hei_elapsed hei_rest; do
+		hash_set history_buildtime "${hei_pkgname}" "${hei_elapsed}"
+		hei_sum="$((hei_sum + hei_elapsed))"
+		hei_known="$((hei_known + 1))"
+	done
+	[ "${hei_known}" -gt 0 ] || return 1
+	hei_avg="$((hei_sum / hei_known))"
+	_history_eta_left=0
+	_history_eta_n=0
+	while mapfile_read_loop "${MASTER_DATADIR:?}/tobuild_pkgs" \
+	    hei_pkgname hei_rest; do
+		hash_remove history_buildtime "${hei_pkgname}" hei_elapsed ||
+		    hei_elapsed="${hei_avg}"
+		hash_set history_eta "${hei_pkgname}" "${hei_elapsed}"
+		_history_eta_left="$((_history_eta_left + hei_elapsed))"
+		_history_eta_n="$((_history_eta_n + 1))"
+	done
+	_history_eta_loaded=1
+}
+
+# Estimate the seconds remaining in the build from the expected build
+# times of the packages not yet finished, spread across the builders.
+# Packages without a known time are assumed to take the average time.
+# Each finished package is subtracted once as it shows up in the
+# .poudriere.ports.* lists so repeated calls do not rescan them.
+history_estimate_remaining() {
+	[ $# -eq 1 ] || eargs history_estimate_remaining var_return
+	local her_var_return="$1"
+	# shellcheck disable=SC2034
+	local her_log her_type her_handle her_originspec her_pkgname her_rest
+	local her_elapsed her_builders
+
+	case "${_history_eta_loaded-}" in
+	1) ;;
+	*) _history_eta_init || return 1 ;;
+	esac
+	_log_path her_log
+	for her_type in built failed skipped fetched; do
+		if ! hash_get history_eta_handle "${her_type}" her_handle; then
+			[ -e "${her_log:?}/.poudriere.ports.${her_type}" ] ||
+			    continue
+			mapfile her_handle \
+			    "${her_log:?}/.poudriere.ports.${her_type}" "re" ||
+			    continue
+			hash_set history_eta_handle "${her_type}" \
+			    "${her_handle}"
+		fi
+		# Reads stop at the current end of the list and pick up
+		# from there next time.
+		while mapfile_read "${her_handle}" her_originspec \
+		    her_pkgname her_rest; do
+			# Removed so repeated entries only count once.
+			hash_remove history_eta "${her_pkgname}" \
+			    her_elapsed || continue
+			_history_eta_left="$((_history_eta_left - her_elapsed))"
+			_history_eta_n="$((_history_eta_n - 1))"
+		done
+	done
+	her_builders="${PARALLEL_JOBS:?}"
+	if [ "${_history_eta_n}" -lt "${her_builders}" ]; then
+		her_builders="${_history_eta_n}"
+	fi
+	if [ "${her_builders}" -lt 1 ]; then
+		her_builders=1
+	fi
+	setvar "${her_var_return}" \
+	    "$((_history_eta_left / her_builders))"
+}
@@ -25,7 +25,7 @@
 # SUCH DAMAGE.
 
 stress_snapshot() {
-	local loadavg swapinfo elapsed now min_load loaddec loadpct ncpu
+	local loadavg swapinfo elapsed now min_load loaddec loadpct ncpu eta
 
 	loadavg=$(/sbin/sysctl -n vm.loadavg|/usr/bin/awk '{print $2,$3,$4}')
 	min_load="${loadavg%% *}"
@@ -45,6 +45,9 @@ stress_snapshot() {
 	bset snap_swapinfo "${swapinfo}"
 	bset snap_elapsed "${elapsed}"
 	bset snap_now "${now}"
+	if history_estimate_remaining eta; then
+		bset snap_eta "${eta}"
+	fi
 }
 
 html_json_main() {
@@ -72,13 +75,41 @@ html_json_main() {
 	log_path="${_relpath:?}"
 
 	while :; do
-		stress_snapshot
-		update_stats || :
-		build_all_json
+		if msg_level debug; then
+			html_json_tick
+		else
+			stress_snapshot
+			update_stats || :
+			build_all_json
+		fi
 		sleep "${HTML_JSON_UPDATE_INTERVAL}" 2>/dev/null
 	done
 }
 
+_html_json_now() {
+	local hjn_now
+
+	hjn_now="$(clock -monotonic -nsec)"
+	setvar "$1" "${hjn_now%.*}${hjn_now#*.}"
+}
+
+# Same as a html_json_main tick but log how long each step took.
+html_json_tick() {
+	local start snap stats end
+
+	_html_json_now start
+	stress_snapshot
+	_html_json_now snap
+	update_stats || :
+	_html_json_now stats
+	build_all_json
+	_html_json_now end
+	msg_debug "html_json tick: total=$(((end - start) / 1000))us" \
+	    "snapshot=$(((snap - start) / 1000))us" \
+	    "stats=$(((stats - snap) / 1000))us" \
+	    "json=$(((end - stats) / 1000))us${_html_json_stats:+ (${_html_json_stats})}"
+}
+
 build_all_json() {
 	required_env build_json \
 	    log_path_top! '' \
@@ -101,6 +132,12 @@ _build_json() {
 	local - ret
 
 	ret=0
+	if have_builtin html_json; then
+		# Only reads what changed since the last tick.  The changes
+		# are also logged to .data.events for the web UI to poll.
+		html_json -e -s _html_json_stats "${log_path:?}" || ret="$?"
+		return "${ret}"
+	fi
 	set_pipefail
 	/usr/bin/awk \
 	    -f "${AWKPREFIX:?}/json.awk" "${log_path:?}"/.poudriere.*[!%] |
@@ -0,0 +1,255 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 Bryan Drewery <bdrewery@FreeBSD.org>
+# All rights reserved.
+#
+# Redistribution and use in source and binary forms, with or without
+# modification, are permitted provided that the following conditions
+# are met:
+# 1. Redistributions of source code must retain the above copyright
+#    notice, this list of conditions and the following disclaimer.
+# 2. Redistributions in binary form must reproduce the above copyright
+#    notice, this list of conditions and the following disclaimer in the
+#    documentation and/or other materials provided with the distribution.
+#
+# THIS SOFTWARE IS PROVIDED BY THE AUTHOR AND CONTRIBUTORS ``AS IS'' AND
+# ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+# IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+# ARE DISCLAIMED.  IN NO EVENT SHALL THE AUTHOR OR CONTRIBUTORS BE LIABLE
+# FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL
+# DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS
+# OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION)
+# HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT
+# LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY
+# OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+# SUCH DAMAGE.
+
+# Persistent cache of the make -V lookups done while gathering ports
+# metadata.  It lives in ${POUDRIERE_DATA}/cache/metadata/${MASTERNAME}
+# under a directory named for a hash of everything outside of the ports
+# tree which can change the result: the jail version, osversion and arch,
+# the jail's make(1) and share/mk, make.conf, the port options and the
+# poudriere settings which change what is looked up.  A new context starts
+# a new, empty, cache.
+#
+# Each originspec has a file of:
+#   the port_var_fetch arguments
+#   the nanoseconds the lookup took
+#   the ports tree makefiles read by make (.MAKE.MAKEFILES) and the port dir
+#   the mtime, in nanoseconds, :size:inode of each of those files
+#   one line per fetched value
+# An entry is only used if the arguments and every file are unchanged.
+#
+# Not tracked: files a port only tests with exists(), or that did not
+# exist yet for a .sinclude, such as files in other ports or LOCALBASE;
+# the output of != commands; and the environment beyond the settings
+# above.  That is why METADATA_CACHE defaults to no; remove the cache
+# after changing any of those.
+
+METADATA_CACHE_VERSION=2
+
+metadata_cache_enabled() {
+	case "${METADATA_CACHE-}" in
+	yes) return 0 ;;
+	esac
+	return 1
+}
+
+_metadata_cache_path() {
+	local -; set -u +x
+
+	setvar "$1" "${POUDRIERE_DATA:?}/cache/metadata/${MASTERNAME:?}"
+}
+
+# Setup METADATA_CACHE_DIR for port_var_fetch_originspec_cached.
+metadata_cache_init() {
+	[ $# -eq 0 ] || eargs metadata_cache_init
+	local cache_base context dir jail_version
+
+	unset METADATA_CACHE_DIR
+	metadata_cache_enabled || return 0
+	_metadata_cache_path cache_base
+	jail_version=
+	_jget jail_version "${JAILNAME-}" version 2>/dev/null ||
+	    jail_version=
+	context="$({
+		echo "version ${METADATA_CACHE_VERSION}"
+		echo "arch ${ARCH-}"
+		echo "jail_version ${jail_version}"
+		echo "osversion ${JAIL_OSVERSION-}"
+		# An updated world may change make(1) or share/mk
+		# without changing the versions.
+		stat -f '%N %Fm:%z:%i' "${MASTERMNT:?}/usr/bin/make" \
+		    "${MASTERMNT:?}/usr/share/mk" \
+		    "${MASTERMNT:?}/usr/include/sys/param.h" \
+		    2>/dev/null || :
+		echo "features ${P_PORTS_FEATURES-}"
+		echo "overlays ${OVERLAYS-}"
+		echo "changed_options ${CHECK_CHANGED_OPTIONS-}"
+		echo "changed_deps ${CHECK_CHANGED_DEPS-}"
+		echo "non_root ${BUILD_AS_NON_ROOT-}"
+		cat "${MASTERMNT:?}/etc/make.conf" 2>/dev/null || :
+		# The options are copied in fresh for every build so
+		# only their content matters.
+		find "${MASTERMNT:?}/var/db/ports" -type f \
+		    -exec cat {} + 2>/dev/null | sort || :
+	} | sha256 -q)" || context=
+	case "${context}" in
+	"")
+		msg_warn "Unable to hash the metadata cache context; not using it"
+		return 0
+		;;
+	esac
+	# Only the current context is kept.
+	if [ -d "${cache_base:?}" ]; then
+		for dir in "${cache_base:?}"/*; do
+			case "${dir}" in
+			"${cache_base:?}/*") break ;;
+			"${cache_base:?}/${context:?}") continue ;;
+			esac
+			rm -rf "${dir:?}"
+		done
+	fi
+	dir="${cache_base:?}/${context:?}"
+	mkdir -p "${dir:?}" || return 0
+	METADATA_CACHE_DIR="${dir}"
+	:> "${MASTER_DATADIR:?}/metadata_cache.stats"
+}
+
+# Print the hit/miss counts and time saved since metadata_cache_init.
+metadata_cache_report() {
+	[ $# -eq 0 ] || eargs metadata_cache_report
+	local stats hits misses saved_ns saved
+
+	case "${METADATA_CACHE_DIR:+set}" in
+	"") return 0 ;;
+	esac
+	stats="${MASTER_DATADIR:?}/metadata_cache.stats"
+	[ -s "${stats}" ] || return 0
+	read -r hits misses saved_ns <<-EOF
+	$(awk '
+	    $1 == "hit" { hits++; saved += $2 }
+	    $1 == "miss" { misses++ }
+	    END { printf("%d %d %.0f\n", hits, misses, saved) }
+	' "${stats}")
+	EOF
+	calculate_duration saved "$((saved_ns / 1000000000))"
+	msg "Metadata cache: ${hits} hits, ${misses} misses, saved ${saved} of make time"
+	unlink "${stats}" || :
+}
+
+# Signature of the given files in the reference jail.
+_metadata_cache_sig() {
+	[ $# -eq 2 ] || eargs _metadata_cache_sig var_return files
+	local mcs_var_return="$1"
+	local mcs_files="$2"
+	local mcs_file mcs_paths mcs_sig
+	local -; set -f
+
+	mcs_paths=
+	for mcs_file in ${mcs_files}; do
+		mcs_paths="${mcs_paths:+${mcs_paths} }${MASTERMNT?}${mcs_file}"
+	done
+	# shellcheck disable=SC2086
+	mcs_sig="$(stat -f '%Fm:%z:%i' ${mcs_paths} 2>/dev/null)" || return 1
+	# shellcheck disable=SC2086
+	set -- ${mcs_sig}
+	setvar "${mcs_var_return}" "$*"
+}
+
+_metadata_cache_now() {
+	local mcn_now
+
+	mcn_now="$(clock -monotonic -nsec)"
+	setvar "$1" "${mcn_now%.*}${mcn_now#*.}"
+}
+
+# Same as port_var_fetch_originspec but use the metadata cache if
+# it is enabled.  Assignments and lookups are the same.
+port_var_fetch_originspec_cached() {
+	local -; set +x
+	[ $# -ge 3 ] || eargs port_var_fetch_originspec_cached originspec \
+	    PORTVAR var_set ...
+	local pvfc_originspec="$1"
+	shift
+	local pvfc_file pvfc_arg pvfc_want pvfc_vars pvfc_var pvfc_value
+	local pvfc_args pvfc_elapsed pvfc_makefiles pvfc_sig pvfc_cursig
+	local pvfc_nvars pvfc_start pvfc_end pvfc_origin pvfc_portdir
+	local pvfc_file_makefiles pvfc_makefile pvfc_data pvfc_nl
+
+	case "${METADATA_CACHE_DIR:+set}" in
+	"")
+		port_var_fetch_originspec "${pvfc_originspec}" "$@"
+		return
+		;;
+	esac
+	pvfc_file="${METADATA_CACHE_DIR:?}/${pvfc_originspec%/*}!${pvfc_originspec#*/}"
+	# The vars to set are every argument following a make variable.
+	pvfc_vars=
+	pvfc_nvars=0
+	pvfc_want=0
+	for pvfc_arg in "$@"; do
+		case "${pvfc_want}" in
+		1)
+			pvfc_vars="${pvfc_vars:+${pvfc_vars} }${pvfc_arg}"
+			pvfc_nvars="$((pvfc_nvars + 1))"
+			pvfc_want=0
+			continue
+			;;
+		esac
+		case "${pvfc_arg}" in
+		*=*) ;;
+		*) pvfc_want=1 ;;
+		esac
+	done
+
+	# shellcheck disable=SC2086,SC2154
+	if [ -f "${pvfc_file}" ] &&
+	    readlines_file "${pvfc_file}" pvfc_args pvfc_elapsed \
+	    pvfc_makefiles pvfc_sig ${pvfc_vars} &&
+	    [ "${_readlines_lines_read}" -eq "$((pvfc_nvars + 4))" ] &&
+	    [ "${pvfc_args}" = "$*" ] &&
+	    _metadata_cache_sig pvfc_cursig "${pvfc_makefiles}" &&
+	    [ "${pvfc_cursig}" = "${pvfc_sig}" ]; then
+		msg_debug "metadata cache hit for ${COLOR_PORT}${pvfc_originspec}${COLOR_RESET}"
+		echo "hit ${pvfc_elapsed}" >> \
+		    "${MASTER_DATADIR:?}/metadata_cache.stats"
+		return 0
+	fi
+
+	_metadata_cache_now pvfc_start
+	port_var_fetch_originspec "${pvfc_originspec}" "$@" \
+	    .MAKE.MAKEFILES pvfc_makefiles || return
+	_metadata_cache_now pvfc_end
+	pvfc_elapsed="$((pvfc_end - pvfc_start))"
+	echo "miss ${pvfc_elapsed}" >> \
+	    "${MASTER_DATADIR:?}/metadata_cache.stats"
+
+	# Only the ports tree files need to be checked.  Everything else
+	# is part of the context.  The port dir catches new files that
+	# may be .sinclude'd.
+	originspec_decode "${pvfc_originspec}" pvfc_origin '' ''
+	_lookup_portdir pvfc_portdir "${pvfc_origin}"
+	pvfc_file_makefiles="${pvfc_portdir} ${pvfc_portdir}/Makefile"
+	set -f
+	for pvfc_makefile in ${pvfc_makefiles}; do
+		case "${pvfc_makefile}" in
+		"${PORTSDIR:?}/"*|"${OVERLAYSDIR:?}/"*)
+			pvfc_file_makefiles="${pvfc_file_makefiles} ${pvfc_makefile}"
+			;;
+		esac
+	done
+	set +f
+	if ! _metadata_cache_sig pvfc_sig "${pvfc_file_makefiles}"; then
+		return 0
+	fi
+	pvfc_nl=$'\n'
+	pvfc_data="$*${pvfc_nl}${pvfc_elapsed}${pvfc_nl}${pvfc_file_makefiles}"
+	pvfc_data="${pvfc_data}${pvfc_nl}${pvfc_sig}"
+	for pvfc_var in ${pvfc_vars}; do
+		getvar "${pvfc_var}" pvfc_value || pvfc_value=
+		pvfc_data="${pvfc_data}${pvfc_nl}${pvfc_value}"
+	done
+	write_atomic "${pvfc_file}" "${pvfc_data}" ||
+	    msg_debug "Failed to write metadata cache for ${COLOR_PORT}${pvfc_originspec}${COLOR_RESET}"
+}
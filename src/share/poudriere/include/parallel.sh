@@ -464,17 +464,40 @@ kill_all_jobs() {
 
 _parallel_exec_exit() {
 	local ret="$?"
-	echo . >&8
+	# Hand our slot back to parallel_run.
+	echo "${PARALLEL_SLOT:-.}" >&8
 	return "${ret}"
 }
 
 _parallel_exec() {
-	setup_traps _parallel_exec_exit
+	case "${PARALLEL_POOL_BUILTIN:-0}" in
+	0) setup_traps _parallel_exec_exit ;;
+	esac
 	"$@"
 }
 
+# The parallel_pool builtin refills slots as jobs exit, found by wait(2).
+# Otherwise jobs hand their slot back over a fifo and are reaped by polling
+# jobs(1) every so often.
+if have_builtin parallel_pool; then
+	PARALLEL_POOL_BUILTIN=1
+fi
+
 parallel_start() {
-	local fifo
+	local fifo flag wflag reset
+	local OPTIND=1
+
+	wflag=0
+	reset=
+	while getopts "r:w" flag; do
+		case "${flag}" in
+		r) reset="${OPTARG}" ;;
+		w) wflag=1 ;;
+		*) err "${EX_USAGE:-64}" "parallel_start: Invalid flag ${flag}" ;;
+		esac
+	done
+	shift "$((OPTIND-1))"
+	[ "$#" -eq 0 ] || eargs parallel_start '[-w [-r reset_cmd]]'
 
 	case "${NBPARALLEL:+set}" in
 	set)
@@ -482,15 +505,30 @@ parallel_start() {
 		return 1
 		;;
 	esac
-	fifo="$(mktemp -ut parallel.pipe)"
-	mkfifo "${fifo}"
-	exec 8<> "${fifo}"
-	unlink "${fifo}" || :
+	: "${PARALLEL_JOBS:="$(nproc)"}"
+	case "${wflag}.${PARALLEL_WORKERS:-no}" in
+	1.yes) ;;
+	*) wflag=0 ;;
+	esac
+	case "${wflag}.${PARALLEL_POOL_BUILTIN:-0}" in
+	1.*) ;;
+	*.1)
+		parallel_pool start "${PARALLEL_JOBS:?}" || return
+		;;
+	*)
+		fifo="$(mktemp -ut parallel.pipe)"
+		mkfifo "${fifo}"
+		exec 8<> "${fifo}"
+		unlink "${fifo}" || :
+		;;
+	esac
 	NBPARALLEL=0
 	PARALLEL_JOBNOS=""
-	: "${PARALLEL_JOBS:="$(nproc)"}"
 	_SHOULD_REAP=0
 	delay_pipe_fatal_error
+	case "${wflag}" in
+	1) _parallel_workers_start "${reset}" || return ;;
+	esac
 }
 
 # For all running children, look for dead ones, collect their status, error out
@@ -527,18 +565,50 @@ _reap_children() {
 parallel_stop() {
 	[ "$#" -eq 0 ] || [ "$#" -eq 1 ] || eargs parallel_stop '[do_wait]'
 	local do_wait="${1:-1}"
-	local ret
+	local ret wret
 	local jobno -
 
 	ret=0
-	if [ "${do_wait}" -eq 1 ]; then
+	case "${_PARALLEL_WORKERS_DIR:+set}" in
+	set)
+		_parallel_workers_stop "${do_wait}" || ret="$?"
+		;;
+	esac
+	case "${_PARALLEL_WORKERS_DIR:+set}.${PARALLEL_POOL_BUILTIN:-0}.${do_wait}" in
+	set.*) ;;
+	.1.1)
+		while :; do
+			wret=0
+			parallel_pool wait ret || wret="$?"
+			case "${wret}" in
+			0) break ;;
+			# Wait again on SIGINFO interrupts
+			157) ;;
+			*)
+				ret="${wret}"
+				break
+				;;
+			esac
+		done
+		;;
+	*.1)
 		set -o noglob
 		# shellcheck disable=SC2086
 		_wait ${PARALLEL_JOBNOS} || ret="$?"
 		set +o noglob
-	fi
+		;;
+	esac
 
-	exec 8>&-
+	case "${_PARALLEL_WORKERS_DIR:+set}.${PARALLEL_POOL_BUILTIN:-0}" in
+	set.*)
+		exec 8>&-
+		rm -rf "${_PARALLEL_WORKERS_DIR:?}" || :
+		unset _PARALLEL_WORKERS_DIR _PARALLEL_WORKERS_IDLE \
+		    _PARALLEL_WORKERS_RESET
+		;;
+	.1) parallel_pool stop ;;
+	*) exec 8>&- ;;
+	esac
 	unset PARALLEL_JOBNOS
 	unset NBPARALLEL
 
@@ -559,6 +629,9 @@ parallel_shutdown() {
 
 	set -o noglob
 	ret=0
+	case "${_PARALLEL_WORKERS_DIR:+set}.${PARALLEL_POOL_BUILTIN:-0}.${NBPARALLEL:+set}" in
+	.1.set) parallel_pool jobs PARALLEL_JOBNOS || : ;;
+	esac
 	# PARALLEL_JOBNOS may be stale if we received SIGINT while
 	# inside of parallel_stop() or _reap_children(). Clean it up
 	# before kill_job() is called which asserts that all jobs are
@@ -577,15 +650,57 @@ parallel_shutdown() {
 }
 
 : "${PARALLEL_REAP_PERCENT:=200}"
+# Each job is given a PARALLEL_SLOT from 1 to PARALLEL_JOBS which no other
+# running job has.
+# -p prefixes the job's stderr as prefix_stderr_quick does.
 parallel_run() {
-	local ret
+	local ret slot extra
 	local spawn_jobid spawn_job spawn_pgid spawn_pid
 
 	ret=0
+	extra=
 	case "${NBPARALLEL:+set}" in
 	set) ;;
 	*) err 1 "parallel_run: did not parallel_start" ;;
 	esac
+	case "${1-}" in
+	-p)
+		[ "$#" -ge 3 ] || eargs parallel_run '[-p prefix]' cmd...
+		extra="$2"
+		shift 2
+		;;
+	esac
+
+	case "${_PARALLEL_WORKERS_DIR:+set}" in
+	set)
+		_parallel_workers_run "${extra}" "$@"
+		return
+		;;
+	esac
+	case "${extra:+set}" in
+	set) set -- prefix_stderr_quick "${extra}" "$@" ;;
+	esac
+
+	case "${PARALLEL_POOL_BUILTIN:-0}" in
+	1)
+		local wret
+
+		while :; do
+			wret=0
+			parallel_pool get slot ret || wret="$?"
+			case "${wret}" in
+			0) break ;;
+			# Wait again on SIGINFO interrupts
+			157) ;;
+			*) return "${wret}" ;;
+			esac
+		done
+		PARALLEL_CHILD=1 PARALLEL_SLOT="${slot}" \
+		    spawn_job _parallel_exec "$@"
+		parallel_pool add "%${spawn_jobid:?}" "${slot}"
+		return "${ret}"
+		;;
+	esac
 
 	# Occasionally reap dead children. Don't do this too often or it
 	# becomes a bottleneck.
@@ -600,6 +715,7 @@ parallel_run() {
 
 	# Only read once all slots are taken up; burst jobs until maxed out.
 	# NBPARALLEL is never decreased and only increased until maxed.
+	slot=
 	case "${NBPARALLEL}" in
 	"${PARALLEL_JOBS}")
 		local a
@@ -607,6 +723,7 @@ parallel_run() {
 		if read_blocking a <&8; then
 			case "${a}" in
 			".") ;;
+			[0-9]*) slot="${a}" ;;
 			*) err 1 "parallel_run: Invalid token: ${a}" ;;
 			esac
 		fi
@@ -615,13 +732,269 @@ parallel_run() {
 
 	if [ "${NBPARALLEL}" -lt "${PARALLEL_JOBS}" ]; then
 		NBPARALLEL="$((NBPARALLEL + 1))"
+		slot="${NBPARALLEL}"
 	fi
-	PARALLEL_CHILD=1 spawn_job _parallel_exec "$@"
+	PARALLEL_CHILD=1 PARALLEL_SLOT="${slot}" spawn_job _parallel_exec "$@"
 	list_add PARALLEL_JOBNOS "%${spawn_jobid}"
 
 	return "${ret}"
 }
 
+# Worker mode, parallel_start -w, is for phases which run a cheap function
+# for many items.  Rather than forking a job for every parallel_run,
+# PARALLEL_JOBS worker shells are forked once and each parallel_run hands its
+# command to an idle worker over that worker's fifo.  A worker reports back
+# on the shared fifo on fd 8 when the command is done.  The command runs in
+# the worker itself so any globals it sets are seen by the next command in
+# that worker.  Commands should only set locals and keep what they find in
+# files or shash.  Anything else must be cleared by the -r reset_cmd which
+# the worker runs after each command.  A worker which exits, such as from
+# err() or errexit, reports its status from its exit handler and is
+# replaced.
+# Protocol:
+#   request: :prefix\037arg\037...\037:  or "." to exit
+#   response: slot status [exit]
+_PARALLEL_WORKER_SEP=$'\037'
+
+_parallel_workers_start() {
+	[ "$#" -eq 1 ] || eargs _parallel_workers_start reset_cmd
+	local reset="$1"
+	local slot dir
+
+	dir="$(mktemp -dt parallel_workers)" || return
+	mkfifo "${dir:?}/results" || return
+	exec 8<> "${dir:?}/results"
+	_PARALLEL_WORKERS_DIR="${dir}"
+	_PARALLEL_WORKERS_RESET="${reset}"
+	_PARALLEL_WORKERS_IDLE=
+	_PARALLEL_WORKERS_SEQ=0
+	slot=0
+	until [ "${slot}" -eq "${PARALLEL_JOBS:?}" ]; do
+		slot="$((slot + 1))"
+		mkfifo "${dir:?}/${slot}" || return
+		_parallel_worker_spawn "${slot}" || return
+		list_add _PARALLEL_WORKERS_IDLE "${slot}"
+	done
+	msg_dev "parallel_start: Started ${PARALLEL_JOBS} workers"
+}
+
+_parallel_workers_stop() {
+	[ "$#" -eq 1 ] || eargs _parallel_workers_stop do_wait
+	local do_wait="$1"
+	local ret wret seq retseq slot job -
+
+	ret=0
+	retseq=0
+	case "${do_wait}" in
+	1)
+		while [ "${NBPARALLEL}" -gt 0 ]; do
+			wret=0
+			_parallel_workers_collect seq || wret="$?"
+			case "${wret}" in
+			0) continue ;;
+			esac
+			# Like _wait, keep the status of the last command
+			# that failed.
+			if [ "${seq:-0}" -ge "${retseq}" ]; then
+				ret="${wret}"
+				retseq="${seq:-0}"
+			fi
+		done
+		;;
+	esac
+	slot=0
+	until [ "${slot}" -eq "${PARALLEL_JOBS:?}" ]; do
+		slot="$((slot + 1))"
+		hash_unset parallel_worker_seq "${slot}"
+		hash_remove parallel_worker_job "${slot}" job || continue
+		case "${do_wait}" in
+		1) echo "." 1<> "${_PARALLEL_WORKERS_DIR:?}/${slot}" ;;
+		esac
+	done
+	case "${do_wait}" in
+	1)
+		set -o noglob
+		# The statuses were already collected from the fifo.
+		# shellcheck disable=SC2086
+		_wait ${PARALLEL_JOBNOS} || :
+		set +o noglob
+		;;
+	esac
+	return "${ret}"
+}
+
+_parallel_worker_spawn() {
+	[ "$#" -eq 1 ] || eargs _parallel_worker_spawn slot
+	local slot="$1"
+	local spawn_jobid spawn_job spawn_pgid spawn_pid
+
+	# Hold the fifo open from before forking so nothing written to it
+	# is lost before the worker opens it.
+	PARALLEL_CHILD=1 PARALLEL_SLOT="${slot}" \
+	    spawn_job _parallel_worker_main "${slot}" \
+	    0<> "${_PARALLEL_WORKERS_DIR:?}/${slot}" || return
+	hash_set parallel_worker_job "${slot}" "${spawn_job:?}"
+	list_add PARALLEL_JOBNOS "${spawn_job:?}"
+}
+
+_parallel_worker_main() {
+	[ "$#" -eq 1 ] || eargs _parallel_worker_main slot
+	local slot="$1"
+
+	setproctitle "parallel worker ${slot}" || :
+	set_pipefail
+	{
+		_parallel_worker_loop "${slot}" 2>&1 1>&3 |
+		    _parallel_worker_stderr
+	} 3>&1
+}
+
+_parallel_worker_exit() {
+	local ret="$?"
+
+	echo "${PARALLEL_SLOT:?} ${ret} exit" >&8
+	return "${ret}"
+}
+
+_parallel_worker_loop() {
+	[ "$#" -eq 1 ] || eargs _parallel_worker_loop slot
+	local slot="$1"
+	local pwl_line pwl_extra pwl_ret sep
+
+	sep="${_PARALLEL_WORKER_SEP}"
+	setup_traps _parallel_worker_exit
+	pwl_extra=
+	while mapfile_read_loop_redir pwl_line; do
+		case "${pwl_line}" in
+		".") break ;;
+		esac
+		pwl_line="${pwl_line#:}"
+		pwl_line="${pwl_line%:}"
+		# Only tell the stderr filter when the prefix changes.
+		case "${pwl_line%%"${sep}"*}" in
+		"${pwl_extra}") ;;
+		*)
+			pwl_extra="${pwl_line%%"${sep}"*}"
+			printf "\001%s\n" "${pwl_extra}" >&2
+			;;
+		esac
+		# With errexit a failure exits the worker, as it would a
+		# forked job, and the exit handler reports it instead.
+		_parallel_worker_exec "${pwl_extra}" "${pwl_line#*"${sep}"}" \
+		    < /dev/null
+		pwl_ret="$?"
+		case "${_PARALLEL_WORKERS_RESET:+set}" in
+		set)
+			"${_PARALLEL_WORKERS_RESET}" ||
+			    err 1 "parallel_run: ${_PARALLEL_WORKERS_RESET} failed"
+			;;
+		esac
+		echo "${slot} ${pwl_ret}" >&8
+	done 0<> "${_PARALLEL_WORKERS_DIR:?}/${slot}"
+}
+
+_parallel_worker_exec() {
+	[ "$#" -eq 2 ] || eargs _parallel_worker_exec extra args
+	local extra="$1"
+	local IFS MSG_NESTED_STDERR
+
+	case "${extra:+set}" in
+	set)
+		# shellcheck disable=SC2034
+		MSG_NESTED_STDERR=1
+		;;
+	esac
+	IFS="${_PARALLEL_WORKER_SEP}"
+	set -o noglob
+	# shellcheck disable=SC2086
+	set -- $2
+	set +o noglob
+	unset IFS
+	"$@"
+}
+
+# Same as prefix_stderr_quick but the prefix is sent by the worker before
+# each command.
+_parallel_worker_stderr() {
+	local line extra soh
+
+	soh=$'\001'
+	extra=
+	while read_blocking_line line; do
+		case "${line}" in
+		"${soh}"*)
+			extra="${line#"${soh}"}"
+			continue
+			;;
+		esac
+		case "${extra:+set}" in
+		set) msg_warn "${extra}: ${line}" ;;
+		*) echo "${line}" >&2 ;;
+		esac
+	done
+}
+
+_parallel_workers_run() {
+	[ "$#" -ge 2 ] || eargs _parallel_workers_run extra cmd...
+	local extra="$1"
+	shift
+	local ret slot arg line sep nl
+
+	sep="${_PARALLEL_WORKER_SEP}"
+	nl=$'\n'
+	line="${extra}"
+	for arg in "${extra}" "$@"; do
+		case "${arg}" in
+		*"${sep}"*|*"${nl}"*)
+			err "${EX_SOFTWARE:-70}" "parallel_run: Cannot pass '${arg}' to a worker"
+			;;
+		esac
+	done
+	for arg in "$@"; do
+		line="${line}${sep}${arg}"
+	done
+	ret=0
+	while [ "${NBPARALLEL}" -eq "${PARALLEL_JOBS}" ]; do
+		_parallel_workers_collect || ret="$?"
+	done
+	slot="${_PARALLEL_WORKERS_IDLE%% *}"
+	list_remove _PARALLEL_WORKERS_IDLE "${slot:?}"
+	NBPARALLEL="$((NBPARALLEL + 1))"
+	_PARALLEL_WORKERS_SEQ="$((_PARALLEL_WORKERS_SEQ + 1))"
+	hash_set parallel_worker_seq "${slot}" "${_PARALLEL_WORKERS_SEQ}"
+	echo ":${line}${sep}:" 1<> "${_PARALLEL_WORKERS_DIR:?}/${slot}"
+	return "${ret}"
+}
+
+# Wait for a worker to finish its command and return its status.
+_parallel_workers_collect() {
+	[ "$#" -le 1 ] || eargs _parallel_workers_collect '[seq_var]'
+	local pwc_seq_var="${1-}"
+	local pwc_slot pwc_status pwc_exit pwc_job
+
+	read_blocking pwc_slot pwc_status pwc_exit <&8 || return
+	NBPARALLEL="$((NBPARALLEL - 1))"
+	case "${pwc_exit}" in
+	exit)
+		if hash_remove parallel_worker_job "${pwc_slot}" pwc_job; then
+			_wait "${pwc_job}" || :
+			list_remove PARALLEL_JOBNOS "${pwc_job}" || :
+		fi
+		msg_dev "parallel_run: Worker ${pwc_slot} exited ${pwc_status}"
+		_parallel_worker_spawn "${pwc_slot}" ||
+		    err 1 "parallel_run: Failed to replace worker ${pwc_slot}"
+		;;
+	esac
+	list_add _PARALLEL_WORKERS_IDLE "${pwc_slot}"
+	case "${pwc_seq_var:+set}" in
+	set)
+		hash_get parallel_worker_seq "${pwc_slot}" "${pwc_seq_var}" ||
+		    setvar "${pwc_seq_var}" 0
+		;;
+	esac
+	return "${pwc_status}"
+}
+
 nohang() {
 	[ "$#" -gt 5 ] || eargs nohang cmd_timeout log_timeout logfile pidfile cmd
 	local cmd_timeout
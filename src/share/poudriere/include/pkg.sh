@@ -49,17 +49,21 @@ pkg_get_origin() {
 	local var_return="$1"
 	local pkg="$2"
 	local _origin="${3-}"
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
 
-	get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 	case "${_origin}" in
 	"")
-		if ! shash_get 'pkg' 'origin' _origin; then
+		if _pkg_metadata_get _origin "${pkg}" origin; then
+			:
+		elif get_pkg_cache_dir SHASH_VAR_PATH "${pkg}" &&
+		    ! shash_get 'pkg' 'origin' _origin; then
 			_origin=$(injail "${PKG_BIN:?}" query -F \
 			    "/packages/All/${pkg##*/}" "%o") || return
+			shash_set 'pkg' 'origin' "${_origin}"
 		fi
-		;& # FALLTHROUGH
+		;;
 	*)
+		get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 		shash_set 'pkg' 'origin' "${_origin}"
 		;;
 	esac
@@ -76,9 +80,13 @@ pkg_get_generic_list() {
 	local flags="$2"
 	local _pggl_mapfile_var="$3"
 	local _pkg="$4"
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
-	local Tflag
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
+	local Tflag pggl_list
 
+	if _pkg_metadata_get pggl_list "${_pkg}" "${name}"; then
+		_pkg_metadata_list "${pggl_list}" "${_pggl_mapfile_var}"
+		return
+	fi
 	# If outputting the value to stdout then tee it on cache miss,
 	# and shash_read it on cache hit.
 	case "${_pggl_mapfile_var}" in
@@ -121,17 +129,22 @@ pkg_get_shlib_required_count() {
 	local var_return="$1"
 	local pkg="$2"
 	local _count=$3
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
 
-	get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 	case "${_count}" in
 	"")
-		if ! shash_get 'pkg' 'shlib_required_count' _count; then
+		if _pkg_metadata_get _count "${pkg}" \
+		    shlib_required_count; then
+			:
+		elif get_pkg_cache_dir SHASH_VAR_PATH "${pkg}" &&
+		    ! shash_get 'pkg' 'shlib_required_count' _count; then
 			_count=$(injail "${PKG_BIN:?}" query -F \
 			    "/packages/All/${pkg##*/}" "%#B") || return
+			shash_set 'pkg' 'shlib_required_count' "${_count}"
 		fi
-		;& # FALLTHROUGH
+		;;
 	*)
+		get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 		shash_set 'pkg' 'shlib_required_count' "${_count}"
 		;;
 	esac
@@ -206,17 +219,21 @@ pkg_get_arch() {
 	local var_return="$1"
 	local pkg="$2"
 	local _arch=$3
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
 
-	get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 	case "${_arch}" in
 	"")
-		if ! shash_get 'pkg' 'arch' _arch; then
+		if _pkg_metadata_get _arch "${pkg}" arch; then
+			:
+		elif get_pkg_cache_dir SHASH_VAR_PATH "${pkg}" &&
+		    ! shash_get 'pkg' 'arch' _arch; then
 			_arch=$(injail "${PKG_BIN:?}" query -F \
 			    "/packages/All/${pkg##*/}" "%q") || return
+			shash_set 'pkg' 'arch' "${_arch}"
 		fi
-		;& # FALLTHROUGH
+		;;
 	*)
+		get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
 		shash_set 'pkg' 'arch' "${_arch}"
 		;;
 	esac
@@ -234,15 +251,17 @@ pkg_get_dep_origin_pkgnames() {
 	local var_return_origins="$1"
 	local var_return_pkgnames="$2"
 	local pkg="$3"
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
 	local fetched_data compiled_dep_origins compiled_dep_pkgnames
 	local origin pkgname
 	local -
 
 	compiled_dep_origins=
 	compiled_dep_pkgnames=
-	get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
-	if ! shash_get 'pkg' 'deps' fetched_data; then
+	if _pkg_metadata_get fetched_data "${pkg}" deps; then
+		:
+	elif get_pkg_cache_dir SHASH_VAR_PATH "${pkg}" &&
+	    ! shash_get 'pkg' 'deps' fetched_data; then
 		fetched_data=$(set_pipefail; \
 		    injail "${PKG_BIN:?}" query -F \
 		    "/packages/All/${pkg##*/}" '%do %dn-%dv' |
@@ -294,12 +313,14 @@ pkg_get_options() {
 	[ $# -eq 2 ] || eargs pkg_get_options var_return pkg
 	local var_return="$1"
 	local pkg="$2"
-	local SHASH_VAR_PATH SHASH_VAR_PREFIX=
-	local _compiled_options
+	local SHASH_VAR_PATH SHASH_VAR_PREFIX= SHASH_BACKEND=file
+	local _compiled_options key value
 
 	_compiled_options=
-	get_pkg_cache_dir SHASH_VAR_PATH "${pkg}"
-	if ! shash_get 'pkg' 'options2' _compiled_options; then
+	if _pkg_metadata_get _compiled_options "${pkg}" options2; then
+		:
+	elif get_pkg_cache_dir SHASH_VAR_PATH "${pkg}" &&
+	    ! shash_get 'pkg' 'options2' _compiled_options; then
 		local pgo_options
 
 		_compiled_options=
@@ -392,6 +413,8 @@ get_cache_dir() {
 }
 
 # Return the cache dir for the given pkg
+# The cache dir is persistent and used as SHASH_VAR_PATH with the file
+# shash backend.
 # @param var_return The variable to set the result in
 # @param string pkg $PKGDIR/All/PKGNAME.PKG_EXT
 get_pkg_cache_dir() {
@@ -456,6 +479,239 @@ delete_stale_pkg_cache() {
 	return 0
 }
 
+# The pkg_get_* data for every package in ${PACKAGES}/All is kept in a single
+# index file rather than a cache dir per package.  Each line is one package,
+# with fields separated by \036:
+#   pkg file, mtime:size:inode, origin, arch, shlib_required_count,
+#   options2, deps, annotations, shlib_requires, shlib_provides
+# List fields separate their lines with \037.  An entry is only used while
+# the package file signature matches.  pkg_metadata_index_update loads it
+# into the pkg_metadata hash; packages built after that use the
+# get_pkg_cache_dir cache.
+_PKG_METADATA_INDEX_FIELDS="origin arch shlib_required_count options2 deps annotations shlib_requires shlib_provides"
+
+# Run in the jail.  Reads "pkgfile sig" lines and writes the pkg query
+# output for each, prefixed by type.  A record ends with "." and a failed
+# query adds "!".
+_PKG_METADATA_EXTRACT_SCRIPT='
+pkg_bin="$1"
+while read -r file sig; do
+	pkg="/packages/All/${file}"
+	echo "@ ${file} ${sig}"
+	"${pkg_bin}" query -F "${pkg}" "o %o	%q	%#B" || echo "!"
+	{ "${pkg_bin}" query -F "${pkg}" "O %Ok %Ov" || echo "!"; } | sort
+	{ "${pkg_bin}" query -F "${pkg}" "A %At %Av" || echo "!"; } | sort
+	"${pkg_bin}" query -F "${pkg}" "D %do %dn-%dv" || echo "!"
+	{ "${pkg_bin}" query -F "${pkg}" "B %B" || echo "!"; } | sort
+	{ "${pkg_bin}" query -F "${pkg}" "b %b" || echo "!"; } | sort
+	echo "."
+done
+'
+
+_pkg_metadata_index_path() {
+	setvar "$1" "${POUDRIERE_DATA:?}/cache/pkg_metadata/${MASTERNAME:?}.idx"
+}
+
+_pkg_metadata_extract() {
+	[ $# -eq 2 ] || eargs _pkg_metadata_extract listfile outfile
+	local listfile="$1"
+	local outfile="$2"
+
+	injail /bin/sh -c "${_PKG_METADATA_EXTRACT_SCRIPT}" pkg_metadata \
+	    "${PKG_BIN:?}" < "${listfile:?}" > "${outfile:?}"
+}
+
+# Bring the package metadata index up to date with ${PACKAGES}/All in one
+# pass and load it.  Only new or changed packages are queried.
+pkg_metadata_index_update() {
+	[ $# -eq 0 ] || eargs pkg_metadata_index_update
+	local index index_in tmpdir line missing chunk ret rs
+
+	hash_unset_var pkg_metadata
+	package_dir_exists_and_has_packages || return 0
+	ensure_pkg_installed || return 0
+	_pkg_metadata_index_path index
+	mkdir -p "${index%/*}" || return
+	_mktemp tmpdir -d -t pkg_metadata || return
+	index_in="${index}"
+	[ -f "${index_in}" ] || index_in=/dev/null
+	# Keep the entries which are still valid and list the packages
+	# which need to be queried, spread over PARALLEL_JOBS lists.
+	stat -L -f '%N %m:%z:%i' "${PACKAGES:?}"/All/*.${PKG_EXT} \
+	    > "${tmpdir:?}/current" 2>/dev/null || :
+	missing="$(awk -v FS='\036' -v jobs="${PARALLEL_JOBS:?}" \
+	    -v tmpdir="${tmpdir:?}" '
+	    FILENAME == ARGV[1] {
+		split($0, a, " ")
+		file = a[1]
+		sub(/.*\//, "", file)
+		current[file] = a[2]
+		next
+	    }
+	    ($1 in current) && current[$1] == $2 && !($1 in kept) {
+		kept[$1] = 1
+		print > (tmpdir "/index")
+	    }
+	    END {
+		for (file in current) {
+			if (file in kept)
+				continue
+			print file, current[file] > \
+			    (tmpdir "/list." (missing++ % jobs))
+		}
+		print missing + 0
+	    }' "${tmpdir:?}/current" "${index_in:?}")" || {
+		msg_warn "Failed to read package metadata index ${index}"
+		rm -rf "${tmpdir:?}"
+		return 1
+	}
+	ret=0
+	if [ "${missing}" -gt 0 ]; then
+		msg "Indexing metadata for ${missing} packages"
+		parallel_start || err 1 "parallel_start"
+		for chunk in "${tmpdir:?}"/list.*; do
+			case "${chunk}" in
+			"${tmpdir:?}/list.*") break ;;
+			esac
+			parallel_run _pkg_metadata_extract "${chunk}" \
+			    "${chunk%/*}/out.${chunk##*.}"
+		done
+		parallel_stop || ret="$?"
+		awk -v OFS='\036' -v US='\037' '
+		    function item(list, value) {
+			return (list == "" ? "" : list US) value
+		    }
+		    $1 == "@" {
+			file = $2
+			sig = $3
+			origin = arch = count = options = deps = ""
+			annotations = requires = provides = ""
+			bad = optdone = 0
+			next
+		    }
+		    $0 == "!" { bad = 1; next }
+		    $0 == "." {
+			if (!bad && file != "")
+				print file, sig, origin, arch, count, options,
+				    deps, annotations, requires, provides
+			file = ""
+			next
+		    }
+		    {
+			type = substr($0, 1, 2)
+			value = substr($0, 3)
+		    }
+		    type == "o " {
+			split(value, a, "\t")
+			origin = a[1]
+			arch = a[2]
+			count = a[3]
+		    }
+		    type == "O " && !optdone {
+			split(value, a, " ")
+			if (a[2] == "off" || a[2] == "false")
+				a[1] = "-" a[1]
+			else if (a[2] == "on" || a[2] == "true")
+				a[1] = "+" a[1]
+			else {
+				# no options
+				optdone = 1
+				next
+			}
+			options = (options == "" ? "" : options " ") a[1]
+		    }
+		    type == "D " { deps = deps value " " }
+		    type == "A " { annotations = item(annotations, value) }
+		    type == "B " { requires = item(requires, value) }
+		    type == "b " { provides = item(provides, value) }
+		' "${tmpdir:?}"/out.* >> "${tmpdir:?}/index" || ret="$?"
+	fi
+	if [ "${ret}" -eq 0 ]; then
+		touch "${tmpdir:?}/index"
+		rename "${tmpdir:?}/index" "${index:?}" || ret="$?"
+	else
+		msg_warn "Failed to index package metadata"
+	fi
+	if [ -f "${index}" ]; then
+		rs=$'\036'
+		while IFS= read -r line; do
+			hash_set pkg_metadata "${line%%"${rs}"*}" "${line}"
+		done < "${index}"
+	fi
+	rm -rf "${tmpdir:?}"
+	return "${ret}"
+}
+
+# Lookup one of _PKG_METADATA_INDEX_FIELDS for the given package.
+_pkg_metadata_get() {
+	[ $# -eq 3 ] || eargs _pkg_metadata_get var_return pkg field
+	local pmg_var_return="$1"
+	local pmg_pkg="$2"
+	local pmg_field="$3"
+	local pmg_line pmg_sig pmg_name
+	local IFS -
+
+	hash_get pkg_metadata "${pmg_pkg##*/}" pmg_line || return 1
+	pmg_sig="$(stat -L -f '%m:%z:%i' "${pmg_pkg}" 2>/dev/null)" ||
+	    return 1
+	set -f
+	IFS=$'\036'
+	# shellcheck disable=SC2086
+	set -- ${pmg_line}
+	unset IFS
+	case "$2" in
+	"${pmg_sig}") ;;
+	*) return 1 ;;
+	esac
+	shift 2
+	for pmg_name in ${_PKG_METADATA_INDEX_FIELDS}; do
+		case "${pmg_name}" in
+		"${pmg_field}")
+			setvar "${pmg_var_return}" "${1-}"
+			return
+			;;
+		esac
+		[ "$#" -eq 0 ] || shift
+	done
+	err "${EX_SOFTWARE}" "_pkg_metadata_get: Unknown field ${pmg_field}"
+}
+
+# Return a list field the same as pkg_get_generic_list does.
+_pkg_metadata_list() {
+	[ $# -eq 2 ] || eargs _pkg_metadata_list list mapfile_handle_var
+	local pml_list="$1"
+	local pml_mapfile_var="$2"
+	local pml_tmp pml_ret
+	local IFS -
+
+	case "${pml_mapfile_var}" in
+	"") return 0 ;;
+	-)
+		set -f
+		IFS=$'\037'
+		# shellcheck disable=SC2086
+		set -- ${pml_list}
+		unset IFS
+		[ "$#" -eq 0 ] || printf "%s\n" "$@"
+		;;
+	*)
+		# mapfile needs a file.  It is unlinked once opened.
+		_mktemp pml_tmp || return
+		pml_ret=0
+		_pkg_metadata_list "${pml_list}" - > "${pml_tmp:?}" ||
+		    pml_ret="$?"
+		case "${pml_ret}" in
+		0)
+			mapfile -q "${pml_mapfile_var}" "${pml_tmp}" "re" ||
+			    pml_ret="$?"
+			;;
+		esac
+		unlink "${pml_tmp}"
+		return "${pml_ret}"
+		;;
+	esac
+}
+
 # If the user ran pkg-repo in the wrong directory we need to undo that.
 delete_bad_pkg_repo_files() {
 	local ext file
@@ -484,6 +740,9 @@ delete_all_pkgs() {
 	get_cache_dir cache_dir
 	msg_n "${reason}, cleaning all packages..."
 	rm -rf ${PACKAGES:?}/* ${cache_dir}
+	_pkg_metadata_index_path cache_dir
+	rm -f "${cache_dir:?}"
+	hash_unset_var pkg_metadata
 	echo " done"
 }
 
@@ -65,6 +65,25 @@ pkgqueue_job_encode() {
 	setvar "${var_return}" "${__pkgqueue_job}"
 }
 
+if ! have_builtin pkgqueue_find_ready; then
+# Find the first ready-to-run job in the given pool buckets, in order.
+pkgqueue_find_ready() {
+	[ $# -ge 2 ] || eargs pkgqueue_find_ready var_return bucket...
+	local pfr_var_return="$1"
+	local pfr_dir
+	shift
+
+	pfr_dir="$(find "$@" \
+	    -ignore_readdir_race \
+	    -type d -depth 1 -empty -print -quit || :)"
+	setvar "${pfr_var_return}" "${pfr_dir}" || return
+	case "${pfr_dir:+set}" in
+	set) return 0 ;;
+	esac
+	return 1
+}
+fi
+
 ## Pick the next package from the "ready to build" queue in pool/
 ## Then move the package to the "running" dir in running/
 ## This is only ran from 1 process
@@ -78,9 +97,8 @@ pkgqueue_get_next() {
 	# May need to try multiple times due to races and queued-for-order jobs
 	recheck_empty=0
 	while :; do
-		pkgq_dir="$(find ${POOL_BUCKET_DIRS:?} \
-		    -ignore_readdir_race \
-		    -type d -depth 1 -empty -print -quit || :)"
+		# shellcheck disable=SC2086
+		pkgqueue_find_ready pkgq_dir ${POOL_BUCKET_DIRS:?} || :
 		# Check twice that the queue is empty. This avoids racing with
 		# pkgqueue_clean_queue() and pkgqueue_balance_pool() moving files
 		# between the dirs; find does not have an atomic view of
@@ -330,12 +348,18 @@ pkgqueue_add_dep() {
 	local job_name="$2"
 	local dep_job_type="$3"
 	local dep_job_name="$4"
-	local pkg_dir_name pkgqueue_job dep_pkgqueue_job
+	local pkg_dir_name pkgqueue_job dep_pkgqueue_job rdep_dir_name
 
 	pkgqueue_job_encode pkgqueue_job "${job_type}" "${job_name}"
 	pkgqueue_dir pkg_dir_name "${pkgqueue_job}"
 	pkgqueue_job_encode dep_pkgqueue_job "${dep_job_type}" "${dep_job_name}"
-	:> "deps/${pkg_dir_name}/${dep_pkgqueue_job}"
+	:> "deps/${pkg_dir_name}/${dep_pkgqueue_job}" || return
+	# Record the back reference now rather than walking all of deps/
+	# later. This is used for quickly finding things to skip if the
+	# dependency fails.
+	pkgqueue_dir rdep_dir_name "${dep_pkgqueue_job}"
+	mkdir -p "rdeps/${rdep_dir_name}" || return
+	:> "rdeps/${rdep_dir_name}/${pkgqueue_job}"
 }
 
 # Remove myself from the remaining list of dependencies for anything
@@ -402,12 +426,14 @@ _pkgqueue_clean_rdeps() {
 
 			# Look for packages that are now ready to build. They
 			# have no remaining dependencies. Move them to
-			# /unbalanced for later processing.
-			# shellcheck disable=SC2086
-			echo "${deps_to_check}" |
-			    xargs -J % \
-			    find % -type d -maxdepth 0 -empty |
-			    xargs -J % mv % "pool/unbalanced" || :
+			# /unbalanced for later processing. This is O(rdeps)
+			# without forking; losing a race to another
+			# pkgqueue_clean_queue() is harmless.
+			for dep_dir in ${deps_to_check}; do
+				dirempty "${dep_dir}" || continue
+				rename -q "${dep_dir}" \
+				    "pool/unbalanced/${dep_dir##*/}" || :
+			done
 			;;
 		# Errors are hidden as this has harmless races with other procs.
 		esac 2>/dev/null
@@ -665,34 +691,11 @@ _pkgqueue_remove_many_pipe() {
 	done | remove_many_pipe rm -rf
 }
 
-_pkgqueue_compute_rdeps() {
-	required_env _pkgqueue_compute_rdeps PWD "${MASTER_DATADIR_ABS:?}"
-	[ $# -eq 0 ] || eargs _pkgqueue_compute_rdeps
-	local rdep_dir_name job dep_job
-
-	find deps -mindepth 3 -maxdepth 3 -type f |
-	    sed -e 's,deps/,,' |
-	    cut -d / -f 2- |
-	    awk -F/ '{print $1, $2}' |
-	    while mapfile_read_loop_redir job dep_job; do
-		pkgqueue_dir rdep_dir_name "${dep_job}"
-		echo "${rdep_dir_name}/${job}"
-	done
-}
-
-# Compute back references for quickly finding things to skip if this job
-# fails.
+# Back references are now recorded by pkgqueue_add_dep as each dependency
+# is added so there is nothing left to compute.
 pkgqueue_compute_rdeps() {
 	required_env pkgqueue_compute_rdeps PWD "${MASTER_DATADIR_ABS:?}"
 	[ $# -eq 0 ] || eargs pkgqueue_compute_rdeps
-	local job rdep_dir_name dep
-
-	# cd into rdeps to allow xargs mkdir to have more args.
-	_pkgqueue_compute_rdeps |
-	    sed -e 's,/[^/]*$,,' |
-	    ( cd rdeps && xargs mkdir -p )
-	_pkgqueue_compute_rdeps |
-	    ( cd rdeps && xargs touch )
 }
 
 pkgqueue_remaining() {
@@ -710,6 +713,29 @@ pkgqueue_remaining() {
 	return 0
 }
 
+# Output the jobs ready-to-run followed by the jobs waiting on no more
+# than max_deps other jobs, fewest first.
+pkgqueue_near_ready() {
+	[ $# -eq 1 ] || eargs pkgqueue_near_ready max_deps
+	local max_deps="$1"
+	local -; set +e
+
+	{
+		( cd "${MASTER_DATADIR:?}/pool"; find . -type d -depth 2 ) |
+		    sed -e 's,.*/,,'
+		( cd "${MASTER_DATADIR:?}"; find deps -mindepth 2 -maxdepth 3 ) |
+		    awk -F / -v max_deps="${max_deps}" '
+		    NF == 3 { ndeps[$3] += 0 }
+		    NF == 4 { ndeps[$3]++ }
+		    END {
+			for (job in ndeps)
+				if (ndeps[job] <= max_deps)
+					print ndeps[job], job
+		    }' | sort -n -k1,1 -k2 | sed -e 's,^[0-9]* ,,'
+	} 2>/dev/null
+	return 0
+}
+
 # Output a dependency file
 pkgqueue_graph() {
 	[ $# -eq 0 ] || eargs pkgqueue_graph
@@ -743,8 +769,18 @@ pkgqueue_dir() {
 }
 
 pkgqueue_running() {
-	find "${MASTER_DATADIR:?}/running" -type d -mindepth 1 -maxdepth 1 |
-	    sed -e "s,^${MASTER_DATADIR:?}/running/,," | tr '\n' ' '
+	local pr_dir
+	local -
+
+	# Ensure globbing is on
+	set +o noglob
+	for pr_dir in "${MASTER_DATADIR:?}/running/"*; do
+		case "${pr_dir}" in
+		# empty dir
+		"${MASTER_DATADIR:?}/running/*") break ;;
+		esac
+		printf "%s " "${pr_dir##*/}"
+	done
 }
 
 pkgqueue_sanity_check() {
@@ -28,8 +28,23 @@
 : "${SHASH_VAR_NAME_SUB_BADCHARS:=" /"}"
 : "${SHASH_VAR_PATH:="${TMPDIR:-/tmp}"}"
 : "${SHASH_VAR_PREFIX="$$"}"
+# file: One file per var%key in SHASH_VAR_PATH.
+# mmap: A single shared hash table file in SHASH_VAR_PATH. Requires the
+#       shash_mmap_* builtins.
+: "${SHASH_BACKEND:=file}"
 add_relpath_var SHASH_VAR_PATH || err "Failed to add SHASH_VAR_PATH to relpaths"
 
+# Return the mmap backend's db file in _shash_mmap_db, or 1 if the
+# file backend should be used.
+_shash_mmap_db() {
+	case "${SHASH_BACKEND}" in
+	mmap) ;;
+	*) return 1 ;;
+	esac
+	have_builtin shash_mmap_get || return 1
+	_shash_mmap_db="${SHASH_VAR_PATH:+${SHASH_VAR_PATH}/}${SHASH_VAR_PREFIX}shash.db"
+}
+
 _shash_var_name() {
 	[ $# -eq 2 ] || eargs _shash_var_name var key
 	local _svn_var="${1}"
@@ -64,9 +79,14 @@ shash_get() {
 	local sg_key="$2"
 	local sg_var_return="$3"
 	local _shash_var_name _shash_var_path _f _sh_value _sh_values
-	local sg_ret sg_rret
+	local sg_ret sg_rret _shash_mmap_db
 	local -
 
+	if _shash_mmap_db; then
+		shash_mmap_get "${_shash_mmap_db:?}" "${sg_var:?}" \
+		    "${sg_key:?}" "${sg_var_return:?}"
+		return
+	fi
 	sg_ret=0
 	_sh_values=
 	_shash_var_path
@@ -121,8 +141,12 @@ shash_exists() {
 	[ $# -eq 2 ] || eargs shash_exists var key
 	local var="$1"
 	local key="$2"
-	local _shash_var_path _shash_var_name _f
+	local _shash_var_path _shash_var_name _f _shash_mmap_db
 
+	if _shash_mmap_db; then
+		shash_mmap_exists "${_shash_mmap_db:?}" "${var:?}" "${key:?}"
+		return
+	fi
 	_shash_var_path
 	_shash_var_name "${var:?}" "${key:?}"
 	# Ensure globbing is on
@@ -154,8 +178,13 @@ shash_set() {
 	local var="$1"
 	local key="$2"
 	local value="$3"
-	local _shash_varkey_file
+	local _shash_varkey_file _shash_mmap_db
 
+	if _shash_mmap_db; then
+		shash_mmap_set "${_shash_mmap_db:?}" "${var:?}" "${key:?}" \
+		    "${value}"
+		return
+	fi
 	_shash_varkey_file "${var}" "${key}"
 	case "${value+set}" in
 	set)
@@ -182,8 +211,25 @@ shash_read_mapfile() {
 	local srm_var="$1"
 	local srm_key="$2"
 	local srm_mapfile_hadle_var="$3"
-	local _shash_varkey_file
+	local _shash_varkey_file _shash_mmap_db srm_tmp srm_ret
 
+	if _shash_mmap_db; then
+		# mapfile needs a file. It is unlinked once opened.
+		srm_tmp="$(mktemp \
+		    "${SHASH_VAR_PATH:?}/.shash_read_mapfile.XXXXXX")" ||
+		    return
+		srm_ret=0
+		shash_mmap_get "${_shash_mmap_db:?}" "${srm_var:?}" \
+		    "${srm_key:?}" - > "${srm_tmp:?}" || srm_ret="$?"
+		case "${srm_ret}" in
+		0)
+			mapfile -q "${srm_mapfile_hadle_var}" "${srm_tmp}" \
+			    "re" || srm_ret="$?"
+			;;
+		esac
+		unlink "${srm_tmp}"
+		return "${srm_ret}"
+	fi
 	_shash_varkey_file "${srm_var}" "${srm_key}"
 	# shellcheck disable=SC2034
 	mapfile -q "${srm_mapfile_hadle_var}" "${_shash_varkey_file}" "re"
@@ -208,8 +254,13 @@ shash_write() {
 	[ "$#" -eq 2 ] || eargs shash_write '[-T]' var key
 	local var="$1"
 	local key="$2"
-	local _shash_varkey_file
+	local _shash_varkey_file _shash_mmap_db
 
+	if _shash_mmap_db; then
+		shash_mmap_set ${Tflag:+-T} "${_shash_mmap_db:?}" "${var:?}" \
+		    "${key:?}"
+		return
+	fi
 	_shash_varkey_file "${var}" "${key}"
 	write_atomic ${Tflag:+-T} -- "${_shash_varkey_file:?}"
 }
@@ -245,8 +296,12 @@ shash_unset() {
 	[ $# -eq 2 ] || eargs shash_unset var key
 	local var="$1"
 	local key="$2"
-	local _shash_var_path _shash_var_name
+	local _shash_var_path _shash_var_name _shash_mmap_db
 
+	if _shash_mmap_db; then
+		shash_mmap_unset "${_shash_mmap_db:?}" "${var:?}" "${key:?}"
+		return
+	fi
 	_shash_var_path
 	_shash_var_name "${var:?}" "${key:?}"
 	# Ensure globbing is on
@@ -3075,11 +3075,71 @@ _lock_read_pid() {
 	setvar "${_lrp_var_return:?}" "${_lrp_pid:?}" || return
 }
 
+# Set _plock_file to the lock file for the locks in lockpath's directory
+# if waiters should queue in it with the plock builtins.
+_plock_file() {
+	[ $# -eq 1 ] || eargs _plock_file lockpath
+	local lockpath="$1"
+
+	case "${LOCK_BACKEND:-plock}" in
+	plock) ;;
+	*) return 1 ;;
+	esac
+	have_builtin plock_acquire || return 1
+	_plock_file="${lockpath%/*}/.poudriere-locks"
+}
+
+_lock_mkdir() {
+	[ $# -eq 5 ] ||
+	    eargs _lock_mkdir quiet lockname lockpath waittime mypid
+	local quiet="$1"
+	local lockname="$2"
+	local lockpath="$3"
+	local waittime="$4"
+	local mypid="$5"
+	local lm_ret real_lock_pid
+
+	lm_ret=0
+	locked_mkdir "${waittime}" "${lockpath}" "${mypid}" ||
+	    lm_ret="$?"
+	case "${lm_ret}" in
+	0) ;;
+	*)
+		if [ "${quiet}" -eq 0 ]; then
+			msg_warn "Failed to acquire ${lockname} lock ret=${lm_ret}"
+		fi
+		return "${lm_ret}"
+		;;
+	esac
+	# XXX: Remove this block with locked_mkdir [EINTR] fixes.
+	{
+		# locked_mkdir is quite racy. We may have gotten a false-success
+		# and need to consider it a failure.
+		if [ ! -d "${lockpath}" ]; then
+			if [ "${quiet}" -eq 0 ]; then
+				msg_warn "Lost race grabbing ${lockname} lock: no dir"
+			fi
+			return 1
+		fi
+		_lock_read_pid "${lockpath:?}.pid" real_lock_pid ||
+		    real_lock_pid=
+		case "${real_lock_pid}" in
+		"${mypid}") ;;
+		*)
+			if [ "${quiet}" -eq 0 ]; then
+				msg_warn "Lost race grabbing ${lockname} lock: wrong pid: mypid=${mypid} lock_pid=${real_lock_pid}"
+			fi
+			return 1
+			;;
+		esac
+	}
+}
+
 _lock_acquire() {
 	local -; set +x
 	[ $# -eq 3 ] || [ $# -eq 4 ] ||
 	    eargs _lock_acquire quiet lockpath lockname '[waittime]'
-	local have_lock mypid lock_pid real_lock_pid
+	local have_lock mypid lock_pid
 	local quiet="$1"
 	local lockname="$2"
 	local lockpath="$3"
@@ -3095,47 +3155,60 @@ _lock_acquire() {
 	*)
 		hash_unset have_lock "${lockname}"
 		hash_unset lock_pid "${lockname}"
+		hash_unset lock_plock "${lockname}"
 		lock_pid=
 		have_lock=0
 		;;
 	esac
 	if [ "${have_lock}" -eq 0 ]; then
-		local lm_ret
+		local lm_ret lm_start lm_now _plock_file
 
 		lm_ret=0
-		locked_mkdir "${waittime}" "${lockpath}" "${mypid}" ||
-		    lm_ret="$?"
-		case "${lm_ret}" in
-		0) ;;
-		*)
-			if [ "${quiet}" -eq 0 ]; then
-				msg_warn "Failed to acquire ${lockname} lock ret=${lm_ret}"
-			fi
+		_plock_file=
+		if _plock_file "${lockpath}"; then
+			critical_retry_cmdsubst lm_start "\$(clock -monotonic)"
+			plock_acquire "${waittime}" "${_plock_file:?}" \
+			    "${lockpath##*/}" || lm_ret="$?"
+			case "${lm_ret}" in
+			0)
+				# The lock dir is still taken to exclude
+				# processes using locked_mkdir alone.  Only they
+				# can be holding it now.
+				critical_retry_cmdsubst lm_now \
+				    "\$(clock -monotonic)"
+				waittime="$((waittime - (lm_now - lm_start)))"
+				if [ "${waittime}" -lt 0 ]; then
+					waittime=0
+				fi
+				;;
+			"${EX_UNAVAILABLE-69}")
+				# No room for it in the lock file.
+				_plock_file=
+				lm_ret=0
+				;;
+			*)
+				if [ "${quiet}" -eq 0 ]; then
+					msg_warn "Failed to acquire ${lockname} lock ret=${lm_ret}"
+				fi
+				return "${lm_ret}"
+				;;
+			esac
+		fi
+		_lock_mkdir "${quiet}" "${lockname}" "${lockpath}" \
+		    "${waittime}" "${mypid}" || lm_ret="$?"
+		case "${lm_ret}.${_plock_file}" in
+		0.) ;;
+		0.*)
+			hash_set lock_plock "${lockname}" "${_plock_file}"
+			;;
+		*.)
 			return "${lm_ret}"
 			;;
-		esac
-	# XXX: Remove this block with locked_mkdir [EINTR] fixes.
-	{
-		# locked_mkdir is quite racy. We may have gotten a false-success
-		# and need to consider it a failure.
-		if [ ! -d "${lockpath}" ]; then
-			if [ "${quiet}" -eq 0 ]; then
-				msg_warn "Lost race grabbing ${lockname} lock: no dir"
-			fi
-			return 1
-		fi
-		_lock_read_pid "${lockpath:?}.pid" real_lock_pid ||
-		    real_lock_pid=
-		case "${real_lock_pid}" in
-		"${mypid}") ;;
 		*)
-			if [ "${quiet}" -eq 0 ]; then
-				msg_warn "Lost race grabbing ${lockname} lock: wrong pid: mypid=${mypid} lock_pid=${real_lock_pid}"
-			fi
-			return 1
+			plock_release "${_plock_file}" "${lockpath##*/}" || :
+			return "${lm_ret}"
 			;;
 		esac
-	}
 	elif [ "${have_lock}" -eq 1 ]; then
 		# Lock recursion may happen in a trap handler if the lock
 		# was held before the trap.
@@ -3247,7 +3320,7 @@ _lock_release() {
 	[ $# -eq 2 ] || eargs _lock_release lockname lockpath
 	local lockname="$1"
 	local lockpath="$2"
-	local have_lock lock_pid mypid pid
+	local have_lock lock_pid mypid pid _plock_file
 
 	hash_get have_lock "${lockname}" have_lock ||
 		err 1 "Releasing unheld lock ${lockname}"
@@ -3285,6 +3358,12 @@ _lock_release() {
 			err 1 "Held lock dir not found: ${lockpath}"
 		fi
 		critical_retry rmdir "${lockpath:?}" || :
+		_plock_file=
+		if hash_get lock_plock "${lockname}" _plock_file; then
+			hash_unset lock_plock "${lockname}"
+			plock_release "${_plock_file:?}" "${lockpath##*/}" ||
+				err 1 "Failed to release ${lockname} lock"
+		fi
 	fi
 
 	# Callers assume _lock_release cannot fail.
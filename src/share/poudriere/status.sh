@@ -33,11 +33,14 @@ poudriere status [options]
 Options:
     -a          -- Show all builds, not just latest. This implies -f.
     -f          -- Show finished builds as well. This is default
-                   if -a, -B or -r are specified.
+                   if -a, -B, -e or -r are specified.
     -b          -- Display status of each builder for the matched build.
     -B name     -- What buildname to use (must be unique, defaults to
                    "latest"). This implies -f.
     -c          -- Compact output (shorter headers and no logs/url)
+    -e          -- Write the matched builds' attribute stores out to their
+                   .poudriere.* files, as a build does when it exits.
+                   This implies -f.
     -H          -- Script mode. Do not print headers and separate fields by a
                    single tab instead of arbitrary white space.
     -j name     -- Run on the given jail
@@ -60,9 +63,10 @@ URL=1
 BUILDER_INFO=0
 BUILDNAME=
 RESULTS=0
+EXPORT=0
 SUMMARY=0
 
-while getopts "abB:cfHj:lp:rz:" FLAG; do
+while getopts "abB:cefHj:lp:rz:" FLAG; do
 	case "${FLAG}" in
 		a)
 			ALL=1
@@ -79,6 +83,10 @@ while getopts "abB:cfHj:lp:rz:" FLAG; do
 		c)
 			COMPACT=1
 			;;
+		e)
+			EXPORT=1
+			SHOW_FINISHED=1
+			;;
 		f)
 			SHOW_FINISHED=1
 			;;
@@ -110,7 +118,7 @@ done
 shift $((OPTIND-1))
 post_getopts
 
-[ ${BUILDER_INFO} -eq 0 -a ${RESULTS} -eq 0 ] && \
+[ ${BUILDER_INFO} -eq 0 -a ${RESULTS} -eq 0 -a ${EXPORT} -eq 0 ] && \
     SUMMARY=1
 
 # Default to "latest" if not using -a and no -B specified
@@ -128,6 +136,14 @@ output_builder_info() {
 	BUILDERS="${builders}" siginfo_handler
 }
 
+export_build() {
+	local log
+
+	_log_path log
+	bset_export "${log:?}" ||
+	    msg_warn "Failed to export ${MASTERNAME}/${BUILDNAME}"
+}
+
 add_summary_build() {
 	local status nbqueued nbfailed nbignored nbskipped nbbuilt nbremaining
 	local nbfetched nbinspected
@@ -246,16 +262,25 @@ show_results() {
 	return 0
 }
 
-case "${SUMMARY}${BUILDER_INFO}${RESULTS}" in
-	100)
+export_builds() {
+	status_for_each_build export_build
+
+	return 0
+}
+
+case "${SUMMARY}${BUILDER_INFO}${RESULTS}${EXPORT}" in
+	1000)
 		show_summary
 		;;
-	010)
+	0100)
 		show_builder_info
 		;;
-	001)
+	0010)
 		show_results
 		;;
+	0001)
+		export_builds
+		;;
 	*)
 		usage
 		;;
@@ -418,7 +418,7 @@ if [ ${ret} -ne 0 ]; then
 
 	ln -s "../${PKGNAME:?}.log" "${log:?}/logs/errors/${PKGNAME:?}.log"
 	bset_job_status "processlog" "${ORIGINSPEC}" "${PKGNAME}"
-	errortype="$(awk -f ${AWKPREFIX:?}/processonelog.awk \
+	errortype="$(processonelog \
 		"${log:?}/logs/errors/${PKGNAME:?}.log" \
 		2> /dev/null)" || :
 	bset_job_status "${status%%:*}" "${ORIGINSPEC}" "${PKGNAME}"
@@ -0,0 +1,59 @@
+. ./common.sh
+
+TMP=$(mktemp -dt bstats_tally)
+POUDRIERE_DATA="${TMP}/data"
+MASTERNAME=bstats_tally-test
+BUILDNAME=current
+POUDRIERE_BUILD_TYPE=bulk
+SCRIPTNAME=bulk.sh
+BSET_BACKEND=file
+_log_path log
+assert_true mkdir -p "${log}"
+
+# built failed ignored inspected skipped as update_stats() counts them.
+stats() {
+	local type value out
+
+	out=
+	assert_true update_stats
+	for type in built failed ignored inspected skipped; do
+		read -r value < "${log:?}/.poudriere.stats_${type}"
+		out="${out:+${out} }${value}"
+	done
+	echo "${out}"
+}
+
+assert_true bstats_tally_init
+assert "0 0 0 0 0" "$(stats)"
+
+assert_true badd ports.built "devel/foo foo-1.0 10"
+assert_true badd ports.built "devel/bar bar-1.0 20"
+assert_true badd ports.failed "devel/baz baz-1.0 build 30"
+assert_true badd ports.ignored "devel/ign ign-1.0 broken"
+assert_true badd ports.inspected "devel/ins ins-1.0 meta"
+assert "2 1 1 1 0" "$(stats)"
+
+# A port skipped by more than one failure is only counted once.
+assert_true badd ports.skipped "misc/dep dep-1.0 baz-1.0"
+assert_true badd ports.skipped "misc/dep dep-1.0 qux-1.0"
+assert_true badd ports.skipped "misc/dep@py39 py39-dep-1.0 baz-1.0"
+assert "2 1 1 1 2" "$(stats)"
+assert 3 "$(wc -l < "${log}/.poudriere.ports.skipped" | tr -d ' ')"
+
+# A resumed build counts what is already in the lists.
+assert_true rm -rf "${log}"/.poudriere.ports.*.tally% \
+    "${log}/.poudriere.ports.skipped.seen%"
+echo "misc/dep dep-1.0 zzz-1.0" >> "${log}/.poudriere.ports.skipped"
+assert_true bstats_tally_init
+assert "2 1 1 1 2" "$(stats)"
+assert_true badd ports.built "devel/new new-1.0 5"
+assert_true badd ports.skipped "misc/dep dep-1.0 new-1.0"
+assert_true badd ports.skipped "misc/other other-1.0 new-1.0"
+assert "3 1 1 1 3" "$(stats)"
+
+# Without the tallies the lists are counted instead.
+assert_true rm -rf "${log}"/.poudriere.ports.*.tally% \
+    "${log}/.poudriere.ports.skipped.seen%"
+assert "3 1 1 1 3" "$(stats)"
+
+rm -rf "${TMP}"
@@ -0,0 +1,98 @@
+. ./common.sh
+
+if ! have_builtin bstore_set || ! have_builtin html_json; then
+	exit 77
+fi
+
+TMP=$(mktemp -dt bstore)
+LOG="${TMP}/log"
+STORE="${LOG}/.poudriere.store%"
+assert_true mkdir "${LOG}"
+
+json_awk() {
+	awk -f "${AWKPREFIX:?}/json.awk" "${LOG:?}"/.poudriere.*[!%] |
+	    awk 'ORS=""; {print} END {print "\n"}' |
+	    sed -e 's/,\([]}]\)/\1/g'
+}
+
+# Nothing there yet.
+assert_false bstore_get "${STORE}" status value
+assert_true bstore_export "${STORE}" "${LOG}"
+assert_false [ -e "${STORE}" ]
+
+assert_true bstore_set "${STORE}" status "parallel_build:"
+assert_true bstore_set "${STORE}" status.01 \
+    "building:devel/foo@py39:foo-1.0:1700000000:30"
+assert_true bstore_set "${STORE}" status.02 "idle:"
+assert_true bstore_set "${STORE}" stats_built "5"
+assert_true bstore_get "${STORE}" status value
+assert "parallel_build:" "${value}"
+assert_true bstore_set "${STORE}" status "done:"
+assert_true bstore_get "${STORE}" status value
+assert "done:" "${value}"
+assert "idle:" "$(bstore_get "${STORE}" status.02 -)"
+assert_false bstore_get "${STORE}" status.03 value
+# Only the store was written.
+assert_false [ -e "${LOG}/.poudriere.status" ]
+
+# Values too long for the store are left for the file.
+long="$(jot -b x -s "" 500)"
+assert_false bstore_set "${STORE}" snap_loadavg "${long}"
+assert_false bstore_get "${STORE}" snap_loadavg value
+echo "${long}" > "${LOG}/.poudriere.snap_loadavg"
+assert_true bstore_set "${STORE}" snap_swapinfo "1.00%"
+
+# Readers never see a partly written value.
+n=0
+until [ "${n}" -eq 4 ]; do
+	(
+		i=0
+		until [ "${i}" -eq 500 ]; do
+			bstore_set "${STORE}" snap_now "${i}:${i}:${i}"
+			i=$((i + 1))
+		done
+	) &
+	n=$((n + 1))
+done
+i=0
+until [ "${i}" -eq 1000 ]; do
+	if bstore_get "${STORE}" snap_now value; then
+		n="${value%%:*}"
+		assert "${n}:${n}:${n}" "${value}" "torn read"
+	fi
+	i=$((i + 1))
+done
+wait
+
+# html_json reads the store in place of the files.
+echo "stale:" > "${LOG}/.poudriere.status"
+assert_true html_json -s stats "${LOG}"
+json="$(cat "${LOG}/.data.json")"
+assert_true html_json -s stats "${LOG}"
+assert "files=7 changed=0 reread=0 read=0 written=0" "${stats}"
+assert_true bstore_set "${STORE}" status.02 \
+    "building:devel/bar:bar-1:1700000000:31"
+assert_true html_json "${LOG}"
+assert_true [ "${json}" != "$(cat "${LOG}/.data.json")" ]
+json="$(cat "${LOG}/.data.json")"
+
+# The exported files give the same JSON.
+assert_true bstore_export "${STORE}" "${LOG}"
+assert "done:" "$(cat "${LOG}/.poudriere.status")"
+assert "${long}" "$(cat "${LOG}/.poudriere.snap_loadavg")"
+assert "${json}" "$(json_awk)"
+
+# So can a build's store from outside of it, as poudriere status -e does
+# for a build killed before it exported.
+assert_true rm -f "${LOG}/.poudriere.status" \
+    "${LOG}/.poudriere.snap_swapinfo"
+assert_true bset_export "${LOG}"
+assert "done:" "$(cat "${LOG}/.poudriere.status")"
+assert "1.00%" "$(cat "${LOG}/.poudriere.snap_swapinfo")"
+assert_true bset_export "${TMP}"
+
+assert_true rm -f "${STORE}"
+assert_true html_json "${LOG}"
+assert "${json}" "$(cat "${LOG}/.data.json")"
+
+rm -rf "${TMP}"
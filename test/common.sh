@@ -365,6 +365,21 @@ time_bounded_loop() {
 	hash_set tbl_timeout "${tbl_idx}" "${tbl_timeout}"
 }
 
+# Print the rate of count what done between start and end, which are
+# clock -monotonic -nsec times.  For the *bench*.sh tests.
+bench_report() {
+	[ $# -eq 5 ] || eargs bench_report label count what start end
+	awk -v label="$1" -v count="$2" -v what="$3" -v start="$4" \
+	    -v end="$5" '
+	    END {
+		secs = end - start
+		if (secs <= 0)
+			secs = 0.000001
+		printf("%-10s %7d %s: %10.2f %s/sec %8.3f sec\n", label,
+		    count, what, count / secs, what, secs)
+	    }' /dev/null
+}
+
 _teer() {
 	[ $# -eq 2 ] || eargs _teer tee_file stdin_fifo
 	local tee_file="$1"
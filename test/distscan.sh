@@ -0,0 +1,73 @@
+. ./common.sh
+
+TMP=$(mktemp -dt distscan)
+DISTDIR="${TMP}/distfiles"
+PORTS="${TMP}/ports"
+
+assert_true mkdir -p "${DISTDIR}/sub/deep" "${DISTDIR}/other" \
+    "${PORTS}/devel/a" "${PORTS}/devel/b" "${PORTS}/devel/c"
+echo "a" > "${DISTDIR}/a-1.tar.gz"
+echo "b" > "${DISTDIR}/sub/b-1.tar.gz"
+echo "deep" > "${DISTDIR}/sub/deep/c-1.tar.gz"
+echo "stale" > "${DISTDIR}/a-0.tar.gz"
+echo "stale" > "${DISTDIR}/other/x-1.tar.gz"
+echo "fetching" > "${DISTDIR}/.a-2.tar.gz.fetch"
+assert_true ln -s a-1.tar.gz "${DISTDIR}/link.tar.gz"
+
+distinfo() {
+	[ $# -eq 1 ] || eargs distinfo file
+	local file="$1"
+	local sha size
+
+	sha="$(sha256 -q "${DISTDIR}/${file}")"
+	size="$(stat -f %z "${DISTDIR}/${file}")"
+	echo "SHA256 (${file}) = ${sha}"
+	echo "SIZE (${file}) = ${size}"
+}
+
+{
+	echo "TIMESTAMP = 1700000000"
+	distinfo a-1.tar.gz
+} > "${PORTS}/devel/a/distinfo"
+{
+	echo "TIMESTAMP = 1700000000"
+	distinfo sub/b-1.tar.gz
+	distinfo sub/deep/c-1.tar.gz
+} > "${PORTS}/devel/b/distinfo"
+
+# devel/c has no distinfo.
+assert "${DISTDIR}/a-0.tar.gz
+${DISTDIR}/other/x-1.tar.gz" \
+    "$(distscan -j 4 -d "${DISTDIR}/" "${PORTS}"/devel/*/distinfo)" \
+    "args"
+assert "${DISTDIR}/a-0.tar.gz
+${DISTDIR}/other/x-1.tar.gz" \
+    "$(printf "%s\n" "${PORTS}"/devel/*/distinfo "${PORTS}/devel/c/distinfo" |
+    distscan -j 1 -d "${DISTDIR}")" "stdin"
+
+# Only checked with -c.
+echo "corrupt" > "${DISTDIR}/sub/b-1.tar.gz"
+echo "bbbbbbb" > "${DISTDIR}/sub/deep/c-1.tar.gz"
+assert "${DISTDIR}/a-0.tar.gz
+${DISTDIR}/other/x-1.tar.gz" \
+    "$(distscan -d "${DISTDIR}" "${PORTS}"/devel/*/distinfo)" "no -c"
+assert "${DISTDIR}/a-0.tar.gz
+${DISTDIR}/other/x-1.tar.gz
+${DISTDIR}/sub/b-1.tar.gz
+${DISTDIR}/sub/deep/c-1.tar.gz" \
+    "$(distscan -c -d "${DISTDIR}" "${PORTS}"/devel/*/distinfo)" "-c"
+
+# Another tree with a newer version of the same file.
+assert_true mkdir -p "${PORTS}/devel/d"
+distinfo sub/b-1.tar.gz > "${PORTS}/devel/d/distinfo"
+assert "${DISTDIR}/a-0.tar.gz
+${DISTDIR}/other/x-1.tar.gz
+${DISTDIR}/sub/deep/c-1.tar.gz" \
+    "$(distscan -c -d "${DISTDIR}" "${PORTS}"/devel/*/distinfo)" \
+    "-c any tree"
+
+# Nothing expected is an error rather than cleaning everything.
+assert_false distscan -d "${DISTDIR}" "${PORTS}/devel/c/distinfo"
+assert_false distscan -d "${TMP}/missing" "${PORTS}/devel/a/distinfo"
+
+rm -rf "${TMP:?}"
@@ -0,0 +1,57 @@
+. ./common.sh
+
+TMP=$(mktemp -dt fscheck)
+ROOT="${TMP}/root"
+INDEX="${TMP}/index"
+EXCLUDE="${TMP}/exclude"
+
+assert_true mkdir -p "${ROOT}/usr/local/lib" "${ROOT}/usr/local/share/doc" \
+    "${ROOT}/usr/local/etc" "${ROOT}/tmp" "${ROOT}/var/crash"
+echo "a" > "${ROOT}/usr/local/lib/a"
+echo "b" > "${ROOT}/usr/local/share/doc/b"
+echo "c" > "${ROOT}/usr/local/etc/c"
+assert_true ln -s a "${ROOT}/usr/local/lib/l"
+{
+	echo "./tmp"
+	echo "./var/crash/*.core"
+	echo "*.pid"
+} > "${EXCLUDE}"
+# So the unchanged directories are not read again.
+sleep 1
+
+assert_true fscheck -c -X "${EXCLUDE}" -p "${ROOT}" > "${INDEX}"
+assert "" "$(fscheck -X "${EXCLUDE}" -f "${INDEX}" -p "${ROOT}")" "unchanged"
+
+echo "aa" > "${ROOT}/usr/local/lib/a"
+chmod 0600 "${ROOT}/usr/local/etc/c"
+rm -rf "${ROOT}/usr/local/share/doc"
+rm -f "${ROOT}/usr/local/lib/l"
+mkdir "${ROOT}/usr/local/lib/l"
+:> "${ROOT}/usr/local/lib/l/in"
+mkdir -p "${ROOT}/usr/local/new/x"
+:> "${ROOT}/usr/local/new/x/y"
+# Excluded.
+:> "${ROOT}/tmp/t"
+:> "${ROOT}/var/crash/foo.core"
+:> "${ROOT}/usr/local/etc/foo.pid"
+assert "M ${ROOT}/usr/local/etc/c permissions (0644, 0600)
+M ${ROOT}/usr/local/lib/a size (2, 3)
+M ${ROOT}/usr/local/lib/l type (link, dir)
++ ${ROOT}/usr/local/lib/l/in
++ ${ROOT}/usr/local/new
++ ${ROOT}/usr/local/new/x
++ ${ROOT}/usr/local/new/x/y
+- ${ROOT}/usr/local/share/doc
+- ${ROOT}/usr/local/share/doc/b" \
+    "$(fscheck -X "${EXCLUDE}" -f "${INDEX}" -p "${ROOT}")" "changed"
+
+# Changed right after the index was made.
+assert_true fscheck -c -X "${EXCLUDE}" -p "${ROOT}" > "${INDEX}"
+:> "${ROOT}/usr/local/etc/d"
+assert "+ ${ROOT}/usr/local/etc/d" \
+    "$(fscheck -X "${EXCLUDE}" -f "${INDEX}" -p "${ROOT}")" "racy"
+
+assert_false fscheck -f "${EXCLUDE}" -p "${ROOT}"
+assert_false fscheck -c -f "${INDEX}" -p "${ROOT}"
+
+rm -rf "${TMP:?}"
@@ -0,0 +1,101 @@
+# Compare the hash_* builtins against the mangled variables which the
+# shell versions in hash.sh use.  For each of HASH_BENCH_KEYS keys are set
+# and read back, listed once with hash_vars and then removed.  The rate of
+# each is printed.
+set -e
+. ./common.sh
+set +e
+
+: ${HASH_BENCH_KEYS:="10000 100000"}
+
+report() {
+	[ $# -eq 7 ] || eargs report impl keys start set get vars unset
+	local impl="$1"
+	local keys="$2"
+
+	bench_report "${impl} set" "${keys}" keys "$3" "$4"
+	bench_report "${impl} get" "${keys}" keys "$4" "$5"
+	bench_report "${impl} vars" "${keys}" keys "$5" "$6"
+	bench_report "${impl} unset" "${keys}" keys "$6" "$7"
+}
+
+bench_builtin() {
+	[ $# -eq 1 ] || eargs bench_builtin keys
+	local keys="$1"
+	local ts_start ts_set ts_get ts_vars ts_unset n value list
+
+	ts_start="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		hash_set bench "key-${n}" "value ${n}"
+		n="$((n + 1))"
+	done
+	ts_set="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		hash_get bench "key-${n}" value
+		n="$((n + 1))"
+	done
+	ts_get="$(clock -monotonic -nsec)"
+	assert "value $((keys - 1))" "${value}"
+	assert_true hash_vars list bench
+	ts_vars="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		hash_unset bench "key-${n}"
+		n="$((n + 1))"
+	done
+	ts_unset="$(clock -monotonic -nsec)"
+	assert_false hash_isset_var bench
+	report builtin "${keys}" "${ts_start}" "${ts_set}" "${ts_get}" \
+	    "${ts_vars}" "${ts_unset}"
+}
+
+# What the shell hash_set/hash_get/hash_vars/hash_unset do.
+bench_vars() {
+	[ $# -eq 1 ] || eargs bench_vars keys
+	local keys="$1"
+	local ts_start ts_set ts_get ts_vars ts_unset n value list line name
+
+	ts_start="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		_gsub_var_name "_HASH_Bbench_Kkey-${n}" name
+		setvar "${name}" "value ${n}"
+		n="$((n + 1))"
+	done
+	ts_set="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		_gsub_var_name "_HASH_Bbench_Kkey-${n}" name
+		getvar "${name}" value
+		n="$((n + 1))"
+	done
+	ts_get="$(clock -monotonic -nsec)"
+	assert "value $((keys - 1))" "${value}"
+	list=
+	while read -r line; do
+		case "${line}" in
+		_HASH_Bbench_K*=*) list="${list:+${list} }${line%%=*}" ;;
+		esac
+	done <<-EOF
+	$(set)
+	EOF
+	ts_vars="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${keys}" ]; do
+		_gsub_var_name "_HASH_Bbench_Kkey-${n}" name
+		unset "${name}"
+		n="$((n + 1))"
+	done
+	ts_unset="$(clock -monotonic -nsec)"
+	report vars "${keys}" "${ts_start}" "${ts_set}" "${ts_get}" \
+	    "${ts_vars}" "${ts_unset}"
+}
+
+for keys in ${HASH_BENCH_KEYS}; do
+	if have_builtin hash_set; then
+		bench_builtin "${keys}"
+	fi
+	bench_vars "${keys}"
+done
@@ -0,0 +1,77 @@
+. ./common.sh
+
+set_pipefail
+
+TMP=$(mktemp -dt history)
+POUDRIERE_DATA="${TMP}/data"
+MASTERNAME=history-test
+BUILDNAME=current
+POUDRIERE_BUILD_TYPE=bulk
+MASTER_DATADIR="${TMP}/datadir"
+BUILD_HISTORY=yes
+BUILD_HISTORY_KEEP=2
+PARALLEL_JOBS=2
+assert_true mkdir -p "${MASTER_DATADIR}"
+_log_path log
+assert_true mkdir -p "${log}"
+
+echo "log" > "${TMP}/pkg.log"
+assert_true history_compact
+assert_true [ -d "${POUDRIERE_DATA}/history" ]
+assert_true history_add llvm-15.0 built 100 "${TMP}/pkg.log"
+assert_true history_add llvm-15.0 built 200 "${TMP}/pkg.log"
+assert_true history_add llvm-15.1 built 300 "${TMP}/pkg.log"
+assert_true history_add zsh-5.9 failed 10 "${TMP}/pkg.log"
+assert_true history_add gcc-13 failed 40 "${TMP}/pkg.log"
+assert_true history_add gcc-13 built 60 "${TMP}/pkg.log"
+
+_history_path history
+assert 6 "$(wc -l < "${history}" | tr -d ' ')"
+read -r pkgbase epoch result elapsed logsize < "${history}"
+assert "llvm" "${pkgbase}"
+assert "built" "${result}"
+assert 100 "${elapsed}"
+assert 4 "${logsize}"
+
+# Only the last 2 builds of llvm are kept.
+assert_true history_compact
+assert 5 "$(wc -l < "${history}" | tr -d ' ')"
+
+# Failures only count if there are no successful builds.
+lookup="$(printf "llvm-16.0\nzsh-5.9.1\ngcc-13\nunknown-1\n" | history_lookup)"
+assert 0 "$?"
+assert "llvm-16.0 250 built 2
+zsh-5.9.1 10 failed 1
+gcc-13 60 built 2" "${lookup}"
+
+cat > "${MASTER_DATADIR}/tobuild_pkgs" <<-EOF2
+llvm-16.0 devel/llvm16 listed
+gcc-13 lang/gcc13 listed
+unknown-1 misc/unknown listed
+EOF2
+assert_true history_load_buildtimes "${MASTER_DATADIR}/pkg_buildtimes"
+assert_file - "${MASTER_DATADIR}/pkg_buildtimes" <<-EOF2
+llvm-16.0 250
+gcc-13 60
+EOF2
+
+# unknown-1 is assumed to take the average of 155.
+assert_true history_load_buildtimes "${MASTER_DATADIR}/pkg_buildtimes"
+assert_true history_estimate_remaining eta
+assert "$(((250 + 60 + 155) / 2))" "${eta}"
+echo "lang/gcc13 gcc-13 55" > "${log}/.poudriere.ports.built"
+assert_true history_estimate_remaining eta
+assert "$(((250 + 155) / 2))" "${eta}"
+
+# Without history the last completed build is used.
+assert_true rm -f "${history}"
+_log_path_jail log_jail
+assert_true mkdir -p "${log_jail}/previous"
+assert_true ln -s previous "${log_jail}/latest-done"
+echo "devel/llvm15 llvm-15.1 500" > "${log_jail}/previous/.poudriere.ports.built"
+assert_true history_load_buildtimes "${MASTER_DATADIR}/pkg_buildtimes"
+assert_file - "${MASTER_DATADIR}/pkg_buildtimes" <<-EOF2
+llvm-16.0 500
+EOF2
+
+assert_true rm -rf "${TMP}"
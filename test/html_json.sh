@@ -0,0 +1,193 @@
+. ./common.sh
+
+if ! have_builtin html_json; then
+	exit 77
+fi
+
+TMP=$(mktemp -dt html_json)
+LOG="${TMP}/log"
+assert_true mkdir "${LOG}"
+
+# The html.sh _build_json pipeline which the builtin replaces.
+json_awk() {
+	[ $# -eq 1 ] || eargs json_awk mini
+	local mini="$1"
+
+	awk -v mini="${mini}" \
+	    -f "${AWKPREFIX:?}/json.awk" "${LOG:?}"/.poudriere.*[!%] |
+	    awk 'ORS=""; {print} END {print "\n"}' |
+	    sed -e 's/,\([]}]\)/\1/g'
+}
+
+# Only one ports list and skipped port at a time are used since awk
+# prints those in an unspecified order.
+check() {
+	[ $# -eq 1 ] || eargs check msg
+	local msg="$1"
+
+	assert_true html_json -s stats "${LOG}"
+	assert "$(json_awk "")" "$(cat "${LOG}/.data.json")" "${msg}: full"
+	assert "$(json_awk yes)" "$(cat "${LOG}/.data.mini.json")" \
+	    "${msg}: mini"
+}
+
+echo "foo" > "${LOG}/.poudriere.mastername"
+echo "141amd64-default" > "${LOG}/.poudriere.jailname"
+echo "parallel_build:" > "${LOG}/.poudriere.status"
+echo "01 02" > "${LOG}/.poudriere.builders"
+echo "5" > "${LOG}/.poudriere.stats_built"
+echo "1" > "${LOG}/.poudriere.stats_failed"
+echo "(50%) 1.00 2.00 3.00" > "${LOG}/.poudriere.snap_loadavg"
+echo "building:devel/foo@py39:foo-1.0:1700000000:30" > \
+    "${LOG}/.poudriere.status.01"
+echo "idle:" > "${LOG}/.poudriere.status.02"
+echo "journal" > "${LOG}/.poudriere.status.journal%"
+{
+	echo "devel/a a-1 10"
+	echo "lang/b@default b-2 20"
+} > "${LOG}/.poudriere.ports.built"
+check "initial"
+
+# Nothing changed, nothing is read or written.
+touch -t 200001010000 "${LOG}/.data.json"
+assert_true html_json -s stats "${LOG}"
+assert "files=10 changed=0 reread=0 read=0 written=0" "${stats}"
+assert "200001010000" "$(stat -f %Sm -t %Y%m%d%H%M "${LOG}/.data.json")"
+
+# Appended lines are read without rereading the rest.
+echo "devel/c c-1 30" >> "${LOG}/.poudriere.ports.built"
+check "append"
+assert "files=10 changed=1 reread=0 read=15 written=1" "${stats}"
+
+# A line still being written, then finished.
+printf "devel/d" >> "${LOG}/.poudriere.ports.built"
+check "partial"
+printf " d-1 40\n" >> "${LOG}/.poudriere.ports.built"
+check "partial done"
+
+# Replaced, truncated and rewritten in place.
+echo "idle:" > "${LOG}/.poudriere.status.01.tmp"
+assert_true mv "${LOG}/.poudriere.status.01.tmp" "${LOG}/.poudriere.status.01"
+check "replaced"
+echo "devel/e e-1 5" > "${LOG}/.poudriere.ports.built"
+check "truncated"
+{
+	echo "devel/a a-1 11"
+	echo "lang/b@default b-2 20"
+	echo "devel/c c-1 30"
+	echo "devel/d d-1 40"
+} > "${LOG}/.poudriere.ports.built"
+echo "devel/f f-1 50" >> "${LOG}/.poudriere.ports.built"
+check "rewritten"
+
+# Each of the ports lists.
+assert_true rm -f "${LOG}/.poudriere.ports.built"
+echo "devel/g g-1 build compiler 40" > "${LOG}/.poudriere.ports.failed"
+check "failed"
+assert_true rm -f "${LOG}/.poudriere.ports.failed"
+echo 'devel/h h-1 is "marked" \broken   and,} bad' > \
+    "${LOG}/.poudriere.ports.ignored"
+check "ignored"
+assert_true rm -f "${LOG}/.poudriere.ports.ignored"
+{
+	echo "devel/i i-1 g-1"
+	echo "devel/j j-1 g-1"
+} > "${LOG}/.poudriere.ports.skipped"
+check "skipped"
+echo "devel/k k-1 g-1" >> "${LOG}/.poudriere.ports.skipped"
+check "skipped append"
+printf "devel/l l-1 g-1" >> "${LOG}/.poudriere.ports.skipped"
+check "skipped partial"
+echo "devel/m m-1 g-1" > "${LOG}/.poudriere.ports.skipped"
+check "skipped rewritten"
+assert_true rm -f "${LOG}/.poudriere.ports.skipped"
+echo "n-1 ready" > "${LOG}/.poudriere.ports.remaining"
+check "remaining"
+
+# Removed files are dropped.
+assert_true rm -f "${LOG}/.poudriere.status.02" "${LOG}/.poudriere.snap_loadavg"
+check "removed"
+
+assert_false html_json "${TMP}/missing"
+
+# The event log.  The first call only starts it since .data.json has
+# everything so far.
+EV="${TMP}/events"
+assert_true mkdir "${EV}"
+echo "devel/a a-1 10" > "${EV}/.poudriere.ports.built"
+echo "idle:" > "${EV}/.poudriere.status.01"
+echo "5" > "${EV}/.poudriere.stats_built"
+assert_true html_json -e "${EV}"
+assert '{"seq":1,"type":"restart"}' "$(cat "${EV}/.data.events")"
+assert_true grep -q '"events":{"seq":1,"offset":0}' "${EV}/.data.json"
+
+# An appended port.  The offset is where the last event's line starts.
+echo "devel/b@py39 b-1 20" >> "${EV}/.poudriere.ports.built"
+assert_true html_json -e "${EV}"
+assert '{"seq":2,"type":"port","status":"built","n":1,"port":{"origin":"devel/b","flavor":"py39","pkgname":"b-1","elapsed":"20"}}' \
+    "$(sed -n 2p "${EV}/.data.events")"
+assert_true grep -q '"events":{"seq":2,"offset":27}' "${EV}/.data.json"
+
+# A rewritten list, the builders and everything else.
+echo "devel/c c-1 5" > "${EV}/.poudriere.ports.built"
+echo "building:devel/foo:foo-1.0:1700000000:30" > \
+    "${EV}/.poudriere.status.01"
+echo "6" > "${EV}/.poudriere.stats_built"
+assert_true html_json -e "${EV}"
+assert '{"seq":3,"type":"reset","status":"built"}
+{"seq":4,"type":"port","status":"built","n":0,"port":{"origin":"devel/c","pkgname":"c-1","elapsed":"5"}}
+{"seq":5,"type":"state","data":{"stats":{"built":"6"}}}
+{"seq":6,"type":"jobs","jobs":[{"id":"01","status":"building","origin":"devel/foo","pkgname":"foo-1.0","started":"1700000000","elapsed":"30"}]}' \
+    "$(sed -n '3,$p' "${EV}/.data.events")"
+assert_true grep -q '"events":{"seq":6,"offset":352}' "${EV}/.data.json"
+
+# Nothing changed, nothing logged.
+assert_true html_json -e -s stats "${EV}"
+assert "written=0" "${stats##* }"
+assert 6 $(wc -l < "${EV}/.data.events")
+
+# Started over once bigger than .data.json.  The sequence carries on.
+awk 'END {
+	for (i = 0; i < 15000; i++)
+		printf("category/port%d port%d-1.0 %d\n", i, i, i)
+}' /dev/null >> "${EV}/.poudriere.ports.built"
+assert_true html_json -e "${EV}"
+assert '{"seq":15007,"type":"restart"}' "$(cat "${EV}/.data.events")"
+assert_true grep -q '"events":{"seq":15007,"offset":0}' "${EV}/.data.json"
+
+# Without -e nothing is logged and .data.json has no events.
+echo "devel/d d-1 1" >> "${EV}/.poudriere.ports.built"
+assert_true html_json "${EV}"
+assert_false grep -q '"events"' "${EV}/.data.json"
+assert 1 $(wc -l < "${EV}/.data.events")
+
+# Time a tick with a large ports list for both, and then after a few
+# more ports are built.
+: ${HTML_JSON_BENCH_PORTS:=30000}
+awk -v n="${HTML_JSON_BENCH_PORTS}" 'END {
+	for (i = 0; i < n; i++)
+		printf("category/port%d port%d-1.0 %d\n", i, i, i % 600)
+}' /dev/null > "${LOG}/.poudriere.ports.built"
+bench() {
+	[ $# -eq 1 ] || eargs bench msg
+	local msg="$1"
+	local start mid native
+
+	start="$(clock -monotonic -nsec)"
+	json_awk "" > /dev/null
+	json_awk yes > /dev/null
+	mid="$(clock -monotonic -nsec)"
+	assert_true html_json -s stats "${LOG}"
+	native="$(clock -monotonic -nsec)"
+	awk -v msg="${msg}" -v start="${start}" -v mid="${mid}" \
+	    -v native="${native}" -v stats="${stats}" 'END {
+		printf("%-14s awk %8.3f sec html_json %8.3f sec (%s)\n",
+		    msg, mid - start, native - mid, stats)
+	}' /dev/null
+}
+bench "initial"
+echo "category/new new-1.0 5" >> "${LOG}/.poudriere.ports.built"
+bench "append"
+check "bench"
+
+rm -rf "${TMP:?}"
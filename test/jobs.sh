@@ -1244,4 +1244,39 @@ test_jobs_20() {
 	assert_runs_shorter_than 1 assert_ret 143 wait %1
 }
 
+# jobs_wait_fd wakes on either the fd or a job exit.
+add_test_function test_jobs_wait_fd
+test_jobs_wait_fd() {
+	local fifo line status
+
+	fifo="$(mktemp -ut jobs_wait_fd)"
+	assert_true mkfifo "${fifo}"
+	exec 8<> "${fifo}"
+	assert_true unlink "${fifo}"
+
+	sleep 5 &
+	assert_true get_job_id "$!" spawn_jobid
+	assert "1" "${spawn_jobid}"
+	# Nothing happens.
+	assert_runs_between 1 3 assert_ret 142 jobs_wait_fd -t 2 8 %1
+	# The fd is readable.
+	echo "1" >&8
+	assert_runs_shorter_than 1 assert_ret 0 jobs_wait_fd -t 10 8 %1
+	assert_true read -r line <&8
+	assert "1" "${line}"
+	# The job exits without writing to the fd.
+	assert_runs_between 2 7 assert_ret 1 jobs_wait_fd -t 10 8 %1
+	assert_true get_job_status "%1" status
+	assert "Done" "${status}"
+	# Already exited.
+	assert_runs_shorter_than 1 assert_ret 1 jobs_wait_fd -t 10 8 %1
+	# Already exited but the fd is preferred.
+	echo "2" >&8
+	assert_runs_shorter_than 1 assert_ret 0 jobs_wait_fd -t 10 8 %1
+	assert_true read -r line <&8
+	assert "2" "${line}"
+	assert_ret 0 wait %1
+	exec 8>&-
+}
+
 run_test_functions
@@ -0,0 +1,76 @@
+. ./common.sh
+
+TMP=$(mktemp -dt logcat)
+IN="${TMP}/in.log"
+OUT="${TMP}/out.log"
+
+# Enough for several frames.
+awk 'END {
+	for (i = 0; i < 100000; i++)
+		printf("c++ -O2 -c src/file%d.cpp -o obj/file%d.o\n", i, i)
+	print "foo.c:5:3: error: use of undeclared identifier \x27x\x27"
+}' /dev/null > "${IN}"
+size="$(stat -f %z "${IN}")"
+
+assert_true timestamp -T -z < "${IN}" > "${OUT}"
+assert_true [ "$(stat -f %z "${OUT}")" -lt "${size}" ]
+# Each frame is a gzip member so any gzip reader handles it.
+assert "$(cat "${IN}")" "$(gzip -dc "${OUT}")" "gzip -dc"
+assert "$(cat "${IN}")" "$(logcat "${OUT}")" "logcat"
+assert "$(awk -f "${AWKPREFIX:?}/processonelog.awk" "${IN}")" \
+    "$(processonelog "${OUT}")" "processonelog"
+
+# Ranges, for the framed, plain and plain gzip logs.
+gzip -c "${IN}" > "${TMP}/in.log.gz"
+for log in "${OUT}" "${IN}" "${TMP}/in.log.gz"; do
+	for n in 0 1 100 1048576 1048577 "${size}" "$((size + 1))"; do
+		assert "$(tail -c "${n}" "${IN}" | cksum)" \
+		    "$(logcat -t "${n}" "${log}" | cksum)" "${log} -t ${n}"
+	done
+	for range in "0 10" "1048570 20" "5 1048576" "$((size - 10)) 100" \
+	    "${size} 10"; do
+		set -- ${range}
+		assert "$(tail -c "+$(($1 + 1))" "${IN}" | head -c "$2" | cksum)" \
+		    "$(logcat -o "$1" -n "$2" "${log}" | cksum)" \
+		    "${log} -o $1 -n $2"
+		assert "$(tail -c "+$(($1 + 1))" "${IN}" | cksum)" \
+		    "$(logcat -o "$1" "${log}" | cksum)" "${log} -o $1"
+	done
+done
+assert_false logcat -t 1 -n 1 "${OUT}"
+assert_false logcat -o 1 -t 1 "${OUT}"
+assert_false logcat "${TMP}/missing"
+
+# A frame still being written is not read yet.
+head -c "$(($(stat -f %z "${OUT}") - 10))" "${OUT}" > "${TMP}/partial.log"
+logcat "${TMP}/partial.log" > "${TMP}/partial.out"
+assert_ret 0 $?
+partial="$(stat -f %z "${TMP}/partial.out")"
+assert_true [ "${partial}" -gt 0 ]
+assert_true [ "${partial}" -lt "${size}" ]
+assert "$(head -c "${partial}" "${IN}" | cksum)" \
+    "$(cksum < "${TMP}/partial.out")" "partial"
+
+# Idle output is flushed to disk while still running.
+mkfifo "${TMP}/fifo"
+timestamp -T -z < "${TMP}/fifo" > "${TMP}/live.log" &
+pid=$!
+exec 5> "${TMP}/fifo"
+echo "first line" >&5
+n=0
+until [ -s "${TMP}/live.log" ] || [ "${n}" -eq 50 ]; do
+	sleep 0.1
+	n=$((n + 1))
+done
+assert "first line" "$(logcat "${TMP}/live.log")" "live"
+echo "second line" >&5
+exec 5>&-
+assert_true wait "${pid}"
+assert "first line
+second line" "$(logcat "${TMP}/live.log")" "live done"
+
+# Empty input.
+assert_true timestamp -T -z < /dev/null > "${TMP}/empty.log"
+assert "" "$(logcat "${TMP}/empty.log")"
+
+rm -rf "${TMP:?}"
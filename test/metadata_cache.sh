@@ -0,0 +1,132 @@
+. ./common.sh
+
+TMP=$(mktemp -dt metadata_cache)
+POUDRIERE_DATA="${TMP}/data"
+MASTERNAME=metadata_cache-test
+MASTER_DATADIR="${TMP}/datadir"
+MASTERMNT="${TMP}/mnt"
+PORTSDIR=/usr/ports
+OVERLAYSDIR=/overlays
+OVERLAYS=
+METADATA_CACHE=yes
+assert_true mkdir -p "${MASTER_DATADIR}" "${MASTERMNT}/etc" \
+    "${MASTERMNT}/usr/bin" "${MASTERMNT}/usr/share/mk" \
+    "${MASTERMNT}/var/db/ports/misc_foo" \
+    "${MASTERMNT}${PORTSDIR}/Mk" "${MASTERMNT}${PORTSDIR}/misc/foo"
+echo "WITH_FOO=1" > "${MASTERMNT}/etc/make.conf"
+echo "OPTIONS_FILE_SET+=DOCS" > "${MASTERMNT}/var/db/ports/misc_foo/options"
+echo "# bsd.port.mk" > "${MASTERMNT}${PORTSDIR}/Mk/bsd.port.mk"
+echo "PORTNAME=foo" > "${MASTERMNT}${PORTSDIR}/misc/foo/Makefile"
+echo "make" > "${MASTERMNT}/usr/bin/make"
+
+# Stand in for make -V.
+FETCHES=0
+port_var_fetch_originspec() {
+	local originspec="$1"
+	shift
+
+	FETCHES=$((FETCHES + 1))
+	while [ "$#" -gt 0 ]; do
+		case "$1" in
+		*=*)
+			shift
+			continue
+			;;
+		.MAKE.MAKEFILES)
+			setvar "$2" "/usr/share/mk/sys.mk /etc/make.conf ${PORTSDIR}/misc/foo/Makefile ${PORTSDIR}/Mk/bsd.port.mk"
+			;;
+		IGNORE)
+			setvar "$2" ""
+			;;
+		*)
+			setvar "$2" "${originspec} $1"
+			;;
+		esac
+		shift 2
+	done
+}
+
+fetch() {
+	port_var_fetch_originspec_cached misc/foo \
+	    PKGNAME pkgname \
+	    _DEPS='${BUILD_DEPENDS}' \
+	    '${_DEPS:O}' deps \
+	    IGNORE ignore \
+	    FLAVORS flavors
+}
+
+assert_true metadata_cache_init
+assert_not "" "${METADATA_CACHE_DIR}"
+assert_true [ -d "${METADATA_CACHE_DIR}" ]
+
+# First lookup is a miss and is cached.
+assert_true fetch
+assert 1 "${FETCHES}"
+assert "misc/foo PKGNAME" "${pkgname}"
+assert "misc/foo \${_DEPS:O}" "${deps}"
+assert "" "${ignore}"
+assert "misc/foo FLAVORS" "${flavors}"
+
+# Second is a hit with the same values.
+unset pkgname deps ignore flavors
+assert_true fetch
+assert 1 "${FETCHES}"
+assert "misc/foo PKGNAME" "${pkgname}"
+assert "misc/foo \${_DEPS:O}" "${deps}"
+assert "" "${ignore}"
+assert "misc/foo FLAVORS" "${flavors}"
+
+# Different lookups are a miss.
+assert_true port_var_fetch_originspec_cached misc/foo PKGNAME pkgname
+assert 2 "${FETCHES}"
+assert_true fetch
+assert 3 "${FETCHES}"
+
+# Changing any of the makefiles read is a miss.
+echo "# changed" >> "${MASTERMNT}${PORTSDIR}/Mk/bsd.port.mk"
+assert_true fetch
+assert 4 "${FETCHES}"
+assert_true fetch
+assert 4 "${FETCHES}"
+# Even within the same second and without changing the size.
+echo "PORTNAME=bar" > "${MASTERMNT}${PORTSDIR}/misc/foo/Makefile"
+assert_true fetch
+assert 5 "${FETCHES}"
+assert_true fetch
+assert 5 "${FETCHES}"
+
+# But files outside of the ports tree are part of the context.
+olddir="${METADATA_CACHE_DIR}"
+echo "WITH_BAR=1" >> "${MASTERMNT}/etc/make.conf"
+assert_true fetch
+assert 5 "${FETCHES}"
+assert_true metadata_cache_init
+assert_not "${olddir}" "${METADATA_CACHE_DIR}"
+assert_false [ -d "${olddir}" ]
+assert_true fetch
+assert 6 "${FETCHES}"
+
+# As is the jail's world.
+olddir="${METADATA_CACHE_DIR}"
+echo "make" > "${MASTERMNT}/usr/bin/make.new"
+assert_true mv "${MASTERMNT}/usr/bin/make.new" "${MASTERMNT}/usr/bin/make"
+assert_true metadata_cache_init
+assert_not "${olddir}" "${METADATA_CACHE_DIR}"
+assert_true fetch
+assert 7 "${FETCHES}"
+olddir="${METADATA_CACHE_DIR}"
+assert_true metadata_cache_init
+assert "${olddir}" "${METADATA_CACHE_DIR}"
+assert_true fetch
+assert 7 "${FETCHES}"
+
+# Disabled.
+METADATA_CACHE=no
+assert_true metadata_cache_init
+assert "" "${METADATA_CACHE_DIR-}"
+assert_true fetch
+assert 8 "${FETCHES}"
+assert_true fetch
+assert 9 "${FETCHES}"
+
+rm -rf "${TMP}"
@@ -0,0 +1,88 @@
+set +e
+. ./common.sh
+set -e
+
+if ! have_builtin parallel_pool; then
+	exit 77
+fi
+
+TMP="$(mktemp -dt parallel_pool)"
+
+retval() {
+	[ $# -eq 2 ] || eargs retval file ret
+	until [ -e "$1" ]; do
+		sleep 0.1
+	done
+	return "$2"
+}
+
+sleeper() {
+	[ $# -eq 1 ] || eargs sleeper pidfile
+	getpid > "$1.tmp"
+	rename "$1.tmp" "$1"
+	sleep 30
+}
+
+# Slots are given out lowest first and reused once their job is
+# collected along with its status.
+assert_true parallel_pool start 2
+assert_true parallel_pool get slot ret
+assert 1 "${slot}"
+assert 0 "${ret}"
+spawn_job retval /dev/null 3
+assert_true parallel_pool add "%${spawn_jobid:?}" "${slot}"
+assert_true parallel_pool get slot ret
+assert 2 "${slot}"
+assert 0 "${ret}"
+spawn_job retval "${TMP}/go" 5
+assert_true parallel_pool add "%${spawn_jobid:?}" "${slot}"
+# Full; blocks until the first job is gone.
+assert_true parallel_pool get slot ret
+assert 1 "${slot}"
+assert 3 "${ret}"
+spawn_job retval "${TMP}/go" 7
+assert_true parallel_pool add "%${spawn_jobid:?}" "${slot}"
+assert_true parallel_pool jobs jobs
+assert 2 "$(echo "${jobs}" | wc -w | tr -d ' ')"
+assert_true touch "${TMP}/go"
+# The last failure in the order they were added.
+assert_true parallel_pool wait ret
+assert 7 "${ret}"
+assert_true parallel_pool jobs jobs
+assert "" "${jobs}"
+assert_true parallel_pool stop
+assert_true rm -f "${TMP}/go"
+
+# A signal interrupts a full pool without losing its jobs, and
+# parallel_shutdown kills and collects them.
+PARALLEL_JOBS=2
+got_usr1=0
+trap 'got_usr1=1' USR1
+assert_true parallel_start
+assert_true parallel_run sleeper "${TMP}/pid.1"
+assert_true parallel_run sleeper "${TMP}/pid.2"
+assert_true wait_for_file 10 "${TMP}/pid.1"
+assert_true wait_for_file 10 "${TMP}/pid.2"
+read -r pid1 < "${TMP}/pid.1"
+read -r pid2 < "${TMP}/pid.2"
+(
+	trap - USR1
+	sleep 1
+	kill -USR1 $$
+) &
+killpid=$!
+ret=0
+parallel_run sleeper "${TMP}/pid.3" || ret="$?"
+assert "$(($(kill -l USR1) + 128))" "${ret}"
+assert 1 "${got_usr1}"
+assert_false [ -e "${TMP}/pid.3" ]
+assert_true kill -0 "${pid1}"
+assert_true kill -0 "${pid2}"
+assert_true _wait "${killpid}"
+parallel_shutdown || :
+assert_false kill -0 "${pid1}"
+assert_false kill -0 "${pid2}"
+assert "" "${NBPARALLEL-}"
+trap - USR1
+
+rm -rf "${TMP}"
@@ -0,0 +1,45 @@
+# Compare jobs/sec for parallel_run with the parallel_pool builtin against
+# the fifo and jobs(1) polling fallback, and against worker mode.
+set -e
+. ./common.sh
+set +e
+
+: ${PARALLEL_RUN_BENCH_JOBS:=10000}
+PARALLEL_WORKERS=yes
+
+if ! have_builtin parallel_pool; then
+	exit 77
+fi
+
+bench() {
+	[ $# -ge 2 ] || eargs bench mode builtin '[parallel_start flags]'
+	local mode="$1"
+	local PARALLEL_POOL_BUILTIN="$2"
+	shift 2
+	local start end n
+
+	start="$(clock -monotonic -nsec)"
+	assert_true parallel_start "$@"
+	n=0
+	until [ "${n}" -eq "${PARALLEL_RUN_BENCH_JOBS}" ]; do
+		parallel_run :
+		assert 0 "$?" "${mode}: parallel_run should succeed"
+		n="$((n + 1))"
+	done
+	assert_true parallel_stop
+	end="$(clock -monotonic -nsec)"
+	bench_report "${mode}/${PARALLEL_JOBS}" "${n}" jobs "${start}" "${end}"
+}
+
+for PARALLEL_JOBS in 1 8; do
+	bench fifo 0
+	bench builtin 1
+	bench workers 0 -w
+done
+
+# Statuses are still collected with the fallback.
+PARALLEL_POOL_BUILTIN=0
+assert_true parallel_start
+assert_true parallel_run false
+parallel_stop
+assert 1 "$?" "fifo: parallel_stop should see the failure"
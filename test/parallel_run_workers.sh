@@ -0,0 +1,167 @@
+set +e
+. ./common.sh
+set -e
+
+set_test_contexts - '' '' <<-EOF
+PARALLEL_JOBS 1 2 4 8
+EOF
+
+PARALLEL_WORKERS=yes
+
+retval() {
+	return "$1"
+}
+
+# Fails if another command already claimed the global.
+claim() {
+	[ "$#" -eq 1 ] || eargs claim name
+	case "${claimed-}" in
+	"") ;;
+	*) return 1 ;;
+	esac
+	claimed="$1"
+}
+
+unclaim() {
+	unset claimed
+}
+
+record() {
+	[ "$#" -ge 1 ] || eargs record file args...
+	local file="$1"
+	shift
+
+	echo "$(getpid) $# [$*]" > "${file}"
+}
+
+while get_test_context; do
+	TDIR="$(mktemp -d -t parallel_run_workers)"
+
+	capture_output_simple '' stderr
+	{
+		n=0
+		max=40
+		assert_true parallel_start -w
+		until [ "${n}" -eq "${max}" ]; do
+			assert_true parallel_run record "${TDIR}/${n}" "${n}" "" \
+			    "a b"
+			n=$((n + 1))
+		done
+		assert_true parallel_stop
+		n=0
+		until [ "${n}" -eq "${max}" ]; do
+			assert_true [ -e "${TDIR}/${n}" ]
+			read -r pid nargs args < "${TDIR}/${n}"
+			assert 3 "${nargs}" "empty arguments should be kept"
+			assert "[${n}  a b]" "${args}"
+			echo "${pid}" >> "${TDIR}/pids"
+			n=$((n + 1))
+		done
+		# Every command ran in one of the workers.
+		pids="$(sort -u "${TDIR}/pids" | wc -l)"
+		assert_true [ "$((pids + 0))" -le "${PARALLEL_JOBS}" ]
+		find "${TDIR}/" -type f -delete
+	}
+
+	{
+		n=0
+		max=20
+		ret=0
+		assert_true parallel_start -w
+		until [ "${n}" -eq "${max}" ]; do
+			case "${n}" in
+			5)
+				assert_true parallel_run retval 5
+				;;
+			*)
+				parallel_run : || ret="$?"
+				;;
+			esac
+			n=$((n + 1))
+		done
+		assert_true parallel_run retval 95
+		parallel_stop || ret="$?"
+		assert 95 "${ret}"
+	}
+
+	# A worker which exits is replaced.
+	{
+		ret=0
+		assert_true parallel_start -w
+		assert_true parallel_run exit 7
+		n=0
+		max=20
+		until [ "${n}" -eq "${max}" ]; do
+			parallel_run touch "${TDIR}/${n}" || ret="$?"
+			n=$((n + 1))
+		done
+		parallel_stop || ret="$?"
+		assert 7 "${ret}"
+		n=0
+		until [ "${n}" -eq "${max}" ]; do
+			assert_true [ -e "${TDIR}/${n}" ]
+			n=$((n + 1))
+		done
+		find "${TDIR}/" -type f -delete
+	}
+	capture_output_simple_stop
+	# No errors should have been seen.
+	assert_file - "${stderr}" <<-EOF
+	EOF
+
+	# Worker stderr is prefixed for the command that wrote it.
+	capture_output_simple '' stderr
+	{
+		assert_true parallel_start -w
+		assert_true parallel_run -p "(first)" \
+		    sh -c 'echo "first error" >&2'
+		assert_true parallel_run sh -c 'echo "plain error" >&2'
+		assert_true parallel_stop
+	}
+	capture_output_simple_stop
+	assert_true grep -q "(first): first error" "${stderr}"
+	assert_true grep -q "^plain error" "${stderr}"
+	rm -f "${stderr}"
+
+	# Globals set by one command are seen by the next in the same worker
+	# unless the reset command clears them.
+	{
+		n=0
+		max="$((PARALLEL_JOBS + 1))"
+		ret=0
+		assert_true parallel_start -w
+		until [ "${n}" -eq "${max}" ]; do
+			parallel_run claim "${n}" || ret="$?"
+			n=$((n + 1))
+		done
+		parallel_stop || ret="$?"
+		assert 1 "${ret}" "claim should clash without a reset"
+
+		n=0
+		assert_true parallel_start -w -r unclaim
+		until [ "${n}" -eq "${max}" ]; do
+			assert_true parallel_run claim "${n}"
+			n=$((n + 1))
+		done
+		assert_true parallel_stop
+		assert "" "${claimed-}"
+	}
+
+	# PARALLEL_WORKERS=no forks a job for every command.
+	{
+		PARALLEL_WORKERS=no
+		n=0
+		max=10
+		assert_true parallel_start -w
+		until [ "${n}" -eq "${max}" ]; do
+			assert_true parallel_run record "${TDIR}/${n}"
+			n=$((n + 1))
+		done
+		assert_true parallel_stop
+		PARALLEL_WORKERS=yes
+		cat "${TDIR}"/[0-9]* | sort -u > "${TDIR}/pids"
+		pids="$(wc -l < "${TDIR}/pids")"
+		assert "${max}" "$((pids + 0))"
+	}
+	rm -rf "${TDIR}"
+done
@@ -0,0 +1,89 @@
+. ./common.sh
+
+TMP=$(mktemp -dt pkg_metadata_index)
+POUDRIERE_DATA="${TMP}/data"
+MASTERNAME=pkg_metadata_index-test
+MASTER_DATADIR="${TMP}/datadir"
+MASTERMNT=/
+INJAIL_HOST=1
+PACKAGES="${TMP}/packages"
+PKG_EXT=pkg
+PARALLEL_JOBS=2
+QUERIES="${TMP}/queries"
+PKG_BIN="${TMP}/pkg"
+assert_true mkdir -p "${MASTER_DATADIR}" "${PACKAGES}/All"
+assert_true touch "${PACKAGES}/All/foo-1.pkg" "${PACKAGES}/All/bar-2.pkg"
+
+# Stand in for pkg query -F.
+cat > "${PKG_BIN}" <<'PKGEOF'
+#! /bin/sh
+file="${3##*/}"
+echo "${file}" >> "${QUERIES}"
+case "${file}:${4}" in
+bar-2.pkg:o*) printf "o misc/bar\tFreeBSD:14:amd64\t2\n" ;;
+bar-2.pkg:O*) echo "O DOCS on"; echo "O X11 off" ;;
+bar-2.pkg:A*) echo "A flavor py39" ; echo "A repository FreeBSD" ;;
+bar-2.pkg:D*) echo "D misc/foo foo-1" ;;
+bar-2.pkg:B*) echo "B libm.so.5"; echo "B libc.so.7" ;;
+bar-2.pkg:b*) echo "b libbar.so.1" ;;
+foo-1.pkg:o*) printf "o misc/foo\tFreeBSD:14:amd64\t0\n" ;;
+*) ;;
+esac
+PKGEOF
+assert_true chmod +x "${PKG_BIN}"
+export QUERIES
+
+queries() {
+	if [ -f "${QUERIES}" ]; then
+		sort -u "${QUERIES}" | paste -s -d ' ' -
+	fi
+	rm -f "${QUERIES}"
+}
+
+assert_true pkg_metadata_index_update
+assert "bar-2.pkg foo-1.pkg" "$(queries)"
+
+pkg="${PACKAGES}/All/bar-2.pkg"
+assert_true pkg_get_origin origin "${pkg}"
+assert "misc/bar" "${origin}"
+assert_true pkg_get_arch arch "${pkg}"
+assert "FreeBSD:14:amd64" "${arch}"
+assert_true pkg_get_shlib_required_count count "${pkg}"
+assert 2 "${count}"
+assert_true pkg_get_options options "${pkg}"
+assert "+DOCS -X11" "${options}"
+assert_true pkg_get_dep_origin_pkgnames origins pkgnames "${pkg}"
+assert "misc/foo" "${origins}"
+assert "foo-1" "${pkgnames}"
+assert_true pkg_get_flavor flavor "${pkg}"
+assert "py39" "${flavor}"
+assert "libc.so.7 libm.so.5" "$(pkg_get_shlib_requires - "${pkg}" |
+    paste -s -d ' ' -)"
+assert "libbar.so.1" "$(pkg_get_shlib_provides - "${pkg}")"
+assert_true pkg_get_origin origin "${PACKAGES}/All/foo-1.pkg"
+assert "misc/foo" "${origin}"
+assert_true pkg_get_options options "${PACKAGES}/All/foo-1.pkg"
+assert "" "${options}"
+assert "" "$(queries)"
+
+# Only new or changed packages are queried again.
+echo changed >> "${pkg}"
+assert_true touch "${PACKAGES}/All/baz-3.pkg"
+assert_true pkg_metadata_index_update
+assert "bar-2.pkg baz-3.pkg" "$(queries)"
+assert_true pkg_get_origin origin "${pkg}"
+assert "misc/bar" "${origin}"
+assert "" "$(queries)"
+
+# Removed packages are dropped from the index.
+assert_true unlink "${PACKAGES}/All/baz-3.pkg"
+assert_true pkg_metadata_index_update
+assert "" "$(queries)"
+_pkg_metadata_index_path index
+assert 2 "$(wc -l < "${index}" | tr -d ' ')"
+
+# A package changed after the index was loaded is not used from it.
+echo changed >> "${pkg}"
+assert_false _pkg_metadata_get origin "${pkg}" origin
+
+rm -rf "${TMP}"
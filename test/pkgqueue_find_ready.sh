@@ -0,0 +1,36 @@
+. ./common.sh
+
+TMP=$(mktemp -dt pkgqueue_find_ready)
+assert_true cd "${TMP}"
+
+assert_true mkdir -p b0 b1 b2
+# Non-empty dirs are not ready.
+assert_true mkdir -p b0/notready/dep
+assert_true mkdir -p b1/notready2/dep
+assert_true mkdir -p b2/ready
+# Files are ignored.
+assert_true touch b1/file
+
+assert_true pkgqueue_find_ready dir b0 b1 b2
+assert "b2/ready" "${dir}"
+
+# Buckets are searched in order.
+assert_true mkdir b1/ready1
+assert_true pkgqueue_find_ready dir b0 b1 b2
+assert "b1/ready1" "${dir}"
+assert_true pkgqueue_find_ready dir b2 b1 b0
+assert "b2/ready" "${dir}"
+
+# Missing buckets are ignored.
+assert_true pkgqueue_find_ready dir missing b2
+assert "b2/ready" "${dir}"
+
+# Nothing ready clears the var.
+assert_false pkgqueue_find_ready dir b0 missing
+assert "" "${dir}"
+assert_true rmdir b0/notready/dep
+assert_true pkgqueue_find_ready dir b0
+assert "b0/notready" "${dir}"
+
+assert_true cd /
+assert_true rm -rf "${TMP}"
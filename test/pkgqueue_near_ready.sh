@@ -0,0 +1,54 @@
+. ./common.sh
+
+set_pipefail
+
+MASTER_DATADIR=$(mktemp -dt datadir)
+assert_true cd "${MASTER_DATADIR}"
+assert_true add_relpath_var MASTER_DATADIR
+
+assert_true pkgqueue_init
+assert_true pkgqueue_add "build" pkg
+assert_true pkgqueue_add "build" bash
+assert_true pkgqueue_add_dep "build" bash "build" pkg
+assert_true pkgqueue_add "build" patchutils
+assert_true pkgqueue_add_dep "build" patchutils "build" bash
+assert_true pkgqueue_add_dep "build" patchutils "build" pkg
+assert_true pkgqueue_add "build" zsh
+assert_true pkgqueue_add_dep "build" zsh "build" pkg
+assert_true pkgqueue_move_ready_to_pool
+
+# Ready jobs first, then by the number of dependencies left.
+assert_out 0 - pkgqueue_near_ready 0 <<EOF
+build:pkg
+EOF
+assert_out 0 - pkgqueue_near_ready 1 <<EOF
+build:pkg
+build:bash
+build:zsh
+EOF
+assert_out 0 - pkgqueue_near_ready 2 <<EOF
+build:pkg
+build:bash
+build:zsh
+build:patchutils
+EOF
+
+assert_true cd "${MASTER_DATADIR:?}/pool"
+assert_true pkgqueue_get_next job_type pkgname
+assert "pkg" "${pkgname}"
+# A running job is no longer listed.
+assert_out 0 - pkgqueue_near_ready 1 <<EOF
+build:bash
+build:zsh
+EOF
+assert_true pkgqueue_clean_queue "${job_type}" "${pkgname}" "${clean_rdepends-}"
+assert_true pkgqueue_job_done "${job_type}" "${pkgname}"
+
+assert_out_unordered 0 - pkgqueue_near_ready 0 <<EOF
+build:bash
+build:zsh
+EOF
+assert "build:patchutils" "$(pkgqueue_near_ready 1 | sed -n '$p')"
+
+assert_true cd "${POUDRIERE_TMPDIR:?}"
+rm -rf "${MASTER_DATADIR:?}"
@@ -0,0 +1,168 @@
+. ./common.sh
+
+if ! have_builtin plock_acquire; then
+	exit 77
+fi
+
+TMP=$(mktemp -dt plock)
+LOCKFILE="${TMP}/.poudriere-locks"
+
+# plock_stats fields for name.
+stats() {
+	plock_stats "${LOCKFILE}" | awk -v name="$1" '$1 == name'
+}
+
+# Nothing there yet.
+assert "" "$(plock_stats "${LOCKFILE}")"
+assert_true plock_acquire 0 "${LOCKFILE}" TEST
+assert_true [ -f "${LOCKFILE}" ]
+assert_false hide_stderr plock_acquire 0 "${LOCKFILE}" TEST
+assert_true plock_release "${LOCKFILE}" TEST
+assert_false hide_stderr plock_release "${LOCKFILE}" TEST
+assert_true plock_acquire 0 "${LOCKFILE}" TEST
+assert_true plock_acquire 0 "${LOCKFILE}" TEST2
+assert_true plock_release "${LOCKFILE}" TEST
+assert_true plock_release "${LOCKFILE}" TEST2
+
+# A held lock times out, or fails at once with no waittime.
+SYNC_FIFO="$(mktemp -ut plock)"
+assert_true mkfifo "${SYNC_FIFO}"
+(
+	trap - INT
+	assert_true plock_acquire 5 "${LOCKFILE}" TEST
+	write_pipe "${SYNC_FIFO}" have_lock
+	read_pipe "${SYNC_FIFO}" waiting
+	assert_true plock_release "${LOCKFILE}" TEST
+) &
+lockpid=$!
+assert_true read_pipe "${SYNC_FIFO}" line
+assert "have_lock" "${line}"
+assert_ret 124 plock_acquire 0 "${LOCKFILE}" TEST
+time=$(clock -monotonic)
+assert_ret 124 plock_acquire 2 "${LOCKFILE}" TEST
+nowtime=$(clock -monotonic)
+assert_true [ "$((nowtime - time))" -ge 1 ]
+# Nor can the child's lock be released.
+assert_false hide_stderr plock_release "${LOCKFILE}" TEST
+assert_true write_pipe "${SYNC_FIFO}" done
+assert_true _wait "${lockpid}"
+assert_true plock_acquire 0 "${LOCKFILE}" TEST
+
+# Waiters get the lock in the order they queued.
+: > "${TMP}/order"
+n=0
+until [ "${n}" -eq 4 ]; do
+	(
+		trap - INT
+		plock_acquire 30 "${LOCKFILE}" TEST
+		echo "${n}" >> "${TMP}/order"
+		sleep 0.2
+		plock_release "${LOCKFILE}" TEST
+	) &
+	# Queued before the next one.
+	sleep 0.5
+	n=$((n + 1))
+done
+assert "" "$(cat "${TMP}/order")"
+assert_true plock_release "${LOCKFILE}" TEST
+wait
+assert "0 1 2 3" "$(echo $(cat "${TMP}/order"))"
+
+# A lock held by a process that died is passed on.
+(
+	trap - INT
+	plock_acquire 0 "${LOCKFILE}" TEST
+	sleep 1
+) &
+lockpid=$!
+sleep 0.5
+time=$(clock -monotonic)
+assert_true plock_acquire 10 "${LOCKFILE}" TEST
+nowtime=$(clock -monotonic)
+assert_true [ "$((nowtime - time))" -le 3 ]
+_wait "${lockpid}"
+
+# name acquires contended timeouts stale wait_ms wait_max_ms hold_ms
+# hold_max_ms owner
+read -r name acquires contended timeouts stale wait_ms wait_max_ms \
+    hold_ms hold_max_ms owner <<-EOF
+$(stats TEST)
+EOF
+assert "TEST" "${name}"
+assert 10 "${acquires}"
+assert 7 "${contended}"
+assert 2 "${timeouts}"
+assert 1 "${stale}"
+assert_true [ "${wait_max_ms}" -ge 1000 ]
+assert_true [ "${wait_ms}" -ge "${wait_max_ms}" ]
+assert_true [ "${hold_max_ms}" -ge 1000 ]
+assert "$(getpid)" "${owner}"
+assert_true plock_release "${LOCKFILE}" TEST
+read -r name acquires contended timeouts stale wait_ms wait_max_ms \
+    hold_ms hold_max_ms owner <<-EOF
+$(stats TEST)
+EOF
+assert 0 "${owner}"
+
+# lock_acquire queues in it and still takes the lock dir.
+lockpath="${POUDRIERE_TMPDIR:?}/lock-${MASTERNAME:+${MASTERNAME}-}TEST"
+owner() {
+	plock_stats "${_plock_file:?}" | awk '$1 ~ /-TEST$/ { print $10 }'
+}
+assert_true lock_acquire TEST 0
+_plock_file=
+assert_true _plock_file "${lockpath}"
+assert_true [ -f "${_plock_file}" ]
+assert "$(getpid)" "$(owner)"
+assert_true [ -d "${lockpath}" ]
+# So processes using only locked_mkdir are excluded.
+assert_ret 124 locked_mkdir 0 "${lockpath}"
+assert_true lock_release TEST
+assert 0 "$(owner)"
+assert_false [ -d "${lockpath}" ]
+
+# Lock names that are no longer used do not fill the lock file up.
+n=0
+until [ "${n}" -eq 300 ]; do
+	assert_true plock_acquire 0 "${LOCKFILE}" "old-${n}"
+	assert_true plock_release "${LOCKFILE}" "old-${n}"
+	n=$((n + 1))
+done
+assert 256 "$(($(plock_stats "${LOCKFILE}" | wc -l)))"
+
+# With every slot held lock_acquire uses only locked_mkdir.
+c=0
+until [ "${c}" -eq 4 ]; do
+	(
+		trap - INT
+		n=0
+		until [ "${n}" -eq 64 ]; do
+			plock_acquire 0 "${_plock_file}" "held-${c}-${n}" ||
+			    exit 1
+			n=$((n + 1))
+		done
+		touch "${TMP}/held.${c}"
+		until [ -e "${TMP}/done" ]; do
+			sleep 0.1
+		done
+	) &
+	c=$((c + 1))
+done
+until [ -e "${TMP}/held.0" ] && [ -e "${TMP}/held.1" ] &&
+    [ -e "${TMP}/held.2" ] && [ -e "${TMP}/held.3" ]; do
+	sleep 0.1
+done
+assert_ret 69 plock_acquire 0 "${_plock_file}" TEST
+assert_true lock_acquire TEST 0
+assert_true [ -d "${lockpath}" ]
+assert "" "$(owner)"
+assert_true lock_release TEST
+assert_false [ -d "${lockpath}" ]
+touch "${TMP}/done"
+wait
+# Their slots are reused once they are gone.
+assert_true lock_acquire TEST 0
+assert "$(getpid)" "$(owner)"
+assert_true lock_release TEST
+
+rm -rf "${TMP}" "${SYNC_FIFO}"
@@ -124,3 +124,32 @@ port_var_fetch "port_var_fetch_syntax_error" \
     PKGNAME pkgname
 assert 1 $? "port_var_fetch should detect make syntax error with 1 -V"
 assert "" "${pkgname}" "PKGNAME shouldn't have gotten a value in a failed lookup"
+
+# The same lookups through a port_var_fetch worker.
+TMP=$(mktemp -dt port_var_fetch)
+MASTERNAME=port_var_fetch
+MASTER_DATADIR="${TMP}/datadir"
+MASTERMNT="${TMP}/mnt"
+INJAIL_HOST=1
+PARALLEL_JOBS=1
+PORT_VAR_FETCH_WORKERS=yes
+assert_true mkdir -p "${MASTER_DATADIR}" "${MASTERMNT}/tmp"
+assert_true port_var_fetch_workers_start
+PARALLEL_SLOT=1
+assert_true _port_var_fetch_worker worker
+assert "${MASTER_DATADIR}/port_var_fetch.1" "${worker}"
+pkgname=
+port_var_fetch "port_var_fetch1" \
+    PKGNAME pkgname
+assert 0 "$?"
+assert "py34-sqlrelay-1.0.0_2" "${pkgname}" "worker: PKGNAME"
+pkgname=
+port_var_fetch "port_var_fetch_syntax_error" \
+    PKGNAME pkgname
+assert_not 0 "$?" "worker: port_var_fetch should detect make syntax error failure"
+assert "" "${pkgname}" "worker: PKGNAME shouldn't have gotten a value in a failed lookup"
+unset PARALLEL_SLOT
+assert_true port_var_fetch_workers_stop
+assert_false [ -e "${MASTER_DATADIR}/port_var_fetch.1.in" ]
+rm -f /tmp/.port_var_fetch.1.err
+rm -rf "${TMP}"
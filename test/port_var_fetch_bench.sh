@@ -0,0 +1,59 @@
+# Compare origins/sec for port_var_fetch running make directly against
+# sending the lookups to a port_var_fetch worker.
+set -e
+. ./common.sh
+set +e
+PORTSDIR=${THISDIR%/*}/test-ports/port_var_fetch
+export PORTSDIR
+export __MAKE_CONF=/dev/null
+
+: ${PORT_VAR_FETCH_BENCH_ORIGINS:=200}
+
+TMP=$(mktemp -dt port_var_fetch_bench)
+MASTERNAME=port_var_fetch_bench
+MASTER_DATADIR="${TMP}/datadir"
+MASTERMNT="${TMP}/mnt"
+INJAIL_HOST=1
+PARALLEL_JOBS=1
+PORT_VAR_FETCH_WORKERS=yes
+assert_true mkdir -p "${MASTER_DATADIR}" "${MASTERMNT}/tmp"
+
+bench() {
+	[ $# -eq 1 ] || eargs bench mode
+	local mode="$1"
+	local start end n pkgname pdeps
+
+	start="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${PORT_VAR_FETCH_BENCH_ORIGINS}" ]; do
+		pkgname=
+		port_var_fetch "port_var_fetch1" \
+		    PKGNAME pkgname \
+		    _PDEPS='${PKG_DEPENDS} ${BUILD_DEPENDS} ${RUN_DEPENDS}' \
+		    '${_PDEPS:C,([^:]*):([^:]*):?.*,\2,:C,^${PORTSDIR}/,,:O:u}' \
+		    pdeps
+		assert 0 "$?" "${mode}: port_var_fetch should succeed"
+		assert "py34-sqlrelay-1.0.0_2" "${pkgname}" "${mode}: PKGNAME"
+		n="$((n + 1))"
+	done
+	end="$(clock -monotonic -nsec)"
+	bench_report "${mode}" "${n}" origins "${start}" "${end}"
+}
+
+unset PARALLEL_SLOT
+bench direct
+
+assert_true port_var_fetch_workers_start
+PARALLEL_SLOT=1
+assert_true _port_var_fetch_worker worker
+assert "${MASTER_DATADIR}/port_var_fetch.1" "${worker}"
+bench worker
+# Errors from make are still seen.
+port_var_fetch "port_var_fetch_missing" PKGNAME pkgname 2>/dev/null
+assert_not 0 "$?" "worker: missing port should fail"
+unset PARALLEL_SLOT
+assert_true port_var_fetch_workers_stop
+assert_false [ -e "${MASTER_DATADIR}/port_var_fetch.1.in" ]
+
+rm -f /tmp/.port_var_fetch.1.err
+rm -rf "${TMP}"
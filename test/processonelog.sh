@@ -0,0 +1,113 @@
+. ./common.sh
+
+TMP=$(mktemp -dt processonelog)
+SAMPLES="${TMP}/samples"
+
+# A line for each of the processonelog.awk reasons, and some which match
+# none of them.
+cat > "${SAMPLES}" <<'SAMPLES_EOF'
+Error: Filesystem touched during build:
+Configuration amd64-portbld-freebsd14 not supported
+foo.c:12:10: fatal error: 'bar.h' file not found
+configure: error: C compiler cannot create executables
+=> Couldn't fetch it - please try to retrieve this
+Error: shared library "libfoo.so.1" does not exist
+ld: error: duplicate symbol: main
+ld: error: relocation R_X86_64_32 cannot be used; recompile with -fPIC
+error: can't create dynamic relocation R_X86_64_64 against symbol: foo in readonly segment
+foo.c:1: parse error before 'x'
+foo.c:3: warning: passing arg 1 of `f' changes signedness
+ld: error: undefined symbol: std::__1::foo
+foo.cpp:3: error: no matching function for call to 'f()'
+foo.c:4: error: 'x' was not declared in this scope
+install: /usr/local/bin/foo: No such file or directory
+pkg-static: foo-1 conflicts with installed package bar-2
+foo.c:5:3: error: use of undeclared identifier 'x'
+foo.c:7: error: C requires a type specifier for all declarations
+foo.o: undefined reference to `bar'
+foo.s: Assembler messages:
+=> Checksum mismatch for foo.tar.gz
+LLVM ERROR: out of memory
+Error: Can't open display: :0
+=> No checksum recorded for foo.tar.gz.
+fetch: foo: No address record
+fetch: transfer timed out
+See <URL:http://gcc.gnu.org/bugs.html> for instructions.
+cc: ndbm.so: No such file or directory
+Could not create Makefile
+make: don't know how to make all. Stop
+regression-test.continuing make: don't know how to make all. Stop
+/usr/local/man/man1/foo.1: No such file or directory
+1 out of 2 hunks failed--saving rejects to foo.c.rej
+*** Signal 11
+*** Error code 127 Abort trap
+error: 'regparm' is not valid on this platform
+Killing runaway build after 10 seconds
+#warning "this file includes <sys/termios.h> which is deprecated"
+cannot find -lc_r
+mkdir: Read-only file system
+foo.c:12:3: error: unused variable 'x' [-Werror,-Wunused-variable]
+cc1: warnings being treated as errors
+Abort trap (core dumped)
+tar: Error exit delayed from previous errors
+Cannot stat: foo
+error in dependency foo, exiting
+/usr/bin/ld: cannot find -lfoo
+#error "unsupported"
+Segmentation fault
+error: process didn't exit successfully: `build-script-build`
+ninja: build stopped: subcommand failed
+just some ordinary line
+SAMPLES_EOF
+
+# The native classifier must give the same answer as processonelog.awk.
+check() {
+	[ $# -eq 1 ] || eargs check log
+	local log="$1"
+	local expected
+
+	expected="$(awk -f "${AWKPREFIX:?}/processonelog.awk" "${log}")"
+	assert "${expected}" "$(processonelog "${log}")" \
+	    "processonelog ${log}: $(head -c 200 "${log}")"
+}
+
+LOG="${TMP}/test.log"
+while IFS= read -r line; do
+	echo "${line}" > "${LOG}"
+	check "${LOG}"
+	# Without a newline at the end.
+	printf "%s" "${line}" > "${LOG}"
+	check "${LOG}"
+	# Only the first matching line counts.
+	{
+		echo "${line}"
+		echo "ninja: build stopped: subcommand failed"
+	} > "${LOG}"
+	check "${LOG}"
+	# And nothing after a phase.
+	{
+		echo "=======================<phase: build          >============================"
+		echo "${line}"
+	} > "${LOG}"
+	check "${LOG}"
+done < "${SAMPLES}"
+
+# All of them together, and empty.
+check "${SAMPLES}"
+:> "${LOG}"
+assert "???" "$(processonelog "${LOG}")"
+
+# Compressed logs and stdin.
+expected="$(awk -f "${AWKPREFIX:?}/processonelog.awk" "${SAMPLES}")"
+for compress in gzip bzip2 xz zstd; do
+	if ! type "${compress}" >/dev/null 2>&1; then
+		continue
+	fi
+	"${compress}" -c "${SAMPLES}" > "${TMP}/samples.${compress}"
+	assert "${expected}" "$(processonelog "${TMP}/samples.${compress}")" \
+	    "${compress}"
+done
+assert "${expected}" "$(processonelog < "${SAMPLES}")" "stdin"
+assert "${expected}" "$(processonelog - < "${SAMPLES}")" "stdin -"
+
+rm -rf "${TMP:?}"
@@ -0,0 +1,58 @@
+# Compare the wall time of classifying a corpus of failed build logs with
+# the processonelog.sh bzgrep chain, processonelog.awk and the native
+# processonelog.  Each log is PROCESSONELOG_BENCH_LINES lines of compiler
+# output followed by an error.
+set -e
+. ./common.sh
+set +e
+
+: ${PROCESSONELOG_BENCH_LINES:=100000}
+
+TMP=$(mktemp -dt processonelog_bench)
+CORPUS="${TMP}/corpus"
+assert_true mkdir -p "${CORPUS}"
+
+n=0
+while IFS= read -r error; do
+	n=$((n + 1))
+	awk -v lines="${PROCESSONELOG_BENCH_LINES}" -v error="${error}" '
+	    END {
+		for (i = 0; i < lines; i++)
+			printf("c++ -O2 -pipe -fstack-protector-strong " \
+			    "-c src/lib/file%d.cpp -o obj/file%d.o " \
+			    "-Iinclude -DNDEBUG\n", i, i)
+		print error
+		print "*** Error code 1"
+	    }' /dev/null > "${CORPUS}/${n}.log"
+done <<-EOF
+foo.c:12:10: fatal error: 'bar.h' file not found
+foo.o: undefined reference to \`bar'
+foo.c:5:3: error: use of undeclared identifier 'x'
+LLVM ERROR: out of memory
+Segmentation fault
+ninja: build stopped: subcommand failed
+EOF
+
+bench() {
+	[ $# -ge 1 ] || eargs bench name cmd...
+	local name="$1"
+	local start end log
+	shift
+
+	start="$(clock -monotonic -nsec)"
+	for log in "${CORPUS}"/*.log; do
+		"$@" "${log}" > "${log}.${name}"
+	done
+	end="$(clock -monotonic -nsec)"
+	bench_report "${name}" "${n}" logs "${start}" "${end}"
+}
+
+bench shell sh "${SCRIPTPREFIX:?}/processonelog.sh"
+bench awk awk -f "${AWKPREFIX:?}/processonelog.awk"
+bench native processonelog
+
+for log in "${CORPUS}"/*.log; do
+	assert "$(cat "${log}.awk")" "$(cat "${log}.native")" "${log}"
+done
+
+rm -rf "${TMP:?}"
@@ -0,0 +1,96 @@
+# Compare depth-only priorities against build time weighted priorities
+# by replaying a queue through schedule_sim.awk.  A recorded bulk run may
+# be replayed instead of the synthetic queue with:
+#   SIM_PKG_DEPS=.../.poudriere.pkg_deps%
+#   SIM_PORTS_BUILT=.../.poudriere.ports.built
+#   SIM_BUILDERS=N
+#   SIM_QUANTUM=seconds
+. ./common.sh
+
+set_pipefail
+
+TMP=$(mktemp -dt ptsort-weighted)
+assert_true cd "${TMP}"
+
+simulate() {
+	[ $# -eq 1 ] || eargs simulate priorities
+	local priorities="$1"
+
+	awk -f "${THISDIR:?}/schedule_sim.awk" -v builders="${SIM_BUILDERS}" \
+	    "${priorities}" "${SIM_PKG_DEPS}" "${SIM_PORTS_BUILT}" |
+	    awk '$1 == "makespan" { print $2 }'
+}
+
+case "${SIM_PKG_DEPS:+set}" in
+set)
+	REPLAY=1
+	: ${SIM_BUILDERS:=$(sysctl -n hw.ncpu)}
+	: ${SIM_QUANTUM:=300}
+	;;
+*)
+	REPLAY=0
+	SIM_BUILDERS=2
+	SIM_QUANTUM=20
+	SIM_PKG_DEPS="${TMP}/pkg_deps"
+	SIM_PORTS_BUILT="${TMP}/ports.built"
+	# 2 deep chains of short builds, a much longer build with one
+	# dependent and some short leaves.
+	for pkg in llvm mesa s1 s2 s3 s4 s5 t1 t2 t3 t4 t5 x1 x2 x3 x4; do
+		echo "run:${pkg}-1.0 build:${pkg}-1.0"
+		case "${pkg}" in
+		llvm) time=3000 ;;
+		*) time=10 ;;
+		esac
+		echo "devel/${pkg} ${pkg}-1.0 ${time}" >> "${SIM_PORTS_BUILT}"
+	done > "${SIM_PKG_DEPS}"
+	{
+		echo "build:mesa-1.0 run:llvm-1.0"
+		for chain in s t; do
+			for n in 2 3 4 5; do
+				echo "build:${chain}${n}-1.0 run:${chain}$((n - 1))-1.0"
+			done
+		done
+	} >> "${SIM_PKG_DEPS}"
+	;;
+esac
+
+awk '{print $2 " " $1}' "${SIM_PKG_DEPS}" > pkg_deps.ptsort
+MASTER_DATADIR="${TMP}"
+PRIORITY_BUILDTIME=yes
+PRIORITY_BUILDTIME_QUANTUM="${SIM_QUANTUM}"
+PRIORITY_BUILDTIME_BUCKETS=8
+awk '{print $2, $3}' "${SIM_PORTS_BUILT}" > pkg_buildtimes
+assert_true load_priorities_weights pkg_deps.weights
+
+assert_true ptsort -p pkg_deps.ptsort > priority.depth
+assert_true ptsort -p -w pkg_deps.weights pkg_deps.ptsort > priority.weighted
+
+makespan_depth=$(simulate priority.depth)
+assert 0 "$?"
+makespan_weighted=$(simulate priority.weighted)
+assert 0 "$?"
+msg "builders=${SIM_BUILDERS} makespan depth-only=${makespan_depth} weighted=${makespan_weighted}"
+
+case "${REPLAY}" in
+0)
+	# The long build must be started first even with its weight on
+	# a log scale.
+	assert "build:llvm-1.0 8" "$(awk '$1 == "build:llvm-1.0"' \
+	    pkg_deps.weights)"
+	assert "build:s1-1.0 1" "$(awk '$1 == "build:s1-1.0"' \
+	    pkg_deps.weights)"
+	read -r prio job < priority.weighted
+	assert "build:llvm-1.0" "${job}"
+	assert 11 "${prio}"
+	assert 3040 "${makespan_depth}"
+	assert 3010 "${makespan_weighted}"
+	;;
+esac
+
+# However long a build takes its weight stays within the buckets.
+echo "huge-1.0 99999999" > pkg_buildtimes
+assert_true load_priorities_weights pkg_deps.weights
+assert "build:huge-1.0 8" "$(cat pkg_deps.weights)"
+
+assert_true cd /
+assert_true rm -rf "${TMP}"
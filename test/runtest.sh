@@ -240,6 +240,7 @@ prep.sh) : "${DEF_TIMEOUT:=250}" ;;
 bulk*build*.sh|testport*build*.sh) : "${DEF_TIMEOUT:=400}" ;;
 critical_section_inherit.sh) : "${DEF_TIMEOUT:=20}" ;;
 shellcheck.sh) : "${DEF_TIMEOUT:=90}" ;;
+*bench*.sh) : "${DEF_TIMEOUT:=600}" ;;
 esac
 : "${DEF_TIMEOUT:=60}"
 case "${TEST##*/}" in
@@ -0,0 +1,117 @@
+# Simulate build_queue() dispatching a recorded queue to a number of
+# builders and print the resulting makespan.  This is used to compare
+# priority schemes offline against a previous bulk run.
+#
+# Usage: awk -f schedule_sim.awk -v builders=N \
+#     pkg_deps.priority pkg_deps .poudriere.ports.built
+#
+# - pkg_deps.priority: "priority job" lines from ptsort -p.
+# - pkg_deps: "job dep" lines as generated by generate_queue().
+# - .poudriere.ports.built: "originspec pkgname elapsed" lines.  Build
+#   times are matched by package base so that an older run's times may be
+#   replayed against a newer queue.
+#
+# Jobs without a recorded time, and all run: jobs, take no time and do
+# not occupy a builder.  Ties in priority are broken by name so the
+# result is deterministic.
+BEGIN {
+	if (builders < 1)
+		builders = 1
+	file = 0
+}
+FNR == 1 { file++ }
+file == 1 {
+	prio[$2] = $1
+	jobs[$2] = 1
+	next
+}
+file == 2 {
+	jobs[$1] = 1
+	jobs[$2] = 1
+	if (($1, $2) in edge)
+		next
+	edge[$1, $2] = 1
+	ndeps[$1]++
+	nrdeps[$2]++
+	rdeps[$2, nrdeps[$2]] = $1
+	next
+}
+file == 3 {
+	pkgbase = $2
+	sub(/-[^-]*$/, "", pkgbase)
+	elapsed[pkgbase] = $3
+	next
+}
+function job_time(job, pkgbase) {
+	if (job !~ /^build:/)
+		return 0
+	pkgbase = substr(job, 7)
+	sub(/-[^-]*$/, "", pkgbase)
+	return (pkgbase in elapsed) ? elapsed[pkgbase] + 0 : 0
+}
+function job_done(job, i, r) {
+	done++
+	for (i = 1; i <= nrdeps[job]; i++) {
+		r = rdeps[job, i]
+		if (--ndeps[r] == 0)
+			ready[r] = 1
+	}
+}
+function pick(job, best) {
+	best = ""
+	for (job in ready) {
+		if (best == "" || prio[job] + 0 > prio[best] + 0 ||
+		    (prio[job] + 0 == prio[best] + 0 && job < best))
+			best = job
+	}
+	return best
+}
+END {
+	njobs = 0
+	for (job in jobs) {
+		njobs++
+		if (ndeps[job] + 0 == 0)
+			ready[job] = 1
+	}
+	now = 0
+	busy = 0
+	done = 0
+	while (done < njobs) {
+		while ((job = pick()) != "") {
+			t = job_time(job)
+			if (t == 0) {
+				delete ready[job]
+				job_done(job)
+				continue
+			}
+			if (busy == builders)
+				break
+			delete ready[job]
+			busy++
+			finish[job] = now + t
+		}
+		if (busy == 0) {
+			if (done < njobs) {
+				printf("schedule_sim: %d jobs are stuck " \
+				    "in a cycle\n", njobs - done) > "/dev/stderr"
+				exit 1
+			}
+			break
+		}
+		# Advance to the next completion.
+		next_t = -1
+		for (job in finish) {
+			if (next_t == -1 || finish[job] < next_t)
+				next_t = finish[job]
+		}
+		now = next_t
+		for (job in finish) {
+			if (finish[job] != now)
+				continue
+			delete finish[job]
+			busy--
+			job_done(job)
+		}
+	}
+	print "makespan", now
+}
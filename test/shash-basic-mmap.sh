@@ -0,0 +1,2 @@
+SHASH_BACKEND=mmap
+. ./shash-basic.sh
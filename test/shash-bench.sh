@@ -0,0 +1,52 @@
+# Compare the shash backends.  For each backend SHASH_BENCH_KEYS keys are
+# set and then read back, and the set/get rate and the number of files
+# used in SHASH_VAR_PATH are printed.
+. ./common.sh
+
+: ${SHASH_BENCH_KEYS:=2000}
+
+bench() {
+	[ $# -eq 1 ] || eargs bench backend
+	local SHASH_BACKEND="$1"
+	local SHASH_VAR_PATH start mid end n value files
+
+	SHASH_VAR_PATH="$(mktemp -dt shash-bench)"
+	start="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${SHASH_BENCH_KEYS}" ]; do
+		assert_true shash_set bench-origin "key ${n}" "value ${n}"
+		n="$((n + 1))"
+	done
+	mid="$(clock -monotonic -nsec)"
+	n=0
+	until [ "${n}" -eq "${SHASH_BENCH_KEYS}" ]; do
+		value=
+		assert_true shash_get bench-origin "key ${n}" value
+		assert "value ${n}" "${value}"
+		n="$((n + 1))"
+	done
+	end="$(clock -monotonic -nsec)"
+	files="$(find "${SHASH_VAR_PATH}" -mindepth 1 | wc -l)"
+	files="${files##* }"
+	bench_report "${SHASH_BACKEND} set" "${SHASH_BENCH_KEYS}" keys \
+	    "${start}" "${mid}"
+	bench_report "${SHASH_BACKEND} get" "${SHASH_BENCH_KEYS}" keys \
+	    "${mid}" "${end}"
+	echo "${SHASH_BACKEND} files: ${files}"
+	case "${SHASH_BACKEND}" in
+	file)
+		assert "${SHASH_BENCH_KEYS}" "${files}"
+		;;
+	mmap)
+		if have_builtin shash_mmap_get; then
+			assert 1 "${files}"
+		fi
+		;;
+	esac
+	assert_true shash_remove_var bench-origin
+	assert_false shash_exists bench-origin "key 0"
+	rm -rf "${SHASH_VAR_PATH}"
+}
+
+bench file
+bench mmap
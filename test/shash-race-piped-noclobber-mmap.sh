@@ -0,0 +1,2 @@
+SHASH_BACKEND=mmap
+. ./shash-race-piped-noclobber.sh
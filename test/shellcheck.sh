@@ -14,7 +14,9 @@ FILES="$({
 })"
 PASSING="
 include/hash.sh
+include/history.sh
 include/html.sh
+include/metadata_cache.sh
 include/parallel.sh
 include/shared_hash.sh
 include/util.sh
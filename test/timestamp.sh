@@ -156,6 +156,58 @@ test_timestamp_7() {
 	EOF
 }
 
+# A prefix change and a long line split across reads.
+add_test_function test_timestamp_block_boundary
+test_timestamp_block_boundary() {
+	local input
+
+	input="$(mktemp -t timestamp_input)"
+	# The prefix change starts 2 bytes before the first 64k read ends.
+	{
+		awk 'END { for (i = 0; i < 65533; i++) printf("a"); print }' \
+		    /dev/null
+		printf '\001PX:new\nafter\n'
+		awk 'END { for (i = 0; i < 200000; i++) printf("b"); print }' \
+		    /dev/null
+	} > "${input}"
+	timestamp -T -D -1 stdout < "${input}" >${STDOUT} 2>${STDERR}
+	assert 0 $? "$0:${LINENO}: incorrect exit status"
+	assert 3 "$(wc -l < "${STDOUT}" | tr -d ' ')"
+	assert "stdout aaa" "$(head -n 1 "${STDOUT}" | cut -c 1-10)"
+	assert "new after" "$(sed -n 2p "${STDOUT}")"
+	assert "new bbb" "$(tail -n 1 "${STDOUT}" | cut -c 1-7)"
+	assert 200005 "$(tail -n 1 "${STDOUT}" | wc -c | tr -d ' ')"
+	assert_file - "${STDERR}" <<-EOF
+	EOF
+	rm -f "${input}"
+}
+
+# Throughput of prefixing compiler-like output.
+# Enough lines to span many of the blocks that are read at a time.
+add_test_function test_timestamp_many_lines
+test_timestamp_many_lines() {
+	local input lines flags
+
+	input="$(mktemp -t timestamp_input)"
+	lines=20000
+	awk -v lines="${lines}" 'END {
+		for (i = 0; i < lines; i++)
+			printf("c++ -O2 -pipe -c src/lib/file%d.cpp " \
+			    "-o obj/file%d.o -Iinclude -DNDEBUG\n", i, i)
+	}' /dev/null > "${input}"
+	for flags in "" "-t -1 prefix" "-T -D"; do
+		timestamp ${flags} < "${input}" >${STDOUT} 2>${STDERR}
+		assert 0 $? "$0:${LINENO}: timestamp ${flags}"
+		assert "${lines}" \
+		    "$(wc -l < "${STDOUT}" | tr -d ' ')" \
+		    "timestamp ${flags}"
+		assert "$(tail -n 1 "${input}")" \
+		    "$(tail -n 1 "${STDOUT}" | sed -e 's,^.* c++,c++,')" \
+		    "timestamp ${flags}"
+	done
+	rm -f "${input}"
+}
+
 add_test_function test_timestamp_forwards_sigterm
 test_timestamp_forwards_sigterm() {
 	local waitfile
@@ -0,0 +1,36 @@
+# Throughput of timestamp with each kind of prefix over
+# TIMESTAMP_BENCH_LINES lines of compiler output.
+set -e
+. ./common.sh
+set +e
+
+: ${TIMESTAMP_BENCH_LINES:=500000}
+
+trap '' SIGINFO
+
+TMP="$(mktemp -dt timestamp_bench)"
+INPUT="${TMP}/input"
+awk -v lines="${TIMESTAMP_BENCH_LINES}" 'END {
+	for (i = 0; i < lines; i++)
+		printf("c++ -O2 -pipe -c src/lib/file%d.cpp " \
+		    "-o obj/file%d.o -Iinclude -DNDEBUG\n", i, i)
+}' /dev/null > "${INPUT}"
+
+for flags in "" "-t -1 prefix" "-T -D" "-z"; do
+	start="$(clock -monotonic -nsec)"
+	timestamp ${flags} < "${INPUT}" > "${TMP}/stdout" 2>"${TMP}/stderr"
+	assert 0 "$?" "timestamp ${flags}"
+	end="$(clock -monotonic -nsec)"
+	case "${flags}" in
+	-z) ;;
+	*)
+		assert "${TIMESTAMP_BENCH_LINES}" \
+		    "$(wc -l < "${TMP}/stdout" | tr -d ' ')" \
+		    "timestamp ${flags}"
+		;;
+	esac
+	bench_report "${flags:-none}" "${TIMESTAMP_BENCH_LINES}" lines \
+	    "${start}" "${end}"
+done
+
+rm -rf "${TMP:?}"